@@ -23,6 +23,40 @@
 
 #include "abstractclient.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "../consts.h"
+#include "../common/argumentdirection.h"
+
+std::string AbstractClient::parseFuncNameAndArgs(const char *funcNameAndArgs, std::vector<ArgumentInfo> &argInfos)
+{
+    // ArgTy is "typeID", "typeID;bitwidth" for integers or "typeID;pointedToTypeID[;bitwidth][;direction]" for pointers
+    const char *funcNameEnd = strchr(funcNameAndArgs, ':');
+    std::string funcName = funcNameEnd ? std::string(funcNameAndArgs, funcNameEnd) : std::string(funcNameAndArgs);
+
+    argInfos.clear();
+    char *currArg = (char *) funcNameEnd;
+    while (currArg != nullptr && *currArg == ':') {
+        ArgumentInfo argInfo = { static_cast<llvm::Type::TypeID>(strtoul(++currArg, &currArg, 10)), 0U, llvm::Type::NumTypeIDs, ArgumentDirection::NONE };
+
+        if (argInfo.typeID == llvm::Type::IntegerTyID) // integers additionally need bitwidths
+            argInfo.bitwidth = strtoul(++currArg, &currArg, 10);
+
+        if (argInfo.typeID == llvm::Type::PointerTyID) { // pointers additionally need typeID of type pointed to
+            argInfo.pointedToTypeID = static_cast<llvm::Type::TypeID>(strtoul(++currArg, &currArg, 10));
+            if (argInfo.pointedToTypeID == llvm::Type::IntegerTyID) // integers additionally need bitwidths
+                argInfo.bitwidth = strtoul(++currArg, &currArg, 10);
+            // direction is optional, without it arrays are transferred in both directions
+            argInfo.direction = (*currArg == ';') ? strtoul(++currArg, &currArg, 10) : ArgumentDirection::INOUT;
+        }
+        argInfos.push_back(argInfo);
+    }
+
+    return funcName;
+}
+
 
 long AbstractClient::getTimeDiffOpt() const
 {
@@ -45,5 +79,108 @@ AbstractClient::AbstractClient()
 
 AbstractClient::~AbstractClient()
 {
+    // derived classes already waited for the pending call, arrays must be back before the arena is gone
+    if (SharedArena::active == arena.get())
+        SharedArena::active = nullptr;
+}
+
+void AbstractClient::createArena(size_t size, size_t threshold, bool shared)
+{
+    arena.reset(new SharedArena(shared ? SHMEM_ARENA_PREFIX + std::to_string(getpid()) : "", size, threshold));
+    SharedArena::active = arena.get();
+}
+
+const char *AbstractClient::parseReturnType(const char *retTypeFuncNameArgTypes, PendingCall &call)
+{
+    // "RetTy[;bitwidth]:funcNameAndArgs"
+    char* behindResTypePtr;
+    call.retType = static_cast<llvm::Type::TypeID>(strtol(retTypeFuncNameArgTypes, &behindResTypePtr, 10));
+    if (call.retType == llvm::Type::IntegerTyID)
+        call.retTypeBitWidth = strtol(++behindResTypePtr, &behindResTypePtr, 10);
+    return ++behindResTypePtr;
+}
+
+void AbstractClient::callAcc(const char *retTypeFuncNameArgTypes, va_list args)
+{
+    // the connection carries one call at a time
+    waitForPendingCall();
 
+    // get result type and container to write result value to
+    PendingCall call;
+    const char *funcNameAndArgs = parseReturnType(retTypeFuncNameArgTypes, call);
+    if (call.retType != llvm::Type::VoidTyID)
+        call.retContainerPtr = va_arg(args, void*);
+
+    residentBuffers.beginCall();
+    sendCall(funcNameAndArgs, args, call);
+    receiveResult(call);
+    finishCall(call);
+}
+
+bool AbstractClient::callAccAsync(const char *retTypeFuncNameArgTypes, va_list args)
+{
+    waitForPendingCall();
+
+    pendingCall = PendingCall();
+    const char *funcNameAndArgs = parseReturnType(retTypeFuncNameArgTypes, pendingCall);
+    if (pendingCall.retType != llvm::Type::VoidTyID) // the program needs the result right away
+        pendingCall.retContainerPtr = va_arg(args, void*);
+
+    residentBuffers.beginCall();
+    sendCall(funcNameAndArgs, args, pendingCall);
+    if (pendingCall.retType != llvm::Type::VoidTyID || !trackInFlight(pendingCall)) {
+        receiveResult(pendingCall);
+        finishCall(pendingCall);
+        return false;
+    }
+
+    // receive in the background, the program continues until it touches an array of the call
+    inFlight->begin();
+    receiver = std::thread([this] {
+        InFlightTracker::isReceivingThread = true;
+        receiveResult(pendingCall);
+        inFlight->complete();
+    });
+    return true;
+}
+
+bool AbstractClient::trackInFlight(PendingCall &call)
+{
+    if (!inFlight)
+        inFlight.reset(new InFlightTracker());
+
+    // only arrays owning their pages can be tracked, other calls are completed right away
+    bool tracked = true;
+    for (auto &array : call.awaitedArrays) {
+        array.destination = (arena && arena->contains(array.ptr, array.size)) ? inFlight->relocate(array.ptr, array.size) : nullptr;
+        if (array.destination == nullptr) {
+            tracked = false;
+            break;
+        }
+    }
+    for (const auto &array : call.inPlaceArrays)
+        tracked = tracked && inFlight->protect(array.first, array.second);
+
+    if (!tracked) {
+        inFlight->abort();
+        for (auto &array : call.awaitedArrays)
+            array.destination = array.ptr;
+    }
+    return tracked;
+}
+
+void AbstractClient::waitForPendingCall()
+{
+    if (!receiver.joinable())
+        return;
+    receiver.join();
+    inFlight->wait();
+    finishCall(pendingCall);
+}
+
+void AbstractClient::finishCall(PendingCall &call)
+{
+    // arrays now hold the content of the server's copies
+    for (const auto &array : call.awaitedArrays)
+        residentBuffers.synchronised(array.ptr, array.size);
 }
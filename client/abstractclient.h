@@ -25,8 +25,17 @@
 #define ABSTRACTCLIENT_H
 
 #include <string>
+#include <vector>
 #include <cstdarg>
 #include <chrono>
+#include <memory>
+#include <thread>
+
+#include "llvm/IR/DerivedTypes.h"
+
+#include "residencytracker.h"
+#include "inflighttracker.h"
+#include "sharedarena.h"
 
 class AbstractClient
 {
@@ -36,18 +45,72 @@ protected:
         exit(1);
     }
 
+    struct ArgumentInfo {
+        llvm::Type::TypeID typeID;
+        unsigned bitwidth;                  // integers and pointers to integers only
+        llvm::Type::TypeID pointedToTypeID; // pointers only
+        uint32_t direction;                 // pointers only, ArgumentDirection::Direction
+    };
+
+    // parses "functionName:ArgTy1:ArgTy2:...:ArgTyn" as created by the RPCAccelerate pass, returns the function name
+    static std::string parseFuncNameAndArgs(const char *funcNameAndArgs, std::vector<ArgumentInfo> &argInfos);
+
+    struct AwaitedArray {
+        void *ptr;              // array of the program
+        void *destination;      // where the result is written to, differs from ptr while an asynchronous call relocated the array
+        std::pair<llvm::Type::TypeID, unsigned> typeIDWithBitwidth;
+        uint64_t size;          // in bytes
+    };
+
+    // a call sent to the server, its result has not been received yet
+    struct PendingCall {
+        llvm::Type::TypeID retType = llvm::Type::VoidTyID;
+        unsigned retTypeBitWidth = 0U;
+        void *retContainerPtr = nullptr;
+        std::vector<AwaitedArray> awaitedArrays;                // written by the function, transferred back
+        std::vector<std::pair<void *, uint64_t>> inPlaceArrays; // used by the server in place, see SharedArena
+    };
+
+    // a call is split into sending it and receiving its result, receiving may happen in another thread
+    virtual void sendCall(const char *funcNameAndArgs, va_list args, PendingCall &call) = 0;
+    virtual void receiveResult(PendingCall &call) = 0;
+
     long TimeDiffOpt = -1;
     long TimeDiffInit = -1;
     long TimeDiffLastExecution = -1;
 
+    // arrays the server keeps between calls
+    ResidencyTracker residentBuffers;
+
+    // large arrays of the program, see SharedArena
+    std::unique_ptr<SharedArena> arena;
+
 public:
     AbstractClient();
     virtual ~AbstractClient();
     virtual void initialiseAccelerationWithIR(const std::string &IR) = 0; // when function returns, server has to be ready to accept calls
-    virtual void callAcc(const char *retTypeFuncNameArgTypes, va_list args) = 0;
+    // arrays allocated by the program from now on can be shared with the server (shared memory only) or tracked for asynchronous calls
+    void createArena(size_t size, size_t threshold, bool shared);
+    // returns when the result of the call is there
+    void callAcc(const char *retTypeFuncNameArgTypes, va_list args);
+    // returns as soon as the call is sent, if the function has no return value and its arrays can be tracked.
+    // The program blocks when it touches the arrays of the call before the result arrived, further calls wait for it as well.
+    // Returns false if the call was completed right away
+    bool callAccAsync(const char *retTypeFuncNameArgTypes, va_list args);
+    // has to be called by destructors of derived classes as well, before the connection is torn down
+    void waitForPendingCall();
     long getTimeDiffOpt() const;
     long getTimeDiffInit() const;
     long getTimeDiffLastExecution() const;
+
+private:
+    PendingCall pendingCall;
+    std::thread receiver;
+    std::unique_ptr<InFlightTracker> inFlight; // created with the first asynchronous call
+
+    static const char *parseReturnType(const char *retTypeFuncNameArgTypes, PendingCall &call);
+    void finishCall(PendingCall &call);
+    bool trackInFlight(PendingCall &call);
 };
 
 #endif // ABSTRACTCLIENT_H
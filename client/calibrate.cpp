@@ -0,0 +1,255 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+// Calibration of a host/accelerator pair for AccScore (-calibration): two small kernels are sent to a running server
+// and run there as well as in the client's JIT. Calls of a kernel with growing arrays give the latency and bandwidth
+// of the link (the time of a call besides the server's execution), a compute bound kernel on data in cache gives
+// the operation throughput, a streaming kernel on large arrays the memory bandwidth of each side.
+
+#include "abstractclient.h"
+#include "socketclient.h"
+#include "shmemclient.h"
+#include "pass/calibration.h"
+#include "../common/moduletransfer.h"
+#include "../common/argumentdirection.h"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/JIT.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/ManagedStatic.h"
+
+#include <cstdarg>
+#include <cstdlib>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <memory>
+#include <functional>
+
+enum clientCommTypes {
+    socket, sharedmem
+};
+llvm::cl::opt<clientCommTypes> ClientCommunicationType("comm", llvm::cl::desc("Choose type of communication to calibrate:"), llvm::cl::init(socket),
+                                              llvm::cl::values(clEnumVal(socket, "use communication over socket (default)"),
+                                                               clEnumVal(sharedmem, "use communication over shared memory"),
+                                                               clEnumValEnd));
+llvm::cl::opt<std::string> ServerHostname("host", llvm::cl::desc("Server hostname or IP, defaults to 'localhost'"), llvm::cl::init("localhost"));
+llvm::cl::opt<unsigned> ChunkSize("chunk-size", llvm::cl::desc("Chunk size in KB, as used by the client (socket only), defaults to 1024"), llvm::cl::init(1024));
+llvm::cl::opt<unsigned> LargestArray("largest-array", llvm::cl::desc("Size of the largest array transferred in MB, defaults to 64"), llvm::cl::init(64));
+llvm::cl::opt<unsigned> Repetitions("repetitions", llvm::cl::desc("How often each measurement is repeated, the fastest one counts, defaults to 5"), llvm::cl::init(5));
+llvm::cl::opt<std::string> OutputFile("o", llvm::cl::desc("Output file for the calibration, defaults to 'baar_calibration.txt'"), llvm::cl::init("baar_calibration.txt"));
+
+// a[i] = a[i] * 0.5 + 0.5, reps times over n elements: two floating point operations per element and repetition
+// a[i] = a[i] + 1.0 over n elements: one load and one store per element
+static const char *KernelsIR =
+    "define void @baar_calib_flops(double* %a, i64 %n, i32 %reps) {\n"
+    "entry:\n"
+    "  br label %rep\n"
+    "rep:\n"
+    "  %r = phi i32 [ 0, %entry ], [ %r.next, %rep.latch ]\n"
+    "  br label %loop\n"
+    "loop:\n"
+    "  %i = phi i64 [ 0, %rep ], [ %i.next, %loop ]\n"
+    "  %p = getelementptr inbounds double* %a, i64 %i\n"
+    "  %v = load double* %p, align 8\n"
+    "  %m = fmul double %v, 5.000000e-01\n"
+    "  %s = fadd double %m, 5.000000e-01\n"
+    "  store double %s, double* %p, align 8\n"
+    "  %i.next = add i64 %i, 1\n"
+    "  %c = icmp slt i64 %i.next, %n\n"
+    "  br i1 %c, label %loop, label %rep.latch\n"
+    "rep.latch:\n"
+    "  %r.next = add i32 %r, 1\n"
+    "  %rc = icmp slt i32 %r.next, %reps\n"
+    "  br i1 %rc, label %rep, label %exit\n"
+    "exit:\n"
+    "  ret void\n"
+    "}\n"
+    "define void @baar_calib_stream(double* %a, i64 %n) {\n"
+    "entry:\n"
+    "  br label %loop\n"
+    "loop:\n"
+    "  %i = phi i64 [ 0, %entry ], [ %i.next, %loop ]\n"
+    "  %p = getelementptr inbounds double* %a, i64 %i\n"
+    "  %v = load double* %p, align 8\n"
+    "  %s = fadd double %v, 1.000000e+00\n"
+    "  store double %s, double* %p, align 8\n"
+    "  %i.next = add i64 %i, 1\n"
+    "  %c = icmp slt i64 %i.next, %n\n"
+    "  br i1 %c, label %loop, label %exit\n"
+    "exit:\n"
+    "  ret void\n"
+    "}\n";
+
+static const int64_t CacheElements = 4096;     // 32 KB, stays in the caches of both sides
+static const int FlopsRepetitions = 20000;
+
+// signature as created by the RPCAccelerate pass, arrays are transferred in both directions
+static std::string signature(const char *name, bool withRepetitions)
+{
+    std::string result = std::to_string(llvm::Type::VoidTyID) + ":" + name;
+    result += ":" + std::to_string(llvm::Type::PointerTyID) + ";" + std::to_string(llvm::Type::DoubleTyID) + ";" + std::to_string(ArgumentDirection::INOUT);
+    result += ":" + std::to_string(llvm::Type::IntegerTyID) + ";64";
+    if (withRepetitions)
+        result += ":" + std::to_string(llvm::Type::IntegerTyID) + ";32";
+    return result;
+}
+
+static void callRemote(AbstractClient &client, const char *funcNameAndArgs, ...)
+{
+    va_list args;
+    va_start(args, funcNameAndArgs);
+    client.callAcc(funcNameAndArgs, args);
+    va_end(args);
+}
+
+// microseconds of the call, its array is modified before, so it is not kept resident by the server but transferred
+static double timeRemoteCall(AbstractClient &client, const std::string &funcNameAndArgs, std::vector<double> &array, int64_t n, int reps = 0)
+{
+    array[0] += 1.0;
+    const auto StartTime = std::chrono::high_resolution_clock::now();
+    if (reps > 0)
+        callRemote(client, funcNameAndArgs.c_str(), array.data(), n, reps);
+    else
+        callRemote(client, funcNameAndArgs.c_str(), array.data(), n);
+    const auto EndTime = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(EndTime - StartTime).count() / 1000.0;
+}
+
+template<typename Measurement>
+static double fastest(Measurement measurement)
+{
+    double best = measurement();
+    for (unsigned i = 1; i < Repetitions; i++)
+        best = std::min(best, measurement());
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+    llvm::InitializeNativeTarget();
+    llvm::LLVMContext &Context = llvm::getGlobalContext();
+
+    llvm::SMDiagnostic Err;
+    llvm::Module *KernelsMod = llvm::ParseIR(llvm::MemoryBuffer::getMemBuffer(KernelsIR), Err, Context);
+    if (!KernelsMod) {
+        Err.print("baar_calibrate", llvm::errs());
+        exit(1);
+    }
+    const std::string exportedModule = ModuleTransfer::encode(*KernelsMod, ModuleTransfer::BITCODE);
+
+    std::unique_ptr<AbstractClient> client;
+    switch (ClientCommunicationType) {
+        case socket: client.reset(new SocketClient(ServerHostname, (uint64_t) ChunkSize << 10)); break;
+        case sharedmem: client.reset(new ShmemClient()); break;
+    }
+    std::cout << "INFO: " << "initialising accelerator...\n";
+    client->initialiseAccelerationWithIR(exportedModule);
+
+    baar::Calibration calibration;
+    calibration.server = ClientCommunicationType == socket ? std::string(ServerHostname) : std::string("sharedmem");
+    const std::string flops = signature("baar_calib_flops", true);
+    const std::string stream = signature("baar_calib_stream", false);
+    std::vector<double> array(std::max<size_t>(((size_t) LargestArray << 20) / sizeof(double), CacheElements), 0.0);
+
+    // link: time besides execution of calls with growing arrays, fitted by least squares to latency + bytes / bandwidth
+    std::vector<std::pair<double, double>> transfers; // bytes in both directions, microseconds
+    const int64_t smallest = 1;
+    for (int64_t n = smallest; n <= (int64_t) array.size(); n = n == smallest ? 16384 : n * 4) {
+        const double time = fastest([&]() {
+            const double total = timeRemoteCall(*client, stream, array, n);
+            return total - client->getTimeDiffLastExecution();
+        });
+        transfers.push_back(std::make_pair(2.0 * n * sizeof(double), std::max(time, 0.0)));
+        std::cout << "INFO: " << (long) transfers.back().first << " bytes transferred in " << (long) time << " microseconds\n";
+    }
+    double sumBytes = 0.0, sumTime = 0.0, sumBytesSquared = 0.0, sumBytesTime = 0.0;
+    for (const auto &transfer : transfers) {
+        sumBytes += transfer.first;
+        sumTime += transfer.second;
+        sumBytesSquared += transfer.first * transfer.first;
+        sumBytesTime += transfer.first * transfer.second;
+    }
+    const double count = transfers.size();
+    const double slope = (count * sumBytesTime - sumBytes * sumTime) / (count * sumBytesSquared - sumBytes * sumBytes);
+    if (transfers.size() < 2 || !(slope > 0.0)) {
+        std::cerr << "ERROR, could not measure the bandwidth of the link, use larger arrays (-largest-array)" << std::endl;
+        exit(1);
+    }
+    calibration.linkBandwidth = 1.0 / slope;
+    calibration.latency = transfers.front().second;
+
+    // accelerator: execution times as measured by the server
+    calibration.remoteFlops = 2.0 * CacheElements * FlopsRepetitions / fastest([&]() {
+        timeRemoteCall(*client, flops, array, CacheElements, FlopsRepetitions);
+        return (double) std::max(client->getTimeDiffLastExecution(), 1L);
+    });
+    calibration.remoteMemoryBandwidth = 2.0 * array.size() * sizeof(double) / fastest([&]() {
+        timeRemoteCall(*client, stream, array, array.size());
+        return (double) std::max(client->getTimeDiffLastExecution(), 1L);
+    });
+
+    // host: the same kernels compiled by the JIT, as the program runs locally
+    std::string err;
+    std::unique_ptr<llvm::ExecutionEngine> ExeEngine(llvm::ExecutionEngine::create(KernelsMod, false, &err));
+    if (!err.empty()) {
+        std::cerr << "ERROR, " << err << std::endl;
+        exit(1);
+    }
+    auto localFlops = (void (*)(double *, int64_t, int)) ExeEngine->getPointerToFunction(KernelsMod->getFunction("baar_calib_flops"));
+    auto localStream = (void (*)(double *, int64_t)) ExeEngine->getPointerToFunction(KernelsMod->getFunction("baar_calib_stream"));
+    auto timeLocal = [](std::function<void()> kernel) {
+        const auto StartTime = std::chrono::high_resolution_clock::now();
+        kernel();
+        const auto EndTime = std::chrono::high_resolution_clock::now();
+        return std::max(std::chrono::duration_cast<std::chrono::nanoseconds>(EndTime - StartTime).count() / 1000.0, 1.0);
+    };
+    calibration.localFlops = 2.0 * CacheElements * FlopsRepetitions / fastest([&]() {
+        return timeLocal([&]() { localFlops(array.data(), CacheElements, FlopsRepetitions); });
+    });
+    calibration.localMemoryBandwidth = 2.0 * array.size() * sizeof(double) / fastest([&]() {
+        return timeLocal([&]() { localStream(array.data(), array.size()); });
+    });
+
+    std::cout << "INFO: " << "link: latency " << (long) calibration.latency << " microseconds, bandwidth " << (long) calibration.linkBandwidth << " MB/s\n";
+    std::cout << "INFO: " << "host: " << (long) calibration.localFlops << " MFLOP/s, memory " << (long) calibration.localMemoryBandwidth << " MB/s\n";
+    std::cout << "INFO: " << "accelerator: " << (long) calibration.remoteFlops << " MFLOP/s, memory " << (long) calibration.remoteMemoryBandwidth << " MB/s\n";
+    if (!calibration.save(OutputFile)) {
+        std::cerr << "ERROR, could not write " << OutputFile << std::endl;
+        exit(1);
+    }
+    std::cout << "INFO: " << "calibration written to " << OutputFile << ", pass it to the client with -calibration\n";
+
+    client.reset(nullptr);
+    llvm::llvm_shutdown();
+}
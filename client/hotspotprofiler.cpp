@@ -0,0 +1,97 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "hotspotprofiler.h"
+
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/PassManager.h"
+
+#include <iostream>
+
+HotspotProfiler::HotspotProfiler(unsigned hotShare, uint64_t minIterations) : hotShare(hotShare), minIterations(minIterations)
+{
+}
+
+void HotspotProfiler::instrument(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE)
+{
+    functionNames.clear();
+    for (llvm::Module::iterator I = ProgramMod->begin(), E = ProgramMod->end(); I != E; ++I)
+        if (!I->isDeclaration() && I->getName().str() != "main")
+            functionNames.push_back(I->getName().str());
+    counters.reset(new std::atomic<uint64_t>[functionNames.size()]);
+    for (size_t i = 0; i < functionNames.size(); i++)
+        counters[i].store(0U, std::memory_order_relaxed);
+    lastCounts.assign(functionNames.size(), 0U);
+    reported.clear();
+
+    // the program increments the counters defined here, they are mapped like 'baar_acc_ready'
+    llvm::Type *Int64Ty = llvm::IntegerType::get(ProgramMod->getContext(), 64);
+    llvm::GlobalVariable *Counters = new llvm::GlobalVariable(*ProgramMod, llvm::ArrayType::get(Int64Ty, functionNames.size()), false,
+                                                              llvm::GlobalValue::ExternalLinkage, nullptr, "baar_profile_counters");
+    EE->addGlobalMapping(Counters, counters.get());
+
+    llvm::FunctionPassManager LoopAnalysisPM(ProgramMod);
+    llvm::LoopInfo *LoopInfoPass = new llvm::LoopInfo();
+    LoopAnalysisPM.add(LoopInfoPass);
+    unsigned numLoops = 0;
+    for (unsigned i = 0; i < functionNames.size(); i++) {
+        llvm::Function *F = ProgramMod->getFunction(functionNames[i]);
+        LoopAnalysisPM.run(*F);
+        for (llvm::Function::iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB) {
+            if (!LoopInfoPass->isLoopHeader(BB))
+                continue;
+            llvm::IRBuilder<> Builder(BB, BB->getFirstInsertionPt());
+            llvm::Value *Counter = Builder.CreateConstInBoundsGEP2_32(Counters, 0, i);
+            Builder.CreateStore(Builder.CreateAdd(Builder.CreateLoad(Counter), llvm::ConstantInt::get(Int64Ty, 1)), Counter);
+            numLoops++;
+        }
+    }
+    std::cout << "INFO: profiling " << numLoops << " loops in " << functionNames.size() << " functions\n";
+}
+
+std::list<std::string> HotspotProfiler::newHotspots()
+{
+    std::vector<uint64_t> iterations(functionNames.size());
+    uint64_t total = 0U;
+    for (size_t i = 0; i < functionNames.size(); i++) {
+        const uint64_t count = counters[i].load(std::memory_order_relaxed);
+        iterations[i] = count - lastCounts[i];
+        lastCounts[i] = count;
+        total += iterations[i];
+    }
+
+    std::list<std::string> hotspots;
+    if (total < minIterations)
+        return hotspots;
+    for (size_t i = 0; i < functionNames.size(); i++) {
+        if (iterations[i] * 100U < total * hotShare || reported.count(functionNames[i]))
+            continue;
+        #ifndef NDEBUG
+                std::cout << "DEBUG: " << functionNames[i] << " ran " << iterations[i] << " of " << total << " loop iterations\n";
+        #endif
+        reported.insert(functionNames[i]);
+        hotspots.push_back(functionNames[i]);
+    }
+    return hotspots;
+}
@@ -0,0 +1,61 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef HOTSPOTPROFILER_H
+#define HOTSPOTPROFILER_H
+
+#include <cinttypes>
+#include <string>
+#include <list>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <unordered_set>
+
+#include "llvm/IR/Module.h"
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+
+// Finds the hotspots of the running program. Every loop header counts its executions into a counter of its function,
+// so a counter holds the iterations of all loops of a function. The counters live in the client ('baar_profile_counters'
+// of the program), they are plain increments without synchronisation, a lost one now and then does not matter.
+// A function is hot if its loops ran at least hotShare percent of all iterations counted since the last look.
+class HotspotProfiler
+{
+public:
+    explicit HotspotProfiler(unsigned hotShare = 10U, uint64_t minIterations = 1000U);
+
+    // before any function of the program is compiled, main is not instrumented
+    void instrument(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE);
+    // functions that became hot since the last call, every function is reported once
+    std::list<std::string> newHotspots();
+
+private:
+    const unsigned hotShare;
+    const uint64_t minIterations; // fewer iterations in total since the last look are no hotspot, e.g. while waiting for input
+    std::unique_ptr<std::atomic<uint64_t>[]> counters;
+    std::vector<std::string> functionNames; // of the counter with the same index
+    std::vector<uint64_t> lastCounts;
+    std::unordered_set<std::string> reported;
+};
+
+#endif // HOTSPOTPROFILER_H
@@ -0,0 +1,189 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "inflighttracker.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <climits>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "sharedarena.h"
+
+#ifndef MREMAP_DONTUNMAP
+#define MREMAP_DONTUNMAP 4
+#endif
+
+InFlightTracker *InFlightTracker::active = nullptr;
+struct sigaction InFlightTracker::previousAction;
+thread_local bool InFlightTracker::isReceivingThread = false;
+
+InFlightTracker::InFlightTracker() : numRanges(0U), state(IDLE)
+{
+    if (active != nullptr)
+        return;
+    active = this;
+
+    struct sigaction action;
+    action.sa_sigaction = &InFlightTracker::handleFault;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    if (sigaction(SIGSEGV, &action, &previousAction) == -1)
+        perror("ERROR, unable to install handler for accesses to arrays of asynchronous calls");
+}
+
+InFlightTracker::~InFlightTracker()
+{
+    if (active != this)
+        return;
+    wait();
+    // a handler installed later (see ResidencyTracker) chains to this one, it stays in place then
+    struct sigaction current;
+    if (sigaction(SIGSEGV, nullptr, &current) == 0 && (current.sa_flags & SA_SIGINFO) && current.sa_sigaction == &InFlightTracker::handleFault)
+        sigaction(SIGSEGV, &previousAction, nullptr);
+    active = nullptr;
+}
+
+void InFlightTracker::handleFault(int signal, siginfo_t *info, void *context)
+{
+    // only async-signal-safe code here: the arrays of the call are released by the receiving thread,
+    // returning retries the faulting access
+    InFlightTracker *tracker = active;
+    if (tracker != nullptr && !isReceivingThread && tracker->covers(info->si_addr)) {
+        tracker->waitUntilIdle();
+        return;
+    }
+
+    // not caused by an asynchronous call: pass on to the handler installed before (arrays kept on the server are
+    // write protected as well), or fault again without this one
+    if ((previousAction.sa_flags & SA_SIGINFO) && previousAction.sa_sigaction != nullptr)
+        previousAction.sa_sigaction(signal, info, context);
+    else if (!(previousAction.sa_flags & SA_SIGINFO) && previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN)
+        previousAction.sa_handler(signal);
+    else
+        sigaction(SIGSEGV, &previousAction, nullptr);
+}
+
+bool InFlightTracker::covers(const void *address) const
+{
+    const unsigned count = numRanges.load();
+    for (unsigned i = 0; i < count; i++)
+        if (address >= ranges[i].begin && address < ranges[i].begin + ranges[i].length)
+            return true;
+    return false;
+}
+
+void InFlightTracker::waitFor(const void *ptr)
+{
+    InFlightTracker *tracker = active;
+    if (tracker != nullptr && tracker->covers(ptr))
+        tracker->waitUntilIdle();
+}
+
+void InFlightTracker::waitUntilIdle()
+{
+    while (state.load() == IN_FLIGHT)
+        syscall(SYS_futex, (uint32_t *) &state, FUTEX_WAIT_PRIVATE, (uint32_t) IN_FLIGHT, nullptr, nullptr, 0);
+}
+
+void *InFlightTracker::relocate(void *ptr, size_t size)
+{
+    // arrays in the arena start at a page boundary and own their pages
+    const size_t length = (size + SharedArena::pageSize() - 1) / SharedArena::pageSize() * SharedArena::pageSize();
+    if (numRanges.load() == MAX_RANGES || (uintptr_t) ptr % SharedArena::pageSize() != 0U || length == 0U)
+        return nullptr;
+
+    // the program faults on the old place from now on, it stays mapped so nothing else can be mapped there meanwhile
+    void *destination = mmap(0, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (destination == MAP_FAILED)
+        return nullptr;
+    if (mprotect(ptr, length, PROT_NONE) == -1) {
+        munmap(destination, length);
+        return nullptr;
+    }
+    void *relocated = mremap(ptr, length, length, MREMAP_MAYMOVE | MREMAP_FIXED | MREMAP_DONTUNMAP, destination);
+    if (relocated == MAP_FAILED || mprotect(relocated, length, PROT_READ | PROT_WRITE) == -1) {
+        if (relocated != MAP_FAILED)
+            mremap(relocated, length, length, MREMAP_MAYMOVE | MREMAP_FIXED, ptr);
+        else
+            munmap(destination, length);
+        mprotect(ptr, length, PROT_READ | PROT_WRITE);
+        return nullptr;
+    }
+
+    ranges[numRanges.load()] = { (char *) ptr, length, (char *) relocated };
+    numRanges++;
+    return relocated;
+}
+
+bool InFlightTracker::protect(void *ptr, size_t size)
+{
+    const size_t length = (size + SharedArena::pageSize() - 1) / SharedArena::pageSize() * SharedArena::pageSize();
+    if (numRanges.load() == MAX_RANGES || (uintptr_t) ptr % SharedArena::pageSize() != 0U || length == 0U)
+        return false;
+    if (mprotect(ptr, length, PROT_NONE) == -1)
+        return false;
+
+    ranges[numRanges.load()] = { (char *) ptr, length, nullptr };
+    numRanges++;
+    return true;
+}
+
+void InFlightTracker::restore(Range &range)
+{
+    // moving back replaces the inaccessible placeholder in one step
+    if (range.relocatedTo != nullptr) {
+        if (mremap(range.relocatedTo, range.length, range.length, MREMAP_MAYMOVE | MREMAP_FIXED, range.begin) == MAP_FAILED)
+            perror("ERROR, unable to move array of asynchronous call back");
+    } else if (mprotect(range.begin, range.length, PROT_READ | PROT_WRITE) == -1)
+        perror("ERROR, unable to unprotect array of asynchronous call");
+}
+
+void InFlightTracker::abort()
+{
+    for (unsigned i = 0; i < numRanges.load(); i++)
+        restore(ranges[i]);
+    numRanges = 0U;
+}
+
+void InFlightTracker::begin()
+{
+    state.store(IN_FLIGHT);
+}
+
+void InFlightTracker::complete()
+{
+    for (unsigned i = 0; i < numRanges.load(); i++)
+        restore(ranges[i]);
+    state.store(IDLE);
+    syscall(SYS_futex, (uint32_t *) &state, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
+
+void InFlightTracker::wait()
+{
+    waitUntilIdle();
+    numRanges = 0U;
+}
@@ -0,0 +1,87 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef INFLIGHTTRACKER_H
+#define INFLIGHTTRACKER_H
+
+#include <cstddef>
+#include <atomic>
+#include <csignal>
+
+// Keeps the program away from the arrays of an asynchronous call until its result arrived.
+// Arrays the result is written to are moved away (mremap) and received into where they were moved to,
+// then moved back, so the program never sees them half written. Arrays the server uses in place are protected.
+// The program touching any of them blocks in a SIGSEGV handler until the call is complete.
+// Only arrays having pages of their own can be tracked, see SharedArena.
+class InFlightTracker
+{
+public:
+    InFlightTracker();
+    ~InFlightTracker();
+
+    // pages of the array are moved away, returns where the result has to be written to, nullptr if not possible
+    void *relocate(void *ptr, size_t size);
+    // pages of the array are protected from the program, false if not possible
+    bool protect(void *ptr, size_t size);
+    // undoes relocate and protect, for calls which cannot be done asynchronously after all
+    void abort();
+
+    // to be called after relocate and protect, before the result is received
+    void begin();
+    // result received (into the relocated arrays): arrays are moved back, the program can continue
+    void complete();
+    // blocks until the call is complete, forgets its arrays
+    void wait();
+
+    // blocks while ptr is part of an asynchronous call, for freeing arrays
+    static void waitFor(const void *ptr);
+
+    // the receiving thread must never block on the arrays of the call it receives
+    static thread_local bool isReceivingThread;
+
+private:
+    enum State : uint32_t {
+        IDLE = 0, IN_FLIGHT = 1
+    };
+
+    struct Range {
+        char *begin;
+        size_t length;
+        char *relocatedTo;  // nullptr if the range is only protected
+    };
+
+    static const unsigned MAX_RANGES = 64U;
+    Range ranges[MAX_RANGES];
+    std::atomic<unsigned> numRanges;
+    std::atomic<uint32_t> state;
+
+    static InFlightTracker *active;
+    static struct sigaction previousAction;
+    static void handleFault(int signal, siginfo_t *info, void *context);
+
+    bool covers(const void *address) const;
+    void waitUntilIdle();
+    void restore(Range &range);
+};
+
+#endif // INFLIGHTTRACKER_H
@@ -41,6 +41,7 @@
 #include "llvm/Analysis/BlockFrequencyInfo.h"
 #include "llvm/Transforms/Utils/ValueMapper.h"
 #include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/DebugInfo.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/TargetSelect.h"
@@ -53,6 +54,10 @@
 #include "pass/accscore.h"
 #include "abstractclient.h"
 #include "shmemclient.h"
+#include "sharedarena.h"
+#include "offloadpredictor.h"
+#include "hotspotprofiler.h"
+#include "../common/moduletransfer.h"
 
 #include <iostream>
 #include <fstream>
@@ -63,16 +68,39 @@
 #include <string>
 #include <cstring>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <future>
 #include <sys/stat.h>
 #include <signal.h>
 
 static std::unique_ptr<AbstractClient> AccClient;
 static std::unordered_map<std::string, unsigned long> scores;
 static std::fstream timeMeasureStream;
+static std::unique_ptr<OffloadPredictor> Predictor;
+static std::unique_ptr<HotspotProfiler> Profiler;
+static std::atomic<bool> programFinished;
+static std::mutex AccelerationMutex; // scores and clientOfFunction grow while the program calls accelerated functions
+static std::unordered_map<std::string, AbstractClient*> clientOfFunction;
+static AbstractClient *LastCallClient; // of the last call, it may still be pending (-async-calls)
+
+// functions accelerated together: exported in one module and sent to the server over one connection
+struct AccelerationBatch {
+    std::unique_ptr<AbstractClient> client; // nullptr for the first batch of a run, it uses AccClient which owns the arena
+    std::string exportedModuleIR;
+    std::atomic<int32_t> ready; // 'baar_acc_ready' of its functions, set once the server is ready
+    std::shared_future<void> initialised; // without -blocking-init only
+
+    AbstractClient *getClient() { return client ? client.get() : AccClient.get(); }
+};
 
 llvm::cl::opt<int> OffloadScoreThreshold("offload-threshold", llvm::cl::desc("Functions getting a score greater than this are offloaded, defaults to zero"), llvm::cl::init(0));
 llvm::cl::opt<int> ProgramRuns("runs", llvm::cl::desc("How often the acceleration on program and program itself should run, defaults to one. Reruns the whole process on program exit if greater one"), llvm::cl::init(1));
 llvm::cl::opt<bool> DisableExeEngineParallel("disable-ee-parallel", llvm::cl::desc("Run Execution Engine sequentilly after analysis and alteration"), llvm::cl::init(false));
+llvm::cl::opt<bool> StaticOffload("static-offload", llvm::cl::desc("Decide on offloading by comparing a function's score with the size of its arguments only, by default measured local and remote times decide"), llvm::cl::init(false));
+llvm::cl::opt<bool> BlockingInit("blocking-init", llvm::cl::desc("Alter the program only after the server is ready, by default it calls the local versions of accelerated functions until then"), llvm::cl::init(false));
 
 enum clientCommTypes {
     socket, sharedmem
@@ -81,10 +109,25 @@ llvm::cl::opt<clientCommTypes> ClientCommunicationType("comm", llvm::cl::desc("C
                                               llvm::cl::values(clEnumVal(socket, "use communication over socket (default)"),
                                                                clEnumVal(sharedmem, "use communication over shared memory"),
                                                                clEnumValEnd));
+llvm::cl::opt<bool> ResidencyHashing("residency-hashing", llvm::cl::desc("Detect changes to arrays kept on the server by hashing their content before every call instead of write protecting them, for programs filling such arrays by system calls like read"), llvm::cl::init(false));
+llvm::cl::opt<ModuleTransfer::Format> ExportFormat("export-format", llvm::cl::desc("Choose how the module of functions to accelerate is sent to the server:"), llvm::cl::init(ModuleTransfer::BITCODE),
+                                              llvm::cl::values(clEnumValN(ModuleTransfer::TEXT, "text", "human readable IR"),
+                                                               clEnumValN(ModuleTransfer::BITCODE, "bitcode", "bitcode (default)"),
+                                                               clEnumValN(ModuleTransfer::COMPRESSED_BITCODE, "compressed", "zlib compressed bitcode, for slow networks"),
+                                                               clEnumValEnd));
+llvm::cl::opt<bool> ShmemZeroCopy("shmem-zero-copy", llvm::cl::desc("Allocate the program's large arrays in memory shared with the server, they are used by accelerated functions in place (shared memory only)"), llvm::cl::init(false));
+llvm::cl::opt<bool> AsyncCalls("async-calls", llvm::cl::desc("Return from calls of accelerated functions without return value right away, the program only waits when touching their arrays"), llvm::cl::init(false));
+llvm::cl::opt<unsigned> ArenaSize("arena-size", llvm::cl::desc("Size of the memory for the program's large arrays in MB (-shmem-zero-copy, -async-calls), only touched pages are allocated, defaults to 4096"), llvm::cl::init(4096));
+llvm::cl::opt<unsigned> ArenaThreshold("arena-threshold", llvm::cl::desc("Allocations of at least this many bytes are taken from that memory, defaults to 65536"), llvm::cl::init(65536));
+llvm::cl::opt<unsigned> ChunkSize("chunk-size", llvm::cl::desc("Arrays are sent to the server interleaved in parts of this many KB, so it can start computing before a call arrived completely, 0 disables this (socket only), defaults to 1024"), llvm::cl::init(1024));
 llvm::cl::opt<std::string> ServerHostname("host", llvm::cl::desc("Server hostname or IP, defaults to 'localhost'"), llvm::cl::init("localhost"));
 llvm::cl::opt<std::string> TimeMeasureFile("time-file", llvm::cl::desc("Output file for time measuring, defaults to 'time_measures.txt'"), llvm::cl::init("time_measures.txt"));
 
-llvm::cl::opt<int> BBFreqThreshold("bbfreq-threshold", llvm::cl::desc("Basic block frequency threshold to consider functions for acceleration and analyze further"), llvm::cl::init(100));
+llvm::cl::opt<bool> StaticHotspots("static-hotspots", llvm::cl::desc("Choose acceleration candidates by estimated basic block frequencies before the program runs, by default the running program is profiled (always static with -disable-ee-parallel)"), llvm::cl::init(false));
+llvm::cl::opt<int> BBFreqThreshold("bbfreq-threshold", llvm::cl::desc("Basic block frequency threshold to consider functions for acceleration and analyze further (-static-hotspots)"), llvm::cl::init(100));
+llvm::cl::opt<unsigned> ProfileWindow("profile-window", llvm::cl::desc("Time in milliseconds the program runs before it is looked for hotspots, and between further looks, defaults to 100"), llvm::cl::init(100));
+llvm::cl::opt<unsigned> ProfileWindows("profile-windows", llvm::cl::desc("How often the running program is looked for new hotspots at most, defaults to 50"), llvm::cl::init(50));
+llvm::cl::opt<unsigned> HotShare("hot-share", llvm::cl::desc("Functions running at least this percentage of the loop iterations counted in a profile window are acceleration candidates, defaults to 10"), llvm::cl::init(10));
 
 llvm::cl::opt<std::string> IRFilename(llvm::cl::Positional, llvm::cl::Required, llvm::cl::desc("<IR file>"));
 llvm::cl::list<std::string> InputArgv(llvm::cl::ConsumeAfter, llvm::cl::desc("<program arguments>..."));
@@ -92,6 +135,16 @@ llvm::cl::list<std::string> InputArgv(llvm::cl::ConsumeAfter, llvm::cl::desc("<p
 static void printUsage(std::string programName);
 static void runExeEngine(llvm::Module* Mod, llvm::ExecutionEngine* EE);
 static void declareCallAcc(llvm::Module *ProgramMod);
+static void declareOffloadPredictor(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE);
+static llvm::GlobalVariable *declareAccReady(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, std::atomic<int32_t> &ready);
+static void initialiseAccelerator(AbstractClient *Client, const std::string &exportedModuleIR, std::chrono::high_resolution_clock::time_point StartTimeAccInitialization, bool measure);
+static AbstractClient *createClient();
+static bool sleepWhileRunning(std::chrono::milliseconds duration);
+static std::list<llvm::Function*> estimateCandidates(llvm::Module *Mod);
+static std::list<llvm::Function*> chooseFunctionsToAccelerate(llvm::Module *Mod, const std::list<llvm::Function*>& accelerationCandidates);
+static void accelerateBatch(AccelerationBatch &batch, const AccelerationBatch *first, llvm::LLVMContext *Context, llvm::Module *PristineMod,
+                            llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, const std::list<llvm::Function*>& functionsToAccelerate);
+static void interposeAllocationFunctions(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, bool arena);
 static std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module *ProgramMod, const std::list<llvm::Function*>& functionList);
 
 static void handleSignal(int) {
@@ -108,23 +161,59 @@ extern "C" void callAcc(const char *retTypeFuncNameArgTypes, ...) {
     va_list args;
     va_start(args, retTypeFuncNameArgTypes);
 
-    auto StartTime = std::chrono::high_resolution_clock::now();
-    AccClient->callAcc(retTypeFuncNameArgTypes, args);
-    auto EndTime = std::chrono::high_resolution_clock::now();
-
     auto funcNameStart = strchr(retTypeFuncNameArgTypes, ':');
     funcNameStart++;
     std::string funcName(funcNameStart, strcspn(funcNameStart, ":"));
 
+    // functions of hotspots found later are served over their own connection
+    AbstractClient *Client;
+    unsigned long score;
+    {
+        std::lock_guard<std::mutex> lock(AccelerationMutex);
+        auto entry = clientOfFunction.find(funcName);
+        Client = entry != clientOfFunction.end() ? entry->second : AccClient.get();
+        score = scores[funcName];
+    }
+    // the call pending on another connection may use the same arrays
+    if (LastCallClient != nullptr && LastCallClient != Client)
+        LastCallClient->waitForPendingCall();
+    LastCallClient = Client;
+
+    auto StartTime = std::chrono::high_resolution_clock::now();
+    bool pending = false;
+    if (AsyncCalls)
+        pending = Client->callAccAsync(retTypeFuncNameArgTypes, args);
+    else
+        Client->callAcc(retTypeFuncNameArgTypes, args);
+    auto EndTime = std::chrono::high_resolution_clock::now();
+
+    if (Predictor)
+        Predictor->recordRemote(retTypeFuncNameArgTypes, std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime).count(),
+                                pending ? -1L : Client->getTimeDiffLastExecution());
+
     const auto TimeDiffCallAcc = EndTime - StartTime;
-    timeMeasureStream << funcName << '\t' << scores[funcName] << '\t' <<
-                         AccClient->getTimeDiffLastExecution() << '\t' << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffCallAcc).count() << '\t';
+    // execution time of a pending call is not known yet
+    timeMeasureStream << funcName << '\t' << score << '\t' <<
+                         (pending ? -1L : Client->getTimeDiffLastExecution()) << '\t' << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffCallAcc).count() << '\t';
     timeMeasureStream.flush();
-    std::cout << "INFO: callAcc took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffCallAcc).count() << " microseconds for '" << funcName << "' with score " << scores[funcName] << "\n";
+    std::cout << "INFO: callAcc " << (pending ? "returned after " : "took ") << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffCallAcc).count() << " microseconds for '" << funcName << "' with score " << score << "\n";
 
     va_end(args);
 }
 
+// called by the functions altered by RPCAccelerate, see OffloadPredictor
+extern "C" int32_t baar_shouldOffload(const char *retTypeFuncNameArgTypes, uint64_t argSizeInBytes, int32_t staticDecision) {
+    return Predictor->shouldOffload(retTypeFuncNameArgTypes, argSizeInBytes, staticDecision != 0);
+}
+
+extern "C" int64_t baar_now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+extern "C" void baar_recordLocal(const char *retTypeFuncNameArgTypes, uint64_t argSizeInBytes, int64_t start) {
+    Predictor->recordLocal(retTypeFuncNameArgTypes, argSizeInBytes, baar_now() - start);
+}
+
 int main(int argc, char* argv[]) {
     llvm::cl::ParseCommandLineOptions(argc, argv);
 
@@ -140,18 +229,18 @@ int main(int argc, char* argv[]) {
     if (!fileExists)
         timeMeasureStream << "Ana\tSrvIni\tOpt\tBndIni\tAlt\t(FuncName\tFuncScore\tExeAcc\tCallAcc)*\n";
 
+    ResidencyTracker::detectWritesByHashing(ResidencyHashing);
+
     for (int i = 0; i < ProgramRuns; i++) {
-        switch(ClientCommunicationType) {
-            case socket: AccClient.reset(new SocketClient(ServerHostname)); break;
-            case sharedmem:
-                AccClient.reset(new ShmemClient());
-                if (ProgramRuns > 1) {
-                    std::cout << "WARNING: -runs argument unsupported in shared memory mode, will be ignored\n";
-                    ProgramRuns = 1;
-                }
-            break;
-        }
+        AccClient.reset(createClient());
+        // the arena has to exist before the program allocates its arrays, it is shared for zero copy
+        const bool zeroCopy = ClientCommunicationType == sharedmem && ShmemZeroCopy;
+        if (zeroCopy || AsyncCalls)
+            AccClient->createArena((size_t) ArenaSize << 20, ArenaThreshold, zeroCopy);
         scores.clear();
+        clientOfFunction.clear();
+        LastCallClient = nullptr;
+        programFinished.store(false);
         if (ProgramRuns > 1)
             std::cout << "INFO: " << "---------- " << "Beginning run " << i+1 << " of " << ProgramRuns << " ----------" << std::endl;
 
@@ -175,6 +264,18 @@ int main(int argc, char* argv[]) {
             std::cerr << "ERROR, " << err << std::endl;
             exit(1);
         }
+        // functions are analysed and exported from a copy, the program gets profiling code and is altered while it runs
+        std::unique_ptr<llvm::Module> PristineMod(llvm::CloneModule(ProgramMod));
+        interposeAllocationFunctions(ProgramMod, ExeEngine.get(), zeroCopy || AsyncCalls);
+
+        // ------ prepare the acceleration by declaring callAcc, the OffloadPredictor and the profiling counters
+        declareCallAcc(ProgramMod);
+        Predictor.reset(StaticOffload ? nullptr : new OffloadPredictor());
+        if (Predictor)
+            declareOffloadPredictor(ProgramMod, ExeEngine.get());
+        Profiler.reset(StaticHotspots || DisableExeEngineParallel ? nullptr : new HotspotProfiler(HotShare));
+        if (Profiler)
+            Profiler->instrument(ProgramMod, ExeEngine.get());
         // generate code for main before starting parallel thread to avoid segfaults
         ExeEngine->getPointerToFunction(ProgramMod->getFunction("main"));
 
@@ -184,100 +285,67 @@ int main(int argc, char* argv[]) {
             exeEngineThread.reset(new std::thread(runExeEngine, ProgramMod, ExeEngine.get()));
         }
 
-        auto StartTimeAnalysis = std::chrono::high_resolution_clock::now();
-        // ------ Analyze functions to gather candidates for acceleration
-        // Passes for estimating Basic Block frequency
-        llvm::FunctionPassManager BlockFreqAnalysisPM(ProgramMod);
-        BlockFreqAnalysisPM.add(llvm::createLoopSimplifyPass());
-        llvm::BlockFrequencyInfo* BFIPass = new llvm::BlockFrequencyInfo();
-        BlockFreqAnalysisPM.add(BFIPass);
-
-        std::list<llvm::Function*> accelerationCandidates;
-        for (llvm::Module::iterator I = ProgramMod->begin(); I != ProgramMod->end(); I++) {
-            if (I->getName().compare("main") == 0) // do not try to accelerate main
-                continue;
-
-            BlockFreqAnalysisPM.run(*I);
-
-            unsigned maxBBFreq = 0;
-            for (llvm::Function::iterator J = I->begin(); J != I->end(); J++) {
-                auto currFreq = BFIPass->getBlockFreq(J).getFrequency()/BFIPass->getBlockFreq(J).getEntryFrequency();
-                if (maxBBFreq < currFreq)
-                    maxBBFreq = currFreq;
-            }
-            #ifndef NDEBUG
-                    std::cout << "DEBUG: " << I->getName().str() << " max BB freq = " << maxBBFreq << std::endl;
-            #endif
-            if (maxBBFreq > BBFreqThreshold)
-                accelerationCandidates.push_back(&(*I));
-        }
-        std::cout << "INFO: " << "The following function" << (accelerationCandidates.size() > 1 ? "s were" : " was") << " chosen as acceleration candidate" << (accelerationCandidates.size() > 1 ? "s: " : ": ");
-        for (const auto& func : accelerationCandidates)
-            std::cout << func->getName().str() << " ";
-        std::cout << std::endl;
-
-        // Score and choose functions to accelerate from candidates
-        // Passes for scoring functions
-        llvm::FunctionPassManager ScoringPM(ProgramMod);
-        ScoringPM.add(new llvm::DataLayout(ProgramMod->getDataLayout()));
-        ScoringPM.add(llvm::createPromoteMemoryToRegisterPass());
-        // ScoringPM.add(llvm::createLoopSimplifyPass()); alredy done by BlockFreqAnalysisPM, but needed here!
-        ScoringPM.add(polly::createIndVarSimplifyPass());
-        ScoringPM.add(llvm::createBasicAliasAnalysisPass());
-        ScoringPM.add(new polly::ScopDetection());
-        baar::AccScore* ScorePass = static_cast<baar::AccScore*>(baar::createScoringPass());
-        ScoringPM.add(ScorePass);
-
-        std::list<llvm::Function*> functionsToAccelerate;
-        for (const auto& function : accelerationCandidates) {
-            ScoringPM.run(*function);
-            if (ScorePass->getScore() > OffloadScoreThreshold) { // exclude functions obviously promising no speedup on accelerator
-                functionsToAccelerate.push_back(function);
-                scores[function->getName().str()] = ScorePass->getScore();
+        std::list<std::unique_ptr<AccelerationBatch>> batches;
+        if (!Profiler) {
+            auto StartTimeAnalysis = std::chrono::high_resolution_clock::now();
+            // ------ Analyze functions to gather candidates for acceleration, then score and choose functions to accelerate from them
+            std::list<llvm::Function*> functionsToAccelerate = chooseFunctionsToAccelerate(PristineMod.get(), estimateCandidates(PristineMod.get()));
+            auto EndTimeAnalysis = std::chrono::high_resolution_clock::now();
+            const auto TimeDiffAnalysis = EndTimeAnalysis - StartTimeAnalysis;
+            timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << '\t';
+            std::cout << "INFO: Analysis took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << " microseconds\n";
+
+            batches.emplace_back(new AccelerationBatch());
+            accelerateBatch(*batches.back(), nullptr, Context, PristineMod.get(), ProgramMod, ExeEngine.get(), functionsToAccelerate);
+        } else {
+            // ------ Profile the running program, hotspots found in a window are analysed and accelerated right away
+            auto StartTimeProfiling = std::chrono::high_resolution_clock::now();
+            for (unsigned window = 0; window < ProfileWindows && sleepWhileRunning(std::chrono::milliseconds(ProfileWindow)); window++) {
+                const std::list<std::string> hotspots = Profiler->newHotspots();
+                if (hotspots.empty())
+                    continue;
+
+                auto StartTimeAnalysis = std::chrono::high_resolution_clock::now();
+                std::list<llvm::Function*> accelerationCandidates;
+                std::cout << "INFO: " << "Profiling found the following hotspot" << (hotspots.size() > 1 ? "s" : "") << " after "
+                          << std::chrono::duration_cast<std::chrono::milliseconds>(StartTimeAnalysis - StartTimeProfiling).count() << " milliseconds: ";
+                for (const auto& name : hotspots) {
+                    accelerationCandidates.push_back(PristineMod->getFunction(name));
+                    std::cout << name << " ";
+                }
+                std::cout << std::endl;
+
+                std::list<llvm::Function*> functionsToAccelerate = chooseFunctionsToAccelerate(PristineMod.get(), accelerationCandidates);
+                auto EndTimeAnalysis = std::chrono::high_resolution_clock::now();
+                const auto TimeDiffAnalysis = EndTimeAnalysis - StartTimeAnalysis;
+                std::cout << "INFO: Analysis took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << " microseconds\n";
+                if (functionsToAccelerate.empty())
+                    continue;
+
+                // the server accepts one module per connection, later hotspots are sent over a new one
+                const bool first = batches.empty();
+                if (first)
+                    timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << '\t';
+                batches.emplace_back(new AccelerationBatch());
+                if (!first)
+                    batches.back()->client.reset(createClient());
+                accelerateBatch(*batches.back(), first ? nullptr : batches.front().get(), Context, PristineMod.get(), ProgramMod, ExeEngine.get(), functionsToAccelerate);
             }
+            if (batches.empty()) // no columns of the acceleration, the calls' ones stay in place
+                timeMeasureStream << "-1\t-1\t-1\t-1\t-1\t";
         }
-        accelerationCandidates.clear();
-        auto EndTimeAnalysis = std::chrono::high_resolution_clock::now();
-        const auto TimeDiffAnalysis = EndTimeAnalysis - StartTimeAnalysis;
-        timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << '\t';
-        std::cout << "INFO: Analysis took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAnalysis).count() << " microseconds\n";
-        // functionsToAccelerate.push_back(ProgramMod->getFunction("testfunc")); // ----- DEBUG ----- // TODO add command line argument to always accelerate a desired function (?)
-        std::cout << "INFO: " << "The following function" << (functionsToAccelerate.size() > 1 ? "s were" : " was") << " chosen to be accelerated: ";
-        for (const auto& func : functionsToAccelerate)
-            std::cout << func->getName().str() << " ";
-        std::cout << std::endl;
-
-        auto StartTimeAccInitialization = std::chrono::high_resolution_clock::now();
-        // ------ prepare the acceleration by declaring callAcc and creating module with exported functions
-        declareCallAcc(ProgramMod);
-        std::string exportedModuleIR = exportFunctionsIntoBitcode(Context, ProgramMod, functionsToAccelerate);
-        // initialise client (connect to server and send exported functions)
-        std::cout << "DEBUG: " << "export done, initialising accelerator...\n";
-        AccClient->initialiseAccelerationWithIR(exportedModuleIR);
-        auto EndTimeAccInitialization = std::chrono::high_resolution_clock::now();
-        const auto TimeDiffAccInitialization = EndTimeAccInitialization - StartTimeAccInitialization;
-        timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAccInitialization).count() << '\t';
-        std::cout << "INFO: Initializing the server took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAccInitialization).count() << " microseconds\n";
-        timeMeasureStream << AccClient->getTimeDiffOpt() << '\t' << AccClient->getTimeDiffInit() << '\t';
-
-        // ------ do the actual acceleration by running RPCAcc pass on every function to be accelerated
-        auto StartTimeAlteration = std::chrono::high_resolution_clock::now();
-        bool success = true;
-        llvm::FunctionPassManager FuncToRPCPM(ProgramMod);
-        FuncToRPCPM.add(baar::createRPCAcceleratePass(&scores));
-        for (const auto& function : functionsToAccelerate) {
-            success &= FuncToRPCPM.run(*function);
-            ExeEngine->recompileAndRelinkFunction(function);
-        }
-        auto EndTimeAlteration = std::chrono::high_resolution_clock::now();
-        const auto TimeDiffAlteration = EndTimeAlteration - StartTimeAlteration;
-        timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAlteration).count() << '\t';
-        std::cout << "INFO: Altering the local program to use accelerator took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAlteration).count() << " microseconds\n";
 
         if (!DisableExeEngineParallel)
             exeEngineThread->join();
         else
             runExeEngine(ProgramMod, ExeEngine.get());
+        for (const auto& batch : batches)
+            if (batch->initialised.valid())
+                batch->initialised.wait();
+        for (const auto& batch : batches)
+            batch->getClient()->waitForPendingCall();
+        if (Predictor)
+            Predictor->report();
         timeMeasureStream << std::endl;
     }
     timeMeasureStream.close();
@@ -291,6 +359,26 @@ void runExeEngine(llvm::Module* Mod, llvm::ExecutionEngine* EE) {
     InputArgv.insert(InputArgv.begin(), IRFilename);
     // run program main
     EE->runFunctionAsMain(Mod->getFunction("main"), InputArgv, nullptr);
+    programFinished.store(true);
+}
+
+AbstractClient *createClient() {
+    switch(ClientCommunicationType) {
+        case socket: return new SocketClient(ServerHostname, (uint64_t) ChunkSize << 10);
+        case sharedmem: return new ShmemClient();
+    }
+    return nullptr;
+}
+
+bool sleepWhileRunning(std::chrono::milliseconds duration) {
+    // false if the program finished before, it is checked every few milliseconds
+    const auto EndTime = std::chrono::high_resolution_clock::now() + duration;
+    while (!programFinished.load()) {
+        if (std::chrono::high_resolution_clock::now() >= EndTime)
+            return true;
+        std::this_thread::sleep_for(std::min(duration, std::chrono::milliseconds(10)));
+    }
+    return false;
 }
 
 void printUsage(std::string programName) {
@@ -299,6 +387,25 @@ void printUsage(std::string programName) {
     std::cout << programName << " --sharedmem <program in LLVM IR>\t - \t Communicate over shared memory" << std::endl << std::endl;
 }
 
+void interposeAllocationFunctions(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, bool arena) {
+    // arrays kept on the server are write protected, memory given back by the program must not be anymore;
+    // with an arena, large arrays of the program end up in it instead (see SharedArena), it takes care of both
+    std::vector<std::pair<const char *, void *>> replacements = {
+        { "realloc", (void *) &ResidencyTracker::interposedRealloc },
+        { "free", (void *) &ResidencyTracker::interposedFree }
+    };
+    if (arena)
+        replacements = {
+            { "malloc", (void *) &SharedArena::interposedMalloc },
+            { "calloc", (void *) &SharedArena::interposedCalloc },
+            { "realloc", (void *) &SharedArena::interposedRealloc },
+            { "free", (void *) &SharedArena::interposedFree }
+        };
+    for (const auto &replacement : replacements)
+        if (llvm::Function *F = ProgramMod->getFunction(replacement.first))
+            EE->addGlobalMapping(F, replacement.second);
+}
+
 void declareCallAcc(llvm::Module *ProgramMod) {
     // Create FunctionType for callAcc, externally defined
     std::vector<llvm::Type*>CallAccType_args;
@@ -310,8 +417,221 @@ void declareCallAcc(llvm::Module *ProgramMod) {
     llvm::Function::Create(CallAccType, llvm::GlobalValue::ExternalLinkage, "callAcc", ProgramMod);
 }
 
+void declareOffloadPredictor(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE) {
+    llvm::LLVMContext &Context = ProgramMod->getContext();
+    llvm::Type *StringTy = llvm::PointerType::get(llvm::IntegerType::get(Context, 8), 0);
+    llvm::Type *Int32Ty = llvm::IntegerType::get(Context, 32);
+    llvm::Type *Int64Ty = llvm::IntegerType::get(Context, 64);
+
+    // RPCAccelerate uses them if all of them are declared, they are mapped like the interposed allocation functions
+    const std::vector<llvm::Type*> ShouldOffloadArgs = { StringTy, Int64Ty, Int32Ty };
+    const std::vector<llvm::Type*> RecordLocalArgs = { StringTy, Int64Ty, Int64Ty };
+    const std::pair<llvm::FunctionType *, std::pair<const char *, void *>> functions[] = {
+        { llvm::FunctionType::get(Int32Ty, ShouldOffloadArgs, false), { "baar_shouldOffload", (void *) &baar_shouldOffload } },
+        { llvm::FunctionType::get(Int64Ty, false), { "baar_now", (void *) &baar_now } },
+        { llvm::FunctionType::get(llvm::Type::getVoidTy(Context), RecordLocalArgs, false), { "baar_recordLocal", (void *) &baar_recordLocal } }
+    };
+    for (const auto &function : functions)
+        EE->addGlobalMapping(llvm::Function::Create(function.first, llvm::GlobalValue::ExternalLinkage, function.second.first, ProgramMod), function.second.second);
+}
+
+void initialiseAccelerator(AbstractClient *Client, const std::string &exportedModuleIR, std::chrono::high_resolution_clock::time_point StartTimeAccInitialization, bool measure) {
+    std::cout << "DEBUG: " << "export done, initialising accelerator...\n";
+    Client->initialiseAccelerationWithIR(exportedModuleIR);
+    auto EndTimeAccInitialization = std::chrono::high_resolution_clock::now();
+    const auto TimeDiffAccInitialization = EndTimeAccInitialization - StartTimeAccInitialization;
+    if (measure)
+        timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAccInitialization).count() << '\t';
+    std::cout << "INFO: Initializing the server took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAccInitialization).count() << " microseconds\n";
+    if (measure)
+        timeMeasureStream << Client->getTimeDiffOpt() << '\t' << Client->getTimeDiffInit() << '\t';
+}
+
+llvm::GlobalVariable *declareAccReady(llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, std::atomic<int32_t> &ready) {
+    // the program reads the flag defined here, it has to be mapped before the altered functions are compiled
+    // every batch has its own one, LLVM numbers the names of later ones
+    ready.store(0, std::memory_order_relaxed);
+    llvm::GlobalVariable *AccReady = new llvm::GlobalVariable(*ProgramMod, llvm::IntegerType::get(ProgramMod->getContext(), 32), false,
+                                                              llvm::GlobalValue::ExternalLinkage, nullptr, "baar_acc_ready");
+    EE->addGlobalMapping(AccReady, &ready);
+    return AccReady;
+}
+
+std::list<llvm::Function*> estimateCandidates(llvm::Module *Mod) {
+    // Passes for estimating Basic Block frequency
+    llvm::FunctionPassManager BlockFreqAnalysisPM(Mod);
+    BlockFreqAnalysisPM.add(llvm::createLoopSimplifyPass());
+    llvm::BlockFrequencyInfo* BFIPass = new llvm::BlockFrequencyInfo();
+    BlockFreqAnalysisPM.add(BFIPass);
+
+    std::list<llvm::Function*> accelerationCandidates;
+    for (llvm::Module::iterator I = Mod->begin(); I != Mod->end(); I++) {
+        if (I->getName().compare("main") == 0) // do not try to accelerate main
+            continue;
+
+        BlockFreqAnalysisPM.run(*I);
+
+        unsigned maxBBFreq = 0;
+        for (llvm::Function::iterator J = I->begin(); J != I->end(); J++) {
+            auto currFreq = BFIPass->getBlockFreq(J).getFrequency()/BFIPass->getBlockFreq(J).getEntryFrequency();
+            if (maxBBFreq < currFreq)
+                maxBBFreq = currFreq;
+        }
+        #ifndef NDEBUG
+                std::cout << "DEBUG: " << I->getName().str() << " max BB freq = " << maxBBFreq << std::endl;
+        #endif
+        if (maxBBFreq > BBFreqThreshold)
+            accelerationCandidates.push_back(&(*I));
+    }
+    std::cout << "INFO: " << "The following function" << (accelerationCandidates.size() > 1 ? "s were" : " was") << " chosen as acceleration candidate" << (accelerationCandidates.size() > 1 ? "s: " : ": ");
+    for (const auto& func : accelerationCandidates)
+        std::cout << func->getName().str() << " ";
+    std::cout << std::endl;
+    return accelerationCandidates;
+}
+
+std::list<llvm::Function*> chooseFunctionsToAccelerate(llvm::Module *Mod, const std::list<llvm::Function*>& accelerationCandidates) {
+    // Passes for scoring functions
+    llvm::FunctionPassManager ScoringPM(Mod);
+    ScoringPM.add(new llvm::DataLayout(Mod->getDataLayout()));
+    ScoringPM.add(llvm::createPromoteMemoryToRegisterPass());
+    ScoringPM.add(llvm::createLoopSimplifyPass()); // profiled candidates did not go through estimateCandidates
+    ScoringPM.add(polly::createIndVarSimplifyPass());
+    ScoringPM.add(llvm::createBasicAliasAnalysisPass());
+    ScoringPM.add(new polly::ScopDetection());
+    baar::AccScore* ScorePass = static_cast<baar::AccScore*>(baar::createScoringPass());
+    ScoringPM.add(ScorePass);
+
+    std::list<llvm::Function*> functionsToAccelerate;
+    for (const auto& function : accelerationCandidates) {
+        ScoringPM.run(*function);
+        if (ScorePass->getScore() > OffloadScoreThreshold) { // exclude functions obviously promising no speedup on accelerator
+            functionsToAccelerate.push_back(function);
+            std::lock_guard<std::mutex> lock(AccelerationMutex);
+            scores[function->getName().str()] = ScorePass->getScore();
+        }
+    }
+    // functionsToAccelerate.push_back(Mod->getFunction("testfunc")); // ----- DEBUG ----- // TODO add command line argument to always accelerate a desired function (?)
+    std::cout << "INFO: " << "The following function" << (functionsToAccelerate.size() > 1 ? "s were" : " was") << " chosen to be accelerated: ";
+    for (const auto& func : functionsToAccelerate)
+        std::cout << func->getName().str() << " ";
+    std::cout << std::endl;
+    return functionsToAccelerate;
+}
+
+void accelerateBatch(AccelerationBatch &batch, const AccelerationBatch *first, llvm::LLVMContext *Context, llvm::Module *PristineMod,
+                     llvm::Module *ProgramMod, llvm::ExecutionEngine *EE, const std::list<llvm::Function*>& functionsToAccelerate) {
+    // only the first batch of a run writes the columns of the acceleration, functions of later ones are ready after it
+    const bool measure = first == nullptr;
+    AbstractClient *Client = batch.getClient();
+    auto StartTimeAccInitialization = std::chrono::high_resolution_clock::now();
+    // ------ create module with exported functions, they come without profiling code
+    batch.exportedModuleIR = exportFunctionsIntoBitcode(Context, PristineMod, functionsToAccelerate);
+    if (BlockingInit) {
+        // initialise client (connect to server and send exported functions)
+        initialiseAccelerator(Client, batch.exportedModuleIR, StartTimeAccInitialization, measure);
+    }
+    {
+        std::lock_guard<std::mutex> lock(AccelerationMutex);
+        for (const auto& function : functionsToAccelerate)
+            clientOfFunction[function->getName().str()] = Client;
+    }
+
+    // ------ do the actual acceleration by running RPCAcc pass on every function to be accelerated
+    // without -blocking-init, the altered functions keep calling their local body until the server is ready
+    auto StartTimeAlteration = std::chrono::high_resolution_clock::now();
+    llvm::FunctionPassManager FuncToRPCPM(ProgramMod);
+    FuncToRPCPM.add(llvm::createPromoteMemoryToRegisterPass()); // like the scored and exported copy
+    FuncToRPCPM.add(baar::createRPCAcceleratePass(&scores, BlockingInit ? nullptr : declareAccReady(ProgramMod, EE, batch.ready)));
+    for (const auto& function : functionsToAccelerate) {
+        llvm::Function *ProgramFunction = ProgramMod->getFunction(function->getName());
+        FuncToRPCPM.run(*ProgramFunction);
+        EE->recompileAndRelinkFunction(ProgramFunction);
+    }
+    auto EndTimeAlteration = std::chrono::high_resolution_clock::now();
+    const auto TimeDiffAlteration = EndTimeAlteration - StartTimeAlteration;
+    std::cout << "INFO: Altering the local program to use accelerator took " << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAlteration).count() << " microseconds\n";
+
+    if (BlockingInit) {
+        if (measure)
+            timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAlteration).count() << '\t';
+        return;
+    }
+    // the server optimizes and compiles while the program runs, callAcc is only reached once the batch is ready,
+    // so all columns are written before the first call writes to timeMeasureStream
+    std::shared_future<void> firstInitialised = measure ? std::shared_future<void>() : first->initialised;
+    batch.initialised = std::async(std::launch::async, [&batch, Client, measure, firstInitialised, StartTimeAccInitialization, TimeDiffAlteration]() {
+        initialiseAccelerator(Client, batch.exportedModuleIR, StartTimeAccInitialization, measure);
+        if (measure)
+            timeMeasureStream << std::chrono::duration_cast<std::chrono::microseconds>(TimeDiffAlteration).count() << '\t';
+        else
+            firstInitialised.wait();
+        batch.ready.store(1, std::memory_order_release);
+        std::cout << "INFO: accelerated functions are used from now on\n";
+    }).share();
+}
+
+// Collects the global values the functions to accelerate depend on: everything referenced by their instructions,
+// by the initializers of referenced global variables and by the bodies of called functions, transitively
+static void collectDependencies(const std::list<llvm::Function*>& functionList, std::unordered_set<const llvm::GlobalValue*>& dependencies)
+{
+    std::vector<const llvm::Value*> worklist(functionList.begin(), functionList.end());
+    std::unordered_set<const llvm::Value*> visited;
+    while (!worklist.empty()) {
+        const llvm::Value *V = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(V).second)
+            continue;
+
+        if (const llvm::Function *F = llvm::dyn_cast<llvm::Function>(V)) {
+            dependencies.insert(F);
+            if (F->isDeclaration() || F->getName().str() == "main") // main is never exported with body
+                continue;
+            for (llvm::Function::const_iterator BB = F->begin(), BE = F->end(); BB != BE; ++BB)
+                for (llvm::BasicBlock::const_iterator I = BB->begin(), IE = BB->end(); I != IE; ++I)
+                    for (llvm::User::const_op_iterator OI = I->op_begin(), OE = I->op_end(); OI != OE; ++OI)
+                        if (llvm::isa<llvm::Constant>(OI->get()))
+                            worklist.push_back(OI->get());
+        } else if (const llvm::GlobalVariable *GV = llvm::dyn_cast<llvm::GlobalVariable>(V)) {
+            dependencies.insert(GV);
+            if (GV->hasInitializer())
+                worklist.push_back(GV->getInitializer());
+        } else if (const llvm::GlobalAlias *GA = llvm::dyn_cast<llvm::GlobalAlias>(V)) {
+            dependencies.insert(GA);
+            if (GA->getAliasee())
+                worklist.push_back(GA->getAliasee());
+        } else if (const llvm::Constant *C = llvm::dyn_cast<llvm::Constant>(V)) {
+            // constant expressions and aggregates, e.g. tables of function pointers
+            for (llvm::User::const_op_iterator OI = C->op_begin(), OE = C->op_end(); OI != OE; ++OI)
+                worklist.push_back(OI->get());
+        }
+    }
+}
+
+// true if metadata only refers to global values which are exported
+static bool referencesOnlyExported(const llvm::MDNode *N, llvm::ValueToValueMapTy& VMap, std::unordered_set<const llvm::MDNode*>& visited)
+{
+    if (!visited.insert(N).second)
+        return true;
+    for (unsigned i = 0, e = N->getNumOperands(); i != e; ++i) {
+        const llvm::Value *Op = N->getOperand(i);
+        if (!Op)
+            continue;
+        if (const llvm::GlobalValue *GV = llvm::dyn_cast<llvm::GlobalValue>(Op)) {
+            if (!VMap.count(GV))
+                return false;
+        } else if (const llvm::MDNode *OpN = llvm::dyn_cast<llvm::MDNode>(Op)) {
+            if (!referencesOnlyExported(OpN, VMap, visited))
+                return false;
+        }
+    }
+    return true;
+}
+
 std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module *ProgramMod, const std::list<llvm::Function*>& functionList) { // See LLVM CloneModule.cpp
-    // TODO optimize such that only used globals are copied
+    // only what the functions to accelerate can reach is exported, helper functions they call included
+    std::unordered_set<const llvm::GlobalValue*> dependencies;
+    collectDependencies(functionList, dependencies);
 
     // Map values from the old to values in the new module
     llvm::ValueToValueMapTy VMap;
@@ -321,9 +641,19 @@ std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module
     ExportModule->setDataLayout(ProgramMod->getDataLayout());
     ExportModule->setTargetTriple(ProgramMod->getTargetTriple());
     ExportModule->setModuleInlineAsm(ProgramMod->getModuleInlineAsm());
+    llvm::DataLayout DL(ProgramMod);
 
-    // Copy global variables over to the new module, initializers are copied later
+    // Copy used global variables over to the new module, initializers are copied later
+    uint64_t programDataSize = 0, exportedDataSize = 0;
+    unsigned numProgramGlobals = 0, numExportedGlobals = 0;
     for (llvm::Module::const_global_iterator I = ProgramMod->global_begin(), E = ProgramMod->global_end(); I != E; ++I) {
+      const uint64_t dataSize = I->hasInitializer() ? DL.getTypeAllocSize(I->getType()->getElementType()) : 0;
+      programDataSize += dataSize;
+      numProgramGlobals++;
+      if (!dependencies.count(I))
+        continue;
+      exportedDataSize += dataSize;
+      numExportedGlobals++;
       llvm::GlobalVariable *GV = new llvm::GlobalVariable(*ExportModule,
                                               I->getType()->getElementType(),
                                               I->isConstant(), I->getLinkage(),
@@ -335,19 +665,24 @@ std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module
       VMap[I] = GV;
     }
 
-    // Copy external function declarations for defined functions to the new module
+    // Declare used functions in the new module, bodies of defined ones are copied later
+    unsigned numProgramFunctions = 0, numExportedFunctions = 0;
     for (llvm::Module::const_iterator I = ProgramMod->begin(), E = ProgramMod->end(); I != E; ++I) {
-      if (I->getName().str() == "main") // do not declare main, may cause problems with external compiler backend
-          continue;
-      if (I->isDeclaration() && (!I->getName().count("alloc") && !I->getName().count("free"))) // exclude declaration but include malloc etc. (safety measure for extcompiler backend)
-          continue;
+      if (!I->isDeclaration())
+        numProgramFunctions++;
+      if (!dependencies.count(I))
+        continue;
+      if (!I->isDeclaration() && I->getName().str() != "main")
+        numExportedFunctions++;
       llvm::Function *NF = llvm::Function::Create(llvm::cast<llvm::FunctionType>(I->getType()->getElementType()), I->getLinkage(), I->getName(), ExportModule);
       NF->copyAttributesFrom(I);
       VMap[I] = NF;
     }
 
-    // Copy aliases to the new module
+    // Copy used aliases to the new module
     for (llvm::Module::const_alias_iterator I = ProgramMod->alias_begin(), E = ProgramMod->alias_end(); I != E; ++I) {
+      if (!dependencies.count(I))
+        continue;
       llvm::GlobalAlias *GA = new llvm::GlobalAlias(I->getType(), I->getLinkage(), I->getName(), NULL, ExportModule);
       GA->copyAttributesFrom(I);
       VMap[I] = GA;
@@ -355,13 +690,18 @@ std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module
 
     // Any dependencies initializers might have, are copied now. Copy and set initilializers
     for (llvm::Module::const_global_iterator I = ProgramMod->global_begin(), E = ProgramMod->global_end(); I != E; ++I) {
+      if (!VMap.count(I))
+        continue;
       llvm::GlobalVariable *GV = llvm::cast<llvm::GlobalVariable>(VMap[I]);
       if (I->hasInitializer())
         GV->setInitializer(llvm::MapValue(I->getInitializer(), VMap));
     }
 
-    // Copy chosen functions into newly created module
-    for (const auto& ToBeAccelerated : functionList) {
+    // Copy chosen functions and the helper functions they call into newly created module
+    for (llvm::Module::iterator I = ProgramMod->begin(), E = ProgramMod->end(); I != E; ++I) {
+        if (!VMap.count(I) || I->isDeclaration() || I->getName().str() == "main")
+            continue;
+        llvm::Function *ToBeAccelerated = I;
         // Get reference to function which we want to accelerate
         llvm::Function *ExportFunction = llvm::cast<llvm::Function>(VMap[ToBeAccelerated]);
 
@@ -377,27 +717,36 @@ std::string exportFunctionsIntoBitcode(llvm::LLVMContext* Context, llvm::Module
 
     // Copy missing aliases
     for (llvm::Module::const_alias_iterator I = ProgramMod->alias_begin(), E = ProgramMod->alias_end(); I != E; ++I) {
+      if (!VMap.count(I))
+        continue;
       llvm::GlobalAlias *GA = llvm::cast<llvm::GlobalAlias>(VMap[I]);
       if (const llvm::Constant *C = I->getAliasee())
         GA->setAliasee(llvm::MapValue(C, VMap));
     }
 
-    // Copy metadata
+    // Copy metadata not referring to anything left behind
     for (llvm::Module::const_named_metadata_iterator I = ProgramMod->named_metadata_begin(), E = ProgramMod->named_metadata_end(); I != E; ++I) {
       const llvm::NamedMDNode &NMD = *I;
+      std::unordered_set<const llvm::MDNode*> visited;
+      bool exportable = true;
+      for (unsigned i = 0, e = NMD.getNumOperands(); i != e && exportable; ++i)
+        exportable = referencesOnlyExported(NMD.getOperand(i), VMap, visited);
+      if (!exportable)
+        continue;
       llvm::NamedMDNode *NewNMD = ExportModule->getOrInsertNamedMetadata(NMD.getName());
       for (unsigned i = 0, e = NMD.getNumOperands(); i != e; ++i)
         NewNMD->addOperand(MapValue(NMD.getOperand(i), VMap));
     }
+    // debug info of the cloned functions refers to the whole program, it is of no use on the server
+    llvm::StripDebugInfo(*ExportModule);
+
+    std::cout << "INFO: exporting " << numExportedFunctions << " of " << numProgramFunctions << " defined functions ("
+              << numExportedFunctions - functionList.size() << " called by the chosen ones), "
+              << numExportedGlobals << " of " << numProgramGlobals << " global variables ("
+              << exportedDataSize << " of " << programDataSize << " bytes of initialised data)\n";
 
-    // Write ExportModule to IR file
-    // std::string err;
-    // llvm::raw_fd_ostream moduleStream(fileName.c_str(), err); // for writing to file (deprecated)
-    std::string moduleBitcode;
-    llvm::raw_string_ostream moduleStream(moduleBitcode);
-    //llvm::WriteBitcodeToFile(ExportModule, moduleStream); // human unreadable bitcode TODO not working correctly
-    moduleStream << *ExportModule; // human readable IR
-    // moduleStream.close();
-    moduleStream.flush();
+    // bitcode contains '\0', it is sent with its size (see ModuleTransfer)
+    const std::string moduleBitcode = ModuleTransfer::encode(*ExportModule, ExportFormat);
+    std::cout << "INFO: exported module has " << moduleBitcode.size() << " bytes\n";
     return moduleBitcode;
 }
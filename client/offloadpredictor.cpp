@@ -0,0 +1,155 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "offloadpredictor.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// bytes of the call last offloaded by a thread, callAcc does not know them
+static thread_local uint64_t offloadedBytes = 0U;
+
+void OffloadPredictor::Average::add(double sample, double weight)
+{
+    value = samples == 0U ? sample : value + weight * (sample - value);
+    samples++;
+}
+
+void OffloadPredictor::Link::add(double sampleBytes, double sampleTime, double decay)
+{
+    weight = weight * decay + 1.0;
+    bytes = bytes * decay + sampleBytes;
+    time = time * decay + sampleTime;
+    bytesSquared = bytesSquared * decay + sampleBytes * sampleBytes;
+    bytesTime = bytesTime * decay + sampleBytes * sampleTime;
+}
+
+double OffloadPredictor::Link::microsecondsPerByte() const
+{
+    if (weight == 0.0)
+        return 0.0;
+    const double variance = bytesSquared / weight - (bytes / weight) * (bytes / weight);
+    if (variance <= 1e-9 * bytesSquared / weight) // all calls of the same size, latency and bandwidth cannot be told apart
+        return bytes > 0.0 ? time / bytes : 0.0;
+    return std::max(0.0, (bytesTime / weight - (bytes / weight) * (time / weight)) / variance);
+}
+
+double OffloadPredictor::Link::latency() const
+{
+    if (weight == 0.0)
+        return 0.0;
+    return std::max(0.0, time / weight - microsecondsPerByte() * bytes / weight);
+}
+
+OffloadPredictor::OffloadPredictor(double weight, unsigned probeInterval) : weight(weight), probeInterval(std::max(probeInterval, 2U))
+{
+}
+
+unsigned OffloadPredictor::groupOf(uint64_t bytes)
+{
+    unsigned group = 0U;
+    while (bytes > 1U) {
+        bytes >>= 1;
+        group++;
+    }
+    return group;
+}
+
+OffloadPredictor::Model &OffloadPredictor::modelOf(const char *function)
+{
+    auto model = models.find(function);
+    if (model != models.end())
+        return model->second;
+
+    // "RetTy:functionName:ArgTy1:...", see RPCAccelerate
+    Model &created = models[function];
+    const char *nameStart = strchr(function, ':');
+    nameStart = nameStart ? nameStart + 1 : function;
+    created.name.assign(nameStart, strcspn(nameStart, ":"));
+    created.groups.resize(64);
+    return created;
+}
+
+double OffloadPredictor::predictRemote(const Group &group, uint64_t bytes) const
+{
+    if (group.execution.samples == 0U)
+        return group.remote.value;
+    return group.execution.value + link.latency() + link.microsecondsPerByte() * bytes;
+}
+
+bool OffloadPredictor::shouldOffload(const char *function, uint64_t bytes, bool staticDecision)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Model &model = modelOf(function);
+    Group &group = model.groups[groupOf(bytes)];
+    group.calls++;
+
+    bool offload;
+    const bool measuredLocal = group.local.samples > 0U;
+    const bool measuredRemote = group.execution.samples > 0U || group.remote.samples > 0U;
+    if (!measuredLocal && !measuredRemote)
+        offload = staticDecision;
+    else if (!measuredLocal || !measuredRemote)
+        offload = !measuredRemote;
+    else {
+        offload = predictRemote(group, bytes) < group.local.value;
+        if (group.calls % probeInterval == 0U)
+            offload = !offload;
+    }
+
+    if (offload) {
+        model.offloaded++;
+        offloadedBytes = bytes;
+    } else
+        model.kept++;
+    return offload;
+}
+
+void OffloadPredictor::recordLocal(const char *function, uint64_t bytes, int64_t microseconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    modelOf(function).groups[groupOf(bytes)].local.add(microseconds, weight);
+}
+
+void OffloadPredictor::recordRemote(const char *function, int64_t microseconds, int64_t execution)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Group &group = modelOf(function).groups[groupOf(offloadedBytes)];
+    if (execution < 0) {
+        group.remote.add(microseconds, weight);
+        return;
+    }
+    group.execution.add(execution, weight);
+    link.add(offloadedBytes, std::max<int64_t>(microseconds - execution, 0), 1.0 - weight / 4);
+}
+
+void OffloadPredictor::report()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto &model : models)
+        std::cout << "INFO: '" << model.second.name << "' was offloaded " << model.second.offloaded << " times, kept local " << model.second.kept << " times\n";
+    if (link.weight > 0.0)
+        std::cout << "INFO: measured transfer latency " << (long) link.latency() << " microseconds, bandwidth "
+                  << (link.microsecondsPerByte() > 0.0 ? (long) (1.0 / link.microsecondsPerByte()) : 0L) << " MB/s\n";
+}
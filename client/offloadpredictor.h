@@ -0,0 +1,92 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef OFFLOADPREDICTOR_H
+#define OFFLOADPREDICTOR_H
+
+#include <cinttypes>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+// Decides for every call of an accelerated function whether it runs locally or on the server, from the timings measured so far.
+// Calls are grouped by the size of their arguments (powers of two). Per function and group, the local time and the server's
+// execution time are kept as exponentially weighted moving averages. The transfer is modeled for all functions together as
+// latency + bytes / bandwidth, fitted by decayed least squares to the time of remote calls not spent on execution.
+// Groups without measurements follow the static decision (AccScore), groups measured only on one side try the other one.
+// The side predicted to be slower is measured again every probeInterval calls, so decisions follow changing conditions.
+class OffloadPredictor
+{
+public:
+    explicit OffloadPredictor(double weight = 0.25, unsigned probeInterval = 64U);
+
+    // functions are identified by the string the RPCAccelerate pass passes to callAcc, it stays in place
+    bool shouldOffload(const char *function, uint64_t bytes, bool staticDecision);
+    void recordLocal(const char *function, uint64_t bytes, int64_t microseconds);
+    // for the call last offloaded by this thread, execution is negative if the server's time is not known (asynchronous calls)
+    void recordRemote(const char *function, int64_t microseconds, int64_t execution);
+    // measurements and decisions per function
+    void report();
+
+private:
+    struct Average {
+        double value = 0.0;
+        unsigned long samples = 0U;
+        void add(double sample, double weight);
+    };
+
+    struct Group {
+        Average local;
+        Average execution;
+        Average remote;     // whole calls, only used if the execution time is not known
+        unsigned long calls = 0U;
+    };
+
+    struct Model {
+        std::string name;
+        std::vector<Group> groups;
+        unsigned long offloaded = 0U;
+        unsigned long kept = 0U;
+    };
+
+    // weighted sums of (bytes, transfer time) samples, older ones fade out
+    struct Link {
+        double weight = 0.0, bytes = 0.0, time = 0.0, bytesSquared = 0.0, bytesTime = 0.0;
+        void add(double bytes, double time, double decay);
+        double latency() const;
+        double microsecondsPerByte() const;
+    };
+
+    const double weight;
+    const unsigned probeInterval;
+    std::unordered_map<const char *, Model> models;
+    Link link;
+    std::mutex mutex;
+
+    static unsigned groupOf(uint64_t bytes);
+    Model &modelOf(const char *function);
+    double predictRemote(const Group &group, uint64_t bytes) const;
+};
+
+#endif // OFFLOADPREDICTOR_H
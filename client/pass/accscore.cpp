@@ -34,19 +34,41 @@
 #include "polly/ScopDetection.h"
 
 #include <iostream>
+#include <algorithm>
+#include <limits>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
 
 char baar::AccScore::ID = 0;
 static RegisterPass<baar::AccScore> X("scoring", "scores functions to decide which functions to offload to accelerator from candidates", false, false);
 
 llvm::cl::opt<int> IOPsWeight("iop-weight", llvm::cl::desc("Weight to multiply to integer operation count when scoring functions, defaults to 1"), llvm::cl::init(1));
 llvm::cl::opt<int> FLOPsWeight("flop-weight", llvm::cl::desc("Weight to multiply to floating point operationg count when scoring functions, defaults to 1"), llvm::cl::init(1));
+llvm::cl::opt<double> MachineBalance("machine-balance", llvm::cl::desc("Operations per byte of memory traffic the accelerator sustains, kernels of lower arithmetic intensity get a proportionally lower score, defaults to 1"), llvm::cl::init(1.0));
+llvm::cl::opt<unsigned> ReuseWindow("reuse-window", llvm::cl::desc("Accesses to an array at most this many KB apart are assumed to hit the cache, defaults to 256"), llvm::cl::init(256));
+llvm::cl::opt<unsigned> TileReuse("tile-reuse", llvm::cl::desc("Traffic of accesses invariant in a loop of their nest is divided by this, as Polly tiles such nests, defaults to 32 (Polly's tile size)"), llvm::cl::init(32));
+llvm::cl::opt<std::string> CalibrationFile("calibration", llvm::cl::desc("Profile of the host/accelerator pair written by baar_calibrate, scores predict the speedup of offloading if given"), llvm::cl::init(""));
 
 FunctionPass *baar::createScoringPass() {
-    return new AccScore();
+    auto Pass = new AccScore();
+    if (!CalibrationFile.empty()) {
+        Calibration calibration;
+        if (!calibration.load(CalibrationFile)) {
+            std::cerr << "ERROR, could not read calibration " << CalibrationFile << ", run baar_calibrate first" << std::endl;
+            exit(1);
+        }
+        std::cout << "INFO: " << "scoring with calibration of " << (calibration.server.empty() ? CalibrationFile : calibration.server) << std::endl;
+        Pass->setCalibration(calibration);
+    }
+    return Pass;
 }
 
 bool baar::AccScore::runOnFunction(Function &F) {
     polly::ScopDetection &SCoPDetect = getAnalysis<polly::ScopDetection>();
+    score = 0;
+    double totalOperations = 0.0;
+    double totalMemoryBytes = 0.0;
     if (SCoPDetect.begin() == SCoPDetect.end()) {
         score = 0;
         std::cout << "INFO: " << "no SCoP detected in " << F.getName().str() << std::endl;
@@ -55,18 +77,35 @@ bool baar::AccScore::runOnFunction(Function &F) {
         for (auto Region = SCoPDetect.begin(); Region != SCoPDetect.end(); Region++) {
             unsigned long regionScore = 0;
             for (LoopInfo::iterator Loop = LoopInf.begin(); Loop != LoopInf.end(); Loop++) {
+                if (!(*Region)->contains(*Loop))
+                    continue;
                 unsigned long LoopInnermostTotalTripCount = getInnermostTotalTripCount(**Loop);
 
                 unsigned totalLoopFLOPs = 0;
                 unsigned totalLoopIOPs = 0;
+                unsigned totalLoopFMAs = 0;
                 for (const auto& Block : (*Loop)->getBlocks()) {
                     visit(Block);
                     totalLoopFLOPs += lastBB_FLOPs;
                     totalLoopIOPs += lastBB_IOPs;
+                    totalLoopFMAs += lastBB_FMAs;
                 }
-                std::cout << "DEBUG: " << " LoopInnermostTotalTripCount = " << LoopInnermostTotalTripCount << ", totalLoopIOPs = " << totalLoopIOPs << ", totalLoopFLOPs = " << totalLoopFLOPs << std::endl;
-                unsigned long loopScore = LoopInnermostTotalTripCount * (IOPsWeight*totalLoopIOPs + FLOPsWeight*totalLoopFLOPs);
+                const double loopMemoryBytes = getMemoryBytesPerIteration(**Loop);
+                // a fused multiply-add counts as one operation, its FMul is not issued on its own
+                const double loopOperations = IOPsWeight*totalLoopIOPs + FLOPsWeight*(totalLoopFLOPs - totalLoopFMAs);
+                const double arithmeticIntensity = loopMemoryBytes > 0.0 ? loopOperations / loopMemoryBytes : std::numeric_limits<double>::infinity();
+                std::cout << "DEBUG: " << " LoopInnermostTotalTripCount = " << LoopInnermostTotalTripCount << ", totalLoopIOPs = " << totalLoopIOPs << ", totalLoopFLOPs = " << totalLoopFLOPs
+                          << " (" << totalLoopFMAs << " fused), bytes per iteration = " << loopMemoryBytes << ", arithmetic intensity = " << arithmeticIntensity << std::endl;
+
+                // memory bound nests gain less from the accelerator's compute throughput
+                const double boundFactor = std::min(1.0, arithmeticIntensity / MachineBalance);
+                const double exactLoopScore = LoopInnermostTotalTripCount * loopOperations * boundFactor;
+                const unsigned long loopScore = exactLoopScore >= (double) std::numeric_limits<unsigned long>::max() ? std::numeric_limits<unsigned long>::max() : (unsigned long) exactLoopScore;
                 regionScore += loopScore;
+                if (regionScore < loopScore) // check for overflow
+                    regionScore = std::numeric_limits<unsigned long>::max();
+                totalOperations += (double) LoopInnermostTotalTripCount * (IOPsWeight*totalLoopIOPs + FLOPsWeight*totalLoopFLOPs);
+                totalMemoryBytes += (double) LoopInnermostTotalTripCount * loopMemoryBytes;
             }
             score += regionScore;
             if (score < regionScore) { // check for overflow
@@ -75,6 +114,8 @@ bool baar::AccScore::runOnFunction(Function &F) {
                 break;
             }
         }        
+        if (calibrated)
+            score = getRooflineScore(totalOperations, totalMemoryBytes);
     }
     std::cout << "DEBUG: " << F.getName().str() << " got a score of " << score << std::endl;
 
@@ -94,6 +135,173 @@ unsigned long baar::AccScore::getScore()
     return score;
 }
 
+void baar::AccScore::setCalibration(const Calibration &calibration)
+{
+    this->calibration = calibration;
+    calibrated = true;
+}
+
+void baar::AccScore::visitBinaryOperator(BinaryOperator &I)
+{
+    switch (I.getOpcode()) {
+        case Instruction::FAdd:
+        case Instruction::FSub:
+            for (unsigned i = 0; i < 2; i++)
+                if (BinaryOperator *Mul = dyn_cast<BinaryOperator>(I.getOperand(i)))
+                    if (Mul->getOpcode() == Instruction::FMul && Mul->hasOneUse() && Mul->getParent() == I.getParent()) {
+                        lastBB_FMAs++;
+                        break;
+                    }
+            lastBB_FLOPs++;
+            break;
+        case Instruction::FMul:
+        case Instruction::FDiv:
+        case Instruction::FRem:
+            lastBB_FLOPs++;
+            break;
+        case Instruction::Add:
+        case Instruction::Sub:
+        case Instruction::Mul:
+        case Instruction::UDiv:
+        case Instruction::SDiv:
+        case Instruction::URem:
+        case Instruction::SRem:
+        case Instruction::Shl:
+        case Instruction::LShr:
+        case Instruction::AShr:
+        case Instruction::And:
+        case Instruction::Or:
+        case Instruction::Xor:
+            lastBB_IOPs++;
+            break;
+        default:
+            break;
+    }
+}
+
+// true if the address changes with the iterations of Lp, the recurrences of loops nested in Lp are looked through
+static bool dependsOnLoop(ScalarEvolution &ScalarEv, const SCEV *Address, const Loop *Lp)
+{
+    while (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(Address)) {
+        if (AddRec->getLoop() == Lp)
+            return true;
+        if (!Lp->contains(AddRec->getLoop()))
+            break;
+        Address = AddRec->getStart();
+    }
+    return !ScalarEv.isLoopInvariant(Address, Lp);
+}
+
+double baar::AccScore::getMemoryBytesPerIteration(const Loop &L)
+{
+    // Every access is classified by the SCEV of its address in the innermost loop containing it:
+    // - invariant: stays in a register or the cache, no traffic
+    // - affine with a constant stride: |stride| bytes, at most a cache line
+    // - anything else (including strides depending on parameters): a cache line
+    // Accesses to the same array with the same stride and a constant distance within the reuse window (e.g. the points
+    // of a stencil) or a distance invariant in the nest (neighbouring rows) share one stream, only the first one counts.
+    // Reads of arrays not written in the nest which are invariant in any loop of the nest have temporal reuse,
+    // Polly tiles them, their traffic is divided by TileReuse.
+    const double CacheLine = 64.0;
+    ScalarEvolution &ScalarEv = getAnalysis<ScalarEvolution>();
+    LoopInfo &LoopInf = getAnalysis<LoopInfo>();
+
+    // reuse across a loop is only exploited by tiling if no dependence through the array is carried by that loop
+    std::vector<const SCEV*> writtenArrays;
+    for (const auto& Block : L.getBlocks())
+        for (auto& Inst : *Block)
+            if (StoreInst *Store = dyn_cast<StoreInst>(&Inst))
+                writtenArrays.push_back(ScalarEv.getPointerBase(ScalarEv.getSCEV(Store->getPointerOperand())));
+
+    std::vector<std::pair<bool, const SCEV*>> streams; // (is store, address) of accesses counted
+    double bytes = 0.0;
+    for (const auto& Block : L.getBlocks()) {
+        const Loop *Innermost = LoopInf.getLoopFor(Block);
+        // blocks of outer loops run once per iteration of their loop, i.e. once per many innermost iterations
+        double executionsPerIteration = 1.0;
+        unsigned long innermostIterations = 0;
+        for (const auto& SubLoop : Innermost->getSubLoops())
+            innermostIterations += getInnermostTotalTripCount(*SubLoop);
+        if (innermostIterations > 0)
+            executionsPerIteration = 1.0 / innermostIterations;
+
+        for (auto& Inst : *Block) {
+            Value *Pointer;
+            Type *AccessType;
+            if (LoadInst *Load = dyn_cast<LoadInst>(&Inst)) {
+                Pointer = Load->getPointerOperand();
+                AccessType = Load->getType();
+            } else if (StoreInst *Store = dyn_cast<StoreInst>(&Inst)) {
+                Pointer = Store->getPointerOperand();
+                AccessType = Store->getValueOperand()->getType();
+            } else
+                continue;
+            const bool isStore = isa<StoreInst>(&Inst);
+            const double elementBytes = AccessType->getPrimitiveSizeInBits() / 8;
+
+            const SCEV *Address = ScalarEv.getSCEV(Pointer);
+            if (ScalarEv.isLoopInvariant(Address, Innermost))
+                continue;
+
+            double accessBytes = CacheLine;
+            const SCEV *Step = nullptr;
+            if (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(Address))
+                if (AddRec->getLoop() == Innermost) {
+                    Step = AddRec->getStepRecurrence(ScalarEv);
+                    if (const SCEVConstant *ConstantStep = dyn_cast<SCEVConstant>(Step))
+                        accessBytes = std::min(CacheLine, std::max(elementBytes, (double) std::abs(ConstantStep->getValue()->getSExtValue())));
+                }
+
+            bool reused = false;
+            if (Step) {
+                const SCEV *Base = ScalarEv.getPointerBase(Address);
+                for (const auto& Stream : streams) {
+                    if (Stream.first != isStore || ScalarEv.getPointerBase(Stream.second) != Base)
+                        continue;
+                    const SCEVAddRecExpr *StreamAddRec = dyn_cast<SCEVAddRecExpr>(Stream.second);
+                    if (!StreamAddRec || StreamAddRec->getLoop() != Innermost || StreamAddRec->getStepRecurrence(ScalarEv) != Step)
+                        continue;
+                    const SCEV *Distance = ScalarEv.getMinusSCEV(Address, Stream.second);
+                    if (const SCEVConstant *ConstantDistance = dyn_cast<SCEVConstant>(Distance))
+                        reused = (uint64_t) std::abs(ConstantDistance->getValue()->getSExtValue()) <= (uint64_t) ReuseWindow << 10;
+                    else
+                        reused = ScalarEv.isLoopInvariant(Distance, &L);
+                    if (reused)
+                        break;
+                }
+            }
+            if (reused)
+                continue;
+            streams.push_back(std::make_pair(isStore, Address));
+
+            const bool readOnly = !isStore && std::find(writtenArrays.begin(), writtenArrays.end(), ScalarEv.getPointerBase(Address)) == writtenArrays.end();
+            for (const Loop *Enclosing = Innermost->getParentLoop(); readOnly && Enclosing && L.contains(Enclosing); Enclosing = Enclosing->getParentLoop())
+                if (!dependsOnLoop(ScalarEv, Address, Enclosing)) {
+                    accessBytes /= std::max(1U, (unsigned) TileReuse);
+                    break;
+                }
+            bytes += accessBytes * executionsPerIteration;
+        }
+    }
+    return bytes;
+}
+
+unsigned long baar::AccScore::getRooflineScore(double operations, double memoryBytes) const
+{
+    // each side is bound by its compute throughput or its memory bandwidth, whichever takes longer
+    const double localTime = std::max(operations / calibration.localFlops, memoryBytes / calibration.localMemoryBandwidth);
+    const double remoteTime = std::max(operations / calibration.remoteFlops, memoryBytes / calibration.remoteMemoryBandwidth) + calibration.latency;
+    std::cout << "DEBUG: " << "predicted " << (long) localTime << " microseconds locally, " << (long) remoteTime << " microseconds on the accelerator without transfers" << std::endl;
+    if (localTime <= remoteTime)
+        return 0;
+
+    // offloading pays off as long as transferring the arguments takes less than the time saved
+    const double breakEvenBytes = (localTime - remoteTime) * calibration.linkBandwidth;
+    if (breakEvenBytes >= (double) std::numeric_limits<unsigned long>::max())
+        return std::numeric_limits<unsigned long>::max();
+    return (unsigned long) breakEvenBytes;
+}
+
 unsigned long baar::AccScore::getInnermostTotalTripCount(const Loop &L)
 {
     ScalarEvolution &ScalarEv = getAnalysis<ScalarEvolution>();
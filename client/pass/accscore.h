@@ -29,6 +29,8 @@
 #include "llvm/InstVisitor.h"
 #include "llvm/Analysis/LoopInfo.h"
 
+#include "calibration.h"
+
 using namespace llvm;
 
 namespace baar {
@@ -42,20 +44,23 @@ namespace baar {
         virtual void getAnalysisUsage(AnalysisUsage &AU) const;
 
         unsigned long getScore();
+        // with a calibration, the score is the number of argument bytes up to which offloading is predicted to be faster
+        void setCalibration(const Calibration &calibration);
     private:
         unsigned long score = 0;
+        Calibration calibration;
+        bool calibrated = false;
         unsigned lastBB_FLOPs;
         unsigned lastBB_IOPs;
+        unsigned lastBB_FMAs;     // FMul feeding only an FAdd/FSub, both issue as one fused instruction
 
-        #define HANDLE_INST(N, OPCODE, CLASS) \
-        void visit##OPCODE(CLASS &) { if (#OPCODE == "FAdd" || #OPCODE == "FSub" || #OPCODE == "FMul" || #OPCODE == "FDiv" || #OPCODE == "FRem") lastBB_FLOPs++; \
-                                      if (#OPCODE == "Add" || #OPCODE == "Sub" || #OPCODE == "Mul" || #OPCODE == "UDiv" || #OPCODE == "SDiv" || #OPCODE == "URem" || #OPCODE == "SRem") lastBB_IOPs++; \
-                                      if (#OPCODE == "Shl" || #OPCODE == "LShr" || #OPCODE == "AShr" || #OPCODE == "And" || #OPCODE == "Or" || #OPCODE == "Xor") lastBB_IOPs++; }
-        #include "llvm/IR/Instruction.def"
-
-        void visitBasicBlock(BasicBlock &BB) {lastBB_FLOPs = 0; lastBB_IOPs = 0;}
+        void visitBinaryOperator(BinaryOperator &I);
+        void visitBasicBlock(BasicBlock &BB) {lastBB_FLOPs = 0; lastBB_IOPs = 0; lastBB_FMAs = 0;}
 
         unsigned long getInnermostTotalTripCount(const Loop& L);
+        // bytes moved between core and memory per innermost iteration of the loop nest, see accscore.cpp
+        double getMemoryBytesPerIteration(const Loop &L);
+        unsigned long getRooflineScore(double operations, double memoryBytes) const;
     };
     llvm::FunctionPass *createScoringPass();
 }
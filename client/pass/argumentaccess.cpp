@@ -0,0 +1,88 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "argumentaccess.h"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Support/CallSite.h"
+
+#include <set>
+
+using namespace llvm;
+
+static unsigned getPointerDirection(const Value *Ptr, std::set<const Value*> &Visited)
+{
+    if (!Visited.insert(Ptr).second)
+        return ArgumentDirection::NONE;
+
+    unsigned Direction = ArgumentDirection::NONE;
+    for (Value::const_use_iterator UI = Ptr->use_begin(), UE = Ptr->use_end(); UI != UE && Direction != ArgumentDirection::INOUT; ++UI) {
+        const User *U = *UI;
+
+        if (isa<LoadInst>(U)) {
+            Direction |= ArgumentDirection::IN;
+        } else if (const StoreInst *Store = dyn_cast<StoreInst>(U)) {
+            if (Store->getValueOperand() == Ptr) // pointer itself is stored somewhere, accesses cannot be followed
+                return ArgumentDirection::INOUT;
+            Direction |= ArgumentDirection::OUT;
+        } else if (isa<GetElementPtrInst>(U) || isa<BitCastInst>(U) || isa<PHINode>(U) || isa<SelectInst>(U)) {
+            // derived pointers access the same memory
+            Direction |= getPointerDirection(U, Visited);
+        } else if (isa<ICmpInst>(U) || isa<DbgInfoIntrinsic>(U)) {
+            // no memory access
+        } else if (const MemIntrinsic *MemInst = dyn_cast<MemIntrinsic>(U)) {
+            if (MemInst->getRawDest() == Ptr)
+                Direction |= ArgumentDirection::OUT;
+            if (isa<MemTransferInst>(MemInst) && cast<MemTransferInst>(MemInst)->getRawSource() == Ptr)
+                Direction |= ArgumentDirection::IN;
+        } else if (const IntrinsicInst *Intrinsic = dyn_cast<IntrinsicInst>(U)) {
+            if (Intrinsic->getIntrinsicID() != Intrinsic::lifetime_start && Intrinsic->getIntrinsicID() != Intrinsic::lifetime_end)
+                return ArgumentDirection::INOUT;
+        } else if (isa<CallInst>(U) || isa<InvokeInst>(U)) {
+            // follow pointer into defined callees, unknown callees might do anything
+            ImmutableCallSite CS(U);
+            const Function *Callee = CS.getCalledFunction();
+            if (Callee == nullptr || Callee->isDeclaration() || CS.isCallee(UI) || CS.getArgumentNo(UI) >= Callee->getFunctionType()->getNumParams())
+                return ArgumentDirection::INOUT;
+
+            Function::const_arg_iterator CalleeArg = Callee->arg_begin();
+            std::advance(CalleeArg, CS.getArgumentNo(UI));
+            Direction |= getPointerDirection(CalleeArg, Visited);
+        } else {
+            // ptrtoint, returned, atomics, ...
+            return ArgumentDirection::INOUT;
+        }
+    }
+    return Direction;
+}
+
+ArgumentDirection::Direction baar::getPointerArgumentDirection(const Argument &Arg)
+{
+    std::set<const Value*> Visited;
+    const unsigned Direction = getPointerDirection(&Arg, Visited);
+    // stores are not known to cover the whole array (e.g. a stencil writing the interior only), elements left
+    // untouched have to come from the host, so arrays stored to are transferred both ways
+    return (Direction & ArgumentDirection::OUT) ? ArgumentDirection::INOUT : ArgumentDirection::IN;
+}
@@ -0,0 +1,72 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "calibration.h"
+
+#include <fstream>
+#include <unordered_map>
+
+bool baar::Calibration::load(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+
+    std::unordered_map<std::string, std::string> values;
+    std::string key, value;
+    while (file >> key >> value)
+        values[key] = value;
+
+    const std::pair<const char *, double *> measurements[] = {
+        { "latency_us", &latency },
+        { "link_MBps", &linkBandwidth },
+        { "local_MFLOPs", &localFlops },
+        { "local_memory_MBps", &localMemoryBandwidth },
+        { "remote_MFLOPs", &remoteFlops },
+        { "remote_memory_MBps", &remoteMemoryBandwidth }
+    };
+    server = values["server"];
+    for (const auto &measurement : measurements) {
+        auto entry = values.find(measurement.first);
+        if (entry == values.end())
+            return false;
+        *measurement.second = std::stod(entry->second);
+        if (*measurement.second <= 0.0 && measurement.second != &latency)
+            return false;
+    }
+    return true;
+}
+
+bool baar::Calibration::save(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!server.empty())
+        file << "server " << server << "\n";
+    file << "latency_us " << latency << "\n"
+         << "link_MBps " << linkBandwidth << "\n"
+         << "local_MFLOPs " << localFlops << "\n"
+         << "local_memory_MBps " << localMemoryBandwidth << "\n"
+         << "remote_MFLOPs " << remoteFlops << "\n"
+         << "remote_memory_MBps " << remoteMemoryBandwidth << "\n";
+    return (bool) file;
+}
@@ -0,0 +1,47 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <string>
+
+namespace baar {
+    // Throughput of a host/accelerator pair as measured by baar_calibrate, in bytes (or operations) per microsecond,
+    // so MB/s and MFLOP/s. Used by AccScore to predict the time of a function on either side (roofline model).
+    struct Calibration {
+        std::string server;             // the accelerator measured, for information only
+        double latency = 0.0;           // microseconds of a call without arrays, besides execution
+        double linkBandwidth = 0.0;     // arrays transferred to and from the server
+        double localFlops = 0.0;        // operations of the program run by the client's JIT
+        double localMemoryBandwidth = 0.0;
+        double remoteFlops = 0.0;       // operations of accelerated functions run by the server
+        double remoteMemoryBandwidth = 0.0;
+
+        // "key value" lines, false if the file could not be read or lacks a measurement
+        bool load(const std::string &path);
+        bool save(const std::string &path) const;
+    };
+}
+
+#endif // CALIBRATION_H
@@ -40,8 +40,10 @@
 #include <string>
 #include <list>
 #include <iostream>
+#include <vector>
 
 #include "rpcaccelerate.h"
+#include "argumentaccess.h"
 
 using namespace llvm;
 
@@ -53,17 +55,20 @@ namespace {
 
         virtual bool runOnFunction(Function &F);
         void setFunctionScores(std::unordered_map<std::string, unsigned long> *scores);
+        void setAccReady(GlobalVariable *accReady);
     private:
         std::unordered_map<std::string, unsigned long> *scores;
+        GlobalVariable *accReady = nullptr;
 	};
 }
 
 char RPCAccelerate::ID = 0;
 static RegisterPass<RPCAccelerate> X("rpcacc", "replaces calls to function to RPC calls", false, false);
 
-FunctionPass *baar::createRPCAcceleratePass(std::unordered_map<std::string, unsigned long> *functionScores) {
+FunctionPass *baar::createRPCAcceleratePass(std::unordered_map<std::string, unsigned long> *functionScores, GlobalVariable *accReady) {
     auto Pass = new RPCAccelerate();
     Pass->setFunctionScores(functionScores);
+    Pass->setAccReady(accReady);
 
     return Pass;
 }
@@ -75,18 +80,79 @@ bool RPCAccelerate::runOnFunction(Function &F) {
     //    callAcc(func, args);
     // else
     //    oldFunc();
+    // With accReady, the whole decision is skipped (oldFunc() is called) as long as the server is not ready.
+    // With the client's OffloadPredictor, baar_shouldOffload(func, totalArgSize, $functionScore >= totalArgSize) decides,
+    // the time taken by oldFunc() is passed to baar_recordLocal.
+
+    // classify array arguments before the function is changed, only arrays read by F are transferred to the server, only arrays written back
+    std::vector<ArgumentDirection::Direction> argDirections;
+    for (const auto& arg : F.getArgumentList()) {
+        argDirections.push_back(arg.getType()->isPointerTy() ? baar::getPointerArgumentDirection(arg) : ArgumentDirection::NONE);
+        #ifndef NDEBUG
+            if (arg.getType()->isPointerTy())
+                std::cout << "DEBUG: argument " << argDirections.size() << " of " << F.getName().str() << " has direction " << argDirections.back() << " (1: in, 2: out, 3: inout)\n";
+        #endif
+    }
+
+    // The name of the function, as well as the argument types are stored in a string of the form 'RetTy:functionName:ArgTy1:ArgTy2:...:ArgTyn'
+    // This way, the typeinfo can be easily reused in the client, whithout parsing the IR
+    // Pointer arguments are 'PointerTyID;pointedToTyID[;bitwidth];direction'
+    // return type
+    std::string retTypeFunctionNameArgTypes = std::to_string(F.getReturnType()->getTypeID());
+    if (F.getReturnType()->getTypeID() == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
+        retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(F.getReturnType())->getBitWidth());
+    // function name
+    retTypeFunctionNameArgTypes += std::string(":") + F.getName().str();
+    // arg types
+    for (unsigned int i = 0; i < F.getFunctionType()->getNumParams(); i++) {
+        llvm::Type* currTy = F.getFunctionType()->getParamType(i);
+        retTypeFunctionNameArgTypes += std::string(":") + std::to_string(currTy->getTypeID());
+
+        if (currTy->getTypeID() == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
+            retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(currTy)->getBitWidth());
+
+        if (currTy->getTypeID() == llvm::Type::PointerTyID) { // for pointer, we need to add the typeID of type pointed to and dimension for arrays
+            auto elementType = cast<llvm::PointerType>(currTy)->getElementType();
+            while (elementType->getTypeID() == llvm::Type::ArrayTyID || elementType->getTypeID() == llvm::Type::PointerTyID)
+                elementType = cast<llvm::SequentialType>(elementType)->getElementType();
+
+            auto pointedToTyID = elementType->getTypeID();
+            retTypeFunctionNameArgTypes += std::string(";") + std::to_string(pointedToTyID);
+            if (pointedToTyID == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
+                retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(elementType)->getBitWidth());
+            retTypeFunctionNameArgTypes += std::string(";") + std::to_string(argDirections[i]);
+        }
+
+    }
+    std::cout << "DEBUG: RPCAccPass, retTypeFunctionNameArgTypes = \"" + retTypeFunctionNameArgTypes +"\"\n";
+
+    // if the client offers an OffloadPredictor, it takes the decision and the old body is timed up to each of its returns
+    Function *ShouldOffload = F.getParent()->getFunction("baar_shouldOffload");
+    Function *Now = F.getParent()->getFunction("baar_now");
+    Function *RecordLocal = F.getParent()->getFunction("baar_recordLocal");
+    const bool adaptive = ShouldOffload && Now && RecordLocal;
+    std::vector<ReturnInst*> oldReturns;
+    if (adaptive)
+        for (auto& BB : F)
+            if (ReturnInst *Ret = dyn_cast<ReturnInst>(BB.getTerminator()))
+                oldReturns.push_back(Ret);
 
     IRBuilder<> Builder(F.getContext());
     BasicBlock &oldFunctionBegin = F.front();
     BasicBlock *callAccBB = BasicBlock::Create(F.getContext(), "", &F, &(F.front()));
-    BasicBlock *ScoreConditionBB = BasicBlock::Create(F.getContext(), "", &F, callAccBB);
+    BasicBlock *LocalBB = adaptive ? BasicBlock::Create(F.getContext(), "", &F, &(F.front())) : &oldFunctionBegin;
+    BasicBlock *DecisionBB = BasicBlock::Create(F.getContext(), "", &F, &(F.front()));
+    // with accReady, the argument size is computed in front of the flag's check, the old body's returns need it
+    BasicBlock *ScoreConditionBB = accReady ? BasicBlock::Create(F.getContext(), "", &F, &(F.front())) : DecisionBB;
     Builder.SetInsertPoint(ScoreConditionBB);
+    auto ir_functionNameAndArgTypes = Builder.CreateGlobalStringPtr(retTypeFunctionNameArgTypes, ".str");
 
     auto ToBeAcceleratedFunctionType = F.getFunctionType();
     llvm::Value* totalArraySizeInByte = Builder.getInt64(0U);
     long unsigned totalNotArrayArgSize = ToBeAcceleratedFunctionType->getReturnType()->getScalarSizeInBits() / 8;
     auto argI = F.getArgumentList().begin();
-    for (auto paramI = ToBeAcceleratedFunctionType->param_begin(); paramI != ToBeAcceleratedFunctionType->param_end(), argI != F.getArgumentList().end(); paramI++, argI++) {
+    auto argDirectionI = argDirections.begin();
+    for (auto paramI = ToBeAcceleratedFunctionType->param_begin(); paramI != ToBeAcceleratedFunctionType->param_end(), argI != F.getArgumentList().end(); paramI++, argI++, argDirectionI++) {
         if ((*paramI)->getTypeID() == llvm::Type::PointerTyID) {
             assert((*(paramI + 1))->getTypeID() == llvm::Type::IntegerTyID); // It is assumed that the parameter after an array is #elements (also when marshalling arrays)
             argI++; // ilist_iterator unfortunately does not support '+' operator
@@ -97,7 +163,8 @@ bool RPCAccelerate::runOnFunction(Function &F) {
             while (ArrayElementType->getTypeID() == llvm::Type::PointerTyID || ArrayElementType->getTypeID() == llvm::Type::ArrayTyID)
                 ArrayElementType = ArrayElementType->getSequentialElementType();
 
-            const auto& ArrayElementSize = Builder.getInt64((ArrayElementType->getScalarSizeInBits() / 8) * 2); // count arrays twice (transferred to and from server as a whole)
+            const unsigned TransferCount = 1U + ArgumentDirection::isDownloaded(*argDirectionI); // count arrays once per direction they are transferred in
+            const auto& ArrayElementSize = Builder.getInt64((ArrayElementType->getScalarSizeInBits() / 8) * TransferCount);
             const auto& ArrayNumElementsArgExt = Builder.CreateSExtOrTrunc(ArrayNumElementsArgVal, totalArraySizeInByte->getType(), "arrayNumElementsArgExt"); // TODO ZExt ?
             const auto& ArraySizeInByte = Builder.CreateMul(ArrayElementSize, ArrayNumElementsArgExt, "arraySizeInByte");
             totalArraySizeInByte = Builder.CreateAdd(totalArraySizeInByte, ArraySizeInByte, "totalArraySizeInByte");
@@ -107,45 +174,38 @@ bool RPCAccelerate::runOnFunction(Function &F) {
     std::cout << "DEBUG: Total argument size, excluding arrays, in bytes is " << totalNotArrayArgSize << std::endl;
 
     const auto& totalArgSizeInBytes = Builder.CreateAdd(totalArraySizeInByte, Builder.getInt64(totalNotArrayArgSize), "totalArgSizeInBytes");
+    if (accReady) {
+        // the flag is set once by the client, acquire pairs with its release so the server connection is visible
+        LoadInst *ready = Builder.CreateLoad(accReady, "accReady");
+        ready->setAlignment(4);
+        ready->setAtomic(Acquire);
+        Builder.CreateCondBr(Builder.CreateICmpNE(ready, Builder.getInt32(0)), DecisionBB, LocalBB);
+        Builder.SetInsertPoint(DecisionBB);
+    }
     if (F.getParent()->getFunction("printf")) // TODO use getOrInsertFunction(..) to always declare printf and show runtime decision
         Builder.CreateCall2(F.getParent()->getFunction("printf"), Builder.CreateGlobalString("INFO: runtime decision is " + std::to_string(scores->at(F.getName().str())) + " >= %ld ?\n"), totalArgSizeInBytes);
     else
         std::cout << "WARNING: " << "declare printf in program to see runtime decision \n";
-    Builder.CreateCondBr(Builder.CreateICmpUGE(Builder.getInt64(scores->at(F.getName().str())), totalArgSizeInBytes), callAccBB, &oldFunctionBegin);
-    Builder.SetInsertPoint(callAccBB);
-
-    // The name of the function, as well as the argument types are stored in a string of the form 'RetTy:functionName:ArgTy1:ArgTy2:...:ArgTyn'
-    // This way, the typeinfo can be easily reused in the client, whithout parsing the IR
-    // return type
-    std::string retTypeFunctionNameArgTypes = std::to_string(F.getReturnType()->getTypeID());
-    if (F.getReturnType()->getTypeID() == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
-        retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(F.getReturnType())->getBitWidth());
-    // function name
-    retTypeFunctionNameArgTypes += std::string(":") + F.getName().str();
-    // arg types
-    for (unsigned int i = 0; i < ToBeAcceleratedFunctionType->getNumParams(); i++) {
-        llvm::Type* currTy = ToBeAcceleratedFunctionType->getParamType(i);
-        retTypeFunctionNameArgTypes += std::string(":") + std::to_string(currTy->getTypeID());
-
-        if (currTy->getTypeID() == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
-            retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(currTy)->getBitWidth());
-
-        if (currTy->getTypeID() == llvm::Type::PointerTyID) { // for pointer, we need to add the typeID of type pointed to and dimension for arrays
-            auto elementType = cast<llvm::PointerType>(currTy)->getElementType();
-            while (elementType->getTypeID() == llvm::Type::ArrayTyID || elementType->getTypeID() == llvm::Type::PointerTyID)
-                elementType = cast<llvm::SequentialType>(elementType)->getElementType();
-
-            auto pointedToTyID = elementType->getTypeID();
-            retTypeFunctionNameArgTypes += std::string(";") + std::to_string(pointedToTyID);
-            if (pointedToTyID == llvm::Type::IntegerTyID) // for ints, we have to add the bitwidth
-                retTypeFunctionNameArgTypes += std::string(";") + std::to_string(cast<llvm::IntegerType>(elementType)->getBitWidth());
+    Value *offload = Builder.CreateICmpUGE(Builder.getInt64(scores->at(F.getName().str())), totalArgSizeInBytes);
+    if (adaptive) {
+        // the static decision is the predictor's guess for argument sizes it has not measured yet
+        Value *predicted = Builder.CreateCall3(ShouldOffload, ir_functionNameAndArgTypes, totalArgSizeInBytes, Builder.CreateZExt(offload, Builder.getInt32Ty()), "predicted");
+        offload = Builder.CreateICmpNE(predicted, Builder.getInt32(0));
+    }
+    Builder.CreateCondBr(offload, callAccBB, LocalBB);
+
+    if (adaptive) {
+        Builder.SetInsertPoint(LocalBB);
+        Value *localStart = Builder.CreateCall(Now, "localStart");
+        Builder.CreateBr(&oldFunctionBegin);
+        for (auto Ret : oldReturns) {
+            Builder.SetInsertPoint(Ret);
+            Builder.CreateCall3(RecordLocal, ir_functionNameAndArgTypes, totalArgSizeInBytes, localStart);
         }
-
     }
-    std::cout << "DEBUG: RPCAccPass, retTypeFunctionNameArgTypes = \"" + retTypeFunctionNameArgTypes +"\"\n";
+    Builder.SetInsertPoint(callAccBB);
 
-    // add functionNameAndArgTypes to IR and set as first argument to the call
-    auto ir_functionNameAndArgTypes = Builder.CreateGlobalStringPtr(retTypeFunctionNameArgTypes, ".str");
+    // functionNameAndArgTypes is the first argument to the call
     std::vector<Value*> callAcc_params;
     callAcc_params.push_back(ir_functionNameAndArgTypes);
 
@@ -183,3 +243,8 @@ void RPCAccelerate::setFunctionScores(std::unordered_map<std::string, unsigned l
 {
     this->scores = scores;
 }
+
+void RPCAccelerate::setAccReady(GlobalVariable *accReady)
+{
+    this->accReady = accReady;
+}
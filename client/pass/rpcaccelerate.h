@@ -25,11 +25,13 @@
 #define RPCACCELERATE_H
 
 #include "llvm/Pass.h"
+#include "llvm/IR/GlobalVariable.h"
 
 #include <unordered_map>
 
 namespace baar {
-    llvm::FunctionPass *createRPCAcceleratePass(std::unordered_map<std::string, unsigned long> *functionScores);
+    // with an accReady flag (i32), functions keep running their local body until the flag is set (see main.cpp)
+    llvm::FunctionPass *createRPCAcceleratePass(std::unordered_map<std::string, unsigned long> *functionScores, llvm::GlobalVariable *accReady = nullptr);
 }
 
 #endif // RPCACCELERATE_H
@@ -0,0 +1,317 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "residencytracker.h"
+
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <malloc.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// 64 bit hash of an array's content, four independent lanes to hide multiplication latency
+static uint64_t contentHash(const void *data, uint64_t size)
+{
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    auto round = [=](uint64_t acc, uint64_t input) {
+        acc += input * prime2;
+        acc = (acc << 31) | (acc >> 33);
+        return acc * prime1;
+    };
+
+    const char *pos = (const char *) data;
+    const char *end = pos + size;
+    uint64_t lanes[4] = { prime1 + prime2, prime2, 0U, 0U - prime1 };
+    for (; pos + 32 <= end; pos += 32) {
+        uint64_t words[4];
+        memcpy(words, pos, sizeof(words));
+        for (int i = 0; i < 4; i++)
+            lanes[i] = round(lanes[i], words[i]);
+    }
+
+    uint64_t hash = ((lanes[0] << 1) | (lanes[0] >> 63)) + ((lanes[1] << 7) | (lanes[1] >> 57))
+                  + ((lanes[2] << 12) | (lanes[2] >> 52)) + ((lanes[3] << 18) | (lanes[3] >> 46));
+    hash ^= size;
+    for (; pos < end; pos++)
+        hash = round(hash, (uint8_t) *pos);
+
+    hash ^= hash >> 33;
+    hash *= prime2;
+    hash ^= hash >> 29;
+    return hash;
+}
+
+ResidencyTracker::ProtectedRange ResidencyTracker::ranges[ResidencyTracker::MAX_PROTECTED_RANGES];
+bool ResidencyTracker::hashing = false;
+struct sigaction ResidencyTracker::previousAction;
+static std::mutex rangesMutex; // allocating and dropping ranges, never taken by the fault handler
+static bool handlerInstalled = false;
+static size_t pageSize = 0U;
+
+void ResidencyTracker::detectWritesByHashing(bool enable)
+{
+    hashing = enable;
+}
+
+void ResidencyTracker::handleFault(int signal, siginfo_t *info, void *context)
+{
+    // only async-signal-safe code here, returning retries the faulting access
+    char *address = (char *) info->si_addr;
+    bool covered = false;
+    for (unsigned i = 0; i < MAX_PROTECTED_RANGES; i++) {
+        char *begin = ranges[i].begin.load();
+        const size_t length = ranges[i].length.load();
+        if (begin != nullptr && address >= begin && address < begin + length) {
+            markWritten(begin, length);
+            covered = true;
+        }
+    }
+    // another thread may just be lifting the protection, the page is writable in any case then
+    char *page = (char *) ((uintptr_t) address / pageSize * pageSize);
+    if (covered && mprotect(page, pageSize, PROT_READ | PROT_WRITE) == 0)
+        return;
+
+    // not caused by a tracked array: pass on to the handler installed before, or fault again without this one
+    if ((previousAction.sa_flags & SA_SIGINFO) && previousAction.sa_sigaction != nullptr)
+        previousAction.sa_sigaction(signal, info, context);
+    else if (!(previousAction.sa_flags & SA_SIGINFO) && previousAction.sa_handler != SIG_DFL && previousAction.sa_handler != SIG_IGN)
+        previousAction.sa_handler(signal);
+    else
+        sigaction(SIGSEGV, &previousAction, nullptr);
+}
+
+void ResidencyTracker::markWritten(char *begin, size_t length)
+{
+    // lifting the protection of a range exposes all ranges sharing pages with it, they count as written as well
+    for (unsigned i = 0; i < MAX_PROTECTED_RANGES; i++) {
+        char *other = ranges[i].begin.load();
+        const size_t otherLength = ranges[i].length.load();
+        if (other == nullptr || other >= begin + length || begin >= other + otherLength)
+            continue;
+        ranges[i].written.store(true);
+        if (ranges[i].isProtected.exchange(false)) {
+            mprotect(other, otherLength, PROT_READ | PROT_WRITE);
+            markWritten(other, otherLength);
+        }
+    }
+}
+
+int ResidencyTracker::allocateRange(const void *ptr, uint64_t size)
+{
+    if (hashing)
+        return -1;
+
+    std::lock_guard<std::mutex> lock(rangesMutex);
+    if (!handlerInstalled) {
+        pageSize = sysconf(_SC_PAGESIZE);
+        struct sigaction action;
+        action.sa_sigaction = &ResidencyTracker::handleFault;
+        sigemptyset(&action.sa_mask);
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        if (sigaction(SIGSEGV, &action, &previousAction) == -1) {
+            perror("ERROR, unable to install handler for writes to resident arrays");
+            hashing = true;
+            return -1;
+        }
+        handlerInstalled = true;
+    }
+
+    // only pages owned by the array completely, and none of the stack the handler runs on
+    char *first = (char *) (((uintptr_t) ptr + pageSize - 1) / pageSize * pageSize);
+    char *last = (char *) (((uintptr_t) ptr + size) / pageSize * pageSize);
+    if (last <= first)
+        return -1;
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0)
+        return -1;
+    void *stack = nullptr;
+    size_t stackSize = 0U;
+    pthread_attr_getstack(&attributes, &stack, &stackSize);
+    pthread_attr_destroy(&attributes);
+    if (last > (char *) stack && first < (char *) stack + stackSize)
+        return -1;
+
+    for (unsigned i = 0; i < MAX_PROTECTED_RANGES; i++) {
+        if (ranges[i].begin.load() != nullptr)
+            continue;
+        ranges[i].length.store(last - first);
+        ranges[i].written.store(false);
+        ranges[i].isProtected.store(false);
+        ranges[i].begin.store(first);
+        return i;
+    }
+    return -1;
+}
+
+uint64_t ResidencyTracker::unprotectedHash(const void *ptr, uint64_t size, int range)
+{
+    if (range < 0)
+        return contentHash(ptr, size);
+    // bytes in front of the first and behind the last protected page
+    const char *begin = ranges[range].begin.load();
+    const char *end = begin + ranges[range].length.load();
+    const uint64_t tail = (const char *) ptr + size - end;
+    return contentHash(ptr, begin - (const char *) ptr) ^ (contentHash(end, tail) * 0x9E3779B185EBCA87ULL);
+}
+
+void ResidencyTracker::protect(int range)
+{
+    ranges[range].written.store(false);
+    if (mprotect(ranges[range].begin.load(), ranges[range].length.load(), PROT_READ) == 0)
+        ranges[range].isProtected.store(true);
+    else
+        ranges[range].written.store(true); // cannot be tracked, transferred every time
+}
+
+void ResidencyTracker::forget(const void *ptr, size_t size)
+{
+    if (ptr != nullptr && size != 0U)
+        markWritten((char *) ptr, size);
+}
+
+void ResidencyTracker::interposedFree(void *ptr)
+{
+    if (ptr != nullptr)
+        forget(ptr, malloc_usable_size(ptr));
+    free(ptr);
+}
+
+void *ResidencyTracker::interposedRealloc(void *ptr, size_t size)
+{
+    if (ptr != nullptr)
+        forget(ptr, malloc_usable_size(ptr));
+    return realloc(ptr, size);
+}
+
+ResidencyTracker::ResidencyTracker(uint64_t capacity) : capacity(capacity)
+{
+}
+
+ResidencyTracker::~ResidencyTracker()
+{
+    for (auto &entry : entries)
+        drop(entry.second);
+}
+
+void ResidencyTracker::beginCall()
+{
+    currentCall++;
+}
+
+ResidencyTracker::Decision ResidencyTracker::prepare(const void *ptr, uint64_t size, bool writtenBack)
+{
+    const Residency::BufferKey key = { (uint64_t) ptr, size };
+
+    auto entry = entries.find(key);
+    if (entry != entries.end()) {
+        entry->second.lastUse = currentCall;
+        const int range = entry->second.range;
+        const uint64_t hash = unprotectedHash(ptr, size, range);
+        const bool written = range >= 0 && ranges[range].written.load();
+        // the server's version is written back to the array after the call, arrays only read stay protected
+        if (range >= 0 && writtenBack)
+            markWritten(ranges[range].begin.load(), ranges[range].length.load());
+        if (!written && entry->second.hash == hash)
+            return { Residency::RESIDENT, entry->second.version };
+
+        // modified by host since last call, the server has the same content again once it is transferred
+        entry->second.hash = hash;
+        entry->second.version = nextVersion++;
+        if (range >= 0 && !writtenBack)
+            protect(range);
+        return { Residency::KEEP, entry->second.version };
+    }
+
+    if (!makeRoomFor(size))
+        return { Residency::TRANSIENT, 0U };
+
+    // array might have been evicted earlier in the current call, it is kept again instead of being released
+    released.erase(std::remove(released.begin(), released.end(), key), released.end());
+
+    const int range = allocateRange(ptr, size);
+    const Entry newEntry = { unprotectedHash(ptr, size, range), nextVersion++, currentCall, range };
+    if (range >= 0 && !writtenBack)
+        protect(range);
+    entries.emplace(key, newEntry);
+    residentBytes += size;
+    return { Residency::KEEP, newEntry.version };
+}
+
+void ResidencyTracker::synchronised(const void *ptr, uint64_t size)
+{
+    // only arrays prepared for the current call are kept on the server, others were not transferred and have an outdated copy there
+    auto entry = entries.find({ (uint64_t) ptr, size });
+    if (entry == entries.end() || entry->second.lastUse != currentCall)
+        return;
+    entry->second.hash = unprotectedHash(ptr, size, entry->second.range);
+    if (entry->second.range >= 0)
+        protect(entry->second.range);
+}
+
+void ResidencyTracker::drop(Entry &entry)
+{
+    if (entry.range < 0)
+        return;
+    std::lock_guard<std::mutex> lock(rangesMutex);
+    markWritten(ranges[entry.range].begin.load(), ranges[entry.range].length.load());
+    ranges[entry.range].begin.store(nullptr);
+    entry.range = -1;
+}
+
+std::vector<Residency::BufferKey> ResidencyTracker::takeReleased()
+{
+    std::vector<Residency::BufferKey> result;
+    result.swap(released);
+    return result;
+}
+
+bool ResidencyTracker::makeRoomFor(uint64_t size)
+{
+    if (size > capacity)
+        return false;
+
+    // evict least recently used arrays, but none used in the current call
+    while (residentBytes + size > capacity) {
+        auto victim = entries.end();
+        for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+            if (entry->second.lastUse != currentCall && (victim == entries.end() || entry->second.lastUse < victim->second.lastUse))
+                victim = entry;
+        if (victim == entries.end())
+            return false;
+
+        #ifndef NDEBUG
+            std::cout << "DEBUG: evicting resident array at " << (void *) victim->first.clientAddress << " (" << victim->first.size << " bytes)\n";
+        #endif
+        residentBytes -= victim->first.size;
+        released.push_back(victim->first);
+        drop(victim->second);
+        entries.erase(victim);
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef RESIDENCYTRACKER_H
+#define RESIDENCYTRACKER_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <atomic>
+#include <csignal>
+#include <unordered_map>
+#include <vector>
+
+#include "../consts.h"
+#include "../common/residency.h"
+
+// Keeps track of the arrays the server holds for this client. Unmodified arrays are not transferred again.
+// Host side modifications are detected by write protecting the pages an array owns completely once the host's and
+// the server's copy agree; the first write to them faults, a SIGSEGV handler marks the array as written and lifts
+// the protection. Bytes sharing pages with other data and arrays without pages of their own (small ones, those on
+// the stack of the calling thread, or all of them with detectWritesByHashing) are compared by a hash of their content instead.
+// Memory written by system calls (read, recv, ...) instead of the program's own stores is not noticed, such a
+// system call fails with EFAULT on a protected array: programs doing so need detectWritesByHashing.
+class ResidencyTracker
+{
+public:
+    struct Decision {
+        Residency::Flags flags;
+        uint64_t version;
+    };
+
+    explicit ResidencyTracker(uint64_t capacity = MAX_RESIDENT_BYTES);
+    ~ResidencyTracker();
+
+    // to be called once at the beginning of every call, arrays used in the current call are never evicted
+    void beginCall();
+    // decides how the array is transferred in the current call; if the server's version is written back,
+    // the array can be written afterwards and synchronised has to follow
+    Decision prepare(const void *ptr, uint64_t size, bool writtenBack);
+    // to be called after the server's version of the array has been written back to ptr
+    void synchronised(const void *ptr, uint64_t size);
+    // arrays evicted since the last call, the server has to be told to release them
+    std::vector<Residency::BufferKey> takeReleased();
+
+    // before the program frees memory: arrays in it count as written, their protection is lifted
+    static void forget(const void *ptr, size_t size);
+    static void interposedFree(void *ptr);
+    static void *interposedRealloc(void *ptr, size_t size);
+
+    // hash the whole content of every array instead of write protecting it, before any tracker is used
+    static void detectWritesByHashing(bool enable);
+
+private:
+    struct Entry {
+        uint64_t hash;      // of the bytes not protected
+        uint64_t version;
+        uint64_t lastUse;
+        int range;          // protected pages, see ProtectedRange, -1 if there are none
+    };
+
+    const uint64_t capacity;
+    uint64_t residentBytes = 0U;
+    uint64_t currentCall = 0U;
+    uint64_t nextVersion = 1U;
+    std::unordered_map<Residency::BufferKey, Entry, Residency::BufferKeyHash> entries;
+    std::vector<Residency::BufferKey> released;
+
+    bool makeRoomFor(uint64_t size);
+    void drop(Entry &entry);
+
+    // pages of arrays of all trackers, read by the fault handler, which may run in any thread
+    struct ProtectedRange {
+        std::atomic<char *> begin; // nullptr if unused
+        std::atomic<size_t> length;
+        std::atomic<bool> written;
+        std::atomic<bool> isProtected;
+    };
+    static const unsigned MAX_PROTECTED_RANGES = 1024U;
+    static ProtectedRange ranges[MAX_PROTECTED_RANGES];
+    static bool hashing;
+    static struct sigaction previousAction;
+    static void handleFault(int signal, siginfo_t *info, void *context);
+    static void markWritten(char *begin, size_t length);
+    static int allocateRange(const void *ptr, uint64_t size);
+    static uint64_t unprotectedHash(const void *ptr, uint64_t size, int range);
+    static void protect(int range);
+};
+
+#endif // RESIDENCYTRACKER_H
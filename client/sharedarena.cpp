@@ -0,0 +1,220 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "sharedarena.h"
+#include "residencytracker.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <malloc.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "inflighttracker.h"
+
+// arrays in the arena start at cache line boundaries, like arrays in a CallFrame's payload
+static const size_t ARENA_ALIGNMENT = 64U;
+
+SharedArena *SharedArena::active = nullptr;
+
+static void error(const char *msg) {
+    perror(msg);
+    exit(1);
+}
+
+SharedArena::SharedArena(const std::string &name, size_t size, size_t threshold) :
+    name(name), size(size / pageSize() * pageSize()), threshold(threshold), linked(!name.empty())
+{
+    if (isShared()) {
+        int shmemfd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (shmemfd == -1)
+            error("ERROR, could not allocate shared arena");
+
+        // pages are only backed once touched
+        if (ftruncate(shmemfd, this->size) != 0)
+            error("ERROR, unable to resize shared arena");
+
+        base = mmap(0, this->size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, shmemfd, 0);
+        close(shmemfd);
+    } else
+        base = mmap(0, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED)
+        error("ERROR, unable to map shared arena into memory");
+
+    freeBlocks[0U] = this->size;
+    std::cout << "INFO: allocations of at least " << threshold << " bytes are served from the " << (isShared() ? "shared arena " + name : "private arena")
+              << " (" << (this->size >> 20) << " MB)\n";
+}
+
+SharedArena::~SharedArena()
+{
+    if (active == this)
+        active = nullptr;
+    unlink();
+    if (munmap(base, size))
+        perror("ERROR, unable to unmap shared arena from memory");
+}
+
+void SharedArena::unlink()
+{
+    if (linked && shm_unlink(name.c_str()))
+        perror("ERROR, unable to unlink shared arena");
+    linked = false;
+}
+
+size_t SharedArena::pageSize()
+{
+    static const size_t size = sysconf(_SC_PAGE_SIZE);
+    return size;
+}
+
+void *SharedArena::allocate(size_t size)
+{
+    // arrays of at least a page get pages of their own, they can be protected without affecting other data
+    const size_t alignment = size >= pageSize() ? pageSize() : ARENA_ALIGNMENT;
+    const size_t blockSize = std::max((size + alignment - 1) / alignment * alignment, alignment);
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // first fit, arrays are few and large
+    for (auto block = freeBlocks.begin(); block != freeBlocks.end(); ++block) {
+        const size_t offset = (block->first + alignment - 1) / alignment * alignment;
+        const size_t skipped = offset - block->first;
+        if (block->second < skipped + blockSize)
+            continue;
+
+        const size_t blockEnd = block->first + block->second;
+        if (skipped > 0U)
+            block->second = skipped;
+        else
+            freeBlocks.erase(block);
+        if (blockEnd > offset + blockSize)
+            freeBlocks[offset + blockSize] = blockEnd - offset - blockSize;
+        allocatedBlocks[offset] = blockSize;
+        allocatedBytes += blockSize;
+        return (char *) base + offset;
+    }
+    return nullptr;
+}
+
+bool SharedArena::deallocate(void *ptr)
+{
+    if (!contains(ptr))
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto allocated = allocatedBlocks.find(offsetOf(ptr));
+    if (allocated == allocatedBlocks.end())
+        return false;
+    size_t offset = allocated->first;
+    size_t blockSize = allocated->second;
+    allocatedBlocks.erase(allocated);
+    allocatedBytes -= blockSize;
+
+    // merge with neighbouring free blocks
+    auto next = freeBlocks.lower_bound(offset);
+    if (next != freeBlocks.end() && next->first == offset + blockSize) {
+        blockSize += next->second;
+        next = freeBlocks.erase(next);
+    }
+    if (next != freeBlocks.begin()) {
+        auto previous = std::prev(next);
+        if (previous->first + previous->second == offset) {
+            offset = previous->first;
+            blockSize += previous->second;
+            freeBlocks.erase(previous);
+        }
+    }
+    freeBlocks[offset] = blockSize;
+    return true;
+}
+
+bool SharedArena::contains(const void *ptr, size_t size) const
+{
+    return ptr >= base && (const char *) ptr + size <= (const char *) base + this->size;
+}
+
+size_t SharedArena::allocationSize(const void *ptr) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto allocated = allocatedBlocks.find(offsetOf(ptr));
+    return allocated == allocatedBlocks.end() ? 0U : allocated->second;
+}
+
+void *SharedArena::interposedMalloc(size_t size)
+{
+    if (active != nullptr && size >= active->threshold) {
+        void *ptr = active->allocate(size);
+        if (ptr != nullptr)
+            return ptr;
+#ifndef NDEBUG
+        std::cout << "DEBUG" << ": shared arena exhausted, " << size << " bytes allocated privately\n";
+#endif
+    }
+    return malloc(size);
+}
+
+void *SharedArena::interposedCalloc(size_t num, size_t size)
+{
+    if (active != nullptr && size != 0U && num >= active->threshold / size && num <= SIZE_MAX / size) {
+        void *ptr = active->allocate(num * size);
+        if (ptr != nullptr) {
+            memset(ptr, 0, num * size);
+            return ptr;
+        }
+    }
+    return calloc(num, size);
+}
+
+void *SharedArena::interposedRealloc(void *ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return interposedMalloc(size);
+
+    // the array might still be written by an asynchronous call
+    InFlightTracker::waitFor(ptr);
+    // private memory may hold arrays kept on the server, the ResidencyTracker has to forget them
+    const bool inArena = active != nullptr && active->contains(ptr);
+    if (!inArena && (active == nullptr || size < active->threshold))
+        return ResidencyTracker::interposedRealloc(ptr, size);
+
+    // moving between arena and private memory, or within the arena
+    const size_t oldSize = inArena ? active->allocationSize(ptr) : malloc_usable_size(ptr);
+    void *newPtr = interposedMalloc(size);
+    if (newPtr == nullptr)
+        return nullptr;
+    memcpy(newPtr, ptr, std::min(oldSize, size));
+    interposedFree(ptr);
+    return newPtr;
+}
+
+void SharedArena::interposedFree(void *ptr)
+{
+    InFlightTracker::waitFor(ptr);
+    if (active != nullptr && active->deallocate(ptr))
+        return;
+    ResidencyTracker::interposedFree(ptr);
+}
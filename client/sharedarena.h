@@ -0,0 +1,93 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef SHAREDARENA_H
+#define SHAREDARENA_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+// Shared memory region the program's large arrays are allocated in (see interposedMalloc and friends).
+// The server maps the arena of its client as well, so arrays living in it are used by accelerated
+// functions in place and never copied, calls only carry their offset into the arena.
+// Without a name the arena is private to the client, it then only serves to give arrays pages of their own
+// (allocations of at least a page are page aligned), as needed by asynchronous calls (see InFlightTracker).
+class SharedArena
+{
+public:
+    // creates and maps the region, allocations of at least threshold bytes are served from it, name may be empty
+    SharedArena(const std::string &name, size_t size, size_t threshold);
+    ~SharedArena();
+
+    // nullptr if the arena is exhausted
+    void *allocate(size_t size);
+    // false if ptr was not allocated in the arena
+    bool deallocate(void *ptr);
+    // true if the size bytes at ptr lie within the arena
+    bool contains(const void *ptr, size_t size = 1U) const;
+    uint64_t offsetOf(const void *ptr) const {
+        return (const char *) ptr - (const char *) base;
+    }
+
+    // the server mapped the arena, its name is not needed anymore
+    void unlink();
+    const std::string &getName() const {
+        return name;
+    }
+    bool isShared() const {
+        return !name.empty();
+    }
+    static size_t pageSize();
+    size_t getSize() const {
+        return size;
+    }
+
+    // arena the interposed allocation functions use, nullptr: libc only
+    static SharedArena *active;
+    // replacements for the allocation functions of the program run by the client
+    static void *interposedMalloc(size_t size);
+    static void *interposedCalloc(size_t num, size_t size);
+    static void *interposedRealloc(void *ptr, size_t size);
+    static void interposedFree(void *ptr);
+
+private:
+    const std::string name;
+    const size_t size;
+    const size_t threshold;
+    void *base = nullptr;
+    bool linked;
+
+    // offsets into the arena, free blocks are kept coalesced
+    std::map<size_t, size_t> freeBlocks;
+    std::unordered_map<size_t, size_t> allocatedBlocks;
+    size_t allocatedBytes = 0U;
+    mutable std::mutex mutex;
+
+    size_t allocationSize(const void *ptr) const;
+};
+
+#endif // SHAREDARENA_H
@@ -33,15 +33,23 @@
 #include <sys/file.h>
 #include <sys/mman.h>
 #include <fcntl.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <cerrno>
 
 #include <iostream>
 #include <string>
 #include <list>
+#include <atomic>
 
 #include "llvm/IR/DerivedTypes.h"
 
 #include "../consts.h"
 #include "../common/shmemhelperfunctions.h"
+#include "../common/shmemchannel.h"
+#include "../common/callframe.h"
+#include "../common/residency.h"
+#include "../common/argumentdirection.h"
 
 ShmemClient::ShmemClient() : AbstractClient()
 {
@@ -49,82 +57,124 @@ ShmemClient::ShmemClient() : AbstractClient()
 
 ShmemClient::~ShmemClient()
 {
+    if (channel == nullptr)
+        return;
+    waitForPendingCall();
+
     // write exit message to server
     strcpy((char *)shmemptr, ";");
-    sem_post(shmem_sem);
-
-    // close shared semaphores
-    if (sem_close(shmem_force_order_sem) == -1)
-        perror("ERROR, unable to close semaphore");
-    if (sem_close(shmem_sem) == -1)
-        perror("ERROR, unable to close semaphore");
+    toServer->ring();
 
-    if (munmap(shmemptr, SHMEM_SIZE))
+    if (munmap(channel, SHMEM_SIZE))
         perror("ERROR, unable to unmap shared memory region from memory");
 }
 
-void ShmemClient::connectToAccelerator()
+void ShmemClient::createChannel()
+{
+    // one channel per client, a process may connect more than once (hotspots found later), a stale channel is truncated
+    static std::atomic<unsigned> numChannels(0U);
+    channelName = SHMEM_CHANNEL_PREFIX + std::to_string(getpid()) + "_" + std::to_string(numChannels++);
+    int shmemfd = shm_open(channelName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (shmemfd == -1)
+        error("ERROR, could not allocate shared memory");
+
+    if (ftruncate(shmemfd, SHMEM_SIZE) != 0)
+        error("ERROR, unable to resize shared memory region");
+
+    channel = mmap(0, SHMEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
+    if (channel == MAP_FAILED)
+        error("ERROR, unable to map shared memory region into memory");
+    close(shmemfd);
+    shmemptr = ShmemChannel::messages(channel);
+
+    // doorbells for synchronisation live in the channel, shared with the server
+    toServer = &ShmemChannel::header(channel)->toServer;
+    toClient = &ShmemChannel::header(channel)->toClient;
+    toServer->init();
+    toClient->init();
+    auto header = ShmemChannel::header(channel);
+    header->status.store(ShmemChannel::PENDING);
+
+    // tell the server where to find arrays allocated in the arena
+    memset(header->arenaName, 0, sizeof(header->arenaName));
+    header->arenaSize = 0U;
+    if (arena && arena->isShared()) {
+        strncpy(header->arenaName, arena->getName().c_str(), sizeof(header->arenaName) - 1);
+        header->arenaSize = arena->getSize();
+    }
+}
+
+void ShmemClient::requestChannel()
 {
-    // open shmem
+    // open control region of the server
     int shmemfd = shm_open(SHMEM_NAME.c_str(), O_RDWR, 0666);
     if (shmemfd == -1)
         error("ERROR, could not get shared memory");
 
-    shmemptr = mmap(0, SHMEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
-    if (shmemptr == MAP_FAILED)
+    auto control = (ShmemChannel::ControlRegion *) mmap(0, sizeof(ShmemChannel::ControlRegion), PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
+    if (control == MAP_FAILED)
         error("ERROR, unable to map shared memory region into memory");
     close(shmemfd);
+    serverPid = control->serverPid;
 
-    // open shared semaphore for synchronisation
-    shmem_sem = sem_open(SHMEM_SEM_NAME.c_str(), 0);
-    if (shmem_sem == SEM_FAILED)
+    // open shared semaphore for requesting channels
+    sem_t *control_sem = sem_open(SHMEM_SEM_NAME.c_str(), 0);
+    if (control_sem == SEM_FAILED)
         error("ERROR, unable to open semaphore");
 
-    // open shared semaphore for forcing order on synchronisation
-    shmem_force_order_sem = sem_open(SHMEM_FORCE_ORDER_SEM_NAME.c_str(), 0);
-    if (shmem_force_order_sem == SEM_FAILED)
-        error("ERROR, unable to open semaphore");
+    // name channel in a free slot
+    ShmemChannel::Slot *claimedSlot = nullptr;
+    for (auto &slot : control->slots) {
+        uint32_t free = ShmemChannel::FREE;
+        if (slot.state.compare_exchange_strong(free, ShmemChannel::CLAIMED)) {
+            claimedSlot = &slot;
+            break;
+        }
+    }
+    if (claimedSlot == nullptr)
+        error("ERROR, too many clients requesting a channel at the same time");
+    claimedSlot->clientPid = getpid();
+    strncpy(claimedSlot->channelName, channelName.c_str(), sizeof(claimedSlot->channelName) - 1);
+    claimedSlot->channelName[sizeof(claimedSlot->channelName) - 1] = '\0';
+    claimedSlot->state.store(ShmemChannel::REQUESTED);
+
+    // signal to server: channel and IR ready
+    sem_post(control_sem);
 
 #ifndef NDEBUG
-    int shmem_sem_val, shmem_force_order_sem_val;
-    sem_getvalue(shmem_sem, &shmem_sem_val);
-    sem_getvalue(shmem_force_order_sem, &shmem_force_order_sem_val);
-    std::cout << "DEBUG" << ": shmem_sem(" << shmem_sem_val << ") shmem_force_order_sem(" << shmem_force_order_sem_val << ")\n";
+    std::cout << "DEBUG" << ": requested channel " << channelName << " in slot " << (claimedSlot - control->slots) << "\n";
 #endif
+
+    if (sem_close(control_sem) == -1)
+        perror("ERROR, unable to close semaphore");
+    if (munmap(control, sizeof(ShmemChannel::ControlRegion)))
+        perror("ERROR, unable to unmap shared memory region from memory");
+}
+
+void ShmemClient::waitForServer(unsigned spinMicroseconds)
+{
+    // wake up regularly, the server might have died
+    while (!toClient->wait(1000000U, spinMicroseconds)) {
+        if (kill(serverPid, 0) == -1 && errno == ESRCH)
+            error(std::string("ERROR, server " + std::to_string(serverPid) + " vanished").c_str());
+    }
 }
 
 void ShmemClient::writeIR(void *shmemptr, const std::string& IR)
 {
-   for (int i = 0; i < IR.size()+1; i++)
-       ((char*)shmemptr)[i] = IR.c_str()[i];
+    // the module may contain '\0' (bitcode), its size is part of the encoding
+    memcpy(shmemptr, IR.c_str(), IR.size() + 1);
 }
 
-void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate)
+void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, PendingCall &call)
 {
 #ifndef NDEBUG
     std::cout << "DEBUG" << ": marshallCall(\"" << funcNameAndArgs << "\", ...)" << std::endl;
 #endif
     // read function name and argument types from funcNameAndArgs
-    std::unique_ptr<char[]> funcNameAndArgsCopy(new char[strlen(funcNameAndArgs)+1]);
-    strcpy(funcNameAndArgsCopy.get(), funcNameAndArgs);
-    char *funcName = strtok(funcNameAndArgsCopy.get(), ":");
-
-    std::list<llvm::Type::TypeID> argTypes;
-    std::list<unsigned int> intBitWidths;
-    std::list<llvm::Type::TypeID> pointersPointedToTypeID;
-    char *currArg;
-    while ((currArg = strtok(nullptr, ":")) != nullptr) {
-        argTypes.push_back(static_cast<llvm::Type::TypeID>(strtoul(currArg, &currArg, 10)));
-
-        if (argTypes.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-          intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-
-        if (argTypes.back() == llvm::Type::PointerTyID) { // pointers additionally need typeID of type pointed to
-            pointersPointedToTypeID.push_back(static_cast<llvm::Type::TypeID>(strtoul(++currArg, &currArg, 10)));
-            if (pointersPointedToTypeID.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-                intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-        }
-    }
+    std::vector<ArgumentInfo> argInfos;
+    const std::string funcNameStr = parseFuncNameAndArgs(funcNameAndArgs, argInfos);
+    const char *funcName = funcNameStr.c_str();
 
     // build call: "functionName:val1val2...valn", vali in machine form
     void *shmempos = shmemptr;
@@ -136,22 +186,24 @@ void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::l
     shmempos = (char *)shmempos + 1;
 
     int i = 0;
-    auto intBWiterator = intBitWidths.begin();
-    auto pointersToTyIDIterator = pointersPointedToTypeID.begin();
     llvm::Type::TypeID pointingToTyID = llvm::Type::NumTypeIDs; // = explicitly unset
     unsigned pointingToIntBW;
+    uint32_t pointingToDirection;
     void* ptrPending = nullptr;
-    for (const auto& currArg : argTypes) {
+    for (const auto& argInfo : argInfos) {
+        const auto currArg = argInfo.typeID;
         i++;
         switch (currArg) {
             case llvm::Type::PointerTyID: {
-                pointingToTyID = *pointersToTyIDIterator++;
-                pointingToIntBW = *intBWiterator++;
-                std::cout << "DEBUG" << ": argument " << i << " is pointer to type with TypeID " << pointingToTyID << ", assuming argument " << i+1 << " is int, giving number of elements in area pointed to\n";
+                pointingToTyID = argInfo.pointedToTypeID;
+                pointingToIntBW = argInfo.bitwidth;
+                pointingToDirection = argInfo.direction;
+                std::cout << "DEBUG" << ": argument " << i << " is pointer to type with TypeID " << pointingToTyID << " (direction: " << pointingToDirection << "), assuming argument " << i+1 << " is int, giving number of elements in area pointed to\n";
                 std::cout << "DEBUG" << ": area will be marshalled with handling of next argument\n";
                 ptrPending = va_arg(args, void*);
-                auto ptrPointingToType = std::make_pair(pointingToTyID, pointingToIntBW);
-                pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate.push_back(std::pair<void *, std::pair<llvm::Type::TypeID, unsigned>>(ptrPending, ptrPointingToType));
+                // only arrays written by the function are transferred back, arrays in the arena are written in place
+                if (ArgumentDirection::isDownloaded(pointingToDirection) && !isInArena(ptrPending))
+                    call.awaitedArrays.push_back({ ptrPending, ptrPending, std::make_pair(pointingToTyID, pointingToIntBW), 0U });
                 break;
             }
             case llvm::Type::FloatTyID:
@@ -168,11 +220,11 @@ void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::l
                 shmempos = (long double *) shmempos + 1;
                 break;
             case llvm::Type::IntegerTyID:  // Note: LLVM does not differentiate between signed/unsiged int types
-                switch (*intBWiterator++) {
+                switch (argInfo.bitwidth) {
                     case 32: {
                         int32_t tmp = va_arg(args, int32_t);
                         if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), shmempos);
+                            marshallArray(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), pointingToDirection, shmempos, call);
                             pointingToTyID = llvm::Type::NumTypeIDs;
                             pointingToIntBW = 0U;
                         }
@@ -183,7 +235,7 @@ void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::l
                     case 64: {
                         int64_t tmp = va_arg(args, int64_t);
                         if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), shmempos);
+                            marshallArray(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), pointingToDirection, shmempos, call);
                             pointingToTyID = llvm::Type::NumTypeIDs;
                             pointingToIntBW = 0U;
                         }
@@ -194,7 +246,7 @@ void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::l
                     default: {
                         int tmp = va_arg(args, int);
                         if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), shmempos);
+                            marshallArray(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), pointingToDirection, shmempos, call);
                             pointingToTyID = llvm::Type::NumTypeIDs;
                             pointingToIntBW = 0U;
                         }
@@ -208,62 +260,115 @@ void ShmemClient::marshallCall(const char *funcNameAndArgs, va_list args, std::l
                 error(std::string("ERROR, LLVM TypeID " + std::to_string(currArg) + " of argument " + std::to_string(i) + " in function \"" + funcName + "\" is not supported").c_str());
         }
     }
+
+    // behind the arguments: resident arrays the server can release
+    const auto released = residentBuffers.takeReleased();
+    *(uint64_t *)shmempos = released.size();
+    shmempos = (uint64_t *) shmempos + 1;
+    if (!released.empty())
+        memcpy(shmempos, released.data(), released.size() * sizeof(Residency::BufferKey));
+}
+
+void ShmemClient::marshallArray(void *arr, int64_t size, std::pair<llvm::Type::TypeID, unsigned> typeIDWithBitwidthPointedTo, uint32_t direction, void *&shmempos, PendingCall &call)
+{
+    const uint64_t bytes = size * CallFrame::elementSize(typeIDWithBitwidthPointedTo);
+    // arrays in the arena are shared with the server, only their offset is written
+    if (isInArena(arr)) {
+        if (!arena->contains(arr, bytes))
+            error("ERROR, array exceeds the shared arena");
+        call.inPlaceArrays.push_back(std::make_pair(arr, bytes));
+#ifndef NDEBUG
+        std::cout << "DEBUG" << ": array at " << arr << " is in the shared arena, not transferred\n";
+#endif
+        Residency::ArrayResidency residency = { arena->offsetOf(arr), 0U, Residency::SHARED, direction };
+        *(Residency::ArrayResidency *)shmempos = residency;
+        shmempos = (Residency::ArrayResidency *) shmempos + 1;
+        *(int64_t *)shmempos = size;
+        shmempos = (int64_t *) shmempos + 1;
+        return;
+    }
+
+    if (!call.awaitedArrays.empty() && call.awaitedArrays.back().ptr == arr)
+        call.awaitedArrays.back().size = bytes;
+
+    // arrays unchanged since the last call are still on the server, only their number of elements is written
+    const auto decision = residentBuffers.prepare(arr, bytes, ArgumentDirection::isDownloaded(direction));
+    Residency::ArrayResidency residency = { (uint64_t) arr, decision.version, decision.flags, direction };
+    *(Residency::ArrayResidency *)shmempos = residency;
+    shmempos = (Residency::ArrayResidency *) shmempos + 1;
+
+    if (decision.flags == Residency::RESIDENT) {
+#ifndef NDEBUG
+        std::cout << "DEBUG" << ": array at " << arr << " is resident on server, not transferred\n";
+#endif
+        *(int64_t *)shmempos = size;
+        shmempos = (int64_t *) shmempos + 1;
+    } else
+        ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(arr, size, typeIDWithBitwidthPointedTo, shmempos);
 }
 
 void ShmemClient::initialiseAccelerationWithIR(const std::string &IR)
 {
-    connectToAccelerator();
+    createChannel();
 
     // send IR to server
     writeIR(shmemptr, IR);
+    requestChannel();
+
+    // wait for server to be ready for calls, optimization takes long, so do not spin
+    waitForServer(0U);
 
-    // signal to server: connection and IR ready
-    sem_post(shmem_sem);
+    // server mapped the channel and the arena, the names are not needed anymore
+    if (shm_unlink(channelName.c_str()))
+        perror("ERROR, unable to unlink shared memory region");
+    if (arena)
+        arena->unlink();
+
+    switch (ShmemChannel::header(channel)->status.load()) {
+        case ShmemChannel::SERVING:
+            break;
+        case ShmemChannel::BUSY:
+            error("ERROR, server serves as many shared memory clients as it has workers (see -shmem-threads on the server)");
+        case ShmemChannel::FAILED:
+            error("ERROR, server could not build module from IR");
+        default:
+            error("ERROR, server answered without serving the channel");
+    }
 
-    sem_wait(shmem_force_order_sem);
-    // wait for server to be ready for calls
-    sem_wait(shmem_sem);
     // get time measurements
     TimeDiffOpt = *(long *)shmemptr;
     TimeDiffInit = *(((long *)shmemptr + 1));
-    sem_post(shmem_force_order_sem);
 }
 
-void ShmemClient::callAcc(const char *retTypeFuncNameArgTypes, va_list args)
+void ShmemClient::sendCall(const char *funcNameAndArgs, va_list args, PendingCall &call)
 {
     assert(shmemptr != nullptr && "Connection to server uninitialised!");
 
-    // get result type and container to write result value to
-    char* behindResTypePtr;
-    unsigned int retTypeBitWidth;
-    auto retType = static_cast<llvm::Type::TypeID>(strtol(retTypeFuncNameArgTypes, &behindResTypePtr, 10));
-    if (retType == llvm::Type::IntegerTyID)
-        retTypeBitWidth = strtol(++behindResTypePtr, &behindResTypePtr, 10);
-    behindResTypePtr++;
-
-    void* retContainerPtr;
-    if (retType != llvm::Type::VoidTyID)
-        retContainerPtr = va_arg(args, void*);
-
-    // initialise list to keep arguments which might change during call, write call
-    std::list<std::pair<void*, std::pair<llvm::Type::TypeID, unsigned>>> pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate;
-    marshallCall(behindResTypePtr, args, pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
+    // write call, arrays which might change during call are kept in call
+    marshallCall(funcNameAndArgs, args, call);
     // signal to server: call ready
-    sem_post(shmem_sem);
+    toServer->ring();
+}
+
+void ShmemClient::receiveResult(PendingCall &call)
+{
+    const llvm::Type::TypeID retType = call.retType;
+    const unsigned retTypeBitWidth = call.retTypeBitWidth;
+    void *retContainerPtr = call.retContainerPtr;
 
-    sem_wait(shmem_force_order_sem);
     // wait for result ready, read mesured time, changes to arguments and result from shmem afterwards
-    sem_wait(shmem_sem);
-    sem_post(shmem_force_order_sem);
+    waitForServer();
 
     auto shmempos = shmemptr;
     TimeDiffLastExecution = *(long *)shmempos;
     shmempos = (long *)shmempos + 1;
 
     // unmarshal changes to pointed to memory areas
-    std::cout << "DEBUG" << ": updating " << pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate.size() << " arguments\n";
-    for (const auto& pointerAndType : pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate)
-        ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoExistingMemory(shmempos, pointerAndType.second, pointerAndType.first);
+    std::cout << "DEBUG" << ": updating " << call.awaitedArrays.size() << " arguments\n";
+    for (auto& array : call.awaitedArrays) {
+        array.size = *(int64_t *)shmempos * CallFrame::elementSize(array.typeIDWithBitwidth);
+        ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoExistingMemory(shmempos, array.typeIDWithBitwidth, array.destination);
+    }
 
     // interpret result with typeinfo from resType
     switch (retType) {
@@ -272,6 +377,7 @@ void ShmemClient::callAcc(const char *retTypeFuncNameArgTypes, va_list args)
             break;
         case llvm::Type::FloatTyID:
             *(float*)retContainerPtr = *(float*) shmempos;
+            break;
         case llvm::Type::DoubleTyID:
             *(double*)retContainerPtr = *(double*) shmempos;
             break;
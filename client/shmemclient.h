@@ -29,25 +29,39 @@
 #include <string>
 #include <list>
 
-#include <semaphore.h>
+#include <sys/types.h>
 
 #include "llvm/IR/DerivedTypes.h"
 
+#include "../common/doorbell.h"
+
 class ShmemClient : public AbstractClient
 {
-    void *shmemptr = nullptr;
-    sem_t *shmem_sem = nullptr;
-    sem_t *shmem_force_order_sem = nullptr;
+    void *channel = nullptr;    // own channel to the server, see ShmemChannel
+    void *shmemptr = nullptr;   // IR, calls and results in the channel
+    Doorbell *toServer = nullptr;
+    Doorbell *toClient = nullptr;
+    std::string channelName;
+    pid_t serverPid = 0;
 
-    void connectToAccelerator();
+    void createChannel();
+    void requestChannel();
+    void waitForServer(unsigned spinMicroseconds = SHMEM_SPIN_MICROSECONDS);
     void writeIR(void *shmemptr, const std::string &IR);
-    void marshallCall(const char *funcNameAndArgs, va_list args, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
+    void marshallCall(const char *funcNameAndArgs, va_list args, PendingCall &call);
+    void marshallArray(void *arr, int64_t size, std::pair<llvm::Type::TypeID, unsigned> typeIDWithBitwidthPointedTo, uint32_t direction, void *&shmempos, PendingCall &call);
+    bool isInArena(const void *ptr) const {
+        return arena && arena->isShared() && arena->contains(ptr);
+    }
+
+protected:
+    virtual void sendCall(const char *funcNameAndArgs, va_list args, PendingCall &call);
+    virtual void receiveResult(PendingCall &call);
 
 public:
     ShmemClient();
     virtual ~ShmemClient();
     virtual void initialiseAccelerationWithIR(const std::string &IR);
-    virtual void callAcc(const char *retTypeFuncNameArgTypes, va_list args);
 };
 
 #endif // SHMEMCLIENT_H
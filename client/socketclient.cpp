@@ -39,21 +39,27 @@
 #include <iostream>
 #include <string>
 #include <list>
+#include <vector>
 
 #include "llvm/IR/DerivedTypes.h"
 
 #include "../consts.h"
+#include "../common/callframe.h"
 #include "../common/sockethelperfunctions.h"
+#include "../common/residency.h"
+#include "../common/argumentdirection.h"
 
 
-SocketClient::SocketClient(std::string serverName) : AbstractClient(), serverName(serverName), msg_buffer(std::shared_ptr<char>((char*)calloc(MSG_BUFFER_SIZE, sizeof(char)), &free))
+SocketClient::SocketClient(std::string serverName, uint64_t chunkSize) : AbstractClient(), serverName(serverName), chunkSize(chunkSize)
 {
 }
 
 SocketClient::~SocketClient()
 {
-    if (sockfd != -1)
+    if (sockfd != -1) {
+        waitForPendingCall();
         close(sockfd);
+    }
 }
 
 int SocketClient::connectToAccelerator()
@@ -84,559 +90,341 @@ void SocketClient::sendIR(int sockfd, const std::string IR) {
         std::cout << "DEBUG: Sending IR\n" << std::endl;
     #endif
 
-    int myrank;
-    MPI_Comm_rank(server, &myrank);
-    int mpi_client_tag = MPI_CLIENT_TAG;
-    int mpi_client_rank =0;
-    
-    // TODO: check this!
-    if(myrank==0)
-          mpi_client_rank = 1;
-
-    MPI_Send((void*) IR.c_str(), IR.size() , MPI_CHAR, mpi_client_rank, mpi_client_tag, server);
+    // module frame: header, then the module as it is
+    CallFrame::Header header;
+    CallFrame::initHeader(header, CallFrame::MODULE, 0U, 0U, IR.size());
+    struct iovec frame[] = { { &header, sizeof(header) }, { (void *) IR.data(), IR.size() } };
+    if (!CallFrame::sendFully(sockfd, frame, 2))
+        error("ERROR, could not write to socket");
 
     #ifndef NDEBUG
         std::cout << "DEBUG: IR Sent\n" << std::endl;
     #endif
 }
 
-void SocketClient::marshallCall(const char *funcNameAndArgs, va_list args, char *msg, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate)
-{
-    #ifndef NDEBUG
-        std::cout << "DEBUG" << ": marshallCall(\"" << funcNameAndArgs << "\", ..., \"" << msg << "\")" << std::endl;
-    #endif
-
-    // read function name and argument types from funcNameAndArgs
-    std::unique_ptr<char[]> funcNameAndArgsCopy(new char[strlen(funcNameAndArgs)+1]);
-    strcpy(funcNameAndArgsCopy.get(), funcNameAndArgs);
-    char *funcName = strtok(funcNameAndArgsCopy.get(), ":");
-
-    std::list<llvm::Type::TypeID> argTypes;
-    std::list<unsigned int> intBitWidths;
-    std::list<llvm::Type::TypeID> pointersPointedToTypeID;
-    char *currArg;
-    while ((currArg = strtok(nullptr, ":")) != nullptr) {
-        argTypes.push_back(static_cast<llvm::Type::TypeID>(strtoul(currArg, &currArg, 10)));
-
-        if (argTypes.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-            intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-
-        if (argTypes.back() == llvm::Type::PointerTyID) { // pointers additionally need typeID of type pointed to
-            pointersPointedToTypeID.push_back(static_cast<llvm::Type::TypeID>(strtoul(++currArg, &currArg, 10)));
-            if (pointersPointedToTypeID.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-                intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-        }
-    }
-
-    // build call: "functionName:val1:val2...:valn"
-    strcpy(msg, funcName);
-}
-
-void SocketClient::marshallMPICall(const char *funcNameAndArgs, va_list args, char *msg, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate)
+void SocketClient::marshallCall(const char *funcNameAndArgs, va_list args, MessageBuffer &msg, std::vector<struct iovec> &frame, PendingCall &call)
 {
     #ifndef NDEBUG
-        std::cout << "DEBUG" << ": marshallCall(\"" << funcNameAndArgs << "\", ..., \"" << msg << "\")" << std::endl;
+        std::cout << "DEBUG" << ": marshallCall(\"" << funcNameAndArgs << "\", ...)" << std::endl;
     #endif
 
     // read function name and argument types from funcNameAndArgs
-    std::unique_ptr<char[]> funcNameAndArgsCopy(new char[strlen(funcNameAndArgs)+1]);
-    strcpy(funcNameAndArgsCopy.get(), funcNameAndArgs);
-    char *funcName = strtok(funcNameAndArgsCopy.get(), ":");
-
-    std::list<llvm::Type::TypeID> argTypes;
-    std::list<unsigned int> intBitWidths;
-    std::list<llvm::Type::TypeID> pointersPointedToTypeID;
-    char *currArg;
-    while ((currArg = strtok(nullptr, ":")) != nullptr) {
-        argTypes.push_back(static_cast<llvm::Type::TypeID>(strtoul(currArg, &currArg, 10)));
-
-        if (argTypes.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-            intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-
-        if (argTypes.back() == llvm::Type::PointerTyID) { // pointers additionally need typeID of type pointed to
-            pointersPointedToTypeID.push_back(static_cast<llvm::Type::TypeID>(strtoul(++currArg, &currArg, 10)));
-            if (pointersPointedToTypeID.back() == llvm::Type::IntegerTyID) // integers additionally need bitwidths
-                intBitWidths.push_back(strtoul(++currArg, nullptr, 10));
-        }
-    }
-
-    // build call: "functionName:val1:val2...:valn"
-    strcpy(msg, funcName);
-
-    //Set up the structure
-    //allocate memory for struct
-    struct ArgumentList argList[MAX_NUMBER_OF_ARGUMENTS];
-    MPI_Status status;
-
-    int myrank;
-    MPI_Comm_rank(server, &myrank);
-
-    //Create the structure
-    int structSize=0;
-    int mpi_client_tag = MPI_CLIENT_TAG;
-    
-    int mpi_client_rank =0;
-    
-    // TODO: check this! 
-    if(myrank==0)
-          mpi_client_rank = 1;
-
-    //Data structure to hold the addresses of the data
-    struct mpi_send_data {
-        void * ptrToAdddress;
-        bool free;
-    } ptrToAdddress[MAX_NUMBER_OF_ARGUMENTS];
-
-    int ptrToAdddressIterator=0;
-
+    std::vector<ArgumentInfo> argInfos;
+    const std::string funcNameStr = parseFuncNameAndArgs(funcNameAndArgs, argInfos);
+    const char *funcName = funcNameStr.c_str();
+
+    if (argInfos.size() > MAX_NUMBER_OF_ARGUMENTS)
+        error(std::string("ERROR, function \"" + std::string(funcName) + "\" has more than " + std::to_string(MAX_NUMBER_OF_ARGUMENTS) + " arguments").c_str());
+
+    // build call frame: header, function name, one descriptor per argument; arrays are referenced in place
+    const uint32_t functionNameSize = CallFrame::alignUp(strlen(funcName) + 1, 8);
+    const size_t callMetadataSize = CallFrame::metadataSize(functionNameSize, argInfos.size());
+    msg.clear();
+    char *metadata = msg.resize(callMetadataSize);
+    memset(metadata, 0, callMetadataSize); // only the metadata is cleared, it is sent including its padding
+    auto header = (CallFrame::Header *) metadata;
+    strcpy(metadata + sizeof(CallFrame::Header), funcName);
+    auto descriptors = (CallFrame::ArgDescriptor *) (metadata + sizeof(CallFrame::Header) + functionNameSize);
+
+    frame.clear();
+    frame.push_back({ metadata, callMetadataSize });
+
+    uint64_t payloadSize = 0U;
     int i = 0;
-    auto intBWiterator = intBitWidths.begin();
-    auto pointersToTyIDIterator = pointersPointedToTypeID.begin();
     llvm::Type::TypeID pointingToTyID = llvm::Type::NumTypeIDs; // = explicitly unset
-    unsigned pointingToIntBW;
+    unsigned pointingToIntBW = 0U;
     void* ptrPending = nullptr;
-    void *tmpdata = nullptr;
-
-    for (const auto& currArg : argTypes) {
-        i++;
-        char currVal[MAX_VAL_SIZE];
+    CallFrame::ArgDescriptor *descriptorPending = nullptr;
+    for (const auto& argInfo : argInfos) {
+        const auto currArg = argInfo.typeID;
+        CallFrame::ArgDescriptor &descriptor = descriptors[i++];
+        descriptor.typeID = currArg;
         switch (currArg) {
             case llvm::Type::PointerTyID: {
-                pointingToTyID = *pointersToTyIDIterator++;
-                // Only get bit width, if pointer points to interger type.
-                if(pointingToTyID == llvm::Type::IntegerTyID) {
-                    pointingToIntBW = *intBWiterator++;
-                } else {
-                    pointingToIntBW = 0;
-                }
+                pointingToTyID = argInfo.pointedToTypeID;
+                pointingToIntBW = argInfo.bitwidth;
                 #ifndef NDEBUG
-                    std::cout << "DEBUG" << ": argument " << i << " is pointer to type with TypeID " << pointingToTyID << " (width: " << pointingToIntBW << "), assuming argument " << i+1 << " is int, giving number of elements in area pointed to\n";
+                    std::cout << "DEBUG" << ": argument " << i << " is pointer to type with TypeID " << pointingToTyID << " (width: " << pointingToIntBW << ", direction: " << argInfo.direction << "), assuming argument " << i+1 << " is int, giving number of elements in area pointed to\n";
                     std::cout << "DEBUG" << ": area will be marshalled with handling of next argument\n";
                 #endif
                 ptrPending = va_arg(args, void*);
-                auto ptrPointingToType = std::make_pair(pointingToTyID, pointingToIntBW);
-                pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate.push_back(std::pair<void *, std::pair<llvm::Type::TypeID, unsigned>>(ptrPending, ptrPointingToType));
-                currVal[0] = '\0';
+                descriptorPending = &descriptor;
+                descriptor.pointedToTypeID = pointingToTyID;
+                descriptor.bitwidth = pointingToIntBW;
+                descriptor.direction = argInfo.direction;
+                // only arrays written by the function are transferred back
+                if (ArgumentDirection::isDownloaded(argInfo.direction))
+                    call.awaitedArrays.push_back({ ptrPending, ptrPending, std::make_pair(pointingToTyID, pointingToIntBW), 0U });
                 break;
             }
-            case llvm::Type::FloatTyID:
-            case llvm::Type::DoubleTyID:
-                tmpdata = malloc(sizeof(double));
-                *(double *)tmpdata = va_arg(args, double);
-
-                argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_DOUBLE;
-                argList[ptrToAdddressIterator].sizeOfArg = 1;
-                ptrToAdddress[ptrToAdddressIterator].free = 1;
-                ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = tmpdata;
-                ptrToAdddressIterator++;
-
+            case llvm::Type::FloatTyID: {
+                float tmp = (float) va_arg(args, double);
+                memcpy(descriptor.value, &tmp, sizeof(tmp));
                 break;
+            }
+            case llvm::Type::DoubleTyID: {
+                double tmp = va_arg(args, double);
+                memcpy(descriptor.value, &tmp, sizeof(tmp));
+                break;
+            }
             case llvm::Type::X86_FP80TyID:
-            case llvm::Type::FP128TyID:
-                tmpdata = malloc(sizeof(long double));
-                *(long double *)tmpdata = va_arg(args, long double);
-
-                argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_LONG_DOUBLE;
-                argList[ptrToAdddressIterator].sizeOfArg = 1;
-                ptrToAdddress[ptrToAdddressIterator].free = 1;
-                ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = tmpdata;
-                ptrToAdddressIterator++;
-
+            case llvm::Type::FP128TyID: {
+                long double tmp = va_arg(args, long double);
+                memcpy(descriptor.value, &tmp, sizeof(tmp));
                 break;
-            case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
-                switch (*intBWiterator++) {
-                    case 32: {
-                        tmpdata = malloc(sizeof(int32_t));
-                        *(int32_t *)tmpdata = va_arg(args, int32_t);
-
-                        if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            switch(pointingToTyID) {
-                                case llvm::Type::IntegerTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                                    break;
-                                case llvm::Type::FloatTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_FLOAT;
-                                    break;
-
-                                case llvm::Type::DoubleTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_DOUBLE;
-                                    break;
-                                case llvm::Type::FP128TyID:
-                                case llvm::Type::X86_FP80TyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_LONG_DOUBLE;
-                                    break;
-                                default:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                            }
-                            argList[ptrToAdddressIterator].sizeOfArg = (long) *(int32_t *)tmpdata;
-                            ptrToAdddress[ptrToAdddressIterator].free=0;
-                            ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = ptrPending;
-                            ptrToAdddressIterator++;
-
-                            //SocketHelperFunctions::marshallArrayOfSizeAndTypeIntoBuffer(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), msg);
-                            pointingToTyID = llvm::Type::NumTypeIDs;
-                            pointingToIntBW = 0U;
-                        }
-
-                        argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                        argList[ptrToAdddressIterator].sizeOfArg = 1;
-                        ptrToAdddress[ptrToAdddressIterator].free = 1;
-                        ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = tmpdata;
-                        ptrToAdddressIterator++;
-
+            }
+            case llvm::Type::IntegerTyID: { // Note: LLVM does not differentiate between signed/unsiged int types
+                descriptor.bitwidth = argInfo.bitwidth;
+                int64_t tmp;
+                switch (descriptor.bitwidth) {
+                    case 64: {
+                        int64_t tmp64 = va_arg(args, int64_t);
+                        memcpy(descriptor.value, &tmp64, sizeof(tmp64));
+                        tmp = tmp64;
                         break;
                     }
-                    case 64: {
-                        tmpdata = malloc(sizeof(int64_t));
-                        *(int64_t *)tmpdata = va_arg(args, int64_t);
-
-                        if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            switch(pointingToTyID) {
-                                case llvm::Type::IntegerTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                                    break;
-                                case llvm::Type::FloatTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_FLOAT;
-                                    break;
-
-                                case llvm::Type::DoubleTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_DOUBLE;
-                                    break;
-                                case llvm::Type::FP128TyID:
-                                case llvm::Type::X86_FP80TyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_LONG_DOUBLE;
-                                    break;
-                                default:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                            }
-
-                            argList[ptrToAdddressIterator].sizeOfArg = (long) *(int64_t *)tmpdata;
-                            ptrToAdddress[ptrToAdddressIterator].free=0;
-                            ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = ptrPending;
-                            ptrToAdddressIterator++;
-
-                            //SocketHelperFunctions::marshallArrayOfSizeAndTypeIntoBuffer(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), msg);
-                            pointingToTyID = llvm::Type::NumTypeIDs;
-                            pointingToIntBW = 0U;
-                        }
-                        argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_LONG;
-                        argList[ptrToAdddressIterator].sizeOfArg = 1;
-                        ptrToAdddress[ptrToAdddressIterator].free = 1;
-                        ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = tmpdata;
-                        ptrToAdddressIterator++;
-
+                    case 32: {
+                        int32_t tmp32 = va_arg(args, int32_t);
+                        memcpy(descriptor.value, &tmp32, sizeof(tmp32));
+                        tmp = tmp32;
                         break;
                     }
                     default: {
-                        void *tmpdata = malloc(sizeof(int));
-                        *(int *)tmpdata = va_arg(args, int);
-
-                        if (pointingToTyID != llvm::Type::NumTypeIDs) {
-                            switch(pointingToTyID) {
-                                case llvm::Type::IntegerTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                                    break;
-                                case llvm::Type::FloatTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_FLOAT;
-                                    break;
-
-                                case llvm::Type::DoubleTyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_DOUBLE;
-                                    break;
-                                case llvm::Type::FP128TyID:
-                                case llvm::Type::X86_FP80TyID:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_LONG_DOUBLE;
-                                    break;
-                                default:
-                                    argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                            }
-
-                            argList[ptrToAdddressIterator].sizeOfArg = (long) *(int *)tmpdata;
-                            ptrToAdddress[ptrToAdddressIterator].free=0;
-                            ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = ptrPending;
-                            ptrToAdddressIterator++;
-
-                            //SocketHelperFunctions::marshallArrayOfSizeAndTypeIntoBuffer(ptrPending, tmp, std::pair<llvm::Type::TypeID, unsigned>(pointingToTyID, pointingToIntBW), msg);
-                            pointingToTyID = llvm::Type::NumTypeIDs;
-                            pointingToIntBW = 0U;
-                        }
-                        argList[ptrToAdddressIterator].typeofArg = ENUM_MPI_INT;
-                        argList[ptrToAdddressIterator].sizeOfArg = 1;
-                        ptrToAdddress[ptrToAdddressIterator].free = 1;
-                        ptrToAdddress[ptrToAdddressIterator].ptrToAdddress = tmpdata            ;
-                        ptrToAdddressIterator++;
+                        int tmpInt = va_arg(args, int);
+                        memcpy(descriptor.value, &tmpInt, CallFrame::elementSize(std::make_pair(llvm::Type::IntegerTyID, descriptor.bitwidth)));
+                        tmp = tmpInt;
+                        break;
+                    }
+                }
 
+                if (pointingToTyID != llvm::Type::NumTypeIDs) {
+                    // this int gives the number of elements of the array pointed to by the previous argument
+                    const size_t arraySize = tmp * CallFrame::elementSize(std::make_pair(pointingToTyID, pointingToIntBW));
+                    descriptorPending->numElements = tmp;
+                    descriptorPending->payloadOffset = payloadSize;
+                    descriptorPending->payloadSize = arraySize;
+                    if (ArgumentDirection::isDownloaded(descriptorPending->direction))
+                        call.awaitedArrays.back().size = arraySize;
+
+                    // arrays unchanged since the last call are still on the server
+                    const auto residency = residentBuffers.prepare(ptrPending, arraySize, ArgumentDirection::isDownloaded(descriptorPending->direction));
+                    descriptorPending->flags = residency.flags;
+                    descriptorPending->clientAddress = (uint64_t) ptrPending;
+                    descriptorPending->version = residency.version;
+                    if (residency.flags == Residency::RESIDENT) {
+                        #ifndef NDEBUG
+                            std::cout << "DEBUG: array of argument " << i-1 << " is resident on server, not transferred\n";
+                        #endif
+                        pointingToTyID = llvm::Type::NumTypeIDs;
+                        pointingToIntBW = 0U;
+                        descriptorPending = nullptr;
                         break;
                     }
+
+                    frame.push_back({ ptrPending, arraySize });
+                    payloadSize += arraySize;
+                    const size_t paddingSize = CallFrame::alignUp(payloadSize, CallFrame::PAYLOAD_ALIGNMENT) - payloadSize;
+                    if (paddingSize) {
+                        frame.push_back({ (void *) CallFrame::padding(), paddingSize });
+                        payloadSize += paddingSize;
+                    }
+
+                    pointingToTyID = llvm::Type::NumTypeIDs;
+                    pointingToIntBW = 0U;
+                    descriptorPending = nullptr;
                 }
                 break;
+            }
             default:
-                error(std::string("ERROR, LLVM TypeID " + std::to_string(currArg) + " of argument " + std::to_string(i) + " in function \"" + funcName + "\" is not supported").c_str());
+                error(std::string("ERROR, LLVM TypeID " + std::to_string(currArg) + " of argument " + std::to_string(i) + " in function \"" + funcNameStr + "\" is not supported").c_str());
         }
     }
 
-    //Send the MPI_Header / structure
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Sending MPI Header";
-        std::cout.flush();
-        
-        //Display sent DS
-        for (int i=0; i<ptrToAdddressIterator; i++) {
-            std::cout <<  "\n MPI Sent DS : Size : " << argList[i].sizeOfArg << "  Type" << argList[i].typeofArg ;
-            std::cout.flush();
-        }
-    #endif
+    // tell server which resident arrays are not needed anymore, they follow the descriptors
+    const auto released = residentBuffers.takeReleased();
+    if (!released.empty()) {
+        const size_t releasedMetadataSize = CallFrame::metadataSize(functionNameSize, argInfos.size(), released.size());
+        metadata = msg.resize(releasedMetadataSize);
+        memset(metadata + callMetadataSize, 0, releasedMetadataSize - callMetadataSize);
+        memcpy(metadata + sizeof(CallFrame::Header) + functionNameSize + argInfos.size() * sizeof(CallFrame::ArgDescriptor), released.data(), released.size() * sizeof(Residency::BufferKey));
+        header = (CallFrame::Header *) metadata;
+        frame[0] = { metadata, releasedMetadataSize };
+    }
 
-    structSize = ptrToAdddressIterator;
-    MPI_Send(argList, structSize, ArgListType, mpi_client_rank, mpi_client_tag, server);
+    CallFrame::initHeader(*header, CallFrame::CALL, argInfos.size(), functionNameSize, payloadSize);
+    header->numReleased = released.size();
 
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Sending MPI Data to server";
-        std::cout.flush();
-    #endif
-    
-    ///MPI_DATA_MOVEMENT
-    //Send the MPI data
-    for(int i=0; i<ptrToAdddressIterator; i++) {
-        switch(argList[i].typeofArg) {
-            case ENUM_MPI_CHAR:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_CHAR , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_SHORT:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_SHORT , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_INT:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_INT , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_LONG:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_LONG , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_LONG_LONG:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_LONG_LONG, mpi_client_rank, mpi_client_tag, server);
-            case ENUM_MPI_FLOAT:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_FLOAT , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_DOUBLE:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_DOUBLE , mpi_client_rank, mpi_client_tag, server);
-                break;
-            case ENUM_MPI_LONG_DOUBLE:
-                MPI_Send(ptrToAdddress[i].ptrToAdddress, argList[i].sizeOfArg, MPI_LONG_DOUBLE , mpi_client_rank, mpi_client_tag, server);
-                break;
-            default:
-                std::cout << "Data-type : " << argList[i].typeofArg << "%d is not supported";
-                std::cout.flush();
-        }
-        //free if required
-        if(ptrToAdddress[i].free) {
-            free(ptrToAdddress[i].ptrToAdddress);
-        }
-    } 
-    
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Completed sending MPI Data to server";
-        std::cout.flush();
-    #endif    
+    // send the arrays interleaved instead, the padding between them is left out
+    if (chunkSize != 0U && payloadSize > chunkSize) {
+        header->chunkSize = chunkSize;
+        descriptors = (CallFrame::ArgDescriptor *) (metadata + sizeof(CallFrame::Header) + functionNameSize);
+        frame.resize(1);
+        for (const auto &chunk : CallFrame::interleave(descriptors, argInfos.size(), chunkSize))
+            frame.push_back({ (char *) descriptors[chunk.descriptor].clientAddress + chunk.offset, chunk.size });
+    }
 }
 
 void SocketClient::initialiseAccelerationWithIR(const std::string &IR)
 {
     sockfd = connectToAccelerator();
-
-    // MPI_CONNECTION_INIT
-    int argc=0;
-    MPI_Init( &argc, NULL ); 
-    server = MPI_COMM_WORLD;
-
     sendIR(sockfd, IR);
-    
-    MPI_Status status;
-    int mpi_client_tag = MPI_CLIENT_TAG;
-    int incomingMessageSize=0;    
-    MPI_Probe(MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-    MPI_Get_count(&status,MPI_CHAR,&incomingMessageSize);    
-    char *rdy_msg_buffer = (char *) calloc(incomingMessageSize + 1 , sizeof(char));    
-    MPI_Recv(rdy_msg_buffer, incomingMessageSize + 1, MPI_CHAR, MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-    
-    char* rdy_msg_buffer_ptr = rdy_msg_buffer;
-    TimeDiffOpt = strtol(rdy_msg_buffer_ptr, &rdy_msg_buffer_ptr, 10);
-    rdy_msg_buffer_ptr++;
-    TimeDiffInit = strtol(rdy_msg_buffer_ptr, &rdy_msg_buffer_ptr, 10);
+
+    // server is ready for calls as soon as it sent the time taken for optimizing the module and initialising the backend
+    CallFrame::Header header;
+    CallFrame::ReadyTimes times;
+    if (!CallFrame::recvFully(sockfd, &header, sizeof(header)))
+        error("ERROR, could not read from socket");
+    const bool swapBytes = CallFrame::needsByteSwap(header);
+    if (swapBytes)
+        CallFrame::byteSwapHeader(header);
+    if (!CallFrame::isValidHeader(header, CallFrame::READY) || header.payloadSize != sizeof(times))
+        error("ERROR, received malformed ready frame");
+    if (!CallFrame::recvFully(sockfd, &times, sizeof(times)))
+        error("ERROR, could not read from socket");
+    if (swapBytes)
+        SocketHelperFunctions::byteSwapArray(&times, 2, sizeof(int64_t));
+
+    TimeDiffOpt = times.optimization;
+    TimeDiffInit = times.initialisation;
 }
 
-void SocketClient::callAcc(const char *retTypeFuncNameArgTypes, va_list args)
+void SocketClient::sendCall(const char *funcNameAndArgs, va_list args, PendingCall &call)
 {
     assert(sockfd != -1 && "Connection to server uninitialised!");
-    
-    // Create MPI Structure
-    int sizeOfData;
-    MPI_Type_size( MPI_INT,&sizeOfData );
-    int array_of_block_lengths[2] = {1, 1};
-    MPI_Aint array_of_displacements[2] = {0, sizeOfData};
-    MPI_Datatype array_of_types[2] = { MPI_INT, MPI_INT };
-
-    MPI_Type_create_struct(2, array_of_block_lengths, array_of_displacements, array_of_types, &ArgListType);
-    MPI_Type_commit(&ArgListType);
-    // End of MPI struct
-
-    // initialise msg_buffer
-    bzero(msg_buffer.get(), MSG_BUFFER_SIZE);
-
-    // get result type and container to write result value to
-    char* behindResTypePtr;
-    unsigned int retTypeBitWidth;
-    auto retType = static_cast<llvm::Type::TypeID>(strtol(retTypeFuncNameArgTypes, &behindResTypePtr, 10));
-    if (retType == llvm::Type::IntegerTyID)
-        retTypeBitWidth = strtol(++behindResTypePtr, &behindResTypePtr, 10);
-    behindResTypePtr++;
-
-    void* retContainerPtr;
-    if (retType != llvm::Type::VoidTyID)
-        retContainerPtr = va_arg(args, void*);
-
-    // initialise list to keep arguments which might change during call, write call
-    std::list<std::pair<void*, std::pair<llvm::Type::TypeID, unsigned>>> pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate;
 
+    // write call, arrays which might change during call are kept in call
+    std::vector<struct iovec> frame;
+    marshallCall(funcNameAndArgs, args, msg_buffer, frame, call);
     #ifndef NDEBUG
-        std::cout << "<marshalled: " << retTypeFuncNameArgTypes << " \n";
-    #endif
-    marshallCall(behindResTypePtr, args, msg_buffer.get(), pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
-    #ifndef NDEBUG
-        std::cout << "<marshalled: \n";
+        std::cout << "DEBUG: marshalled call in " << frame.size() << " pieces, payload of " << ((CallFrame::Header *) msg_buffer.data())->payloadSize << " bytes\n";
     #endif
 
-    // send length of call msg
-    auto msg_buffer_length = strlen(msg_buffer.get());
-
-    // send call msg
-    msg_buffer.get()[msg_buffer_length] = '\0';
-    int num_chars = send(sockfd, msg_buffer.get(), msg_buffer_length + 1, 0);
-    if (num_chars < 0)
+    // send whole call frame at once, arrays are sent directly from their memory
+    if (!CallFrame::sendFully(sockfd, frame.data(), frame.size()))
         error("ERROR, could not write to socket");
-        
-    //MPI Send
-    marshallMPICall(behindResTypePtr, args, msg_buffer.get(), pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
-
-    // reset msg_buffer to read result from socket
-    bzero(msg_buffer.get(), MSG_BUFFER_SIZE);
-    
-    //MPI_DATA_MOVEMENT
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Getting data from server";
-        std::cout.flush();
-    #endif   
-
-    //Get the updated content from the server
-    //Create the MPI data structure
-
-    //allocate memory for struct
-    struct ArgumentList argList[MAX_NUMBER_OF_ARGUMENTS];
-    MPI_Status status;
-
-    //Create the structure
-    int structSize=0;
-    int mpi_client_tag = MPI_CLIENT_TAG;
+}
 
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Waiting for Header\n";
-        std::cout.flush();
-    #endif
+int64_t SocketClient::receiveChunks(const CallFrame::ArgDescriptor *descriptors, PendingCall &call)
+{
+    // parts of the arrays in the order the server finished them, returns the time taken for execution
+    CallFrame::ChunkHeader chunk;
+    while (true) {
+        if (!CallFrame::recvFully(sockfd, &chunk, sizeof(chunk)))
+            error("ERROR, could not read from socket");
+        if (chunk.descriptor == CallFrame::END_OF_RESULT)
+            return chunk.timeDiff;
+        if (chunk.descriptor >= call.awaitedArrays.size() || chunk.offset > descriptors[chunk.descriptor].payloadSize
+                || chunk.size > descriptors[chunk.descriptor].payloadSize - chunk.offset)
+            error("ERROR, received malformed result frame");
+        if (!CallFrame::recvFully(sockfd, (char *) call.awaitedArrays[chunk.descriptor].destination + chunk.offset, chunk.size))
+            error("ERROR, could not read from socket");
+    }
+}
 
-    MPI_Recv(argList, MAX_NUMBER_OF_ARGUMENTS, ArgListType, MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-    
+void SocketClient::receiveResult(PendingCall &call)
+{
+    const llvm::Type::TypeID retType = call.retType;
+    const unsigned retTypeBitWidth = call.retTypeBitWidth;
+    void *retContainerPtr = call.retContainerPtr;
+
+    // reuse msg_buffer to read result from socket, the call frame is not needed anymore
+    msg_buffer.clear();
+    auto header = (CallFrame::Header *) msg_buffer.resize(sizeof(CallFrame::Header));
+    if (!CallFrame::recvFully(sockfd, header, sizeof(CallFrame::Header)))
+        error("ERROR, could not read from socket");
+    const bool swapBytes = CallFrame::needsByteSwap(*header);
+    if (swapBytes)
+        CallFrame::byteSwapHeader(*header);
+    if (!CallFrame::isValidHeader(*header, CallFrame::RESULT))
+        error("ERROR, received malformed result frame");
+    if (header->numArgs != call.awaitedArrays.size())
+        error("ERROR, number of arrays to update does not match");
+    if (header->chunkSize != 0U && swapBytes)
+        error("ERROR, received chunked result frame in foreign byte order");
+
+    // get descriptors of changed arrays
+    const auto resultMetadataSize = CallFrame::metadataSize(header->functionNameSize, header->numArgs);
+    if (resultMetadataSize > MSG_BUFFER_SIZE)
+        error("ERROR, result frame exceeds message buffer");
+    // behind the metadata, room for discarding the padding between arrays
+    char *metadata = msg_buffer.resize(resultMetadataSize + CallFrame::PAYLOAD_ALIGNMENT);
+    header = (CallFrame::Header *) metadata;
+    char *discarded = metadata + resultMetadataSize;
+    if (!CallFrame::recvFully(sockfd, metadata + sizeof(CallFrame::Header), resultMetadataSize - sizeof(CallFrame::Header)))
+        error("ERROR, could not read from socket");
+    auto descriptors = (CallFrame::ArgDescriptor *) (metadata + sizeof(CallFrame::Header) + header->functionNameSize);
+    if (swapBytes)
+        CallFrame::byteSwapDescriptors(descriptors, header->numArgs);
+
+    // receive changes to pointed to memory areas directly into them
     #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Header Recieved\n";
-        std::cout.flush();
+        std::cout << "DEBUG" << ": updating " << call.awaitedArrays.size() << " arguments" << (header->chunkSize != 0U ? " in chunks\n" : "\n");
     #endif
-
-    int recordCount=0;
-    MPI_Get_count(&status,ArgListType,&recordCount);
-        
-    #ifndef NDEBUG 
-        //Display recieved DS
-        for (int i=0; i<recordCount; i++) {
-            std::cout <<  "\n MPI Recieved DS : Size : " << argList[i].sizeOfArg << "  Type" << argList[i].typeofArg ;
-            std::cout.flush();
+    int i;
+    if (header->chunkSize != 0U) {
+        // parts of arrays arrive as soon as the server finished them, the time taken comes last
+        header->timeDiff = receiveChunks(descriptors, call);
+    } else {
+        std::vector<struct iovec> result;
+        uint64_t payloadPos = 0U;
+        i = 0;
+        for (const auto& array : call.awaitedArrays) {
+            const CallFrame::ArgDescriptor &descriptor = descriptors[i++];
+            if (descriptor.payloadOffset < payloadPos || descriptor.payloadOffset - payloadPos > CallFrame::PAYLOAD_ALIGNMENT)
+                error("ERROR, received malformed result frame");
+            if (descriptor.payloadOffset != payloadPos)
+                result.push_back({ discarded, descriptor.payloadOffset - payloadPos }); // discard padding
+            result.push_back({ array.destination, descriptor.payloadSize });
+            payloadPos = descriptor.payloadOffset + descriptor.payloadSize;
         }
-    #endif
-    
-    assert(pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate.size() == recordCount && "Number of arrays to update do not match");
+        if (header->payloadSize < payloadPos || header->payloadSize - payloadPos > CallFrame::PAYLOAD_ALIGNMENT)
+            error("ERROR, received malformed result frame");
+        if (header->payloadSize != payloadPos)
+            result.push_back({ discarded, header->payloadSize - payloadPos });
+        if (!CallFrame::recvScatteredFully(sockfd, result.data(), result.size()))
+            error("ERROR, could not read from socket");
+
+        if (swapBytes) { // server uses different byte order, convert arrays in place
+            i = 0;
+            for (const auto& array : call.awaitedArrays) {
+                const CallFrame::ArgDescriptor &descriptor = descriptors[i++];
+                SocketHelperFunctions::byteSwapArray(array.destination, descriptor.numElements, CallFrame::elementSize(array.typeIDWithBitwidth));
+            }
+        }
+    }
 
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Updting "<< recordCount << "arguments\n";
-        std::cout << "MPI CLIENT: Waiting for data\n";
-        std::cout.flush();
-    #endif
+    i = 0;
+    for (auto& array : call.awaitedArrays)
+        array.size = descriptors[i++].payloadSize;
 
-    for (const auto& pointerAndType : pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate) {
-        MPI_DATATYPE_ENUM mpi_dataType;
-        switch(pointerAndType.second.first) {
+    // get time measures
+    TimeDiffLastExecution = header->timeDiff;
 
-        case llvm::Type::IntegerTyID:
-            MPI_Recv(pointerAndType.first, MPI_MAX_RECV_BUFFER_SIZE, MPI_INT , MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-            break;
+    if (swapBytes && retType != llvm::Type::VoidTyID)
+        SocketHelperFunctions::byteSwapArray(header->returnValue, 1, CallFrame::elementSize(std::make_pair(retType, retTypeBitWidth)));
 
-        case llvm::Type::FloatTyID:
-            MPI_Recv(pointerAndType.first, MPI_MAX_RECV_BUFFER_SIZE, MPI_FLOAT , MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-            break;
-        case llvm::Type::DoubleTyID:
-            MPI_Recv(pointerAndType.first, MPI_MAX_RECV_BUFFER_SIZE, MPI_DOUBLE , MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-            break;
-        case llvm::Type::FP128TyID:
-        case llvm::Type::X86_FP80TyID:
-            MPI_Recv(pointerAndType.first, MPI_MAX_RECV_BUFFER_SIZE, MPI_LONG_DOUBLE , MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-            break;
-        default:
-            MPI_Recv(pointerAndType.first, MPI_MAX_RECV_BUFFER_SIZE, MPI_INT , MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-        }
-    }
-    
-    MPI_Type_free(&ArgListType);
-    
-    #ifndef NDEBUG
-        std::cout << "\nMPI CLIENT: Data from server recieved";
-        std::cout.flush();
-    #endif 
-    
-    auto UINT_MAX_str_len = std::to_string(UINT_MAX).length();
-    MPI_Recv(msg_buffer.get(), UINT_MAX_str_len + 1, MPI_CHAR, MPI_ANY_SOURCE, mpi_client_tag, server, &status);
-    
-    char* msg_buffer_ptr = msg_buffer.get();
-    
-    // get time measures
-    TimeDiffLastExecution = strtol(msg_buffer_ptr, &msg_buffer_ptr, 10);
-    msg_buffer_ptr++;
-    
-    //TODO:: Check this
-    if (pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate.size())
-        msg_buffer_ptr++;
-    
     // interpret result with typeinfo from retType
     switch (retType) {
     case llvm::Type::VoidTyID:
         std::cout << "DEBUG" << ": got void return\n";
         break;
     case llvm::Type::FloatTyID:
-        sscanf(msg_buffer_ptr, "%a", (float*)retContainerPtr);
+        memcpy(retContainerPtr, header->returnValue, sizeof(float));
+        break;
     case llvm::Type::DoubleTyID:
-        sscanf(msg_buffer_ptr, "%la", (double*)retContainerPtr);
+        memcpy(retContainerPtr, header->returnValue, sizeof(double));
         break;
     case llvm::Type::X86_FP80TyID:
     case llvm::Type::FP128TyID:
-        sscanf(msg_buffer_ptr, "%La", (long double*)retContainerPtr);
+        memcpy(retContainerPtr, header->returnValue, sizeof(long double));
         break;
     case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
         switch (retTypeBitWidth) {
         case 8:
-            sscanf(msg_buffer_ptr, "%" SCNx8, (uint8_t*)retContainerPtr);
-            break;
         case 16:
-            sscanf(msg_buffer_ptr, "%" SCNx16, (uint16_t*)retContainerPtr);
-            break;
         case 32:
-            sscanf(msg_buffer_ptr, "%" SCNx32, (uint32_t*)retContainerPtr);
-            break;
         case 64:
-            sscanf(msg_buffer_ptr, "%" SCNx64, (uint64_t*)retContainerPtr);
+            memcpy(retContainerPtr, header->returnValue, retTypeBitWidth / 8);
             break;
         default:
             error(std::string("ERROR, integer bitwidth of " + std::to_string(retTypeBitWidth) + " not supported").c_str());
@@ -646,9 +434,4 @@ void SocketClient::callAcc(const char *retTypeFuncNameArgTypes, va_list args)
     default:
         error(std::string("ERROR, LLVM TypeID " + std::to_string(retType) + " of function return value is not supported").c_str());
     }
-
-    //MPI_CONNECTION_INIT
-    // TODO: check this
-    MPI_Finalize();
-    
-}
\ No newline at end of file
+}
@@ -21,20 +21,20 @@
 //    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
 //    THE SOFTWARE.
 
-#include "mpi.h"
-
 #ifndef SOCKETCLIENT_H
 #define SOCKETCLIENT_H
 
-#include "mpi.h"
-
 #include "abstractclient.h"
 
 #include <string>
 #include <list>
+#include <vector>
 #include <cstdarg>
+#include <sys/uio.h>
 
 #include "../consts.h"
+#include "../common/messagebuffer.h"
+#include "../common/callframe.h"
 
 #include "llvm/IR/DerivedTypes.h"
 
@@ -43,24 +43,25 @@ class SocketClient : public AbstractClient
   private:
     const std::string serverName;
     unsigned int serverPort = SERVER_PORT;
+    const uint64_t chunkSize;
     int sockfd = -1;
-    std::shared_ptr<char> msg_buffer;
-
-    //MPI_CONNECTION_INIT
-    MPI_Comm server; 
-    MPI_Datatype ArgListType;
+    MessageBuffer msg_buffer;
 
     int connectToAccelerator();
     void sendIR(int sockfd, const std::string IR);
-    void marshallCall(const char *funcNameAndArgs, va_list args, char * msg, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
-    void marshallMPICall(const char *funcNameAndArgs, va_list args, char * msg, std::list<std::pair<void *, std::pair<llvm::Type::TypeID, unsigned> > > &pointersAndTypeIDWithBitwidthPointedToAwaitingUpdate);
+    void marshallCall(const char *funcNameAndArgs, va_list args, MessageBuffer &msg, std::vector<struct iovec> &frame, PendingCall &call);
+    int64_t receiveChunks(const CallFrame::ArgDescriptor *descriptors, PendingCall &call);
+
+protected:
+    virtual void sendCall(const char *funcNameAndArgs, va_list args, PendingCall &call);
+    virtual void receiveResult(PendingCall &call);
 
 public:
-    SocketClient(std::string serverName);
+    // arrays are sent interleaved in parts of chunkSize bytes, one after another if 0 (see CallFrame)
+    SocketClient(std::string serverName, uint64_t chunkSize = 0U);
     virtual ~SocketClient();
     virtual void initialiseAccelerationWithIR(const std::string &IR);
-    virtual void callAcc(const char *retTypeFuncNameArgTypes, va_list args);
-    
+
 };
 
 #endif // SOCKETCLIENT_H
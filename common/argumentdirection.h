@@ -0,0 +1,44 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef ARGUMENTDIRECTION_H
+#define ARGUMENTDIRECTION_H
+
+#include <cinttypes>
+
+// Direction in which the array behind a pointer argument has to be transferred, determined by the client from
+// the function's IR: IN arrays are only read by the function and not transferred back, INOUT arrays are transferred
+// both ways. Every array is transferred to the server: the client cannot tell whether a function writing an array
+// writes all of its elements, so there are no OUT arrays, NONE and OUT only occur while accesses are collected.
+namespace ArgumentDirection
+{
+    enum Direction : uint32_t {
+        NONE = 0, IN = 1, OUT = 2, INOUT = IN | OUT
+    };
+
+    inline bool isDownloaded(uint32_t direction) {
+        return direction & OUT;
+    }
+}
+
+#endif // ARGUMENTDIRECTION_H
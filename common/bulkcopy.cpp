@@ -0,0 +1,180 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "bulkcopy.h"
+
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+// non-temporal stores need GCC >= 4.9 (or clang) for intrinsics in functions compiled for other targets, not on k1om
+#if defined(__x86_64__) && !defined(__MIC__) && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define BULKCOPY_AVX2 1
+#include <immintrin.h>
+#if defined(__clang__) || __GNUC__ >= 5
+#define BULKCOPY_AVX512 1
+#endif
+#endif
+
+static const size_t MAX_CACHED_COPY_BYTES = 16UL << 20;  // the last level cache is shared with other cores, see below
+static const size_t PARALLEL_COPY_BYTES = 64UL << 20;   // copies are split among threads from this size on
+static const size_t BYTES_PER_THREAD = 32UL << 20;
+static const unsigned MAX_COPY_THREADS = 8U;
+
+// copies from this size on bypass the cache
+static size_t nonTemporalThreshold()
+{
+    static const size_t size = [] {
+        long llc = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+        llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+        if (llc <= 0)
+            llc = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+        // a copy can expect to own a part of the cache only, on big sockets and VMs the reported size is far larger
+        return llc > 0 ? std::min((size_t) llc / 4U * 3U, MAX_CACHED_COPY_BYTES) : MAX_CACHED_COPY_BYTES;
+    }();
+    return size;
+}
+
+#ifdef BULKCOPY_AVX2
+__attribute__((target("avx2")))
+static void streamAVX2(char *dst, const char *src, size_t bytes)
+{
+    // dst is aligned to 32 byte, bytes a multiple of 128
+    for (size_t i = 0; i < bytes; i += 128) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 32));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(src + i + 64));
+        const __m256i d = _mm256_loadu_si256((const __m256i *)(src + i + 96));
+        _mm256_stream_si256((__m256i *)(dst + i), a);
+        _mm256_stream_si256((__m256i *)(dst + i + 32), b);
+        _mm256_stream_si256((__m256i *)(dst + i + 64), c);
+        _mm256_stream_si256((__m256i *)(dst + i + 96), d);
+    }
+    _mm_sfence();
+}
+#endif
+
+#ifdef BULKCOPY_AVX512
+__attribute__((target("avx512f")))
+static void streamAVX512(char *dst, const char *src, size_t bytes)
+{
+    // dst is aligned to 64 byte, bytes a multiple of 128
+    for (size_t i = 0; i < bytes; i += 128) {
+        const __m512i a = _mm512_loadu_si512((const void *)(src + i));
+        const __m512i b = _mm512_loadu_si512((const void *)(src + i + 64));
+        _mm512_stream_si512((__m512i *)(dst + i), a);
+        _mm512_stream_si512((__m512i *)(dst + i + 64), b);
+    }
+    _mm_sfence();
+}
+#endif
+
+static void copyChunk(BulkCopy::Kernel kernel, char *dst, const char *src, size_t bytes)
+{
+    if (kernel == BulkCopy::MEMCPY || bytes < 256U) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+
+    // head up to the next 64 byte boundary of dst and tail behind the last full 128 byte block are copied normally
+    const size_t head = (64U - ((uintptr_t) dst & 63U)) & 63U;
+    const size_t body = (bytes - head) / 128U * 128U;
+    memcpy(dst, src, head);
+    switch (kernel) {
+#ifdef BULKCOPY_AVX512
+        case BulkCopy::STREAM_AVX512:
+            streamAVX512(dst + head, src + head, body);
+            break;
+#endif
+#ifdef BULKCOPY_AVX2
+        case BulkCopy::STREAM_AVX2:
+            streamAVX2(dst + head, src + head, body);
+            break;
+#endif
+        default:
+            memcpy(dst + head, src + head, body);
+    }
+    memcpy(dst + head + body, src + head + body, bytes - head - body);
+}
+
+BulkCopy::Kernel BulkCopy::streamingKernel()
+{
+    static const Kernel kernel = [] {
+#ifdef BULKCOPY_AVX2
+        __builtin_cpu_init();
+#ifdef BULKCOPY_AVX512
+        if (__builtin_cpu_supports("avx512f"))
+            return STREAM_AVX512;
+#endif
+        if (__builtin_cpu_supports("avx2"))
+            return STREAM_AVX2;
+#endif
+        return MEMCPY;
+    }();
+    return kernel;
+}
+
+const char *BulkCopy::kernelName(Kernel kernel)
+{
+    switch (kernel) {
+        case STREAM_AVX2: return "avx2-stream";
+        case STREAM_AVX512: return "avx512-stream";
+        default: return "memcpy";
+    }
+}
+
+void BulkCopy::copyWith(Kernel kernel, unsigned numThreads, void *dst, const void *src, size_t bytes)
+{
+    if (numThreads <= 1U) {
+        copyChunk(kernel, (char *) dst, (const char *) src, bytes);
+        return;
+    }
+
+    // chunks start at cache line boundaries of dst, the calling thread copies the last one
+    const size_t chunkSize = (bytes / numThreads + 63U) / 64U * 64U;
+    std::vector<std::thread> threads;
+    size_t offset = 0U;
+    for (unsigned i = 0; i + 1 < numThreads && offset + chunkSize < bytes; i++, offset += chunkSize)
+        threads.emplace_back(copyChunk, kernel, (char *) dst + offset, (const char *) src + offset, chunkSize);
+    copyChunk(kernel, (char *) dst + offset, (const char *) src + offset, bytes - offset);
+    for (auto &thread : threads)
+        thread.join();
+}
+
+void BulkCopy::copy(void *dst, const void *src, size_t bytes)
+{
+    // arrays fitting into the cache are likely used again soon, keep them there
+    if (bytes < nonTemporalThreshold()) {
+        memcpy(dst, src, bytes);
+        return;
+    }
+
+    static const unsigned numCPUs = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+    const unsigned numThreads = bytes < PARALLEL_COPY_BYTES ? 1U : std::min<size_t>(std::min(numCPUs, MAX_COPY_THREADS), bytes / BYTES_PER_THREAD);
+    copyWith(streamingKernel(), numThreads, dst, src, bytes);
+}
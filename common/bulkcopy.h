@@ -0,0 +1,47 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef BULKCOPY_H
+#define BULKCOPY_H
+
+#include <cstddef>
+
+// Copies of arrays between program memory and shared memory.
+// Small copies use memcpy, copies larger than the last level cache bypass it with non-temporal stores
+// (AVX-512 or AVX2, chosen at runtime) and very large copies are split among several threads.
+namespace BulkCopy
+{
+    enum Kernel {
+        MEMCPY, STREAM_AVX2, STREAM_AVX512
+    };
+
+    void copy(void *dst, const void *src, size_t bytes);
+
+    // best non-temporal kernel of this CPU, MEMCPY if there is none
+    Kernel streamingKernel();
+    const char *kernelName(Kernel kernel);
+    // copy with the given kernel split among numThreads threads, for benchmarks
+    void copyWith(Kernel kernel, unsigned numThreads, void *dst, const void *src, size_t bytes);
+}
+
+#endif // BULKCOPY_H
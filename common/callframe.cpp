@@ -0,0 +1,208 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "callframe.h"
+#include "sockethelperfunctions.h"
+
+#include <cstring>
+#include <cerrno>
+#include <climits>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+CallFrame::ByteOrder CallFrame::hostByteOrder()
+{
+    const uint16_t probe = 1;
+    return (*(const uint8_t *)&probe == 1) ? LITTLE_ENDIAN_ORDER : BIG_ENDIAN_ORDER;
+}
+
+void CallFrame::initHeader(Header &header, FrameKind kind, uint32_t numArgs, uint32_t functionNameSize, uint64_t payloadSize)
+{
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.kind = kind;
+    header.byteOrder = hostByteOrder();
+    header.numArgs = numArgs;
+    header.functionNameSize = functionNameSize;
+    header.payloadSize = payloadSize;
+}
+
+bool CallFrame::isValidHeader(const Header &header, FrameKind expectedKind)
+{
+    return header.magic == MAGIC && header.version == VERSION && header.kind == expectedKind;
+}
+
+void CallFrame::byteSwapHeader(Header &header)
+{
+    // byteOrder is left untouched, it still tells how the remaining frame has to be treated
+    SocketHelperFunctions::byteSwapArray(&header.magic, 1, sizeof(header.magic));
+    SocketHelperFunctions::byteSwapArray(&header.version, 1, sizeof(header.version));
+    SocketHelperFunctions::byteSwapArray(&header.kind, 1, sizeof(header.kind));
+    SocketHelperFunctions::byteSwapArray(&header.numArgs, 1, sizeof(header.numArgs));
+    SocketHelperFunctions::byteSwapArray(&header.functionNameSize, 1, sizeof(header.functionNameSize));
+    SocketHelperFunctions::byteSwapArray(&header.numReleased, 1, sizeof(header.numReleased));
+    SocketHelperFunctions::byteSwapArray(&header.payloadSize, 1, sizeof(header.payloadSize));
+    SocketHelperFunctions::byteSwapArray(&header.timeDiff, 1, sizeof(header.timeDiff));
+    SocketHelperFunctions::byteSwapArray(&header.chunkSize, 1, sizeof(header.chunkSize));
+}
+
+void CallFrame::byteSwapDescriptors(ArgDescriptor *descriptors, uint32_t numArgs)
+{
+    for (uint32_t i = 0; i < numArgs; i++) {
+        ArgDescriptor &descriptor = descriptors[i];
+        SocketHelperFunctions::byteSwapArray(&descriptor.typeID, 6, sizeof(uint32_t)); // typeID, bitwidth, pointedToTypeID, flags, direction, reserved
+        SocketHelperFunctions::byteSwapArray(&descriptor.numElements, 5, sizeof(uint64_t)); // numElements, payloadOffset, payloadSize, clientAddress, version
+
+        const size_t valueSize = elementSize(std::make_pair((llvm::Type::TypeID) descriptor.typeID, descriptor.bitwidth));
+        if (descriptor.typeID != llvm::Type::PointerTyID && valueSize > 0)
+            SocketHelperFunctions::byteSwapArray(descriptor.value, 1, valueSize);
+    }
+}
+
+void CallFrame::byteSwapReleased(Residency::BufferKey *released, uint32_t numReleased)
+{
+    SocketHelperFunctions::byteSwapArray(released, 2 * numReleased, sizeof(uint64_t)); // clientAddress, size
+}
+
+size_t CallFrame::elementSize(std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidth)
+{
+    switch (typeIDAndBitwidth.first) {
+        case llvm::Type::FloatTyID:
+            return sizeof(float);
+        case llvm::Type::DoubleTyID:
+            return sizeof(double);
+        case llvm::Type::X86_FP80TyID:
+        case llvm::Type::FP128TyID:
+            return sizeof(long double);
+        case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
+            switch (typeIDAndBitwidth.second) {
+                case 8: return sizeof(int8_t);
+                case 16: return sizeof(int16_t);
+                case 32: return sizeof(int32_t);
+                case 64: return sizeof(int64_t);
+                default: return sizeof(int);
+            }
+        default:
+            return 0;
+    }
+}
+
+std::vector<CallFrame::Chunk> CallFrame::interleave(const ArgDescriptor *descriptors, uint32_t numArgs, uint64_t chunkSize)
+{
+    std::vector<Chunk> chunks;
+    uint64_t largest = 0U;
+    for (uint32_t i = 0; i < numArgs; i++)
+        if (isTransferred(descriptors[i]))
+            largest = std::max(largest, descriptors[i].payloadSize);
+    if (largest == 0U || chunkSize == 0U)
+        return chunks;
+
+    // borders of chunks are kept at PAYLOAD_ALIGNMENT, except for the end of an array
+    const uint64_t rounds = (largest + chunkSize - 1) / chunkSize;
+    std::vector<uint64_t> sent(numArgs, 0U);
+    for (uint64_t round = 1; round <= rounds; round++) {
+        for (uint32_t i = 0; i < numArgs; i++) {
+            if (!isTransferred(descriptors[i]))
+                continue;
+            const uint64_t size = descriptors[i].payloadSize;
+            uint64_t end = round == rounds ? size : (uint64_t) ((long double) size * round / rounds) / PAYLOAD_ALIGNMENT * PAYLOAD_ALIGNMENT;
+            if (end > sent[i]) {
+                chunks.push_back({ i, sent[i], end - sent[i] });
+                sent[i] = end;
+            }
+        }
+    }
+    return chunks;
+}
+
+const char *CallFrame::padding()
+{
+    static const char zeros[PAYLOAD_ALIGNMENT] = {0};
+    return zeros;
+}
+
+bool CallFrame::sendFully(int sockfd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        ssize_t num_bytes = writev(sockfd, iov, std::min(iovcnt, IOV_MAX));
+        if (num_bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        // skip completely sent iovecs, adjust partially sent one
+        while (iovcnt > 0 && (size_t)num_bytes >= iov->iov_len) {
+            num_bytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + num_bytes;
+            iov->iov_len -= num_bytes;
+        }
+    }
+    return true;
+}
+
+bool CallFrame::recvFully(int sockfd, void *buffer, size_t length)
+{
+    struct iovec iov = { buffer, length };
+    return recvScatteredFully(sockfd, &iov, 1);
+}
+
+bool CallFrame::recvScatteredFully(int sockfd, struct iovec *iov, int iovcnt)
+{
+    while (iovcnt > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            iovcnt--;
+            continue;
+        }
+        ssize_t num_bytes = readv(sockfd, iov, std::min(iovcnt, IOV_MAX));
+        if (num_bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (num_bytes == 0) // connection closed by peer
+            return false;
+
+        while (iovcnt > 0 && (size_t)num_bytes >= iov->iov_len) {
+            num_bytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + num_bytes;
+            iov->iov_len -= num_bytes;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,152 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef CALLFRAME_H
+#define CALLFRAME_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+#include <sys/uio.h>
+
+#include "llvm/IR/DerivedTypes.h"
+
+#include "residency.h"
+
+// Binary frame used by SocketClient and SocketServer to transfer a call (and its result) in one piece:
+// [Header][function name, '\0'-terminated, padded to 8 byte][ArgDescriptor]*numArgs[BufferKey]*numReleased[padding to 64 byte][payload]
+// Every array in the payload starts at a multiple of PAYLOAD_ALIGNMENT (relative to the payload begin),
+// so arrays can be sent straight from and received straight into the memory of the caller (scatter/gather).
+// Arrays flagged Residency::RESIDENT have no payload, the server uses its copy; released BufferKeys are dropped by the server.
+// Only arrays read by the function are part of the call's payload, only arrays written by it are part of the result's payload.
+// With a chunkSize, the arrays of the payload are sent interleaved without padding (see interleave), so the server can start
+// computing before the call arrived completely; such results consist of the metadata and ChunkHeader-prefixed parts of arrays.
+// A connection starts with a MODULE frame, its payload is the module as encoded by ModuleTransfer, the server answers with
+// a READY frame once calls can be accepted, its payload holds the time taken for optimization and backend initialisation.
+namespace CallFrame
+{
+    const uint32_t MAGIC = 0x52414142; // "BAAR" in little endian
+    const uint16_t VERSION = 5;
+    const size_t PAYLOAD_ALIGNMENT = 64;
+
+    enum FrameKind : uint16_t {
+        CALL = 1, RESULT = 2, MODULE = 3, READY = 4
+    };
+
+    enum ByteOrder : uint8_t {
+        LITTLE_ENDIAN_ORDER = 1, BIG_ENDIAN_ORDER = 2
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t kind;
+        uint8_t byteOrder;
+        uint8_t reserved[3];
+        uint32_t numArgs;
+        uint32_t functionNameSize;  // including '\0' and padding
+        uint32_t numReleased;       // CALL only: number of resident arrays the server can release
+        uint64_t payloadSize;       // in bytes, including padding between arrays
+        int64_t timeDiff;           // RESULT only: time taken for execution on server in microseconds
+        uint8_t returnValue[16];    // RESULT only: return value in machine representation
+        uint64_t chunkSize;         // arrays are transferred interleaved in parts of up to this many bytes, 0 if one after another
+    };
+
+    struct ArgDescriptor {
+        uint32_t typeID;
+        uint32_t bitwidth;          // integers and pointers to integers only
+        uint32_t pointedToTypeID;   // pointers only
+        uint32_t flags;             // pointers only, Residency::Flags
+        uint32_t direction;         // pointers only, ArgumentDirection::Direction
+        uint32_t reserved;
+        uint64_t numElements;       // pointers only
+        uint64_t payloadOffset;     // pointers only, relative to payload begin
+        uint64_t payloadSize;       // pointers only, in bytes (also for arrays not contained in the payload)
+        uint64_t clientAddress;     // pointers only, identifies resident arrays together with payloadSize
+        uint64_t version;           // pointers only, version of resident arrays
+        uint8_t value[16];          // scalars only, in machine representation
+    };
+
+    // precedes every part of an array in a chunked result, the last one marks the end of the result
+    struct ChunkHeader {
+        uint32_t descriptor;        // index into the result's descriptors, END_OF_RESULT for the last one
+        uint32_t reserved;
+        uint64_t offset;            // in bytes, relative to the begin of the array
+        uint64_t size;
+        int64_t timeDiff;           // END_OF_RESULT only: time taken for execution on server in microseconds
+    };
+    const uint32_t END_OF_RESULT = UINT32_MAX;
+
+    // payload of a READY frame, in microseconds
+    struct ReadyTimes {
+        int64_t optimization;
+        int64_t initialisation;
+    };
+
+    // part of an array of a chunked call frame, in the order it is transferred
+    struct Chunk {
+        uint32_t descriptor;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    inline size_t alignUp(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+
+    // size of everything in front of the payload
+    inline size_t metadataSize(uint32_t functionNameSize, uint32_t numArgs, uint32_t numReleased = 0U) {
+        return alignUp(sizeof(Header) + functionNameSize + numArgs * sizeof(ArgDescriptor) + numReleased * sizeof(Residency::BufferKey), PAYLOAD_ALIGNMENT);
+    }
+
+    ByteOrder hostByteOrder();
+    void initHeader(Header &header, FrameKind kind, uint32_t numArgs, uint32_t functionNameSize, uint64_t payloadSize);
+    bool isValidHeader(const Header &header, FrameKind expectedKind); // only after byte order was fixed, see below
+    size_t elementSize(std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidth);
+
+    // true if the array of the descriptor is part of the call's payload
+    inline bool isTransferred(const ArgDescriptor &descriptor) {
+        return descriptor.typeID == llvm::Type::PointerTyID && descriptor.flags != Residency::RESIDENT;
+    }
+    // order of the chunks of a call's payload: in every round, each array advances by the same fraction of its size,
+    // the largest one by chunkSize bytes, so the server can start on the first rows of all arrays at once
+    std::vector<Chunk> interleave(const ArgDescriptor *descriptors, uint32_t numArgs, uint64_t chunkSize);
+
+    // frames are sent in the byte order of the sender, the receiver converts if necessary (header first, it gives the frame's layout)
+    inline bool needsByteSwap(const Header &header) {
+        return header.byteOrder != hostByteOrder();
+    }
+    void byteSwapHeader(Header &header);
+    void byteSwapDescriptors(ArgDescriptor *descriptors, uint32_t numArgs);
+    void byteSwapReleased(Residency::BufferKey *released, uint32_t numReleased);
+
+    // zero filled memory used as source of padding between arrays, at least PAYLOAD_ALIGNMENT bytes
+    const char *padding();
+
+    // send/receive exactly the given amount of data, false on error or closed connection
+    bool sendFully(int sockfd, struct iovec *iov, int iovcnt);
+    bool recvFully(int sockfd, void *buffer, size_t length);
+    bool recvScatteredFully(int sockfd, struct iovec *iov, int iovcnt);
+}
+
+#endif // CALLFRAME_H
@@ -0,0 +1,139 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "doorbell.h"
+
+#include <ctime>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// not FUTEX_PRIVATE_FLAG, the futex word is shared between processes
+static int futexWait(std::atomic<uint32_t> *word, uint32_t expected, const struct timespec *timeout)
+{
+    return syscall(SYS_futex, (uint32_t *) word, FUTEX_WAIT, expected, timeout, nullptr, 0);
+}
+
+static int futexWake(std::atomic<uint32_t> *word, int numWaiters)
+{
+    return syscall(SYS_futex, (uint32_t *) word, FUTEX_WAKE, numWaiters, nullptr, nullptr, 0);
+}
+
+void Doorbell::init()
+{
+    pending.store(0U);
+    sleeping.store(0U);
+}
+
+void Doorbell::ring()
+{
+    // sequentially consistent: either the waiter sees the ring or the ringer sees the sleeping waiter
+    pending.fetch_add(1U);
+    if (sleeping.load() != 0U)
+        futexWake(&pending, 1);
+}
+
+bool Doorbell::tryConsume()
+{
+    uint32_t current = pending.load(std::memory_order_acquire);
+    while (current != 0U)
+        if (pending.compare_exchange_weak(current, current - 1U, std::memory_order_acquire))
+            return true;
+    return false;
+}
+
+static struct timespec timeAfter(uint64_t microseconds)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    time.tv_sec += microseconds / 1000000U;
+    time.tv_nsec += (microseconds % 1000000U) * 1000U;
+    if (time.tv_nsec >= 1000000000L) {
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000L;
+    }
+    return time;
+}
+
+static bool isPast(const struct timespec &time)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > time.tv_sec || (now.tv_sec == time.tv_sec && now.tv_nsec >= time.tv_nsec);
+}
+
+// spinning only keeps the other side from running if both share the only core
+static const bool spinningUseful = sysconf(_SC_NPROCESSORS_ONLN) > 1;
+
+bool Doorbell::wait(uint64_t timeoutMicroseconds, unsigned spinMicroseconds)
+{
+    if (spinningUseful && spinMicroseconds) {
+        const struct timespec spinEnd = timeAfter(spinMicroseconds);
+        do {
+            // reading the clock is more expensive than polling
+            for (unsigned i = 0; i < 64; i++) {
+                if (tryConsume())
+                    return true;
+                cpuRelax();
+            }
+        } while (!isPast(spinEnd));
+    }
+
+    struct timespec deadline;
+    if (timeoutMicroseconds)
+        deadline = timeAfter(timeoutMicroseconds);
+
+    sleeping.fetch_add(1U);
+    bool rung;
+    while (!(rung = tryConsume())) {
+        struct timespec remaining;
+        if (timeoutMicroseconds) {
+            // FUTEX_WAIT takes a relative timeout
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            remaining.tv_sec = deadline.tv_sec - now.tv_sec;
+            remaining.tv_nsec = deadline.tv_nsec - now.tv_nsec;
+            if (remaining.tv_nsec < 0) {
+                remaining.tv_sec--;
+                remaining.tv_nsec += 1000000000L;
+            }
+            if (remaining.tv_sec < 0)
+                break;
+        }
+        // returns immediately if a ring came in since tryConsume()
+        if (futexWait(&pending, 0U, timeoutMicroseconds ? &remaining : nullptr) == -1 && errno == ETIMEDOUT) {
+            rung = tryConsume();
+            break;
+        }
+    }
+    sleeping.fetch_sub(1U);
+    return rung;
+}
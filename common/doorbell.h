@@ -0,0 +1,53 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef DOORBELL_H
+#define DOORBELL_H
+
+#include <atomic>
+#include <cinttypes>
+
+#include "../consts.h"
+
+// Notification between two processes sharing the memory the Doorbell lives in, counting like a semaphore:
+// every ring() lets exactly one wait() return. Waiting spins for a bounded time first (not on single core machines),
+// small kernels usually answer within that, and only then sleeps on a futex. Ringing only enters the kernel
+// if the other side sleeps. Must be placed in shared memory and initialised by init() before first use.
+class Doorbell
+{
+public:
+    void init();
+    void ring();
+    // false if timeoutMicroseconds (0: none) passed without ring
+    bool wait(uint64_t timeoutMicroseconds = 0U, unsigned spinMicroseconds = SHMEM_SPIN_MICROSECONDS);
+
+private:
+    std::atomic<uint32_t> pending;  // rings not consumed by wait(), futex word
+    std::atomic<uint32_t> sleeping; // waiters blocked in the kernel
+
+    bool tryConsume();
+};
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "doorbells are shared between processes, atomics have to be lock free");
+
+#endif // DOORBELL_H
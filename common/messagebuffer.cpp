@@ -0,0 +1,92 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "messagebuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+static void error(const char *msg) {
+    perror(msg);
+    exit(1);
+}
+
+MessageBuffer::MessageBuffer(size_t shrinkWatermark) : shrinkWatermark(shrinkWatermark)
+{
+}
+
+MessageBuffer::~MessageBuffer()
+{
+    release();
+}
+
+char *MessageBuffer::reserve(size_t newCapacity)
+{
+    if (newCapacity <= allocated)
+        return buffer;
+
+    // grow by at least 50% to keep the number of reallocations for growing messages low
+    newCapacity = std::max(newCapacity, allocated + allocated / 2);
+    newCapacity = (newCapacity + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+
+    void *newBuffer;
+    if (posix_memalign(&newBuffer, ALIGNMENT, newCapacity))
+        error("ERROR, could not allocate message buffer");
+    if (length)
+        memcpy(newBuffer, buffer, length);
+    free(buffer);
+
+    buffer = (char *) newBuffer;
+    allocated = newCapacity;
+    return buffer;
+}
+
+char *MessageBuffer::resize(size_t newLength)
+{
+    reserve(newLength);
+    length = newLength;
+    peakLength = std::max(peakLength, length);
+    return buffer;
+}
+
+void MessageBuffer::clear()
+{
+    if (allocated > shrinkWatermark && peakLength < allocated / 2) {
+        #ifndef NDEBUG
+            printf("DEBUG: releasing message buffer of %zu bytes, last message used %zu bytes\n", allocated, peakLength);
+        #endif
+        release();
+    }
+    length = 0U;
+    peakLength = 0U;
+}
+
+void MessageBuffer::release()
+{
+    free(buffer);
+    buffer = nullptr;
+    allocated = 0U;
+    length = 0U;
+}
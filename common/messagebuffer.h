@@ -0,0 +1,66 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef MESSAGEBUFFER_H
+#define MESSAGEBUFFER_H
+
+#include <cstddef>
+
+#include "../consts.h"
+
+// Growable buffer for messages exchanged between client and server.
+// Memory is only allocated when first needed and never cleared; the number of valid bytes is tracked instead.
+// Buffers that grew above the watermark for a single large message are released again by clear(),
+// unless the message just handled still needed most of that space.
+class MessageBuffer
+{
+public:
+    static const size_t ALIGNMENT = 64;
+
+    explicit MessageBuffer(size_t shrinkWatermark = MSG_BUFFER_SHRINK_WATERMARK);
+    ~MessageBuffer();
+    MessageBuffer(const MessageBuffer &) = delete;
+    MessageBuffer &operator=(const MessageBuffer &) = delete;
+
+    char *data() { return buffer; }
+    size_t size() const { return length; }
+    size_t capacity() const { return allocated; }
+
+    // make room for at least newCapacity bytes, the valid bytes are kept; pointers into the buffer may become invalid
+    char *reserve(size_t newCapacity);
+    // reserve and mark the first newLength bytes as valid, new bytes are not initialised
+    char *resize(size_t newLength);
+    // start a new message, releases the memory if it is larger than the watermark and was mostly unused
+    void clear();
+
+private:
+    char *buffer = nullptr;
+    size_t length = 0U;
+    size_t allocated = 0U;
+    size_t peakLength = 0U;
+    const size_t shrinkWatermark;
+
+    void release();
+};
+
+#endif // MESSAGEBUFFER_H
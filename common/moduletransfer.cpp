@@ -0,0 +1,107 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "moduletransfer.h"
+#include "sockethelperfunctions.h"
+
+#include <iostream>
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Support/Compression.h"
+#include "llvm/Support/raw_ostream.h"
+
+std::string ModuleTransfer::encode(const llvm::Module &Mod, Format format)
+{
+    std::string moduleData;
+    llvm::raw_string_ostream moduleStream(moduleData);
+    if (format == TEXT)
+        moduleStream << Mod; // human readable IR
+    else
+        llvm::WriteBitcodeToFile(&Mod, moduleStream);
+    moduleStream.flush();
+
+    Header header = { MAGIC, format, moduleData.size(), moduleData.size() };
+    llvm::OwningPtr<llvm::MemoryBuffer> compressed;
+    if (format == COMPRESSED_BITCODE) {
+        if (llvm::zlib::isAvailable() && llvm::zlib::compress(moduleData, compressed, llvm::zlib::BestSpeedCompression) == llvm::zlib::StatusOK) {
+            header.size = compressed->getBufferSize();
+        } else {
+            std::cout << "WARNING: compression not available, module is sent uncompressed\n";
+            header.format = BITCODE;
+            compressed.reset();
+        }
+    }
+
+    std::string encoded;
+    encoded.reserve(sizeof(Header) + header.size + 1);
+    encoded.append((const char *) &header, sizeof(Header));
+    if (compressed)
+        encoded.append(compressed->getBufferStart(), compressed->getBufferSize());
+    else
+        encoded.append(moduleData);
+    return encoded; // '\0' behind data is provided by std::string
+}
+
+llvm::MemoryBuffer *ModuleTransfer::decode(const char *encoded, size_t encodedSize, std::string &errorMessage)
+{
+    if (encodedSize < sizeof(Header)) {
+        errorMessage = "module too short";
+        return nullptr;
+    }
+    Header header = *(const Header *) encoded;
+    if (header.magic != MAGIC) {
+        SocketHelperFunctions::byteSwapArray(&header.magic, 2, sizeof(uint32_t));
+        SocketHelperFunctions::byteSwapArray(&header.size, 2, sizeof(uint64_t));
+        if (header.magic != MAGIC) {
+            errorMessage = "unknown module encoding";
+            return nullptr;
+        }
+    }
+    if (header.size > encodedSize - sizeof(Header)) {
+        errorMessage = "module truncated";
+        return nullptr;
+    }
+
+    const llvm::StringRef moduleData(encoded + sizeof(Header), header.size);
+    switch (header.format) {
+        case TEXT:
+            // the IR parser relies on the terminating '\0'
+            if (header.size < encodedSize - sizeof(Header) && moduleData.end()[0] == '\0')
+                return llvm::MemoryBuffer::getMemBuffer(moduleData, "", true);
+            return llvm::MemoryBuffer::getMemBufferCopy(moduleData);
+        case BITCODE:
+            return llvm::MemoryBuffer::getMemBuffer(moduleData, "", false);
+        case COMPRESSED_BITCODE: {
+            llvm::OwningPtr<llvm::MemoryBuffer> uncompressed;
+            if (!llvm::zlib::isAvailable() || llvm::zlib::uncompress(moduleData, uncompressed, header.uncompressedSize) != llvm::zlib::StatusOK) {
+                errorMessage = "unable to uncompress module";
+                return nullptr;
+            }
+            return uncompressed.take();
+        }
+        default:
+            errorMessage = "unknown module format " + std::to_string(header.format);
+            return nullptr;
+    }
+}
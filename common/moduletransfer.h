@@ -0,0 +1,60 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef MODULETRANSFER_H
+#define MODULETRANSFER_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+// Encoding of the module the client exports to the server: [Header][module data]'\0'
+// The data is textual IR, bitcode or zlib compressed bitcode; bitcode is smaller and parsed considerably faster,
+// in particular for modules with large constant tables. The header is in the byte order of the sender.
+namespace ModuleTransfer
+{
+    const uint32_t MAGIC = 0x444F4D42; // "BMOD" in little endian
+
+    enum Format : uint32_t {
+        TEXT = 0, BITCODE = 1, COMPRESSED_BITCODE = 2
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t format;
+        uint64_t size;              // of the data following the header, excluding '\0'
+        uint64_t uncompressedSize;  // equals size unless compressed
+    };
+
+    // falls back to BITCODE if compression is not available
+    std::string encode(const llvm::Module &Mod, Format format);
+
+    // module data in a buffer to be parsed by llvm::ParseIR, nullptr on malformed input; encoded holds at most
+    // encodedSize bytes; uncompressed data is not copied, so encoded has to outlive the returned buffer
+    llvm::MemoryBuffer *decode(const char *encoded, size_t encodedSize, std::string &errorMessage);
+}
+
+#endif // MODULETRANSFER_H
@@ -0,0 +1,66 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef RESIDENCY_H
+#define RESIDENCY_H
+
+#include <cinttypes>
+#include <cstddef>
+
+// Arrays passed to accelerated functions can stay resident on the server between calls.
+// The client decides per array (see ResidencyTracker) and tells the server with these flags,
+// the server keeps the arrays in its BufferRegistry, identified by the client's address and the size of the array.
+namespace Residency
+{
+    enum Flags : uint32_t {
+        TRANSIENT = 0,  // array is transferred and dropped by the server after the call
+        KEEP = 1,       // array is transferred and kept by the server in the given version
+        RESIDENT = 2,   // array is unchanged since the last call, server uses its copy of the given version
+        SHARED = 3      // shared memory only: array lives in the client's SharedArena, clientAddress is its offset there
+    };
+
+    struct BufferKey {
+        uint64_t clientAddress;
+        uint64_t size;          // in bytes
+
+        bool operator==(const BufferKey &other) const {
+            return clientAddress == other.clientAddress && size == other.size;
+        }
+    };
+
+    struct BufferKeyHash {
+        size_t operator()(const BufferKey &key) const {
+            return key.clientAddress ^ (key.size * 0x9E3779B97F4A7C15ULL);
+        }
+    };
+
+    // shared memory transport: prefix in front of every array, no elements follow for RESIDENT and SHARED arrays
+    struct ArrayResidency {
+        uint64_t clientAddress;
+        uint64_t version;
+        uint32_t flags;
+        uint32_t direction;     // ArgumentDirection::Direction
+    };
+}
+
+#endif // RESIDENCY_H
@@ -0,0 +1,88 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef SHMEMCHANNEL_H
+#define SHMEMCHANNEL_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <atomic>
+
+#include "../consts.h"
+#include "doorbell.h"
+
+// Every shared memory client gets its own channel, a region of SHMEM_SIZE bytes created by the client:
+// [Header with one Doorbell per direction and the client's arena, padded to 64 byte][IR, calls and results]
+// Clients ask for being served by claiming a slot in the server's control region (SHMEM_NAME)
+// and posting SHMEM_SEM_NAME, the server maps the channel named in the slot and serves it in its own thread.
+// The server answers every request by setting the status of the channel and ringing toClient, a client the server
+// cannot serve is refused instead of being left waiting.
+namespace ShmemChannel
+{
+    enum SlotState : uint32_t {
+        FREE = 0,       // slot can be claimed by a client
+        CLAIMED = 1,    // client is filling in its channel name
+        REQUESTED = 2   // channel waits for the server, slot is freed as soon as the server mapped the channel
+    };
+
+    struct Slot {
+        std::atomic<uint32_t> state;
+        int32_t clientPid;
+        char channelName[64];
+    };
+
+    enum ChannelStatus : uint32_t {
+        PENDING = 0,    // server did not answer yet
+        SERVING = 1,    // module built, server waits for calls
+        BUSY = 2,       // all workers serve other clients (see -shmem-threads), channel was not taken
+        FAILED = 3      // module could not be built from the IR, channel was closed
+    };
+
+    struct ControlRegion {
+        int32_t serverPid;  // clients waiting for the server check whether it is still alive
+        Slot slots[SHMEM_CONTROL_SLOTS];
+    };
+
+    struct Header {
+        Doorbell toServer;  // rung by the client: call ready
+        Doorbell toClient;  // rung by the server: ready for calls, refused or result ready
+        std::atomic<uint32_t> status;   // set by the server before answering the request for the channel
+        char arenaName[64]; // SharedArena of the client, mapped by the server as well, empty if there is none
+        uint64_t arenaSize;
+    };
+
+    static_assert(ATOMIC_INT_LOCK_FREE == 2, "slot states are shared between processes, atomics have to be lock free");
+
+    const size_t HEADER_SIZE = (sizeof(Header) + 63) / 64 * 64;
+
+    inline Header *header(void *channel) {
+        return (Header *) channel;
+    }
+
+    // begin of the area holding IR, calls and results
+    inline void *messages(void *channel) {
+        return (char *) channel + HEADER_SIZE;
+    }
+}
+
+#endif // SHMEMCHANNEL_H
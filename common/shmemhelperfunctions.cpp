@@ -22,6 +22,8 @@
 //    THE SOFTWARE.
 
 #include "shmemhelperfunctions.h"
+#include "bulkcopy.h"
+#include "callframe.h"
 
 static void error(const char *msg) {
     perror(msg);
@@ -32,75 +34,17 @@ void ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(void *arr, int64
 {
     std::cout << "DEBUG" << ": marshalling array of type " << typeIDWithBitwidthPointedTo.first << ", size " << size << "\n";
 
+    const size_t elementSize = CallFrame::elementSize(typeIDWithBitwidthPointedTo);
+    if (elementSize == 0)
+        error(std::string("ERROR, LLVM TypeID " + std::to_string((long long)typeIDWithBitwidthPointedTo.first) + " is not supported for arrays").c_str());
+
     // marshal number of elements in array (total)
     *(int64_t *)shmempos = size;
     shmempos = (int64_t *) shmempos + 1;
 
     // marshal elements
-    switch (typeIDWithBitwidthPointedTo.first) {
-        case llvm::Type::FloatTyID:
-            for (int i = 0; i < size; i++) {
-                *(float *)shmempos = *(float*)arr;
-                shmempos = (float *) shmempos + 1;
-                arr = (float*) arr + 1;
-            }
-        case llvm::Type::DoubleTyID:
-            for (int i = 0; i < size; i++) {
-                *(double *)shmempos = *(double*)arr;
-                shmempos = (double *) shmempos + 1;
-                arr = (double*) arr + 1;
-            }
-            break;
-        case llvm::Type::X86_FP80TyID:
-        case llvm::Type::FP128TyID:
-            for (int i = 0; i < size; i++) {
-                *(long double *)shmempos = *(long double*)arr;
-                shmempos = (long double *) shmempos + 1;
-                arr = (long double*) arr + 1;
-            }
-            break;
-        case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
-            switch (typeIDWithBitwidthPointedTo.second) {
-                case 8:
-                    for (int i = 0; i < size; i++) {
-                        *(int8_t *)shmempos = *(int8_t*)arr;
-                        shmempos = (int8_t *) shmempos + 1;
-                        arr = (int8_t*) arr + 1;
-                    }
-                    break;
-                case 16:
-                    for (int i = 0; i < size; i++) {
-                        *(int16_t *)shmempos = *(int16_t*)arr;
-                        shmempos = (int16_t *) shmempos + 1;
-                        arr = (int16_t*) arr + 1;
-                    }
-                    break;
-                case 32:
-                    for (int i = 0; i < size; i++) {
-                        *(int32_t *)shmempos = *(int32_t*)arr;
-                        shmempos = (int32_t *) shmempos + 1;
-                        arr = (int32_t*) arr + 1;
-                    }
-                    break;
-                case 64:
-                    for (int i = 0; i < size; i++) {
-                        *(int64_t *)shmempos = *(int64_t*)arr;
-                        shmempos = (int64_t *) shmempos + 1;
-                        arr = (int64_t*) arr + 1;
-                    }
-                    break;
-                default:
-                    for (int i = 0; i < size; i++) {
-                        *(int *)shmempos = *(int*)arr;
-                        shmempos = (int *) shmempos + 1;
-                        arr = (int*) arr + 1;
-                    }
-                    break;
-            }
-            break;
-        default:
-            error(std::string("ERROR, LLVM TypeID " + std::to_string((long long)typeIDWithBitwidthPointedTo.first) + " is not supported for arrays").c_str());
-    }
+    BulkCopy::copy(shmempos, arr, size * elementSize);
+    shmempos = (char *) shmempos + size * elementSize;
 }
 
 
@@ -109,65 +53,14 @@ void ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoExistingMemory(void
     int64_t arraySize = *(int64_t *)shmempos;
     shmempos = (int64_t *) shmempos + 1;
 
-    switch (typeIDAndBitwidthPointedTo.first) {
-    case llvm::Type::FloatTyID:
-        for (int i = 0; i != arraySize; i++) {
-            ((float*)pointerToMemory)[i] = *(float *)shmempos;
-            shmempos = (float *) shmempos + 1;
-        }
-        break;
-    case llvm::Type::DoubleTyID:
-        for (int i = 0; i != arraySize; i++) {
-            ((double*)pointerToMemory)[i] = *(double *)shmempos;
-            shmempos = (double *) shmempos + 1;
-        }
-        break;
-    case llvm::Type::X86_FP80TyID:
-    case llvm::Type::FP128TyID:
-        for (int i = 0; i != arraySize; i++) {
-            ((long double*)pointerToMemory)[i] = *(long double *)shmempos;
-            shmempos = (long double *) shmempos + 1;
-        }
-        break;
-    case llvm::Type::IntegerTyID:
-        switch(typeIDAndBitwidthPointedTo.second) {
-        case 8:
-            for (int i = 0; i != arraySize; i++) {
-                ((int8_t*)pointerToMemory)[i] = *(int8_t *)shmempos;
-                shmempos = (int8_t *) shmempos + 1;
-            }
-            break;
-        case 16:
-            for (int i = 0; i != arraySize; i++) {
-                ((int16_t*)pointerToMemory)[i] = *(int16_t *)shmempos;
-                shmempos = (int16_t *) shmempos + 1;
-            }
-            break;
-        case 32:
-            for (int i = 0; i != arraySize; i++) {
-                ((int32_t*)pointerToMemory)[i] = *(int32_t *)shmempos;
-                shmempos = (int32_t *) shmempos + 1;
-            }
-            break;
-        case 64:
-            for (int i = 0; i != arraySize; i++) {
-                ((int64_t*)pointerToMemory)[i] = *(int64_t *)shmempos;
-                shmempos = (int64_t *) shmempos + 1;
-            }
-            break;
-        default:
-            for (int i = 0; i != arraySize; i++) {
-                ((int*)pointerToMemory)[i] = *(int *)shmempos;
-                shmempos = (int *) shmempos + 1;
-            }
-        }
-        break;
-    default:
+    const size_t elementSize = CallFrame::elementSize(typeIDAndBitwidthPointedTo);
+    if (elementSize == 0) {
         std::cerr << "LLVM TypeID " << typeIDAndBitwidthPointedTo.first << " is not supported as array element.\n";
         exit(1);
     }
 
-    return;
+    BulkCopy::copy(pointerToMemory, shmempos, arraySize * elementSize);
+    shmempos = (char *) shmempos + arraySize * elementSize;
 }
 
 
@@ -176,46 +69,19 @@ void *ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoNewMemory(void *&s
     int64_t arraySize = *(int64_t *)shmempos;
     auto pointedToTypeID = typePointedTo->getTypeID();
 
-    unsigned pointedToBitwidth;
+    unsigned pointedToBitwidth = 0U;
     if (pointedToTypeID == llvm::Type::IntegerTyID)
         pointedToBitwidth = llvm::cast<llvm::IntegerType>(typePointedTo)->getBitWidth();
 
-    void* array;
-    switch (pointedToTypeID) {
-    case llvm::Type::FloatTyID:
-        array = malloc(arraySize*sizeof(float));
-        break;
-    case llvm::Type::DoubleTyID:
-        array = malloc(arraySize*sizeof(double));
-        break;
-    case llvm::Type::X86_FP80TyID:
-    case llvm::Type::FP128TyID:
-        array = malloc(arraySize*sizeof(long double));
-        break;
-    case llvm::Type::IntegerTyID:
-        switch(pointedToBitwidth) {
-        case 8:
-            array = malloc(arraySize*sizeof(int8_t));
-            break;
-        case 16:
-            array = malloc(arraySize*sizeof(int16_t));
-            break;
-        case 32:
-            array = malloc(arraySize*sizeof(int32_t));
-            break;
-        case 64:
-            array = malloc(arraySize*sizeof(int64_t));
-            break;
-        default:
-            array = malloc(arraySize*sizeof(int));
-        }
-        break;
-    default:
+    const auto typeIDAndBitwidth = std::pair<llvm::Type::TypeID, unsigned>(pointedToTypeID, pointedToBitwidth);
+    const size_t elementSize = CallFrame::elementSize(typeIDAndBitwidth);
+    if (elementSize == 0) {
         std::cerr << "LLVM TypeID " << pointedToTypeID << " is not supported as array element.\n";
         exit(1);
     }
+    void* array = malloc(arraySize * elementSize);
 
-    unmarshalArrayFromMemoryAsTypeIntoExistingMemory(shmempos, std::pair<llvm::Type::TypeID, unsigned>(pointedToTypeID, pointedToBitwidth), array);
+    unmarshalArrayFromMemoryAsTypeIntoExistingMemory(shmempos, typeIDAndBitwidth, array);
 
     return array;
 }
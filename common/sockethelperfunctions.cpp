@@ -23,218 +23,50 @@
 
 #include "sockethelperfunctions.h"
 
-static void error(const char *msg) {
-    perror(msg);
-    exit(1);
-}
-
-void SocketHelperFunctions::marshallArrayOfSizeAndTypeIntoBuffer(void* arr, uint64_t size, std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidthPointedTo, char* outputBuffer) {
-    std::cout << "DEBUG" << ": marshalling array of type " << typeIDAndBitwidthPointedTo.first << ((typeIDAndBitwidthPointedTo.second) ? ":" + std::to_string((unsigned long long)typeIDAndBitwidthPointedTo.second) : "") << ", size " << size << std::endl;
-    unsigned arrayStrLen = 0U;
-    std::shared_ptr<char> arrayStr((char*)calloc(MAX_ARR_SIZE, sizeof(char)), &free);
-    char max_element[100];
-    sprintf(max_element, ";%La", std::numeric_limits<long double>::max());
-    const auto max_element_size = strlen(max_element) + 1;
-
-    // marshal number of elements in array (total)
-    arrayStrLen += sprintf(arrayStr.get(), ":%" PRIu64, size);
-
-    // marshal elements
-    switch (typeIDAndBitwidthPointedTo.first) {
-        case llvm::Type::FloatTyID:
-            for (uint64_t i = 0; i < size; i++) {
-                if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                    arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%la", *((float*)arr));
-                else
-                    error("ERROR, array in marshalled form is bigger than array buffer");
-                arr = (float*)arr + 1;
-            }
-        case llvm::Type::DoubleTyID:
-            for (uint64_t i = 0; i < size; i++) {
-                if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                    arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%la", *((double*)arr));
-                else
-                    error("ERROR, array in marshalled form is bigger than array buffer");
-                arr = (double*)arr + 1;
-            }
-            break;
-        case llvm::Type::X86_FP80TyID:
-        case llvm::Type::FP128TyID:
-            for (uint64_t i = 0; i < size; i++) {
-                if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                    arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%La", *((long double*)arr));
-                else
-                    error("ERROR, array in marshalled form is bigger than array buffer");
-                arr = (long double*)arr + 1;
-            }
-            break;
-        case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
-            switch (typeIDAndBitwidthPointedTo.second) {
-                case 8:
-                    for (uint64_t i = 0; i < size; i++) {
-                        if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                            arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%" PRIx8, *((int8_t*)arr));
-                        else
-                            error("ERROR, array in marshalled form is bigger than array buffer");
-                        arr = (int8_t*) arr + 1;
-                    }
-                    break;
-                case 16:
-                    for (uint64_t i = 0; i < size; i++) {
-                        if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                            arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%" PRIx16, *((int16_t*)arr));
-                        else
-                            error("ERROR, array in marshalled form is bigger than array buffer");
-                        arr = (int16_t*) arr + 1;
-                    }
-                    break;
-                case 32:
-                    for (uint64_t i = 0; i < size; i++) {
-                        if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                            arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%" PRIx32, *((int32_t*)arr));
-                        else
-                            error("ERROR, array in marshalled form is bigger than array buffer");
-                        arr = (int32_t*) arr + 1;
-                    }
-                    break;
-                case 64:
-                    for (uint64_t i = 0; i < size; i++) {
-                        if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                            arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%" PRIx64, *((int64_t*)arr));
-                        else
-                            error("ERROR, array in marshalled form is bigger than array buffer");
-                        arr = (int64_t*) arr + 1;
-                    }
-                    break;
-                default:
-                    for (uint64_t i = 0; i < size; i++) {
-                        if (arrayStrLen < MAX_ARR_SIZE - max_element_size)
-                            arrayStrLen += sprintf(arrayStr.get() + arrayStrLen, ";%x", *((int*)arr));
-                        else
-                            error("ERROR, array in marshalled form is bigger than array buffer");
-                        arr = (int*) arr + 1;
-                    }
-                    break;
-            }
-            break;
-        default:
-            error(std::string("ERROR, LLVM TypeID " + std::to_string((long long)typeIDAndBitwidthPointedTo.first) + " is not supported for arrays").c_str());
-    }
-    strcat(outputBuffer, arrayStr.get());
-}
+#include <algorithm>
 
-void SocketHelperFunctions::unmarshalArrayFromBufferAsTypeIntoExistingMemory(char *&buffer, std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidthPointedTo, void* pointerToMemory) {
-    int64_t numberOfElements = strtoll(buffer, &buffer, 10);
-    buffer++;
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
 
-    switch (typeIDAndBitwidthPointedTo.first) {
-    case llvm::Type::FloatTyID:
-        for (int i = 0; i != numberOfElements; i++) {
-            ((float*)pointerToMemory)[i] = strtod(buffer, &buffer);
-            buffer++;
-        }
-        break;
-    case llvm::Type::DoubleTyID:
-        for (int i = 0; i != numberOfElements; i++) {
-            ((double*)pointerToMemory)[i] = strtod(buffer, &buffer);
-            buffer++;
-        }
-        break;
-    case llvm::Type::X86_FP80TyID:
-    case llvm::Type::FP128TyID:
-        for (int i = 0; i != numberOfElements; i++) {
-            ((long double*)pointerToMemory)[i] = strtold(buffer, &buffer);
-            buffer++;
-        }
-        break;
-    case llvm::Type::IntegerTyID:
-        switch(typeIDAndBitwidthPointedTo.second) {
-        case 8:
-            for (int i = 0; i != numberOfElements; i++) {
-                ((int8_t*)pointerToMemory)[i] = strtol(buffer, &buffer, 16);
-                buffer++;
-            }
-            break;
-        case 16:
-            for (int i = 0; i != numberOfElements; i++) {
-                ((int16_t*)pointerToMemory)[i] = strtol(buffer, &buffer, 16);
-                buffer++;
-            }
-            break;
-        case 32:
-            for (int i = 0; i != numberOfElements; i++) {
-                ((int32_t*)pointerToMemory)[i] = strtol(buffer, &buffer, 16);
-                buffer++;
-            }
-            break;
-        case 64:
-            for (int i = 0; i != numberOfElements; i++) {
-                ((int64_t*)pointerToMemory)[i] = strtoll(buffer, &buffer, 16);
-                buffer++;
-            }
-            break;
-        default:
-            for (int i = 0; i != numberOfElements; i++) {
-                ((int*)pointerToMemory)[i] = strtol(buffer, &buffer, 16);
-                buffer++;
-            }
+void SocketHelperFunctions::byteSwapArray(void *arr, uint64_t size, size_t elementSize)
+{
+    uint64_t i = 0;
+#ifdef __SSSE3__
+    if (elementSize == 2 || elementSize == 4 || elementSize == 8) {
+        // swap 16 bytes at once with one byte shuffle
+        alignas(16) uint8_t shuffle[16];
+        for (unsigned k = 0; k < 16; k++)
+            shuffle[k] = (k / elementSize) * elementSize + (elementSize - 1 - k % elementSize);
+        const __m128i mask = _mm_load_si128((const __m128i *) shuffle);
+
+        const uint64_t vectorizedBytes = (size * elementSize) & ~(uint64_t)15;
+        for (uint64_t pos = 0; pos < vectorizedBytes; pos += 16) {
+            __m128i *chunk = (__m128i *)((char *) arr + pos);
+            _mm_storeu_si128(chunk, _mm_shuffle_epi8(_mm_loadu_si128(chunk), mask));
         }
-        break;
-    default:
-        std::cerr << "LLVM TypeID " << typeIDAndBitwidthPointedTo.first << " is not supported as array element.\n";
-        exit(1);
+        i = vectorizedBytes / elementSize;
     }
-    buffer--;
+#endif
 
-    return;
-}
-
-
-void *SocketHelperFunctions::unmarshalArrayFromBufferAsTypeIntoNewMemory(char *&buffer, llvm::Type *typePointedTo)
-{
-    int64_t arraySize = strtoll(buffer, nullptr, 10);
-    auto pointedToTypeID = typePointedTo->getTypeID();
-
-    unsigned pointedToTypeBitwidth;
-    if (pointedToTypeID == llvm::Type::IntegerTyID)
-        pointedToTypeBitwidth = llvm::cast<llvm::IntegerType>(typePointedTo)->getBitWidth();
-
-    void* array;
-    switch (pointedToTypeID) {
-    case llvm::Type::FloatTyID:
-        array = malloc(arraySize*sizeof(float));
-        break;
-    case llvm::Type::DoubleTyID:
-        array = malloc(arraySize*sizeof(double));
-        break;
-    case llvm::Type::X86_FP80TyID:
-    case llvm::Type::FP128TyID:
-        array = malloc(arraySize*sizeof(long double));
-        break;
-    case llvm::Type::IntegerTyID:
-        switch(pointedToTypeBitwidth) {
-        case 8:
-            array = malloc(arraySize*sizeof(int8_t));
+    // remaining elements
+    switch (elementSize) {
+        case 1:
             break;
-        case 16:
-            array = malloc(arraySize*sizeof(int16_t));
+        case 2:
+            for (; i < size; i++)
+                ((uint16_t *) arr)[i] = __builtin_bswap16(((uint16_t *) arr)[i]);
             break;
-        case 32:
-            array = malloc(arraySize*sizeof(int32_t));
+        case 4:
+            for (; i < size; i++)
+                ((uint32_t *) arr)[i] = __builtin_bswap32(((uint32_t *) arr)[i]);
             break;
-        case 64:
-            array = malloc(arraySize*sizeof(int64_t));
+        case 8:
+            for (; i < size; i++)
+                ((uint64_t *) arr)[i] = __builtin_bswap64(((uint64_t *) arr)[i]);
             break;
         default:
-            array = malloc(arraySize*sizeof(int));
-        }
-        break;
-    default:
-        std::cerr << "LLVM TypeID " << pointedToTypeID << " is not supported as array element.\n";
-        exit(1);
+            for (; i < size; i++)
+                std::reverse((char *) arr + i * elementSize, (char *) arr + (i + 1) * elementSize);
     }
-
-    unmarshalArrayFromBufferAsTypeIntoExistingMemory(buffer, std::pair<llvm::Type::TypeID, unsigned>(pointedToTypeID, pointedToTypeBitwidth), array);
-
-    return array;
 }
@@ -31,10 +31,11 @@
 
 #include "../consts.h"
 
+// Arrays travel in call frames as they are in memory, in the machine representation of the sender (see CallFrame).
+// The receiver swaps bytes if the byte order of the sender differs from its own.
 namespace SocketHelperFunctions {
-    void marshallArrayOfSizeAndTypeIntoBuffer(void* arr, uint64_t size, std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidthPointedTo, char* outputBuffer);
-    void unmarshalArrayFromBufferAsTypeIntoExistingMemory(char *&buffer, std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidthPointedTo, void* pointerToMemory);
-    void* unmarshalArrayFromBufferAsTypeIntoNewMemory(char *&buffer, llvm::Type* typePointedTo);
+    // reverses the byte order of every element in place
+    void byteSwapArray(void* arr, uint64_t size, size_t elementSize);
 }
 
 #endif // SOCKETHELPERFUNCTIONS_H
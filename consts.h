@@ -27,18 +27,26 @@
 #include <string>
 #include <unistd.h>
 #include <climits>
+#include <cstdint>
 
 // shmem constants
-const std::string SHMEM_NAME = "/RPCAcc_shmem";
-const std::string SHMEM_SEM_NAME = "/RPCAcc_shmem_sem";
-const std::string SHMEM_FORCE_ORDER_SEM_NAME = "/RPCAcc_shmem_force_order_sem";
-const size_t SHMEM_SIZE = sysconf(_SC_PAGE_SIZE) << 17; // 512 MB on Linux 64
+const std::string SHMEM_NAME = "/RPCAcc_shmem"; // control region, clients request their channel here
+const std::string SHMEM_SEM_NAME = "/RPCAcc_shmem_sem"; // posted by clients after requesting a channel
+const std::string SHMEM_CHANNEL_PREFIX = "/RPCAcc_shmem_channel_"; // followed by the pid of the client and the number of the channel
+const std::string SHMEM_ARENA_PREFIX = "/RPCAcc_shmem_arena_"; // followed by the pid of the client
+const size_t SHMEM_SIZE = sysconf(_SC_PAGE_SIZE) << 17; // 512 MB on Linux 64, per channel
+constexpr unsigned SHMEM_CONTROL_SLOTS = 64; // clients requesting a channel at the same time
+constexpr unsigned SHMEM_SPIN_MICROSECONDS = 50; // a Doorbell is polled this long before sleeping
 
 // socket constants
 constexpr unsigned short SERVER_PORT = 55055;
-constexpr unsigned MSG_BUFFER_SIZE = UINT_MAX >> 3;
+constexpr unsigned MSG_BUFFER_SIZE = UINT_MAX >> 3; // upper limit for the metadata of a single message
+constexpr size_t MSG_BUFFER_SHRINK_WATERMARK = 64UL << 20; // message buffers larger than this are released when mostly unused
 constexpr unsigned IR_BUFFER_SIZE = UINT_MAX >> 12;
 constexpr unsigned short MAX_VAL_SIZE = USHRT_MAX;
 constexpr unsigned MAX_ARR_SIZE = UINT_MAX >> 3;
 
+// arrays kept on the server between calls, per client
+constexpr uint64_t MAX_RESIDENT_BYTES = 1ULL << 30; // 1 GB
+
 #endif // CONSTS_H
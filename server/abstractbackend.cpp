@@ -22,11 +22,12 @@
 //    THE SOFTWARE.
 
 #include "abstractbackend.h"
+#include "llvm_ffi.cpp"
 
 #include <iostream>
 #include <functional>
 
-AbstractBackend::AbstractBackend(llvm::Module*& Mod) : Module(Mod)
+AbstractBackend::AbstractBackend(llvm::Module*& Mod) : Module(Mod), dataLayout(new llvm::DataLayout(Mod))
 {
 
 }
@@ -56,6 +57,30 @@ llvm::Function *AbstractBackend::parseMarshalledCallToFunction(const char *marsh
     return calledFunction;
 }
 
+llvm::GenericValue AbstractBackend::callNative(void *code, llvm::Function *F, const std::vector<llvm::GenericValue> &ArgValues) const
+{
+    llvm::GenericValue ret;
+    if (!ffiInvoke((RawFunc) code, F, ArgValues, dataLayout.get(), ret))
+        std::cout << "ERROR: " << "Could not call " << F->getName().str() << " through libffi." << std::endl;
+    return ret;
+}
+
+void AbstractBackend::setPipelinePlans(std::unordered_map<llvm::Function *, baar::PipelinePlan> &&plans)
+{
+    pipelinePlans = std::move(plans);
+}
+
+const baar::PipelinePlan *AbstractBackend::getPipelinePlan(llvm::Function *F) const
+{
+    auto plan = pipelinePlans.find(F);
+    return plan == pipelinePlans.end() ? nullptr : &plan->second;
+}
+
+const baar::PipelinePlan *AbstractBackend::getPipelinePlan(const char *marshalledCall) const
+{
+    return getPipelinePlan(Module->getFunction(parseFunctionName(marshalledCall)));
+}
+
 std::string AbstractBackend::parseFunctionName(const char *marshalledCall)
 {
     char calledFunctionName[128];
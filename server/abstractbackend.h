@@ -29,8 +29,11 @@
 #include <functional>
 
 #include "llvm/IR/Module.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 
+#include "pipelineplanner.h"
+
 class AbstractBackend
 {
 public:
@@ -38,11 +41,21 @@ public:
     virtual ~AbstractBackend();
     llvm::Function* parseMarshalledCallToFunction(const char *marshalledCall);
     virtual llvm::GenericValue callEngine(llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues) = 0;
-private:
+    // machine code of F, which (unlike callEngine) may be called from several threads at once; nullptr if there is none
+    // (interpreter), to be asked by one thread at a time like callEngine
+    virtual void *getNativeFunction(llvm::Function *F) { return nullptr; }
+    virtual llvm::GenericValue callNative(void *code, llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues) const;
+    // functions of the module which can be run in tiles, their tile functions have to be part of the module the backend got
+    void setPipelinePlans(std::unordered_map<llvm::Function *, baar::PipelinePlan> &&plans);
+    const baar::PipelinePlan *getPipelinePlan(llvm::Function *F) const;
+    const baar::PipelinePlan *getPipelinePlan(const char *marshalledCall) const;
     static std::string parseFunctionName(const char *marshalledCall);
+private:
     std::unordered_map<std::string, llvm::Function *> calledFunction_map;
+    std::unordered_map<llvm::Function *, baar::PipelinePlan> pipelinePlans;
 protected:
     std::unique_ptr<llvm::Module> Module;
+    std::unique_ptr<llvm::DataLayout> dataLayout;
 };
 
 #endif // ABSTRACTBACKEND_H
@@ -26,17 +26,24 @@
 #include <iostream>
 #include <functional>
 #include <chrono>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
 
 #include "polly/LinkAllPasses.h"
 
 // Note: LLVM 3.3+ is assumed (released 17th June 2013 or later)
 #include "llvm/IRReader/IRReader.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/CallSite.h"
 #include "llvm/Analysis/Verifier.h"
 #include "llvm/Analysis/AliasAnalysis.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/SourceMgr.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/Support/PassNameParser.h"
 #include "llvm/Pass.h"
 #include "llvm/Transforms/IPO/PassManagerBuilder.h"
@@ -46,18 +53,95 @@
 #include "llvm/MC/SubtargetFeature.h"
 #include "llvm/Target/TargetMachine.h"
 #include "llvm/Target/TargetLibraryInfo.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Config/llvm-config.h"
 
 #include "jitbackend.h"
 #include "interpreterbackend.h"
 #include "extcompilerbackend.h"
 
+#include "../common/moduletransfer.h"
+
 llvm::cl::opt<bool> DisableVectorization("disable-vectorization", llvm::cl::desc("Disable vectorization passes during optimization"), llvm::cl::init(false));
 llvm::cl::opt<bool> DisablePolly("disable-polly", llvm::cl::desc("Disable Polly passes during optimization"), llvm::cl::init(false));
+llvm::cl::opt<std::string> OptimizationProfiles("opt-profile", llvm::cl::desc("How Polly schedules functions: auto (by the shape of their loops), none (Polly's schedule), tile, stencil or gemm; function=profile,... for single functions"), llvm::cl::init("auto"));
+llvm::cl::opt<bool> EnableParallel("parallel", llvm::cl::desc("Let Polly generate OpenMP parallel loops for parallel outer dimensions, run by -kernel-threads threads"), llvm::cl::init(false));
 llvm::cl::opt<bool> DumpOptOut("dump-opt-out", llvm::cl::desc("Dump optimized Module to console"), llvm::cl::init(false));
-
-AbstractServer::AbstractServer(backendTypes backendType) : backendType(backendType)
+llvm::cl::opt<bool> DisablePipelining("disable-pipelining", llvm::cl::desc("Do not start functions before their arrays arrived completely (socket only)"), llvm::cl::init(false));
+llvm::cl::opt<bool> Autotune("autotune", llvm::cl::desc("Build variants of every module (without Polly or vectorization, other tile sizes and vector widths) and keep the fastest one for each function"), llvm::cl::init(false));
+llvm::cl::opt<unsigned> AutotuneRuns("autotune-runs", llvm::cl::desc("Calls of a function timed on every variant before the fastest one is kept"), llvm::cl::init(3));
+llvm::cl::opt<unsigned> MaxSharedBackends("max-shared-backends", llvm::cl::desc("Number of compiled modules kept for clients to come after their last client disconnected"), llvm::cl::init(16));
+llvm::cl::opt<unsigned> KernelThreads("kernel-threads", llvm::cl::desc("Number of cores kernels are split across, defaults to the number of cores, 1 to run kernels in one piece"), llvm::cl::init(0));
+llvm::cl::opt<unsigned> MinTaskSize("min-task-size", llvm::cl::desc("Bytes (in KB) of the largest array a part of a split kernel uses at least"), llvm::cl::init(64));
+llvm::cl::opt<std::string> ModuleCacheDir("module-cache-dir", llvm::cl::desc("Directory optimized modules and generated libraries are cached in across server runs, empty for caching in memory only"), llvm::cl::init(".baar_module_cache"));
+
+// change whenever the optimization pipeline or the code generation changes, invalidates cached modules
+static const unsigned MODULE_CACHE_FORMAT = 4;
+
+thread_local std::chrono::microseconds AbstractServer::TimeDiffOpt;
+thread_local std::chrono::microseconds AbstractServer::TimeDiffInit;
+thread_local std::chrono::microseconds AbstractServer::TimeDiffLastExecution;
+thread_local BufferRegistry AbstractServer::bufferRegistry;
+thread_local std::vector<uint64_t> AbstractServer::argumentSizes;
+
+AbstractServer::AbstractServer(backendTypes backendType) : backendType(backendType), moduleCache(ModuleCacheDir), tuningDatabase(ModuleCacheDir.empty() ? "" : ModuleCacheDir + "/tuning.db")
 {    
     LLVMInitializeNativeTarget();
+
+    const unsigned numKernelThreads = KernelThreads ? KernelThreads : std::thread::hardware_concurrency();
+    if (EnableParallel)
+        enableParallelCodeGeneration(numKernelThreads);
+    // with OpenMP loops the cores are taken by the OpenMP threads already, kernels are not split on top of that
+    if (numKernelThreads > 1 && !parallelCodeGeneration)
+        scheduler.reset(new WorkStealingScheduler(numKernelThreads - 1)); // threads running calls take part as well
+
+    if (!baar::ProfileSelection::parse(OptimizationProfiles, profileSelection)) {
+        std::cerr << "ERROR, " << "invalid -opt-profile " << OptimizationProfiles << std::endl;
+        exit(1);
+    }
+    if (!DisablePolly && profileSelection.reschedules()) {
+        caches = baar::CacheHierarchy::ofHost();
+        std::cout << "INFO: " << "tiles are sized for caches of " << caches.l1 / 1024 << "K (L1), " << caches.l2 / 1024 << "K (L2) with lines of " << caches.lineSize << " bytes\n";
+    }
+}
+
+// options of LLVM and Polly the server sets while running, nullptr if the linked version does not have it
+static llvm::cl::Option *findRegisteredOption(const std::string &name)
+{
+    llvm::StringMap<llvm::cl::Option *> options;
+    llvm::cl::getRegisteredOptions(options);
+    auto option = options.find(name);
+    return option == options.end() ? nullptr : option->second;
+}
+
+void AbstractServer::enableParallelCodeGeneration(unsigned numThreads)
+{
+    if (DisablePolly) {
+        std::cout << "WARNING: " << "-parallel has no effect together with -disable-polly\n";
+        return;
+    }
+
+    // Polly's parallel loops call into libgomp, which takes its number of threads from the environment when it is loaded;
+    // the JIT and generated libraries find it among the libraries of the server
+    setenv("OMP_NUM_THREADS", std::to_string(numThreads).c_str(), 0);
+    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+    std::string errorMessage;
+    if (llvm::sys::DynamicLibrary::SearchForAddressOfSymbol("GOMP_parallel_loop_runtime_start") == nullptr
+            && llvm::sys::DynamicLibrary::LoadLibraryPermanently("libgomp.so.1", &errorMessage)) {
+        std::cout << "WARNING: " << "no OpenMP runtime for parallel loops (" << errorMessage << "), loops stay sequential\n";
+        return;
+    }
+
+    // the option belongs to Polly's code generation, it is the same for all modules of the server
+    llvm::cl::Option *openMP = findRegisteredOption("enable-polly-openmp");
+    if (openMP == nullptr || openMP->addOccurrence(0, "enable-polly-openmp", "true")) {
+        std::cout << "WARNING: " << "Polly cannot generate OpenMP code, loops stay sequential\n";
+        return;
+    }
+    parallelCodeGeneration = true;
+    std::cout << "INFO: " << "parallel loops are run by " << getenv("OMP_NUM_THREADS") << " OpenMP threads\n";
 }
 
 AbstractServer::~AbstractServer()
@@ -74,32 +158,261 @@ void AbstractServer::start()
 void AbstractServer::end()
 {
     cleanupCommunication();
+
+    if (scheduler) {
+        const WorkStealingScheduler::Statistics statistics = scheduler->getStatistics();
+        std::cout << "INFO: " << statistics.executed << " kernel parts run by " << scheduler->getNumWorkers() << " workers, "
+                  << statistics.stolen << " of them stolen\n";
+        scheduler.reset();
+    }
+}
+
+std::unique_ptr<Autotuner> AbstractServer::parseIRtoVariants(const char *module, size_t moduleSize, llvm::LLVMContext &Context)
+{
+    std::vector<OptimizationVariant> variants(1, getDefaultVariant());
+    std::unordered_map<std::string, std::string> functionKeys;
+    if (Autotune) {
+        // if all functions were tuned before, only their variants are built
+        functionKeys = getFunctionKeys(module, moduleSize, Context);
+        const std::vector<OptimizationVariant> candidates = getTuningVariants();
+        std::vector<OptimizationVariant> tuned;
+        bool allTuned = true, keepsState = false;
+        for (const auto &functionAndKey : functionKeys) {
+            if (functionAndKey.second.empty()) { // not tuned, runs on the default variant (see getFunctionKeys)
+                keepsState = true;
+                continue;
+            }
+            std::string name;
+            auto candidate = candidates.end();
+            if (tuningDatabase.lookup(functionAndKey.second, name))
+                candidate = std::find_if(candidates.begin(), candidates.end(), [&](const OptimizationVariant &variant) { return variant.name == name; });
+            if (candidate == candidates.end()) {
+                allTuned = false;
+                break;
+            }
+            if (std::none_of(tuned.begin(), tuned.end(), [&](const OptimizationVariant &variant) { return variant.name == name; }))
+                tuned.push_back(*candidate);
+        }
+        // the Autotuner runs functions which are not tuned on the first variant
+        const OptimizationVariant base = getDefaultVariant();
+        if (allTuned && keepsState) {
+            tuned.erase(std::remove_if(tuned.begin(), tuned.end(), [&](const OptimizationVariant &variant) { return variant.name == base.name; }), tuned.end());
+            tuned.insert(tuned.begin(), base);
+        }
+        variants = allTuned && !tuned.empty() ? tuned : candidates;
+    }
+
+    std::vector<Autotuner::Variant> backends;
+    std::chrono::microseconds optimization(0), initialisation(0);
+    for (const OptimizationVariant &variant : variants) {
+        if (variants.size() > 1)
+            std::cout << "INFO: " << "building variant " << variant.name << " of module\n";
+        backends.push_back({ variant.name, parseIRtoBackend(module, moduleSize, variant, Context) });
+        if (!backends.back().backend)
+            return nullptr;
+        optimization += TimeDiffOpt;
+        initialisation += TimeDiffInit;
+    }
+    TimeDiffOpt = optimization;
+    TimeDiffInit = initialisation;
+    return std::unique_ptr<Autotuner>(new Autotuner(std::move(backends), std::move(functionKeys), tuningDatabase, AutotuneRuns));
+}
+
+// Functions which may write global variables (or memory reachable through pointers kept in them), directly or through
+// the functions they call. Every variant has its own copy of the module's globals, such functions have to stay on one variant.
+static std::unordered_set<const llvm::Function*> getFunctionsWritingGlobals(const llvm::Module &Mod)
+{
+    std::unordered_set<const llvm::Function*> writing;
+    std::vector<const llvm::Value*> worklist;
+    for (llvm::Module::const_global_iterator GV = Mod.global_begin(), GE = Mod.global_end(); GV != GE; ++GV)
+        if (!GV->isConstant())
+            worklist.push_back(GV);
+    std::unordered_set<const llvm::Value*> visited;
+    while (!worklist.empty()) {
+        const llvm::Value *V = worklist.back();
+        worklist.pop_back();
+        if (!visited.insert(V).second)
+            continue;
+        for (llvm::Value::const_use_iterator UI = V->use_begin(), UE = V->use_end(); UI != UE; ++UI) {
+            const llvm::User *U = *UI;
+            const llvm::Instruction *I = llvm::dyn_cast<llvm::Instruction>(U);
+            if (I == nullptr) // constant expressions, initializers of globals pointing to it
+                worklist.push_back(U);
+            else if (llvm::isa<llvm::LoadInst>(I) && !I->getType()->isPointerTy())
+                continue;
+            else if (llvm::isa<llvm::LoadInst>(I) || llvm::isa<llvm::GetElementPtrInst>(I) || llvm::isa<llvm::CastInst>(I)
+                     || llvm::isa<llvm::PHINode>(I) || llvm::isa<llvm::SelectInst>(I))
+                worklist.push_back(I); // derived or loaded pointers
+            else // stores, calls and everything else the pointer might escape into
+                writing.insert(I->getParent()->getParent());
+        }
+    }
+
+    // callers write as well, functions called indirectly are assumed to be called by every indirect call
+    std::vector<const llvm::Function*> callees(writing.begin(), writing.end());
+    bool indirectlyCalled = false;
+    while (!callees.empty()) {
+        const llvm::Function *F = callees.back();
+        callees.pop_back();
+        for (llvm::Value::const_use_iterator UI = F->use_begin(), UE = F->use_end(); UI != UE; ++UI) {
+            llvm::ImmutableCallSite CS(*UI);
+            if (!CS || !CS.isCallee(UI)) {
+                indirectlyCalled = true;
+                continue;
+            }
+            if (writing.insert(CS.getInstruction()->getParent()->getParent()).second)
+                callees.push_back(CS.getInstruction()->getParent()->getParent());
+        }
+        if (callees.empty() && indirectlyCalled) {
+            indirectlyCalled = false;
+            for (llvm::Module::const_iterator G = Mod.begin(), GE = Mod.end(); G != GE; ++G)
+                for (llvm::Function::const_iterator BB = G->begin(), BE = G->end(); BB != BE; ++BB)
+                    for (llvm::BasicBlock::const_iterator J = BB->begin(), JE = BB->end(); J != JE; ++J) {
+                        llvm::ImmutableCallSite CS(J);
+                        if (CS && CS.getCalledFunction() == nullptr && writing.insert(G).second)
+                            callees.push_back(G);
+                    }
+        }
+    }
+    return writing;
+}
+
+std::unordered_map<std::string, std::string> AbstractServer::getFunctionKeys(const char *module, size_t moduleSize, llvm::LLVMContext &Context) const
+{
+    // the unoptimized IR of a function and the target it runs on, errors are reported when the module is built
+    std::unordered_map<std::string, std::string> keys;
+    std::string errorMessage;
+    llvm::MemoryBuffer *moduleBuffer = ModuleTransfer::decode(module, moduleSize, errorMessage);
+    if (!moduleBuffer)
+        return keys;
+    llvm::SMDiagnostic Err;
+    std::unique_ptr<llvm::Module> Mod(llvm::ParseIR(moduleBuffer, Err, Context));
+    if (!Mod)
+        return keys;
+
+    const std::string target = llvm::sys::getProcessTriple() + ";" + llvm::sys::getHostCPUName().str() + ";" + MCPU + ";" + std::to_string((int) backendType);
+    const std::unordered_set<const llvm::Function*> writing = getFunctionsWritingGlobals(*Mod);
+    for (llvm::Module::iterator F = Mod->begin(), FE = Mod->end(); F != FE; ++F) {
+        if (F->isDeclaration())
+            continue;
+        if (writing.count(F)) {
+            std::cout << "INFO: \"" << F->getName().str() << "\" writes global variables, it is not tuned\n";
+            keys[F->getName().str()] = "";
+            continue;
+        }
+        std::string function;
+        llvm::raw_string_ostream functionStream(function);
+        F->print(functionStream);
+        functionStream.flush();
+        keys[F->getName().str()] = ModuleCache::key(function.data(), function.size(), target);
+    }
+    return keys;
+}
+
+AbstractServer::OptimizationVariant AbstractServer::getDefaultVariant() const
+{
+    return { "default", !DisablePolly, !DisableVectorization, 100U, 0U };
+}
+
+std::vector<AbstractServer::OptimizationVariant> AbstractServer::getTuningVariants() const
+{
+    // variants only leave out what is enabled, vector widths are those of the target's vector registers
+    const OptimizationVariant base = getDefaultVariant();
+    std::vector<OptimizationVariant> variants(1, base);
+    if (base.polly)
+        variants.push_back({ "nopolly", false, base.vectorize, 100U, 0U });
+    if (base.vectorize)
+        variants.push_back({ "novect", base.polly, false, 100U, 0U });
+    // older Polly tiles with a fixed size
+    if (base.polly && profileSelection.reschedules() && findRegisteredOption("polly-default-tile-size") != nullptr) {
+        variants.push_back({ "tiles50", true, base.vectorize, 50U, 0U });
+        variants.push_back({ "tiles200", true, base.vectorize, 200U, 0U });
+    }
+#ifdef _K1OM_
+    const unsigned vectorWidths[] = { 8U, 16U };
+#else
+    const unsigned vectorWidths[] = { 4U, 8U };
+#endif
+    if (base.vectorize)
+        for (unsigned width : vectorWidths)
+            variants.push_back({ "vw" + std::to_string(width), base.polly, true, 100U, width });
+    return variants;
 }
 
-std::unique_ptr<AbstractBackend> AbstractServer::parseIRtoBackend(const char *ir_buffer)
+std::unique_ptr<AbstractBackend> AbstractServer::parseIRtoBackend(const char *module, size_t moduleSize, const OptimizationVariant &variant, llvm::LLVMContext &Context)
 {
-    // parse received IR from buffer, create ExecutionEngine
+    // LLVM's pass and target registries are not safe for building modules concurrently
+    std::lock_guard<std::mutex> lock(moduleConstructionMutex);
+
+    std::string errorMessage;
+    llvm::MemoryBuffer *moduleBuffer = ModuleTransfer::decode(module, moduleSize, errorMessage);
+    if (!moduleBuffer) {
+        std::cout << "WARNING: " << errorMessage << std::endl;
+        return nullptr;
+    }
+
+    // clients sending the same module get the module optimized for the first one
+    const std::string cacheKey = ModuleCache::key(moduleBuffer->getBufferStart(), moduleBuffer->getBufferSize(), getCacheConfiguration(variant));
+    std::string optimizedModule;
+    const bool cached = moduleCache.lookup(cacheKey, optimizedModule);
+    if (cached) {
+        delete moduleBuffer;
+        moduleBuffer = llvm::MemoryBuffer::getMemBuffer(optimizedModule, "", false);
+    }
+
+    // parse received module (IR or bitcode, ParseIR takes care of the buffer), create ExecutionEngine
     llvm::SMDiagnostic Err;
-    llvm::Module *Mod = llvm::ParseIR(llvm::MemoryBuffer::getMemBuffer(llvm::StringRef(ir_buffer, strlen(ir_buffer))), Err, llvm::getGlobalContext());
+    llvm::Module *Mod = llvm::ParseIR(moduleBuffer, Err, Context);
     if (!Mod) {
         Err.print("acc_server", llvm::errs());
-        exit(1);
+        return nullptr;
     }
     llvm::verifyModule(*Mod, llvm::PrintMessageAction);
 
-    const auto StartTimeOpt = std::chrono::high_resolution_clock::now();
-    optimizeModule(Mod);
-    const auto EndTimeOpt = std::chrono::high_resolution_clock::now();
-    TimeDiffOpt = std::chrono::duration_cast<std::chrono::microseconds>(EndTimeOpt - StartTimeOpt);
-    std::cout << "INFO: optimization took " << TimeDiffOpt.count() << " microseconds\n";
+    if (cached) {
+        TimeDiffOpt = std::chrono::microseconds::zero();
+        std::cout << "INFO: optimized module " << cacheKey << " taken from cache\n";
+    } else {
+        const auto StartTimeOpt = std::chrono::high_resolution_clock::now();
+        optimizeModule(Mod, variant);
+        const auto EndTimeOpt = std::chrono::high_resolution_clock::now();
+        TimeDiffOpt = std::chrono::duration_cast<std::chrono::microseconds>(EndTimeOpt - StartTimeOpt);
+        std::cout << "INFO: optimization took " << TimeDiffOpt.count() << " microseconds\n";
+
+        llvm::raw_string_ostream optimizedModuleStream(optimizedModule);
+        llvm::WriteBitcodeToFile(Mod, optimizedModuleStream);
+        moduleCache.insert(cacheKey, optimizedModuleStream.str());
+    }
+
+    // functions which can start before their arrays arrived completely get a tile function, before code is generated
+    std::unordered_map<llvm::Function *, baar::PipelinePlan> pipelinePlans;
+    if (!DisablePipelining) {
+        llvm::PassManager PlanningPasses;
+        PlanningPasses.add(new llvm::DataLayout(Mod->getDataLayout()));
+        PlanningPasses.add(new baar::PipelinePlanner(pipelinePlans));
+        PlanningPasses.run(*Mod);
+        baar::PipelinePlanner::createTileFunctions(pipelinePlans);
+        llvm::verifyModule(*Mod, llvm::PrintMessageAction);
+        std::cout << "INFO: " << pipelinePlans.size() << " functions can be run in tiles while their arrays arrive\n";
+    }
 
     const auto StartTimeInit = std::chrono::high_resolution_clock::now();
     std::unique_ptr<AbstractBackend> backend;
     switch(backendType) {
-        case extcompiler: backend.reset(new ExtCompilerBackend(Mod)); break;
+        case extcompiler: {
+            // the generated library only depends on the optimized module, reuse it as well
+            std::string cachedLibraryPath;
+            const bool libraryCached = moduleCache.lookupLibrary(cacheKey, cachedLibraryPath);
+            auto extCompilerBackend = new ExtCompilerBackend(Mod, libraryCached ? cachedLibraryPath : "", parallelCodeGeneration);
+            if (!libraryCached)
+                moduleCache.insertLibrary(cacheKey, extCompilerBackend->getLibraryPath());
+            backend.reset(extCompilerBackend);
+            break;
+        }
         case jit: backend.reset(new JITBackend(Mod)); break;
         case interpret: backend.reset(new InterpreterBackend(Mod)); break;
     }
+    backend->setPipelinePlans(std::move(pipelinePlans));
     const auto EndTimeInit = std::chrono::high_resolution_clock::now();
     TimeDiffInit = std::chrono::duration_cast<std::chrono::microseconds>(EndTimeInit - StartTimeInit);
     std::cout << "INFO: Backend was initialized in " << TimeDiffInit.count() << " microseconds \n";
@@ -107,6 +420,52 @@ std::unique_ptr<AbstractBackend> AbstractServer::parseIRtoBackend(const char *ir
     return backend;
 }
 
+std::shared_ptr<AbstractServer::SharedBackend> AbstractServer::getSharedBackend(const char *module, size_t moduleSize)
+{
+    // held while building, clients sending a module being built wait for it instead of building it again
+    std::lock_guard<std::mutex> lock(sharedBackendsMutex);
+    const std::string cacheKey = ModuleCache::key(module, moduleSize, getCacheConfiguration(getDefaultVariant()));
+    auto shared = sharedBackends.find(cacheKey);
+    if (shared != sharedBackends.end()) {
+        TimeDiffOpt = std::chrono::microseconds::zero();
+        TimeDiffInit = std::chrono::microseconds::zero();
+        std::cout << "INFO: backend for module " << cacheKey << " shared with " << shared->second.use_count() - 1 << " other clients\n";
+        return shared->second;
+    }
+
+    std::shared_ptr<SharedBackend> backend(new SharedBackend);
+    backend->context.reset(new llvm::LLVMContext);
+    backend->variants = parseIRtoVariants(module, moduleSize, *backend->context);
+    if (!backend->variants) // the other clients keep being served, the module is not kept
+        return nullptr;
+
+    // backends nobody uses anymore are only kept up to a limit
+    for (auto entry = sharedBackends.begin(); entry != sharedBackends.end() && sharedBackends.size() >= MaxSharedBackends; ) {
+        if (entry->second.use_count() == 1)
+            entry = sharedBackends.erase(entry);
+        else
+            ++entry;
+    }
+    sharedBackends[cacheKey] = backend;
+    return backend;
+}
+
+std::string AbstractServer::getCacheConfiguration(const OptimizationVariant &variant) const
+{
+    // everything besides the IR the optimized module and the generated code depend on
+    std::string configuration = std::to_string(MODULE_CACHE_FORMAT) + ";" + std::to_string(LLVM_VERSION_MAJOR) + "." + std::to_string(LLVM_VERSION_MINOR) + ";"
+                              + std::to_string((int) backendType) + ";" + (variant.polly ? "polly;" : "nopolly;") + (variant.vectorize ? "vect;" : "novect;")
+                              + std::to_string(variant.tileScale) + ";" + std::to_string(variant.vectorWidth) + ";" + (DisablePipelining ? "nopipe;" : "pipe;") + (parallelCodeGeneration ? "omp;" : "seq;") + OptimizationProfiles + ";"
+                              + llvm::sys::getProcessTriple() + ";" + llvm::sys::getHostCPUName().str() + ";"
+                              + MArch + ";" + MCPU + ";";
+    for (unsigned i = 0; i != MAttrs.size(); ++i)
+        configuration += MAttrs[i] + ",";
+#ifdef _K1OM_
+    configuration += ";k1om";
+#endif
+    return configuration;
+}
+
 llvm::TargetMachine* AbstractServer::GetTargetMachine(llvm::Triple TheTriple) {
   std::string Error;
   const llvm::Target *TheTarget = llvm::TargetRegistry::lookupTarget(MArch, TheTriple, Error);
@@ -131,7 +490,7 @@ llvm::TargetMachine* AbstractServer::GetTargetMachine(llvm::Triple TheTriple) {
                                         llvm::CodeGenOpt::Aggressive);
 }
 
-void AbstractServer::optimizeModule(llvm::Module *Mod)
+void AbstractServer::optimizeModule(llvm::Module *Mod, const OptimizationVariant &variant)
 {
     llvm::PassManager AutoParVectPasses;
     TargetLibraryInfo *TLI = new llvm::TargetLibraryInfo(Triple(Mod->getTargetTriple()));
@@ -150,7 +509,7 @@ void AbstractServer::optimizeModule(llvm::Module *Mod)
     else
         std::cout << "INFO: " << "No TargetMachine detected\n";
 
-    if (!DisablePolly) {
+    if (variant.polly) {
         // polly preparation passes
         AutoParVectPasses.add(llvm::createTypeBasedAliasAnalysisPass());
         AutoParVectPasses.add(llvm::createBasicAliasAnalysisPass());
@@ -158,7 +517,11 @@ void AbstractServer::optimizeModule(llvm::Module *Mod)
         AutoParVectPasses.add(llvm::createLoopSimplifyPass());
         AutoParVectPasses.add(polly::createIndVarSimplifyPass());
 
-        // polly passes
+        // polly passes, the schedule optimizer follows the profile chosen for each function
+        if (profileSelection.reschedules()) {
+            AutoParVectPasses.add(new baar::ProfileSelector(profileSelection, caches, variant.vectorize, variant.tileScale));
+            AutoParVectPasses.add(polly::createIslScheduleOptimizerPass());
+        }
         AutoParVectPasses.add(polly::createCodeGenerationPass());
 
         // cleanup passes
@@ -167,7 +530,13 @@ void AbstractServer::optimizeModule(llvm::Module *Mod)
         AutoParVectPasses.add(llvm::createInstructionCombiningPass());
     }
 
-    if (!DisableVectorization) {
+    if (variant.vectorize) {
+        // the loop vectorizer's width is forced by some variants, 0 lets it choose
+        if (llvm::cl::Option *vectorWidth = findRegisteredOption("force-vector-width")) {
+            vectorWidth->setNumOccurrencesFlag(llvm::cl::ZeroOrMore);
+            vectorWidth->addOccurrence(0, "force-vector-width", std::to_string(variant.vectorWidth));
+        }
+
         // vectorization preparation passes
         AutoParVectPasses.add(llvm::createTypeBasedAliasAnalysisPass());
         AutoParVectPasses.add(llvm::createBasicAliasAnalysisPass());
@@ -212,8 +581,12 @@ llvm::GenericValue AbstractServer::handleCall(AbstractBackend* backend, char *ma
     calledFunction->getType()->dump();
     std::cout << "' in Engine\n";
 
+    // outer loops with independent iterations run on all idle cores
     StartTime = std::chrono::high_resolution_clock::now();
-    const llvm::GenericValue& ret = backend->callEngine(calledFunction, args);
+    llvm::GenericValue ret;
+    const baar::PipelinePlan *plan = backend->getPipelinePlan(calledFunction);
+    if (plan == nullptr || !runInParallel(backend, *plan, baar::PipelineSchedule(*plan, args, argumentSizes, 0U), args, 0U, UINT64_MAX))
+        ret = backend->callEngine(calledFunction, args);
     EndTime = std::chrono::high_resolution_clock::now();
     TimeDiffLastExecution = std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime);
     #ifndef TIMING 
@@ -226,3 +599,93 @@ llvm::GenericValue AbstractServer::handleCall(AbstractBackend* backend, char *ma
 
     return ret;
 }
+
+llvm::GenericValue AbstractServer::handleCallPipelined(AbstractBackend* backend, char *marshalledCall, llvm::Function *&calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs,
+                                                       const std::vector<uint64_t> &arraySizes, uint64_t chunkSize, ArrivalTracker &arrivals, std::mutex &engineMutex, const std::function<void(std::vector<llvm::GenericValue>::size_type, uint64_t)> &publish)
+{
+    calledFunction = backend->parseMarshalledCallToFunction(marshalledCall);
+    const baar::PipelinePlan *plan = backend->getPipelinePlan(calledFunction);
+    assert(plan != nullptr && "Function cannot be run in tiles");
+
+    // arrays still arrive, only their pointers are needed so far
+    unmarshalCallArgs(marshalledCall, calledFunction->getName().size(), calledFunction, args, indexesOfPointersInArgs);
+    const baar::PipelineSchedule schedule(*plan, args, arraySizes, chunkSize);
+    const uint64_t numIterations = schedule.getNumIterations();
+    const uint64_t iterationsPerTile = schedule.getIterationsPerTile();
+    std::cout << "INFO" << ": running \"" << calledFunction->getName().str() << "\" in " << (numIterations + iterationsPerTile - 1) / iterationsPerTile
+              << " tiles of " << iterationsPerTile << " iterations while its arrays arrive\n";
+
+    // only the time spent in the function counts as execution, not waiting for arrays
+    TimeDiffLastExecution = std::chrono::microseconds::zero();
+    llvm::GenericValue ret;
+    std::vector<uint64_t> published(args.size(), 0U);
+    if (numIterations <= iterationsPerTile) {
+        arrivals.waitForAll();
+        std::lock_guard<std::mutex> engineLock(engineMutex);
+        const auto StartTime = std::chrono::high_resolution_clock::now();
+        ret = backend->callEngine(calledFunction, args);
+        TimeDiffLastExecution = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - StartTime);
+    } else {
+        std::vector<llvm::GenericValue> tileArgs(args);
+        tileArgs.resize(args.size() + 2);
+        for (uint64_t begin = 0U; begin < numIterations; begin += iterationsPerTile) {
+            const uint64_t end = std::min(numIterations, begin + iterationsPerTile);
+            for (std::vector<llvm::GenericValue>::size_type i = 0; i < args.size(); i++)
+                if (arraySizes[i] != 0U)
+                    arrivals.waitFor(i, schedule.neededBy(i, end));
+
+            tileArgs[args.size()].IntVal = llvm::APInt(64, begin);
+            tileArgs[args.size() + 1].IntVal = llvm::APInt(64, end);
+            {
+                std::lock_guard<std::mutex> engineLock(engineMutex);
+                const auto StartTime = std::chrono::high_resolution_clock::now();
+                if (!runInParallel(backend, *plan, schedule, args, begin, end))
+                    backend->callEngine(plan->tileFunction, tileArgs);
+                TimeDiffLastExecution += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - StartTime);
+            }
+
+            for (const auto& indexOfPtr : indexesOfPointersInArgs) {
+                const uint64_t final = schedule.finalBefore(indexOfPtr, end);
+                if (final > published[indexOfPtr])
+                    publish(indexOfPtr, published[indexOfPtr] = final);
+            }
+        }
+    }
+    for (const auto& indexOfPtr : indexesOfPointersInArgs)
+        if (published[indexOfPtr] < arraySizes[indexOfPtr])
+            publish(indexOfPtr, arraySizes[indexOfPtr]);
+
+    #ifndef NDEBUG
+    std::cout << "DEBUG: " << "Function call returned, it took " << TimeDiffLastExecution.count() << " microseconds\n";
+    #endif
+
+    return ret;
+}
+
+bool AbstractServer::runInParallel(AbstractBackend *backend, const baar::PipelinePlan &plan, const baar::PipelineSchedule &schedule, const std::vector<llvm::GenericValue> &args, uint64_t begin, uint64_t end)
+{
+    end = std::min(end, schedule.getNumIterations());
+    if (!scheduler || begin >= end || !schedule.isParallel())
+        return false;
+
+    // parts use at least MinTaskSize bytes of the largest array, as many as there are idle cores
+    const uint64_t minIterations = schedule.getLargestStride() > 0U ? ((uint64_t) MinTaskSize << 10) / schedule.getLargestStride() : end - begin;
+    const unsigned parts = scheduler->admit(end - begin, minIterations);
+    void *tileCode = parts > 1 ? backend->getNativeFunction(plan.tileFunction) : nullptr;
+    if (tileCode == nullptr)
+        return false;
+
+    #ifndef NDEBUG
+        const WorkStealingScheduler::Statistics statistics = scheduler->getStatistics();
+        std::cout << "DEBUG: " << "running iterations [" << begin << ", " << end << ") in " << parts << " parts, " << statistics.queued << " parts queued, "
+                  << statistics.busy << " workers busy, " << statistics.stolen << " parts stolen so far\n";
+    #endif
+    scheduler->parallelFor(begin, end, parts, [&](uint64_t first, uint64_t last) {
+        std::vector<llvm::GenericValue> tileArgs(args);
+        tileArgs.resize(args.size() + 2);
+        tileArgs[args.size()].IntVal = llvm::APInt(64, first);
+        tileArgs[args.size() + 1].IntVal = llvm::APInt(64, last);
+        backend->callNative(tileCode, plan.tileFunction, tileArgs);
+    });
+    return true;
+}
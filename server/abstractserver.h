@@ -30,6 +30,9 @@
 #include <vector>
 #include <list>
 #include <chrono>
+#include <mutex>
+#include <memory>
+#include <functional>
 
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/DerivedTypes.h"
@@ -39,6 +42,12 @@
 #include "llvm/PassManager.h"
 
 #include "abstractbackend.h"
+#include "bufferregistry.h"
+#include "modulecache.h"
+#include "arrivaltracker.h"
+#include "workstealingscheduler.h"
+#include "optimizationprofile.h"
+#include "autotuner.h"
 
 class AbstractServer
 {
@@ -54,6 +63,22 @@ public:
 
 
 protected:
+    // compiled module used by all clients which sent the same module, calls into it are serialised (engines are not reentrant)
+    struct SharedBackend {
+        std::unique_ptr<llvm::LLVMContext> context; // has to outlive the backends
+        std::unique_ptr<Autotuner> variants;
+        std::mutex callMutex;
+    };
+
+    // how a module is optimized, -autotune builds several variants of every module
+    struct OptimizationVariant {
+        std::string name;
+        bool polly;
+        bool vectorize;
+        unsigned tileScale;     // percentage of the tile sizes of the profiles (see ProfileSelector)
+        unsigned vectorWidth;   // forced width of the loop vectorizer, 0 lets it choose
+    };
+
     static inline void error(const char *msg)
     {
         perror(msg);
@@ -64,16 +89,63 @@ protected:
     virtual void cleanupCommunication() = 0;
     virtual void unmarshalCallArgs(char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs) = 0;
 
-    std::unique_ptr<AbstractBackend> parseIRtoBackend(const char *ir_buffer);
-    void optimizeModule(llvm::Module* Mod);
+    // module as encoded by ModuleTransfer, built in every variant to be tuned (only as given by the command line without -autotune);
+    // the variants live in Context, which has to outlive them; nullptr if the module cannot be decoded or parsed, the server keeps
+    // serving its other clients
+    std::unique_ptr<Autotuner> parseIRtoVariants(const char *module, size_t moduleSize, llvm::LLVMContext &Context = llvm::getGlobalContext());
+    // like parseIRtoVariants, but clients sending the same module get the same backends, they are only built for the first one;
+    // nullptr as well if the module cannot be decoded or parsed
+    std::shared_ptr<SharedBackend> getSharedBackend(const char *module, size_t moduleSize);
+    std::unique_ptr<AbstractBackend> parseIRtoBackend(const char *module, size_t moduleSize, const OptimizationVariant &variant, llvm::LLVMContext &Context);
+    void optimizeModule(llvm::Module* Mod, const OptimizationVariant &variant);
     llvm::GenericValue handleCall(AbstractBackend* backend, char *marshalledCall, llvm::Function *&calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs);
+    // like handleCall, but runs the function in tiles of its outer loop as soon as the arrays they use arrived (see PipelinePlanner),
+    // publish gets the number of bytes at the front of an array written by the function which later tiles do not change anymore,
+    // engineMutex is held only while a tile runs, not while waiting for arrays or publishing
+    llvm::GenericValue handleCallPipelined(AbstractBackend* backend, char *marshalledCall, llvm::Function *&calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs,
+                                           const std::vector<uint64_t> &arraySizes, uint64_t chunkSize, ArrivalTracker &arrivals, std::mutex &engineMutex, const std::function<void(std::vector<llvm::GenericValue>::size_type, uint64_t)> &publish);
+
+    // runs iterations [begin, end) of the outer loop of plan in parallel parts, if the loop allows and there are idle cores;
+    // false if nothing was run, the caller runs the function as usual then
+    bool runInParallel(AbstractBackend *backend, const baar::PipelinePlan &plan, const baar::PipelineSchedule &schedule, const std::vector<llvm::GenericValue> &args, uint64_t begin, uint64_t end);
 
     backendTypes backendType;
-    std::chrono::microseconds TimeDiffOpt;
-    std::chrono::microseconds TimeDiffInit;
-    std::chrono::microseconds TimeDiffLastExecution;
+    // kernels of all clients, split into parts where possible
+    std::unique_ptr<WorkStealingScheduler> scheduler;
+
+    // per thread, a server may serve its clients from parallel threads (see ShmemServer)
+    static thread_local std::chrono::microseconds TimeDiffOpt;
+    static thread_local std::chrono::microseconds TimeDiffInit;
+    static thread_local std::chrono::microseconds TimeDiffLastExecution;
+
+    // arrays the client of the current thread keeps resident between calls
+    static thread_local BufferRegistry bufferRegistry;
+    // bytes of the arrays of the current call by argument index (0 for scalars), set by unmarshalCallArgs
+    static thread_local std::vector<uint64_t> argumentSizes;
 private:
+    // Polly emits OpenMP parallel loops, see -parallel
+    bool parallelCodeGeneration = false;
+    void enableParallelCodeGeneration(unsigned numThreads);
+
+    // Polly's schedule for every function, see -opt-profile
+    baar::ProfileSelection profileSelection;
+    baar::CacheHierarchy caches;
+
+    // optimized modules of all clients and runs, building modules is serialised
+    ModuleCache moduleCache;
+    std::mutex moduleConstructionMutex;
+    // variants found fastest for functions, next to the cached modules
+    TuningDatabase tuningDatabase;
+    // backends by the cache key of the module they were built from, unused ones are dropped beyond -max-shared-backends
+    std::unordered_map<std::string, std::shared_ptr<SharedBackend>> sharedBackends;
+    std::mutex sharedBackendsMutex;
+
     llvm::TargetMachine *GetTargetMachine(llvm::Triple TheTriple);
+    std::string getCacheConfiguration(const OptimizationVariant &variant) const;
+    OptimizationVariant getDefaultVariant() const;
+    std::vector<OptimizationVariant> getTuningVariants() const;
+    // database keys of the functions of a module by their names, empty for functions writing global variables, they are not tuned
+    std::unordered_map<std::string, std::string> getFunctionKeys(const char *module, size_t moduleSize, llvm::LLVMContext &Context) const;
 };
 
 #endif // ABSTRACTSERVER_H
@@ -0,0 +1,54 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef ARRIVALTRACKER_H
+#define ARRIVALTRACKER_H
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cinttypes>
+
+// Bytes of the arrays of a call received so far, filled in by a receiving thread while the call already runs.
+// Arrays arrive front to back (see CallFrame::interleave).
+class ArrivalTracker
+{
+public:
+    // bytes to arrive by argument index, 0 for arguments not transferred
+    ArrivalTracker(const std::vector<uint64_t> &expected);
+
+    void arrived(unsigned arg, uint64_t bytes);
+    // blocks until the first bytes of the array of arg (or all of it, if less is transferred) are there
+    void waitFor(unsigned arg, uint64_t bytes);
+    void waitForAll();
+    // nothing arrives anymore (connection lost), waiting ends as if everything arrived
+    void cancel();
+
+private:
+    std::mutex mutex;
+    std::condition_variable progress;
+    const std::vector<uint64_t> expected;
+    std::vector<uint64_t> received;
+};
+
+#endif // ARRIVALTRACKER_H
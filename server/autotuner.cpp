@@ -0,0 +1,123 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "autotuner.h"
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+
+TuningDatabase::TuningDatabase(const std::string &path) : path(path)
+{
+    if (path.empty())
+        return;
+    // one "key variant" line per tuned function, later lines override earlier ones
+    std::ifstream file(path);
+    std::string key, variant;
+    while (file >> key >> variant)
+        winners[key] = variant;
+}
+
+bool TuningDatabase::lookup(const std::string &key, std::string &variant) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = winners.find(key);
+    if (entry == winners.end())
+        return false;
+    variant = entry->second;
+    return true;
+}
+
+void TuningDatabase::insert(const std::string &key, const std::string &variant)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    winners[key] = variant;
+    if (path.empty())
+        return;
+    std::ofstream file(path, std::ios::app);
+    if (!(file << key << " " << variant << "\n"))
+        std::cout << "WARNING: " << "could not write tuning database " << path << "\n";
+}
+
+Autotuner::Autotuner(std::vector<Variant> &&variants, std::unordered_map<std::string, std::string> &&functionKeys, TuningDatabase &database, unsigned runsPerVariant)
+    : variants(std::move(variants)), functionKeys(std::move(functionKeys)), database(database), runsPerVariant(std::max(runsPerVariant, 1U))
+{
+    // functions tuned in earlier runs start with their variant, if it was built
+    for (const auto &functionAndKey : this->functionKeys) {
+        std::string name;
+        if (functionAndKey.second.empty() || !database.lookup(functionAndKey.second, name))
+            continue;
+        for (size_t i = 0; i < this->variants.size(); i++)
+            if (this->variants[i].name == name)
+                tunings[functionAndKey.first].winner = i;
+    }
+}
+
+bool Autotuner::isTuned(const std::string &functionName) const
+{
+    auto key = functionKeys.find(functionName);
+    return key != functionKeys.end() && !key->second.empty();
+}
+
+AbstractBackend *Autotuner::select(const std::string &functionName)
+{
+    if (variants.size() == 1 || !isTuned(functionName))
+        return variants.front().backend.get();
+    std::lock_guard<std::mutex> lock(mutex);
+    Tuning &tuning = tunings[functionName];
+    if (tuning.winner >= 0)
+        return variants[tuning.winner].backend.get();
+    return variants[tuning.calls++ % variants.size()].backend.get();
+}
+
+void Autotuner::record(const std::string &functionName, const AbstractBackend *backend, std::chrono::microseconds executionTime)
+{
+    if (variants.size() == 1 || !isTuned(functionName))
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    Tuning &tuning = tunings[functionName];
+    if (tuning.winner >= 0)
+        return;
+    const size_t variant = std::find_if(variants.begin(), variants.end(), [&](const Variant &v) { return v.backend.get() == backend; }) - variants.begin();
+    assert(variant < variants.size() && "Time recorded for a backend which is no variant");
+    tuning.totals.resize(variants.size(), std::chrono::microseconds::zero());
+    tuning.runs.resize(variants.size(), 0U);
+    if (tuning.runs[variant]++ > 0U)
+        tuning.totals[variant] += executionTime;
+    if (std::any_of(tuning.runs.begin(), tuning.runs.end(), [&](unsigned runs) { return runs < runsPerVariant + 1; }))
+        return;
+
+    // calls of several clients may have run a variant more often than the others
+    std::vector<std::chrono::microseconds> averages(variants.size());
+    for (size_t i = 0; i < variants.size(); i++)
+        averages[i] = tuning.totals[i] / (tuning.runs[i] - 1);
+    tuning.winner = std::min_element(averages.begin(), averages.end()) - averages.begin();
+    std::cout << "INFO: \"" << functionName << "\" is run by variant " << variants[tuning.winner].name << ", average times:";
+    for (size_t i = 0; i < variants.size(); i++)
+        std::cout << " " << variants[i].name << " " << averages[i].count() << "us";
+    std::cout << "\n";
+    auto key = functionKeys.find(functionName);
+    if (key != functionKeys.end())
+        database.insert(key->second, variants[tuning.winner].name);
+}
@@ -0,0 +1,92 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef AUTOTUNER_H
+#define AUTOTUNER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+
+#include "abstractbackend.h"
+
+// Name of the variant found fastest for a function, by a key built from the function's IR and the target.
+// Kept in memory and, if a file is given, on disk across server runs. Safe for concurrent use.
+class TuningDatabase
+{
+public:
+    explicit TuningDatabase(const std::string &path = ""); // empty: in memory only
+
+    bool lookup(const std::string &key, std::string &variant) const;
+    void insert(const std::string &key, const std::string &variant);
+
+private:
+    const std::string path;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::string> winners;
+};
+
+// Backends built from one module in different ways (variants). Calls of a function are spread over all variants
+// in turns until every variant ran it runsPerVariant times (not counting its first run, which includes lazy compilation),
+// from then on the variant with the lowest average time runs it, and the database remembers the variant for later runs.
+// Functions without a key are not tuned and always run on the first variant: every variant has its own copy of the
+// module's global variables, functions writing them would see different state on every call otherwise.
+// Safe for concurrent use, calls of several clients may run at the same time; the backends themselves are not.
+class Autotuner
+{
+public:
+    struct Variant {
+        std::string name;
+        std::unique_ptr<AbstractBackend> backend;
+    };
+
+    // functionKeys: database key of every function of the module by its name, empty if it is not to be tuned
+    Autotuner(std::vector<Variant> &&variants, std::unordered_map<std::string, std::string> &&functionKeys, TuningDatabase &database, unsigned runsPerVariant);
+
+    // backend to run the next call of the function on, the call's execution time is recorded for the backend it ran on
+    AbstractBackend *select(const std::string &functionName);
+    void record(const std::string &functionName, const AbstractBackend *backend, std::chrono::microseconds executionTime);
+
+private:
+    struct Tuning {
+        std::vector<std::chrono::microseconds> totals; // by variant
+        std::vector<unsigned> runs;                     // by variant, recorded runs
+        unsigned calls = 0U;    // the next call runs on variant calls % number of variants
+        int winner = -1;
+    };
+
+    std::mutex mutex;
+
+    std::vector<Variant> variants;
+    std::unordered_map<std::string, std::string> functionKeys;
+    std::unordered_map<std::string, Tuning> tunings;
+
+    bool isTuned(const std::string &functionName) const;
+    TuningDatabase &database;
+    const unsigned runsPerVariant;
+};
+
+#endif // AUTOTUNER_H
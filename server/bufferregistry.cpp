@@ -0,0 +1,87 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "bufferregistry.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+static const size_t BUFFER_ALIGNMENT = 64;
+
+BufferRegistry::~BufferRegistry()
+{
+    clear();
+}
+
+void *BufferRegistry::keep(const Residency::BufferKey &key, uint64_t version)
+{
+    auto entry = entries.find(key);
+    if (entry != entries.end()) {
+        entry->second.version = version;
+        return entry->second.memory;
+    }
+
+    void *memory;
+    if (posix_memalign(&memory, BUFFER_ALIGNMENT, key.size ? key.size : 1)) {
+        perror("ERROR, could not allocate resident buffer");
+        exit(1);
+    }
+    entries.emplace(key, Entry{ memory, version });
+    residentBytes += key.size;
+    #ifndef NDEBUG
+        std::cout << "DEBUG: keeping array of client at " << (void *) key.clientAddress << " (" << key.size << " bytes), " << residentBytes << " bytes resident\n";
+    #endif
+    return memory;
+}
+
+void *BufferRegistry::lookup(const Residency::BufferKey &key, uint64_t version) const
+{
+    auto entry = entries.find(key);
+    if (entry == entries.end() || entry->second.version != version)
+        return nullptr;
+    return entry->second.memory;
+}
+
+void BufferRegistry::release(const Residency::BufferKey &key)
+{
+    auto entry = entries.find(key);
+    if (entry == entries.end())
+        return;
+    free(entry->second.memory);
+    residentBytes -= key.size;
+    entries.erase(entry);
+}
+
+void BufferRegistry::clear()
+{
+    for (auto &entry : entries)
+        free(entry.second.memory);
+    entries.clear();
+    residentBytes = 0U;
+}
+
+uint64_t BufferRegistry::getResidentBytes() const
+{
+    return residentBytes;
+}
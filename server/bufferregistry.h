@@ -0,0 +1,60 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef BUFFERREGISTRY_H
+#define BUFFERREGISTRY_H
+
+#include <cinttypes>
+#include <unordered_map>
+
+#include "../common/residency.h"
+
+// Server side copies of arrays a client keeps resident between calls.
+// Arrays are identified by the client's address and their size, the version tells which content the copy holds.
+class BufferRegistry
+{
+public:
+    BufferRegistry() = default;
+    ~BufferRegistry();
+    BufferRegistry(const BufferRegistry &) = delete;
+    BufferRegistry &operator=(const BufferRegistry &) = delete;
+
+    // memory for an array to be kept, existing memory is reused; the caller writes the content of the given version
+    void *keep(const Residency::BufferKey &key, uint64_t version);
+    // nullptr if the array is not resident in the given version
+    void *lookup(const Residency::BufferKey &key, uint64_t version) const;
+    void release(const Residency::BufferKey &key);
+    void clear();
+    uint64_t getResidentBytes() const;
+
+private:
+    struct Entry {
+        void *memory;
+        uint64_t version;
+    };
+
+    std::unordered_map<Residency::BufferKey, Entry, Residency::BufferKeyHash> entries;
+    uint64_t residentBytes = 0U;
+};
+
+#endif // BUFFERREGISTRY_H
@@ -22,7 +22,6 @@
 //    THE SOFTWARE.
 
 #include "extcompilerbackend.h"
-#include "llvm_ffi.cpp"
 
 #include <unistd.h>
 #include <signal.h>
@@ -31,28 +30,57 @@
 
 #include <iostream>
 #include <string>
+#include <atomic>
 
-ExtCompilerBackend::ExtCompilerBackend(llvm::Module *&Mod) : AbstractBackend(Mod), export_name(std::to_string(getpid()) + "_module_export")
+#include "llvm/IR/IRBuilder.h"
+
+// backends of one server process (ShmemServer clients) need distinct files
+static std::atomic<unsigned> numExports(0);
+
+static const char *ENTRY_SUFFIX = "_baar_entry";
+
+ExtCompilerBackend::ExtCompilerBackend(llvm::Module *&Mod, const std::string &cachedLibraryPath, bool openMP) : AbstractBackend(Mod), export_name(std::to_string(getpid()) + "_" + std::to_string(numExports++) + "_module_export")
 {
-    call_remote_compiler_sh = buildShellScript(export_name);
+    // block layouts do not depend on the library, cached libraries contain the entries already
+    for (llvm::Module::iterator F = Module->begin(), FE = Module->end(); F != FE; ++F) {
+        if (F->isDeclaration() || F->hasLocalLinkage())
+            continue;
+        Entry &entry = entries[F];
+        for (llvm::Function::arg_iterator A = F->arg_begin(), AE = F->arg_end(); A != AE; ++A) {
+            const uint64_t alignment = dataLayout->getABITypeAlignment(A->getType());
+            entry.blockSize = (entry.blockSize + alignment - 1) / alignment * alignment;
+            entry.offsets.push_back(entry.blockSize);
+            entry.blockSize += dataLayout->getTypeAllocSize(A->getType());
+        }
+    }
 
-    extern bool WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth, const char *includeName);
+    if (!cachedLibraryPath.empty()) {
+        std::cout << "INFO: " << "using cached library " << cachedLibraryPath << std::endl;
+        library_path = cachedLibraryPath;
+    } else {
+        createEntryFunctions();
+        call_remote_compiler_sh = buildShellScript(export_name, openMP);
+
+        extern bool WriteCXXFile(llvm::Module *module, const char *fn, int vectorWidth, const char *includeName);
 #ifdef _K1OM_
-    WriteCXXFile(Mod, std::string(export_name + ".cpp").c_str(), 8, "knc-i1x8.h");
+        WriteCXXFile(Mod, std::string(export_name + ".cpp").c_str(), 8, "knc-i1x8.h");
 #else
-    WriteCXXFile(Mod, std::string(export_name + ".cpp").c_str(), 16, "generic-16.h");
+        WriteCXXFile(Mod, std::string(export_name + ".cpp").c_str(), 16, "generic-16.h");
 #endif
 
-    signal(SIGCHLD, SIG_DFL);
-    if (system(call_remote_compiler_sh.c_str())) {
-        std::cout << "ERROR while calling remote compiler. \n";
-        exit(-1);
+        signal(SIGCHLD, SIG_DFL);
+        if (system(call_remote_compiler_sh.c_str())) {
+            std::cout << "ERROR while calling remote compiler. \n";
+            exit(-1);
+        }
+        signal(SIGCHLD, SIG_IGN);
+        library_path = "./" + export_name + ".so";
     }
-    signal(SIGCHLD, SIG_IGN);
 
-    if (export_library = dlopen(std::string("./" + export_name + ".so").c_str(), RTLD_NOW  | RTLD_GLOBAL))
-        std::cout << "INFO: " << export_name << ".so" << " successfully loaded." << std::endl;
-    else
+    if (export_library = dlopen(library_path.c_str(), RTLD_NOW  | RTLD_GLOBAL)) {
+        std::cout << "INFO: " << library_path << " successfully loaded." << std::endl;
+        resolveEntries();
+    } else
         std::cout << "ERROR loading " << dlerror() << std::endl;
 }
 
@@ -63,30 +91,139 @@ ExtCompilerBackend::~ExtCompilerBackend() {
     remove(std::string(export_name + ".so").c_str());
 }
 
+void ExtCompilerBackend::createEntryFunctions()
+{
+    llvm::LLVMContext &Context = Module->getContext();
+    llvm::Type *BytePtrTy = llvm::Type::getInt8PtrTy(Context);
+    llvm::Type *Params[] = { BytePtrTy, BytePtrTy };
+    llvm::FunctionType *EntryTy = llvm::FunctionType::get(llvm::Type::getVoidTy(Context), Params, false);
+    for (const auto &FunctionAndEntry : entries) {
+        llvm::Function *F = const_cast<llvm::Function *>(FunctionAndEntry.first);
+        llvm::Function *EntryF = llvm::Function::Create(EntryTy, llvm::GlobalValue::ExternalLinkage, F->getName() + ENTRY_SUFFIX, Module.get());
+        llvm::Function::arg_iterator EntryArg = EntryF->arg_begin();
+        llvm::Argument *Arguments = &*EntryArg++;
+        llvm::Argument *Result = &*EntryArg;
+        Arguments->setName("arguments");
+        Result->setName("result");
+
+        llvm::IRBuilder<> Builder(llvm::BasicBlock::Create(Context, "entry", EntryF));
+        std::vector<llvm::Value *> Args;
+        for (llvm::Function::arg_iterator A = F->arg_begin(), AE = F->arg_end(); A != AE; ++A) {
+            llvm::Value *Slot = Builder.CreateConstInBoundsGEP1_64(Arguments, FunctionAndEntry.second.offsets[A->getArgNo()]);
+            Args.push_back(Builder.CreateLoad(Builder.CreateBitCast(Slot, A->getType()->getPointerTo())));
+        }
+        llvm::Value *Ret = Builder.CreateCall(F, Args);
+        if (!F->getReturnType()->isVoidTy())
+            Builder.CreateStore(Ret, Builder.CreateBitCast(Result, F->getReturnType()->getPointerTo()));
+        Builder.CreateRetVoid();
+    }
+}
+
+void ExtCompilerBackend::resolveEntries()
+{
+    for (auto &FunctionAndEntry : entries) {
+        const std::string name = FunctionAndEntry.first->getName().str();
+        Entry &entry = FunctionAndEntry.second;
+        entry.function = dlsym(export_library, name.c_str());
+        entry.entry = (EntryFunction) dlsym(export_library, (name + ENTRY_SUFFIX).c_str());
+        if (entry.function == nullptr)
+            std::cout << "ERROR: " << "Could not find " << name << " in library." << std::endl;
+        else if (entry.entry == nullptr)
+            std::cout << "WARNING: " << "no entry for " << name << " in library, it is called through libffi" << std::endl;
+    }
+}
+
 llvm::GenericValue ExtCompilerBackend::callEngine(llvm::Function *F, const std::vector<llvm::GenericValue> &ArgValues) {
-    RawFunc F_ptr;
-    if (*(void**)(&F_ptr) = dlsym(export_library, F->getName().str().c_str()))
-        std::cout << "INFO: " << "Found " << F->getName().str() << " in library." << std::endl;
-    else
-        std::cout << "ERROR: " << "Could not find " << F->getName().str() << " in library." << std::endl;
+    return callNative(getNativeFunction(F), F, ArgValues);
+}
 
-    llvm::GenericValue ret;
-    ffiInvoke(F_ptr, F, ArgValues, new llvm::DataLayout(Module.get()), ret); // TODO DataLayout is not initialized for target
+void *ExtCompilerBackend::getNativeFunction(llvm::Function *F)
+{
+    auto entry = entries.find(F);
+    return entry == entries.end() ? nullptr : entry->second.function;
+}
+
+llvm::GenericValue ExtCompilerBackend::callNative(void *code, llvm::Function *F, const std::vector<llvm::GenericValue> &ArgValues) const
+{
+    auto entry = entries.find(F);
+    if (entry == entries.end() || entry->second.entry == nullptr)
+        return AbstractBackend::callNative(code, F, ArgValues);
+    return callEntry(entry->second, F, ArgValues);
+}
 
+llvm::GenericValue ExtCompilerBackend::callEntry(const Entry &entry, llvm::Function *F, const std::vector<llvm::GenericValue> &ArgValues) const
+{
+    // callers run in parallel (split kernels), every thread packs into its own block, which only grows
+    static thread_local std::vector<char> block;
+    if (block.size() < entry.blockSize)
+        block.resize(entry.blockSize);
+
+    llvm::FunctionType *FTy = F->getFunctionType();
+    for (unsigned i = 0; i < entry.offsets.size(); i++) {
+        char *slot = block.data() + entry.offsets[i];
+        llvm::Type *Ty = FTy->getParamType(i);
+        switch (Ty->getTypeID()) {
+            case llvm::Type::IntegerTyID: {
+                // slots are sized by the data layout, i1 (bool) and other narrow integers take one byte
+                const unsigned bitWidth = llvm::cast<llvm::IntegerType>(Ty)->getBitWidth();
+                if (bitWidth <= 8)
+                    *(uint8_t *) slot = (uint8_t) ArgValues[i].IntVal.getZExtValue();
+                else if (bitWidth == 16)
+                    *(int16_t *) slot = (int16_t) ArgValues[i].IntVal.getZExtValue();
+                else if (bitWidth == 32)
+                    *(int32_t *) slot = (int32_t) ArgValues[i].IntVal.getZExtValue();
+                else if (bitWidth == 64)
+                    *(int64_t *) slot = (int64_t) ArgValues[i].IntVal.getZExtValue();
+                else
+                    llvm::report_fatal_error("Integer of " + llvm::Twine(bitWidth) + " bits could not be passed to " + F->getName());
+                break;
+            }
+            case llvm::Type::FloatTyID: *(float *) slot = ArgValues[i].FloatVal; break;
+            case llvm::Type::DoubleTyID: *(double *) slot = ArgValues[i].DoubleVal; break;
+            case llvm::Type::PointerTyID: *(void **) slot = ArgValues[i].PointerVal; break;
+            default: llvm::report_fatal_error("Type value could not be passed to " + F->getName());
+        }
+    }
+
+    uint64_t result[2];
+    entry.entry(block.data(), result);
+
+    llvm::GenericValue ret;
+    llvm::Type *RetTy = FTy->getReturnType();
+    switch (RetTy->getTypeID()) {
+        case llvm::Type::IntegerTyID: {
+            const unsigned bitWidth = llvm::cast<llvm::IntegerType>(RetTy)->getBitWidth();
+            if (bitWidth <= 8) // i1 (bool) included, stored as one byte
+                ret.IntVal = llvm::APInt(bitWidth, *(uint8_t *) result);
+            else if (bitWidth == 16)
+                ret.IntVal = llvm::APInt(16, *(int16_t *) result);
+            else if (bitWidth == 32)
+                ret.IntVal = llvm::APInt(32, *(int32_t *) result);
+            else if (bitWidth == 64)
+                ret.IntVal = llvm::APInt(64, *(int64_t *) result);
+            else
+                llvm::report_fatal_error("Integer of " + llvm::Twine(bitWidth) + " bits could not be returned from " + F->getName());
+            break;
+        }
+        case llvm::Type::FloatTyID: ret.FloatVal = *(float *) result; break;
+        case llvm::Type::DoubleTyID: ret.DoubleVal = *(double *) result; break;
+        case llvm::Type::PointerTyID: ret.PointerVal = *(void **) result; break;
+        default: break;
+    }
     return ret;
 }
 
-std::string ExtCompilerBackend::buildShellScript(const std::string &export_name)
+std::string ExtCompilerBackend::buildShellScript(const std::string &export_name, bool openMP)
 {
 #ifdef _K1OM_
     return std::string("#!/bin/sh\n"
                        "remote_host=${SSH_CONNECTION%%' '*} \n"
                        "scp "+export_name+".cpp $remote_host:. \n"
                        "ssh $remote_host 'module add intel/compiler gcc/4.8.1 cmake/2.8.10.2 && "
-                       "icc -w -mmic -o "+export_name+".so -shared -fPIC "+export_name+".cpp && "
+                       "icc -w -mmic -o "+export_name+".so -shared -fPIC "+export_name+".cpp "+(openMP ? "-openmp " : "")+"&& "
                        "scp "+export_name+".so '\"$(hostname):.\"' \n'");
 #else
     return std::string("#!/bin/sh\n"
-                       "clang++ -w -o "+export_name+".so -shared -fPIC "+export_name+".cpp \n");
+                       "clang++ -w -o "+export_name+".so -shared -fPIC "+export_name+".cpp "+(openMP ? "-lgomp " : "")+"\n");
 #endif
 }
@@ -33,20 +33,43 @@
 #include "llvm/IR/DerivedTypes.h"
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 class ExtCompilerBackend : public AbstractBackend
 {
-    typedef void (*RawFunc)();
 public:
-    ExtCompilerBackend(llvm::Module *&Mod);
+    // a library generated from Mod earlier (cachedLibraryPath) is loaded instead of generating and compiling code,
+    // openMP links it against the OpenMP runtime (Mod contains parallel loops generated by Polly)
+    ExtCompilerBackend(llvm::Module *&Mod, const std::string &cachedLibraryPath = "", bool openMP = false);
     virtual ~ExtCompilerBackend();
     virtual llvm::GenericValue callEngine(llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues);
+    virtual void *getNativeFunction(llvm::Function *F);
+    virtual llvm::GenericValue callNative(void *code, llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues) const;
+    const std::string &getLibraryPath() const { return library_path; }
 
 private:
-    std::string buildShellScript(const std::string& export_name);
+    // every exported function F gets a generated F_baar_entry(char *arguments, void *result) taking its arguments
+    // packed into one block (each at its ABI alignment), so calls need neither libffi nor a lookup in the library
+    typedef void (*EntryFunction)(char *arguments, void *result);
+    struct Entry {
+        void *function = nullptr;       // F itself, for callers of getNativeFunction
+        EntryFunction entry = nullptr;  // nullptr if the library has no entries, calls go through libffi then
+        std::vector<uint64_t> offsets;  // of the arguments in the block
+        uint64_t blockSize = 0U;
+    };
+    std::unordered_map<const llvm::Function *, Entry> entries;
+
+    std::string buildShellScript(const std::string& export_name, bool openMP);
+    // adds the entry functions to the module, has to happen before code is generated
+    void createEntryFunctions();
+    // symbols of functions and entries, once the library is loaded
+    void resolveEntries();
+    llvm::GenericValue callEntry(const Entry &entry, llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues) const;
 
     void* export_library = nullptr;
     std::string export_name;
+    std::string library_path;
     std::string call_remote_compiler_sh;
 };
 
@@ -52,3 +52,8 @@ llvm::GenericValue JITBackend::callEngine(llvm::Function *F, const std::vector<l
 {
     return executionEngine->runFunction(F, ArgValues);
 }
+
+void *JITBackend::getNativeFunction(llvm::Function *F)
+{
+    return executionEngine->getPointerToFunction(F);
+}
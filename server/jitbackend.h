@@ -35,6 +35,7 @@ public:
     JITBackend(llvm::Module*& Mod);
     virtual ~JITBackend();
     virtual llvm::GenericValue callEngine(llvm::Function *F, const std::vector< llvm::GenericValue > &ArgValues);
+    virtual void *getNativeFunction(llvm::Function *F);
 private:
     std::unique_ptr<llvm::ExecutionEngine> executionEngine;
 };
@@ -29,6 +29,7 @@
 
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/PluginLoader.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/LinkAllPasses.h"
 
 #include "polly/RegisterPasses.h"
@@ -64,6 +65,9 @@ void handleSignal(int)
 
 int main(int argc, char* argv[])
 {
+    // both servers build and run modules in parallel threads
+    llvm::llvm_start_multithreaded();
+
     llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
     // initializePollyPasses(Registry); TODO use in LLVM 3.5+
     initializeCore(Registry);
@@ -0,0 +1,126 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "modulecache.h"
+
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/MD5.h"
+
+ModuleCache::ModuleCache(const std::string &directory) : directory(directory)
+{
+    if (!directory.empty() && mkdir(directory.c_str(), 0755) == -1 && errno != EEXIST)
+        perror(std::string("WARNING, unable to create module cache directory " + directory).c_str());
+}
+
+std::string ModuleCache::key(const char *module, size_t moduleSize, const std::string &configuration)
+{
+    llvm::MD5 hash;
+    hash.update(llvm::StringRef(module, moduleSize));
+    hash.update(configuration);
+    llvm::MD5::MD5Result result;
+    hash.final(result);
+    llvm::SmallString<32> key;
+    llvm::MD5::stringifyResult(result, key);
+    return key.str().str();
+}
+
+bool ModuleCache::lookup(const std::string &key, std::string &optimizedModule)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = optimizedModules.find(key);
+    if (entry != optimizedModules.end()) {
+        optimizedModule = entry->second;
+        return true;
+    }
+
+    if (directory.empty())
+        return false;
+    std::ifstream file(pathFor(key, ".bc"), std::ios::binary);
+    if (!file)
+        return false;
+    std::stringstream content;
+    content << file.rdbuf();
+    optimizedModule = content.str();
+    optimizedModules[key] = optimizedModule;
+    return true;
+}
+
+void ModuleCache::insert(const std::string &key, const std::string &optimizedModule)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    optimizedModules[key] = optimizedModule;
+    if (!directory.empty() && !writeFileAtomically(pathFor(key, ".bc"), optimizedModule.data(), optimizedModule.size()))
+        std::cout << "WARNING: unable to store optimized module in cache\n";
+}
+
+bool ModuleCache::lookupLibrary(const std::string &key, std::string &libraryPath) const
+{
+    if (directory.empty())
+        return false;
+    libraryPath = pathFor(key, ".so");
+    return access(libraryPath.c_str(), R_OK) == 0;
+}
+
+void ModuleCache::insertLibrary(const std::string &key, const std::string &libraryPath)
+{
+    if (directory.empty())
+        return;
+
+    std::ifstream file(libraryPath, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string library = content.str();
+    if (!file || library.empty() || !writeFileAtomically(pathFor(key, ".so"), library.data(), library.size()))
+        std::cout << "WARNING: unable to store library " << libraryPath << " in cache\n";
+}
+
+std::string ModuleCache::pathFor(const std::string &key, const std::string &extension) const
+{
+    return directory + "/" + key + extension;
+}
+
+bool ModuleCache::writeFileAtomically(const std::string &path, const char *data, size_t size)
+{
+    // other server processes may read the cache at the same time, they must never see partial files
+    const std::string temporaryPath = path + "." + std::to_string(getpid()) + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file.write(data, size)) {
+            remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (rename(temporaryPath.c_str(), path.c_str()) == -1) {
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return true;
+}
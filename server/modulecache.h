@@ -0,0 +1,60 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef MODULECACHE_H
+#define MODULECACHE_H
+
+#include <string>
+#include <cstddef>
+#include <unordered_map>
+#include <mutex>
+
+// Optimized modules (and libraries generated from them) by a key built from the IR they were built from
+// and everything else influencing the result (optimization flags, target), so clients sending the same IR
+// (several instances or repeated runs of one program) skip optimization and code generation.
+// Kept in memory and, if a directory is given, on disk across server runs. Safe for concurrent use.
+class ModuleCache
+{
+public:
+    explicit ModuleCache(const std::string &directory = ""); // empty: in memory only
+
+    static std::string key(const char *module, size_t moduleSize, const std::string &configuration);
+
+    // optimized modules as bitcode, false if the module was not optimized before
+    bool lookup(const std::string &key, std::string &optimizedModule);
+    void insert(const std::string &key, const std::string &optimizedModule);
+
+    // shared objects generated from optimized modules, on disk only
+    bool lookupLibrary(const std::string &key, std::string &libraryPath) const;
+    void insertLibrary(const std::string &key, const std::string &libraryPath);
+
+private:
+    std::string pathFor(const std::string &key, const std::string &extension) const;
+    static bool writeFileAtomically(const std::string &path, const char *data, size_t size);
+
+    const std::string directory;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::string> optimizedModules;
+};
+
+#endif // MODULECACHE_H
@@ -0,0 +1,352 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "optimizationprofile.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+
+using namespace llvm;
+
+char baar::ProfileSelector::ID = 0;
+
+baar::CacheHierarchy baar::CacheHierarchy::ofHost()
+{
+    CacheHierarchy Caches;
+    for (unsigned Index = 0; ; Index++) {
+        const std::string Directory = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(Index) + "/";
+        std::ifstream LevelFile(Directory + "level"), TypeFile(Directory + "type"), SizeFile(Directory + "size"), LineSizeFile(Directory + "coherency_line_size");
+        unsigned Level;
+        std::string Type, Size;
+        if (!(LevelFile >> Level) || !(TypeFile >> Type) || !(SizeFile >> Size))
+            break;
+        if (Type == "Instruction")
+            continue;
+
+        // sizes are given like "32K" or "8M"
+        char *Unit;
+        uint64_t Bytes = strtoull(Size.c_str(), &Unit, 10);
+        if (*Unit == 'K')
+            Bytes *= 1024;
+        else if (*Unit == 'M')
+            Bytes *= 1024 * 1024;
+        switch (Level) {
+            case 1: Caches.l1 = Bytes; break;
+            case 2: Caches.l2 = Bytes; break;
+            case 3: Caches.l3 = Bytes; break;
+        }
+        uint64_t LineSize;
+        if (LineSizeFile >> LineSize && LineSize > 0)
+            Caches.lineSize = LineSize;
+    }
+    return Caches;
+}
+
+const char *baar::profileName(OptimizationProfile profile)
+{
+    switch (profile) {
+        case NONE: return "none";
+        case TILE: return "tile";
+        case STENCIL: return "stencil";
+        case GEMM: return "gemm";
+        case AUTO: return "auto";
+    }
+    return "";
+}
+
+static bool parseProfile(const std::string &Name, baar::OptimizationProfile &Profile)
+{
+    for (int Candidate = baar::NONE; Candidate <= baar::AUTO; Candidate++) {
+        if (Name == baar::profileName((baar::OptimizationProfile) Candidate)) {
+            Profile = (baar::OptimizationProfile) Candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool baar::ProfileSelection::parse(const std::string &spec, ProfileSelection &selection)
+{
+    std::istringstream Entries(spec);
+    std::string Entry;
+    while (std::getline(Entries, Entry, ',')) {
+        const size_t Separator = Entry.find('=');
+        OptimizationProfile Profile;
+        if (Separator == std::string::npos) {
+            if (!parseProfile(Entry, selection.fallback))
+                return false;
+        } else if (Separator == 0 || !parseProfile(Entry.substr(Separator + 1), Profile)) {
+            return false;
+        } else {
+            selection.byFunction[Entry.substr(0, Separator)] = Profile;
+        }
+    }
+    return true;
+}
+
+bool baar::ProfileSelection::reschedules() const
+{
+    if (fallback != NONE)
+        return true;
+    for (const auto &FunctionAndProfile : byFunction)
+        if (FunctionAndProfile.second != NONE)
+            return true;
+    return false;
+}
+
+// true if S changes with the iterations of L itself, not only with those of loops inside of L
+static bool dependsOn(const SCEV *S, const Loop *L)
+{
+    if (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(S))
+        if (AddRec->getLoop() == L)
+            return true;
+    if (const SCEVNAryExpr *NAry = dyn_cast<SCEVNAryExpr>(S)) {
+        for (SCEVNAryExpr::op_iterator Op = NAry->op_begin(), OpEnd = NAry->op_end(); Op != OpEnd; ++Op)
+            if (dependsOn(*Op, L))
+                return true;
+        return false;
+    }
+    if (const SCEVCastExpr *Cast = dyn_cast<SCEVCastExpr>(S))
+        return dependsOn(Cast->getOperand(), L);
+    if (const SCEVUDivExpr *UDiv = dyn_cast<SCEVUDivExpr>(S))
+        return dependsOn(UDiv->getLHS(), L) || dependsOn(UDiv->getRHS(), L);
+    // values ScalarEvolution cannot tell anything about might change in every iteration of the loop they are computed in
+    if (const SCEVUnknown *Unknown = dyn_cast<SCEVUnknown>(S))
+        if (Instruction *I = dyn_cast<Instruction>(Unknown->getValue()))
+            return L->contains(I);
+    return false;
+}
+
+static unsigned nestDepth(const Loop *L)
+{
+    unsigned Depth = 0;
+    for (Loop::iterator Inner = L->begin(), InnerEnd = L->end(); Inner != InnerEnd; ++Inner)
+        Depth = std::max(Depth, nestDepth(*Inner));
+    return Depth + 1;
+}
+
+namespace {
+    struct Access {
+        const SCEV *Address;
+        const SCEV *Base;
+        const Loop *L;  // innermost loop containing the access
+        bool IsWrite;
+    };
+}
+
+// GEMM: an innermost loop at depth 3 or more accumulating loads of two or more arrays moving with it into one value
+static bool isGemm(const std::vector<Access> &Accesses)
+{
+    for (const Access &Candidate : Accesses) {
+        const Loop *Inner = Candidate.L;
+        if (Inner->getLoopDepth() < 3 || !Inner->empty())
+            continue;
+        unsigned MovingLoads = 0;
+        bool Accumulates = false;
+        for (const Access &A : Accesses) {
+            if (A.L != Inner)
+                continue;
+            if (!A.IsWrite && dependsOn(A.Address, Inner))
+                MovingLoads++;
+            if (A.IsWrite && !dependsOn(A.Address, Inner))
+                Accumulates = true;
+        }
+        // with the store sunk out of the loop, the accumulator is carried by a floating point phi
+        for (BasicBlock::iterator I = Inner->getHeader()->begin(); PHINode *PN = dyn_cast<PHINode>(I); ++I)
+            if (PN->getType()->isFloatingPointTy())
+                Accumulates = true;
+        if (Accumulates && MovingLoads >= 2)
+            return true;
+    }
+    return false;
+}
+
+// time-iterated stencil: an outer loop around sweeps of depth 2 or more, which all write the same elements
+// in every iteration of it, reading neighbours of one array at constant distances
+static bool isStencil(const Loop *Nest, const std::vector<Access> &Accesses, ScalarEvolution &SE)
+{
+    if (nestDepth(Nest) < 3)
+        return false;
+    bool Writes = false;
+    for (const Access &A : Accesses) {
+        if (A.IsWrite && dependsOn(A.Address, Nest))
+            return false;
+        Writes |= A.IsWrite;
+    }
+    if (!Writes)
+        return false;
+    for (auto A = Accesses.begin(); A != Accesses.end(); ++A) {
+        for (auto B = A + 1; B != Accesses.end(); ++B) {
+            if (A->IsWrite || B->IsWrite || A->L != B->L || A->Base != B->Base)
+                continue;
+            const SCEVConstant *Distance = dyn_cast<SCEVConstant>(SE.getMinusSCEV(A->Address, B->Address));
+            if (Distance != nullptr && !Distance->isZero())
+                return true;
+        }
+    }
+    return false;
+}
+
+// tiling pays off if a loop nest reads the same elements again in iterations of an outer loop
+static bool reusesAcrossOuterLoops(const std::vector<Access> &Accesses)
+{
+    for (const Access &A : Accesses) {
+        if (A.IsWrite || A.L->getLoopDepth() < 2 || !dependsOn(A.Address, A.L))
+            continue;
+        for (const Loop *Outer = A.L->getParentLoop(); Outer != nullptr; Outer = Outer->getParentLoop())
+            if (!dependsOn(A.Address, Outer))
+                return true;
+    }
+    return false;
+}
+
+baar::KernelShape baar::KernelShape::of(Function &F, LoopInfo &LI, ScalarEvolution &SE)
+{
+    DataLayout DL(F.getParent());
+    KernelShape Shape;
+    for (LoopInfo::iterator Nest = LI.begin(), NestEnd = LI.end(); Nest != NestEnd; ++Nest) {
+        std::vector<Access> Accesses;
+        std::unordered_set<const SCEV *> Arrays;
+        uint64_t ElementSize = 0;
+        for (Loop::block_iterator BB = (*Nest)->block_begin(), BE = (*Nest)->block_end(); BB != BE; ++BB) {
+            for (BasicBlock::iterator I = (*BB)->begin(), IE = (*BB)->end(); I != IE; ++I) {
+                Value *Ptr;
+                Type *AccessedTy;
+                if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+                    Ptr = Load->getPointerOperand();
+                    AccessedTy = Load->getType();
+                } else if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+                    Ptr = Store->getPointerOperand();
+                    AccessedTy = Store->getValueOperand()->getType();
+                } else {
+                    continue;
+                }
+                const SCEV *Address = SE.getSCEV(Ptr);
+                const Access A = { Address, SE.getPointerBase(Address), LI.getLoopFor(*BB), isa<StoreInst>(I) };
+                Accesses.push_back(A);
+                Arrays.insert(A.Base);
+                ElementSize = std::max(ElementSize, DL.getTypeStoreSize(AccessedTy));
+            }
+        }
+
+        OptimizationProfile Profile = NONE;
+        if (isGemm(Accesses))
+            Profile = GEMM;
+        else if (isStencil(*Nest, Accesses, SE))
+            Profile = STENCIL;
+        else if (reusesAcrossOuterLoops(Accesses))
+            Profile = TILE;
+        // the most demanding loop nest of the function decides
+        if (Profile > Shape.profile || Shape.numArrays == 0) {
+            Shape.profile = Profile;
+            Shape.numArrays = Arrays.size();
+            Shape.elementSize = ElementSize;
+        }
+    }
+    return Shape;
+}
+
+baar::ProfileSelector::ProfileSelector(const ProfileSelection &selection, const CacheHierarchy &caches, bool vectorize, unsigned tileScale)
+    : FunctionPass(ID), selection(selection), caches(caches), vectorize(vectorize), tileScale(tileScale)
+{
+    cl::getRegisteredOptions(options);
+}
+
+unsigned baar::ProfileSelector::tileSize(OptimizationProfile profile, const KernelShape &shape, const CacheHierarchy &caches, unsigned scale)
+{
+    if (profile == NONE || profile == AUTO)
+        return 0;
+    // GEMM and stencils reuse tiles across a whole band (L2), other nests the rows of their tiles (L1);
+    // GEMM keeps half of L2 for the panels streamed through it
+    const uint64_t ElementSize = std::max<uint64_t>(shape.elementSize, 1);
+    uint64_t Budget = profile == TILE || caches.l2 == 0 ? caches.l1 : caches.l2;
+    if (profile == GEMM)
+        Budget /= 2;
+    unsigned Size = (unsigned) std::sqrt((double) (Budget / (std::max(shape.numArrays, 1U) * ElementSize))) * scale / 100;
+
+    // rows of tiles are whole cache lines
+    const unsigned LineElements = std::max<unsigned>(caches.lineSize / ElementSize, 1);
+    Size = std::max(LineElements, Size / LineElements * LineElements);
+    return std::min(Size, 256U);
+}
+
+void baar::ProfileSelector::setPollyOption(const std::string &name, const std::string &value)
+{
+    auto Option = options.find(name);
+    if (Option == options.end()) {
+        if (missingOptions.insert(name).second)
+            std::cout << "INFO: " << "Polly has no option -" << name << ", profiles do without it\n";
+        return;
+    }
+    // options are set again for every function
+    Option->second->setNumOccurrencesFlag(cl::ZeroOrMore);
+    if (Option->second->addOccurrence(0, name, value))
+        std::cout << "WARNING: " << "Polly does not accept -" << name << "=" << value << "\n";
+}
+
+bool baar::ProfileSelector::runOnFunction(Function &F)
+{
+    if (F.isDeclaration())
+        return false;
+
+    OptimizationProfile Profile = selection.fallback;
+    auto Selected = selection.byFunction.find(F.getName().str());
+    if (Selected != selection.byFunction.end())
+        Profile = Selected->second;
+    const KernelShape Shape = KernelShape::of(F, getAnalysis<LoopInfo>(), getAnalysis<ScalarEvolution>());
+    if (Profile == AUTO)
+        Profile = Shape.profile;
+    const unsigned TileSize = tileSize(Profile, Shape, caches, tileScale);
+
+    // older Polly tiles with a fixed size and has no register tiling or wavefronts, the vectorizer strip-mines for registers
+    setPollyOption("polly-no-tiling", Profile == NONE ? "true" : "false");
+    setPollyOption("polly-opt-maximize-bands", "yes");
+    setPollyOption("polly-opt-fusion", Profile == STENCIL ? "max" : "min");
+    setPollyOption("polly-opt-outer-coincidence", Profile == STENCIL ? "true" : "false");
+    setPollyOption("polly-vectorizer", Profile == GEMM && vectorize ? "polly" : "none");
+    setPollyOption("polly-register-tiling", Profile == GEMM ? "true" : "false");
+    if (TileSize > 0)
+        setPollyOption("polly-default-tile-size", std::to_string(TileSize));
+
+    std::cout << "INFO: \"" << F.getName().str() << "\" is optimized with profile " << profileName(Profile);
+    if (TileSize > 0)
+        std::cout << ", tiles of " << TileSize << " iterations";
+    std::cout << "\n";
+    return false;
+}
+
+void baar::ProfileSelector::getAnalysisUsage(AnalysisUsage &AU) const
+{
+    AU.addRequired<LoopInfo>();
+    AU.addRequired<ScalarEvolution>();
+    AU.setPreservesAll();
+}
@@ -0,0 +1,106 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef OPTIMIZATIONPROFILE_H
+#define OPTIMIZATIONPROFILE_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cinttypes>
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/CommandLine.h"
+
+namespace baar {
+    // sizes of the data caches of the host in bytes, read from sysfs (defaults if not available)
+    struct CacheHierarchy {
+        uint64_t l1 = 32 * 1024;
+        uint64_t l2 = 256 * 1024;
+        uint64_t l3 = 0;
+        uint64_t lineSize = 64;
+
+        static CacheHierarchy ofHost();
+    };
+
+    // how Polly schedules the SCoPs of a function:
+    // NONE keeps Polly's schedule, TILE tiles loop nests reusing data of outer loops for the L1 cache,
+    // STENCIL fuses the sweeps of time-iterated stencils and tiles them skewed across time steps (wavefronts),
+    // GEMM tiles for the L2 cache and strip-mines the innermost loop for vector registers (register tiling)
+    enum OptimizationProfile {
+        NONE, TILE, STENCIL, GEMM, AUTO
+    };
+    const char *profileName(OptimizationProfile profile);
+
+    // profiles given on the command line: "profile" for all functions, "function=profile" for single ones, separated by ','
+    struct ProfileSelection {
+        OptimizationProfile fallback = AUTO;
+        std::unordered_map<std::string, OptimizationProfile> byFunction;
+
+        // false if spec is malformed
+        static bool parse(const std::string &spec, ProfileSelection &selection);
+        // false if every function keeps Polly's schedule, Polly's schedule optimizer is not needed then
+        bool reschedules() const;
+    };
+
+    // what the loops of a function look like, as far as choosing a profile is concerned
+    struct KernelShape {
+        OptimizationProfile profile = NONE;   // the profile suiting the loops best
+        unsigned numArrays = 0;     // distinct arrays accessed in the loop nest the profile was chosen for
+        uint64_t elementSize = 0;   // largest element accessed in it in bytes
+
+        static KernelShape of(llvm::Function &F, llvm::LoopInfo &LI, llvm::ScalarEvolution &SE);
+    };
+
+    // Placed in front of Polly's schedule optimizer: chooses the profile of every function (from the selection or from
+    // the shape of its loops) and sets Polly's options for it. The pass manager runs all function passes on one function
+    // before going on to the next one, so the optimizer and code generation see the options of the function they work on.
+    // Options missing in the Polly the server is linked against are skipped (older Polly uses a fixed tile size).
+    class ProfileSelector : public llvm::FunctionPass {
+    public:
+        static char ID;
+        // tileScale: percentage of the tile sizes derived from the caches
+        ProfileSelector(const ProfileSelection &selection, const CacheHierarchy &caches, bool vectorize, unsigned tileScale = 100);
+
+        virtual bool runOnFunction(llvm::Function &F);
+        virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+
+        // edge of square tiles whose data of all arrays of the loop nest fits into the cache level the profile aims at
+        static unsigned tileSize(OptimizationProfile profile, const KernelShape &shape, const CacheHierarchy &caches, unsigned scale = 100);
+    private:
+        const ProfileSelection &selection;
+        const CacheHierarchy &caches;
+        const bool vectorize;
+        const unsigned tileScale;
+        llvm::StringMap<llvm::cl::Option *> options;
+        std::unordered_set<std::string> missingOptions;
+
+        void setPollyOption(const std::string &name, const std::string &value);
+    };
+}
+
+#endif // OPTIMIZATIONPROFILE_H
@@ -0,0 +1,402 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "pipelineplanner.h"
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+
+using namespace llvm;
+
+char baar::PipelinePlanner::ID = 0;
+
+static int64_t signExtend(uint64_t Value, unsigned Bits)
+{
+    return Bits >= 64 ? (int64_t) Value : (int64_t) (Value << (64 - Bits)) >> (64 - Bits);
+}
+
+static uint64_t zeroExtend(int64_t Value, unsigned Bits)
+{
+    return Bits >= 64 ? (uint64_t) Value : (uint64_t) Value & ((1ULL << Bits) - 1);
+}
+
+int64_t baar::ArgExpr::evaluate(const std::vector<GenericValue> &args) const
+{
+    int64_t Result = 0;
+    switch (kind) {
+        case CONSTANT:
+            Result = value;
+            break;
+        case ARGUMENT:
+            Result = args[value].IntVal.getSExtValue();
+            break;
+        case ADD:
+            for (const auto &Operand : operands)
+                Result += Operand.evaluate(args);
+            break;
+        case MUL:
+            Result = 1;
+            for (const auto &Operand : operands)
+                Result *= Operand.evaluate(args);
+            break;
+        case UDIV: {
+            const uint64_t Divisor = zeroExtend(operands[1].evaluate(args), bits);
+            Result = Divisor == 0U ? 0 : (int64_t) (zeroExtend(operands[0].evaluate(args), bits) / Divisor);
+            break;
+        }
+        case SMAX:
+            Result = INT64_MIN;
+            for (const auto &Operand : operands)
+                Result = std::max(Result, Operand.evaluate(args));
+            break;
+        case UMAX: {
+            uint64_t Max = 0U;
+            for (const auto &Operand : operands)
+                Max = std::max(Max, zeroExtend(Operand.evaluate(args), bits));
+            Result = (int64_t) Max;
+            break;
+        }
+        case ZEXT:
+            Result = (int64_t) zeroExtend(operands[0].evaluate(args), operands[0].bits);
+            break;
+        case SEXT:
+        case TRUNC:
+            Result = operands[0].evaluate(args);
+            break;
+    }
+    return signExtend((uint64_t) Result, bits);
+}
+
+bool baar::PipelinePlanner::toArgExpr(const SCEV *S, ArgExpr &Expr)
+{
+    Expr.bits = SE->getTypeSizeInBits(S->getType());
+    Expr.operands.clear();
+    if (const SCEVConstant *Constant = dyn_cast<SCEVConstant>(S)) {
+        Expr.kind = ArgExpr::CONSTANT;
+        Expr.value = Constant->getValue()->getValue().getSExtValue();
+        return Expr.bits <= 64;
+    }
+    if (const SCEVUnknown *Unknown = dyn_cast<SCEVUnknown>(S)) {
+        // only arguments are known when the function is called
+        const Argument *Arg = dyn_cast<Argument>(Unknown->getValue());
+        Expr.kind = ArgExpr::ARGUMENT;
+        Expr.value = Arg ? Arg->getArgNo() : 0;
+        return Arg != nullptr && Arg->getType()->isIntegerTy() && Expr.bits <= 64;
+    }
+    if (const SCEVCastExpr *Cast = dyn_cast<SCEVCastExpr>(S)) {
+        Expr.kind = isa<SCEVZeroExtendExpr>(Cast) ? ArgExpr::ZEXT : isa<SCEVSignExtendExpr>(Cast) ? ArgExpr::SEXT : ArgExpr::TRUNC;
+        Expr.operands.resize(1);
+        return toArgExpr(Cast->getOperand(), Expr.operands[0]);
+    }
+    if (const SCEVUDivExpr *UDiv = dyn_cast<SCEVUDivExpr>(S)) {
+        Expr.kind = ArgExpr::UDIV;
+        Expr.operands.resize(2);
+        return toArgExpr(UDiv->getLHS(), Expr.operands[0]) && toArgExpr(UDiv->getRHS(), Expr.operands[1]);
+    }
+    const SCEVNAryExpr *NAry = dyn_cast<SCEVNAryExpr>(S);
+    if (NAry == nullptr || isa<SCEVAddRecExpr>(NAry))
+        return false;
+    if (isa<SCEVAddExpr>(NAry))
+        Expr.kind = ArgExpr::ADD;
+    else if (isa<SCEVMulExpr>(NAry))
+        Expr.kind = ArgExpr::MUL;
+    else if (isa<SCEVSMaxExpr>(NAry))
+        Expr.kind = ArgExpr::SMAX;
+    else if (isa<SCEVUMaxExpr>(NAry))
+        Expr.kind = ArgExpr::UMAX;
+    else
+        return false;
+    Expr.operands.resize(NAry->getNumOperands());
+    for (unsigned i = 0; i < NAry->getNumOperands(); i++)
+        if (!toArgExpr(NAry->getOperand(i), Expr.operands[i]))
+            return false;
+    return true;
+}
+
+bool baar::PipelinePlanner::addAccess(Value *Ptr, Type *AccessedTy, bool IsWrite, const Loop *L, const DataLayout &DL, PipelinePlan &Plan, std::unordered_map<unsigned, const SCEV *> &Strides)
+{
+    const SCEV *S = SE->getSCEV(Ptr);
+    const SCEVUnknown *Base = dyn_cast<SCEVUnknown>(SE->getPointerBase(S));
+    if (Base == nullptr)
+        return false;
+    // memory of the server itself does not have to arrive first
+    if (isa<GlobalVariable>(Base->getValue()) || isa<AllocaInst>(Base->getValue())) {
+        Plan.usesServerMemory |= IsWrite || isa<AllocaInst>(Base->getValue());
+        return true;
+    }
+    const Argument *Arg = dyn_cast<Argument>(Base->getValue());
+    if (Arg == nullptr)
+        return false;
+
+    ArrayPartition &Array = Plan.arrays[Arg->getArgNo()];
+    Array.written |= IsWrite;
+    if (!Array.partitioned)
+        return true;
+    if (L == nullptr) {
+        Array.partitioned = false;
+        return true;
+    }
+
+    // walk from the innermost loop of the access outwards, until reaching the outer loop
+    AccessExtent Extent;
+    Extent.size = DL.getTypeStoreSize(AccessedTy);
+    const SCEV *Offset = SE->getMinusSCEV(S, Base);
+    const SCEV *Stride = nullptr;
+    while (const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(Offset)) {
+        if (!AddRec->isAffine())
+            break;
+        const SCEV *Step = AddRec->getStepRecurrence(*SE);
+        if (AddRec->getLoop() == L) {
+            Stride = Step;
+            Offset = AddRec->getStart();
+            break;
+        }
+        const SCEV *Count = SE->getBackedgeTakenCount(AddRec->getLoop());
+        std::pair<ArgExpr, ArgExpr> InnerLoop;
+        if (isa<SCEVCouldNotCompute>(Count) || !SE->isLoopInvariant(Step, L) || !SE->isLoopInvariant(Count, L)
+                || !toArgExpr(Step, InnerLoop.first) || !toArgExpr(Count, InnerLoop.second))
+            break;
+        Extent.innerLoops.push_back(InnerLoop);
+        Offset = AddRec->getStart();
+    }
+
+    // accesses not advancing with the outer loop or in a way not expressible need the whole array
+    if (Stride == nullptr || !SE->isLoopInvariant(Offset, L) || !toArgExpr(Offset, Extent.start)) {
+        Array.partitioned = false;
+        return true;
+    }
+    auto KnownStride = Strides.find(Arg->getArgNo());
+    if (KnownStride == Strides.end()) {
+        Strides[Arg->getArgNo()] = Stride;
+        if (!toArgExpr(Stride, Array.stride)) {
+            Array.partitioned = false;
+            return true;
+        }
+    } else if (KnownStride->second != Stride) {
+        Array.partitioned = false;
+        return true;
+    }
+    Array.accesses.push_back(Extent);
+    return true;
+}
+
+bool baar::PipelinePlanner::runOnFunction(Function &F)
+{
+    if (F.isDeclaration() || !F.getReturnType()->isVoidTy())
+        return false;
+    LoopInfo &LI = getAnalysis<LoopInfo>();
+    SE = &getAnalysis<ScalarEvolution>();
+    if (std::distance(LI.begin(), LI.end()) != 1)
+        return false;
+
+    // the loop is only left at its latch, so tiles can end it early without skipping anything
+    Loop *L = *LI.begin();
+    PipelinePlan Plan;
+    Plan.tileFunction = nullptr;
+    Plan.preheader = L->getLoopPreheader();
+    Plan.header = L->getHeader();
+    Plan.inductionVariable = nullptr;
+    if (Plan.preheader == nullptr || L->getLoopLatch() == nullptr || L->getExitingBlock() != L->getLoopLatch())
+        return false;
+
+    // only one value may be carried between iterations, counting them by one; others could not start in the middle
+    for (BasicBlock::iterator I = Plan.header->begin(); PHINode *PN = dyn_cast<PHINode>(I); ++I) {
+        const SCEVAddRecExpr *AddRec = dyn_cast<SCEVAddRecExpr>(SE->getSCEV(PN));
+        const SCEVConstant *Step = AddRec && AddRec->getLoop() == L && AddRec->isAffine() ? dyn_cast<SCEVConstant>(AddRec->getStepRecurrence(*SE)) : nullptr;
+        if (Plan.inductionVariable != nullptr || !PN->getType()->isIntegerTy() || Step == nullptr || !Step->getValue()->isOne())
+            return false;
+        Plan.inductionVariable = PN;
+    }
+    const SCEV *BackedgeTakenCount = SE->getBackedgeTakenCount(L);
+    if (Plan.inductionVariable == nullptr || isa<SCEVCouldNotCompute>(BackedgeTakenCount) || !toArgExpr(BackedgeTakenCount, Plan.backedgeTakenCount))
+        return false;
+
+    // every tile runs the code around the loop again, it must not have side effects
+    DataLayout DL(F.getParent());
+    std::unordered_map<unsigned, const SCEV *> Strides;
+    for (Function::iterator BB = F.begin(), BE = F.end(); BB != BE; ++BB) {
+        const Loop *AccessLoop = L->contains(BB) ? L : nullptr;
+        for (BasicBlock::iterator I = BB->begin(), IE = BB->end(); I != IE; ++I) {
+            if (isa<DbgInfoIntrinsic>(I))
+                continue;
+            if (LoadInst *Load = dyn_cast<LoadInst>(I)) {
+                if (!Load->isSimple() || !addAccess(Load->getPointerOperand(), Load->getType(), false, AccessLoop, DL, Plan, Strides))
+                    return false;
+            } else if (StoreInst *Store = dyn_cast<StoreInst>(I)) {
+                if (AccessLoop == nullptr || !Store->isSimple() || !addAccess(Store->getPointerOperand(), Store->getValueOperand()->getType(), true, AccessLoop, DL, Plan, Strides))
+                    return false;
+            } else if (CallInst *Call = dyn_cast<CallInst>(I)) {
+                if (!Call->doesNotAccessMemory() || Call->mayThrow())
+                    return false;
+            } else if (I->mayReadOrWriteMemory() || I->mayThrow()) {
+                return false;
+            }
+        }
+    }
+
+    plans[&F] = Plan;
+#ifndef NDEBUG
+    std::cout << "DEBUG: \"" << F.getName().str() << "\" can be run in tiles, " << Plan.arrays.size() << " arrays are used\n";
+#endif
+    return false;
+}
+
+void baar::PipelinePlanner::getAnalysisUsage(AnalysisUsage &AU) const
+{
+    AU.addRequired<LoopInfo>();
+    AU.addRequired<ScalarEvolution>();
+    AU.setPreservesAll();
+}
+
+void baar::PipelinePlanner::createTileFunctions(std::unordered_map<Function *, PipelinePlan> &plans)
+{
+    for (auto &FunctionAndPlan : plans) {
+        Function *F = FunctionAndPlan.first;
+        PipelinePlan &Plan = FunctionAndPlan.second;
+        LLVMContext &Context = F->getContext();
+
+        std::vector<Type *> Params(F->getFunctionType()->param_begin(), F->getFunctionType()->param_end());
+        Params.push_back(Type::getInt64Ty(Context));
+        Params.push_back(Type::getInt64Ty(Context));
+        Function *Tile = Function::Create(FunctionType::get(F->getReturnType(), Params, false), GlobalValue::ExternalLinkage, F->getName() + "_baar_tile", F->getParent());
+
+        ValueToValueMapTy VMap;
+        Function::arg_iterator TileArg = Tile->arg_begin();
+        for (Function::arg_iterator Arg = F->arg_begin(), ArgEnd = F->arg_end(); Arg != ArgEnd; ++Arg, ++TileArg) {
+            TileArg->setName(Arg->getName());
+            VMap[Arg] = TileArg;
+        }
+        Argument *First = TileArg++;
+        Argument *End = TileArg;
+        First->setName("first");
+        End->setName("end");
+        SmallVector<ReturnInst *, 4> Returns;
+        CloneFunctionInto(Tile, F, VMap, false, Returns);
+
+        // the loop starts at iteration first ...
+        BasicBlock *Preheader = cast<BasicBlock>(VMap[Plan.preheader]);
+        BasicBlock *Header = cast<BasicBlock>(VMap[Plan.header]);
+        PHINode *IndVar = cast<PHINode>(VMap[Plan.inductionVariable]);
+        IRBuilder<> Builder(Preheader->getTerminator());
+        const int PreheaderIndex = IndVar->getBasicBlockIndex(Preheader);
+        Value *Start = IndVar->getIncomingValue(PreheaderIndex);
+        Value *FirstIndVar = Builder.CreateAdd(Start, Builder.CreateIntCast(First, IndVar->getType(), true), "tile.first");
+        Value *EndIndVar = Builder.CreateAdd(Start, Builder.CreateIntCast(End, IndVar->getType(), true), "tile.end");
+        IndVar->setIncomingValue(PreheaderIndex, FirstIndVar);
+
+        // ... and returns before iteration end, nothing behind the loop has side effects
+        BasicBlock *Body = SplitBlock(Header, Header->getFirstNonPHI(), nullptr);
+        BasicBlock *Return = BasicBlock::Create(Context, "tile.return", Tile);
+        ReturnInst::Create(Context, Return);
+        Header->getTerminator()->eraseFromParent();
+        Builder.SetInsertPoint(Header);
+        Builder.CreateCondBr(Builder.CreateICmpNE(IndVar, EndIndVar, "tile.continue"), Body, Return);
+
+        Plan.tileFunction = Tile;
+    }
+}
+
+baar::PipelineSchedule::PipelineSchedule(const PipelinePlan &plan, const std::vector<GenericValue> &args, const std::vector<uint64_t> &arraySizes, uint64_t chunkSize) : arraySizes(arraySizes)
+{
+    // loops not entered have a negative count here, the function is run at once then
+    const int64_t backedgeTakenCount = plan.backedgeTakenCount.evaluate(args);
+    numIterations = backedgeTakenCount < 0 ? 0U : (uint64_t) backedgeTakenCount + 1;
+
+    for (const auto &IndexAndArray : plan.arrays) {
+        const ArrayPartition &array = IndexAndArray.second;
+        Bounds &arrayBounds = bounds[IndexAndArray.first];
+        arrayBounds.written = array.written;
+        arrayBounds.partitioned = array.partitioned && !array.accesses.empty();
+        arrayBounds.stride = arrayBounds.partitioned ? array.stride.evaluate(args) : 0;
+        arrayBounds.low = INT64_MAX;
+        arrayBounds.high = INT64_MIN;
+        for (const auto &access : array.accesses) {
+            int64_t low = access.start.evaluate(args);
+            int64_t high = low + (int64_t) access.size;
+            for (const auto &innerLoop : access.innerLoops) {
+                const int64_t extent = innerLoop.first.evaluate(args) * std::max<int64_t>(innerLoop.second.evaluate(args), 0);
+                (extent < 0 ? low : high) += extent;
+            }
+            arrayBounds.low = std::min(arrayBounds.low, low);
+            arrayBounds.high = std::max(arrayBounds.high, high);
+        }
+        if (arrayBounds.stride < 0)
+            arrayBounds.partitioned = false;
+        if (arrayBounds.partitioned)
+            largestStride = std::max<uint64_t>(largestStride, arrayBounds.stride);
+    }
+
+    // without arrays advancing with the loop, all iterations form one tile
+    iterationsPerTile = std::max<uint64_t>(largestStride > 0 ? chunkSize / largestStride : numIterations, 1U);
+
+    // iterations are independent if every written array is only touched within the stride of an iteration,
+    // the memory of arrays passed to the call might overlap though (arrays used in place)
+    parallel = !plan.usesServerMemory;
+    for (const auto &IndexAndBounds : bounds) {
+        const Bounds &written = IndexAndBounds.second;
+        if (!written.written)
+            continue;
+        if (!written.partitioned || written.stride <= 0 || written.high - written.low > written.stride)
+            parallel = false;
+        const char *writtenBegin = (const char *) args[IndexAndBounds.first].PointerVal;
+        for (const auto &OtherIndexAndBounds : bounds) {
+            const char *otherBegin = (const char *) args[OtherIndexAndBounds.first].PointerVal;
+            if (OtherIndexAndBounds.first != IndexAndBounds.first && writtenBegin < otherBegin + arraySizes[OtherIndexAndBounds.first]
+                    && otherBegin < writtenBegin + arraySizes[IndexAndBounds.first])
+                parallel = false;
+        }
+    }
+}
+
+uint64_t baar::PipelineSchedule::neededBy(unsigned i, uint64_t end) const
+{
+    auto arrayBounds = bounds.find(i);
+    if (arrayBounds == bounds.end())
+        return 0U;
+    if (!arrayBounds->second.partitioned)
+        return arraySizes[i];
+    if (end == 0U)
+        return 0U;
+    const int64_t needed = (int64_t) (end - 1) * arrayBounds->second.stride + arrayBounds->second.high;
+    return (uint64_t) std::min<int64_t>(std::max<int64_t>(needed, 0), arraySizes[i]);
+}
+
+uint64_t baar::PipelineSchedule::finalBefore(unsigned i, uint64_t begin) const
+{
+    auto arrayBounds = bounds.find(i);
+    if (begin >= numIterations || arrayBounds == bounds.end() || !arrayBounds->second.written)
+        return arraySizes[i];
+    if (!arrayBounds->second.partitioned)
+        return 0U;
+    const int64_t final = (int64_t) begin * arrayBounds->second.stride + arrayBounds->second.low;
+    return (uint64_t) std::min<int64_t>(std::max<int64_t>(final, 0), arraySizes[i]);
+}
@@ -0,0 +1,136 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef PIPELINEPLANNER_H
+#define PIPELINEPLANNER_H
+
+#include <vector>
+#include <unordered_map>
+#include <cinttypes>
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/ExecutionEngine/GenericValue.h"
+
+namespace baar {
+    // integer expression over the arguments of a function, evaluated for every call
+    struct ArgExpr {
+        enum Kind {
+            CONSTANT, ARGUMENT, ADD, MUL, UDIV, SMAX, UMAX, ZEXT, SEXT, TRUNC
+        } kind = CONSTANT;
+        int64_t value = 0;  // CONSTANT: the constant, ARGUMENT: index of the argument
+        unsigned bits = 64; // bit width of the expression's type, values are kept sign extended to 64 bit
+        std::vector<ArgExpr> operands;
+
+        int64_t evaluate(const std::vector<llvm::GenericValue> &args) const;
+    };
+
+    // bytes an access reads or writes in iteration k of the outer loop: start + k * stride plus
+    // step * [0, backedge taken count] of every inner loop, plus the size of the accessed value
+    struct AccessExtent {
+        ArgExpr start;
+        std::vector<std::pair<ArgExpr, ArgExpr> > innerLoops; // step, backedge taken count
+        uint64_t size;
+    };
+
+    struct ArrayPartition {
+        bool partitioned = true;    // false if the whole array might be used by every iteration
+        bool written = false;
+        ArgExpr stride;     // in bytes per iteration of the outer loop, shared by all accesses
+        std::vector<AccessExtent> accesses;
+    };
+
+    struct PipelinePlan {
+        // takes the arguments of the function plus the first and the end iteration of its outer loop as i64
+        llvm::Function *tileFunction;
+        ArgExpr backedgeTakenCount;
+        std::unordered_map<unsigned, ArrayPartition> arrays; // by index of pointer argument
+        bool usesServerMemory = false; // writes globals or uses allocas, which might carry values between iterations
+
+        // outer loop of the function, used for creating tileFunction
+        llvm::BasicBlock *preheader;
+        llvm::BasicBlock *header;
+        llvm::PHINode *inductionVariable;
+    };
+
+    // Finds functions which can be run in tiles of their only outer loop: void functions without side effects outside of it,
+    // a loop counting from its start by one that is only left at its latch, all memory accesses expressible by ScalarEvolution
+    // in terms of the function's arguments. Tiles are run one after another, so the loop does not have to be parallel;
+    // the plan tells which bytes of the arrays a tile uses, so it can run as soon as those arrived.
+    // If those show that no iteration touches what another one writes, parts of the loop can also be run in parallel.
+    class PipelinePlanner : public llvm::FunctionPass {
+    public:
+        static char ID;
+        PipelinePlanner(std::unordered_map<llvm::Function *, PipelinePlan> &plans) : FunctionPass(ID), plans(plans) {}
+
+        virtual bool runOnFunction(llvm::Function &F);
+        virtual void getAnalysisUsage(llvm::AnalysisUsage &AU) const;
+
+        // adds a tile function for every plan to the module, has to be run after the pass
+        static void createTileFunctions(std::unordered_map<llvm::Function *, PipelinePlan> &plans);
+    private:
+        std::unordered_map<llvm::Function *, PipelinePlan> &plans;
+        llvm::ScalarEvolution *SE;
+
+        bool toArgExpr(const llvm::SCEV *S, ArgExpr &Expr);
+        // false if the accessed memory cannot be told, L is nullptr for accesses outside of the loop
+        bool addAccess(llvm::Value *Ptr, llvm::Type *AccessedTy, bool IsWrite, const llvm::Loop *L, const llvm::DataLayout &DL, PipelinePlan &Plan, std::unordered_map<unsigned, const llvm::SCEV *> &Strides);
+    };
+
+    // byte ranges of the arrays used by the tiles of one call
+    class PipelineSchedule {
+    public:
+        // arraySizes in bytes by argument index, iterations of a tile use about chunkSize bytes of the largest array
+        PipelineSchedule(const PipelinePlan &plan, const std::vector<llvm::GenericValue> &args, const std::vector<uint64_t> &arraySizes, uint64_t chunkSize);
+
+        uint64_t getNumIterations() const { return numIterations; }
+        uint64_t getIterationsPerTile() const { return iterationsPerTile; }
+        // bytes at the front of the array of argument i iterations [0, end) might use
+        uint64_t neededBy(unsigned i, uint64_t end) const;
+        // bytes at the front of the array of argument i iterations [begin, numIterations) do not write anymore
+        uint64_t finalBefore(unsigned i, uint64_t begin) const;
+        // true if iterations can run in any order: arrays written stay within the stride of their iteration and do not overlap others
+        bool isParallel() const { return parallel; }
+        uint64_t getLargestStride() const { return largestStride; }
+    private:
+        struct Bounds {
+            bool partitioned;
+            bool written;
+            int64_t stride;
+            int64_t low;    // offsets used by iteration k are within [k * stride + low, k * stride + high)
+            int64_t high;
+        };
+        std::unordered_map<unsigned, Bounds> bounds;
+        const std::vector<uint64_t> &arraySizes;
+        uint64_t numIterations = 0U;
+        uint64_t iterationsPerTile = 1U;
+        uint64_t largestStride = 0U;
+        bool parallel = false;
+    };
+}
+
+#endif // PIPELINEPLANNER_H
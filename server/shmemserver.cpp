@@ -26,74 +26,123 @@
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <signal.h>
+#include <cerrno>
 #include <cstdint>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "../common/shmemhelperfunctions.h"
+#include "../common/shmemchannel.h"
+#include "../common/callframe.h"
+#include "../common/residency.h"
+#include "../common/argumentdirection.h"
 
-ShmemServer::ShmemServer(backendTypes backendType) : AbstractServer(backendType)
+llvm::cl::opt<unsigned> ShmemThreads("shmem-threads", llvm::cl::desc("Number of shared memory clients served in parallel, defaults to the number of cores"), llvm::cl::init(0));
+
+thread_local std::vector<void *> ShmemServer::transientArrays;
+thread_local char *ShmemServer::arena = nullptr;
+thread_local uint64_t ShmemServer::arenaSize = 0U;
+
+ShmemServer::ShmemServer(backendTypes backendType) : AbstractServer(backendType), shuttingDown(false), activeSessions(0)
 {
 }
 
 void ShmemServer::initCommunication()
 {
-#ifndef NDEBUG
-    std::cout << "Creating shared memory region of size: " << (SHMEM_SIZE/1024)/1024 << " MB" << std::endl;
-#endif
-
+    // control region, clients request their channels here
     int shmemfd = shm_open(SHMEM_NAME.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
     if (shmemfd == -1)
         error("ERROR, could not allocate shared memory");
 
-    if (ftruncate(shmemfd, SHMEM_SIZE) != 0)
+    if (ftruncate(shmemfd, sizeof(ShmemChannel::ControlRegion)) != 0)
         error("ERROR, unable to resize shared memory region");
 
-    shmemptr = mmap(0, SHMEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
-    if (shmemptr == MAP_FAILED)
+    controlptr = mmap(0, sizeof(ShmemChannel::ControlRegion), PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
+    if (controlptr == MAP_FAILED)
         error("ERROR, unable to map shared memory region into memory");
     close(shmemfd);
-    *(char *) shmemptr = '\0';
+    ((ShmemChannel::ControlRegion *) controlptr)->serverPid = getpid();
+    for (auto &slot : ((ShmemChannel::ControlRegion *) controlptr)->slots)
+        slot.state.store(ShmemChannel::FREE);
 
-    // create and initialise semaphore for synchronisation
+    // create and initialise semaphore clients post after requesting a channel
     if (sem_unlink(SHMEM_SEM_NAME.c_str()) == 0)
         std::cout << "WARNING" << ": server did not exit cleanly previously\n";
-    shmem_sem = sem_open(SHMEM_SEM_NAME.c_str(), O_CREAT, 0666, 0);
-    if (shmem_sem == SEM_FAILED)
+    control_sem = sem_open(SHMEM_SEM_NAME.c_str(), O_CREAT, 0666, 0);
+    if (control_sem == SEM_FAILED)
         error("ERROR, unable to create semaphore");
 
-    // create and initialise semaphore for forcing order on synchronisation
-    if (sem_unlink(SHMEM_FORCE_ORDER_SEM_NAME.c_str()) == 0)
-        std::cout << "WARNING" << ": server did not exit cleanly previously\n";
-    shmem_force_order_sem = sem_open(SHMEM_FORCE_ORDER_SEM_NAME.c_str(), O_CREAT, 0666, 1);
-    if (shmem_force_order_sem == SEM_FAILED)
-        error("ERROR, unable to create semaphore");
+    workers.reset(new ThreadPool(ShmemThreads ? ShmemThreads : std::thread::hardware_concurrency()));
+    std::cout << "INFO: serving up to " << workers->getNumThreads() << " shared memory clients in parallel\n";
 }
 
 void ShmemServer::handleCommunication()
 {
-    sem_wait(shmem_force_order_sem);
-    // wait for client to connect
-    sem_wait(shmem_sem);
-    sem_post(shmem_force_order_sem);
-    handle_conn();
+    auto control = (ShmemChannel::ControlRegion *) controlptr;
+    while (1) {
+        // wait for clients requesting a channel
+        if (sem_wait(control_sem) == -1) {
+            if (errno == EINTR)
+                continue;
+            error("ERROR, unable to wait for clients");
+        }
+
+        for (auto &slot : control->slots) {
+            if (slot.state.load() != ShmemChannel::REQUESTED)
+                continue;
+
+            const pid_t clientPid = slot.clientPid;
+            int shmemfd = shm_open(slot.channelName, O_RDWR, 0666);
+            void *channel = shmemfd == -1 ? MAP_FAILED : mmap(0, SHMEM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, shmemfd, 0);
+            if (shmemfd != -1)
+                close(shmemfd);
+            // the slot is not needed anymore, the client communicates over its channel from now on
+            slot.state.store(ShmemChannel::FREE);
+            if (channel == MAP_FAILED) {
+                perror("ERROR, unable to map channel of client");
+                continue;
+            }
+
+            // a worker serves its client until the client exits, a client no worker is free for would wait
+            // without any notice, it is refused and told so instead
+            auto header = ShmemChannel::header(channel);
+            if (activeSessions.load() >= workers->getNumThreads()) {
+                std::cout << "WARNING" << ": refusing client " << clientPid << ", all " << workers->getNumThreads() << " workers serve other clients (see -shmem-threads)\n";
+                header->status.store(ShmemChannel::BUSY);
+                header->toClient.ring();
+                if (munmap(channel, SHMEM_SIZE))
+                    perror("ERROR, unable to unmap channel from memory");
+                continue;
+            }
+
+            std::cout << "New client connection (pid " << clientPid << ")" << std::endl;
+            activeSessions++;
+            workers->enqueue([this, channel, clientPid] {
+                handle_conn(channel, clientPid);
+                if (munmap(channel, SHMEM_SIZE))
+                    perror("ERROR, unable to unmap channel from memory");
+                activeSessions--;
+            });
+        }
+    }
 }
 
 void ShmemServer::cleanupCommunication()
 {
-    // close and destroy shared semaphore
-    if (sem_close(shmem_force_order_sem) == -1)
-        perror("ERROR, unable to close semaphore");
-
-    if (sem_unlink(SHMEM_FORCE_ORDER_SEM_NAME.c_str()) == -1)
-        perror("ERROR, unable to unlink semaphore");
+    // workers end their sessions within a second, running calls are finished first
+    shuttingDown = true;
+    workers.reset();
 
     // close and destroy shared semaphore
-    if (sem_close(shmem_sem) == -1)
+    if (sem_close(control_sem) == -1)
         perror("ERROR, unable to close semaphore");
 
     if (sem_unlink(SHMEM_SEM_NAME.c_str()) == -1)
@@ -103,16 +152,46 @@ void ShmemServer::cleanupCommunication()
     std::cout << "Clearing shared memory" << std::endl;
 #endif
 
-    // make completely sure that the exit symbol is gone, in case of an immediate rerun of the server
-    *(char *) shmemptr = '\0';
-
-    if (munmap(shmemptr, SHMEM_SIZE))
+    if (munmap(controlptr, sizeof(ShmemChannel::ControlRegion)))
         perror("ERROR, unable to unmap shared memory region from memory");
 
     if (shm_unlink(SHMEM_NAME.c_str()))
         perror("ERROR, unable to unlink shared memory region");
 }
 
+bool ShmemServer::waitForClient(Doorbell *toServer, pid_t clientPid)
+{
+    // wake up regularly, the client might have died or the server might be shutting down
+    while (!toServer->wait(1000000U)) {
+        if (shuttingDown)
+            return false;
+        if (kill(clientPid, 0) == -1 && errno == ESRCH) {
+            std::cout << "WARNING" << ": client " << clientPid << " vanished without closing its channel\n";
+            return false;
+        }
+    }
+    return !shuttingDown;
+}
+
+void ShmemServer::mapArena(const ShmemChannel::Header *header)
+{
+    char arenaName[sizeof(header->arenaName)];
+    memcpy(arenaName, header->arenaName, sizeof(arenaName));
+    arenaName[sizeof(arenaName) - 1] = '\0';
+    if (arenaName[0] == '\0')
+        return;
+
+    int shmemfd = shm_open(arenaName, O_RDWR, 0666);
+    void *mapped = shmemfd == -1 ? MAP_FAILED : mmap(0, header->arenaSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_NORESERVE, shmemfd, 0);
+    if (shmemfd != -1)
+        close(shmemfd);
+    if (mapped == MAP_FAILED)
+        error("ERROR, unable to map arena of client");
+    arena = (char *) mapped;
+    arenaSize = header->arenaSize;
+    std::cout << "INFO: arrays in the client's arena " << arenaName << " (" << (arenaSize >> 20) << " MB) are used in place\n";
+}
+
 void ShmemServer::unmarshalCallArgs(char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs)
 {
     llvm::FunctionType *CalledFuncType = calledFunction->getFunctionType();
@@ -120,6 +199,7 @@ void ShmemServer::unmarshalCallArgs(char *buffer, int functionName_offset, llvm:
 
     // skip function name in msg from client
     void *shmempos = buffer + functionName_offset + 1;
+    argumentSizes.assign(numArgs, 0U);
 
     // parse arguments into GenericValues for the ExecutionEngine
     for (int i = 0; i < numArgs; i++) {
@@ -127,14 +207,43 @@ void ShmemServer::unmarshalCallArgs(char *buffer, int functionName_offset, llvm:
         llvm::Type *CurrType = CalledFuncType->getParamType(i);
         llvm::Type* pointerToTy;
         switch (CurrType->getTypeID()) {
-            case llvm::Type::PointerTyID:
+            case llvm::Type::PointerTyID: {
                     pointerToTy = static_cast<llvm::PointerType*>(CurrType)->getElementType();
                     while (pointerToTy->getTypeID() == llvm::Type::ArrayTyID || pointerToTy->getTypeID() == llvm::Type::PointerTyID)
                         pointerToTy = llvm::cast<llvm::SequentialType>(pointerToTy)->getElementType();
 
-                    CurrArg.PointerVal = ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoNewMemory(shmempos, pointerToTy);
-                    indexesOfPointersInArgs.push_back(i);
+                    // arrays are prefixed with their residency, resident arrays are taken from the buffer registry
+                    const Residency::ArrayResidency residency = *(Residency::ArrayResidency *)shmempos;
+                    shmempos = (Residency::ArrayResidency *) shmempos + 1;
+                    const std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidth(pointerToTy->getTypeID(), pointerToTy->isIntegerTy() ? pointerToTy->getIntegerBitWidth() : 0U);
+                    const Residency::BufferKey key = { residency.clientAddress, *(int64_t *)shmempos * CallFrame::elementSize(typeIDAndBitwidth) };
+                    if (residency.flags == Residency::SHARED) {
+                        // in the client's arena, used in place, nothing is transferred back either
+                        if (arena == nullptr || residency.clientAddress > arenaSize || key.size > arenaSize - residency.clientAddress)
+                            error(std::string("ERROR, array of argument " + std::to_string(i+1) + " is not within the arena of the client").c_str());
+                        CurrArg.PointerVal = arena + residency.clientAddress;
+                        shmempos = (int64_t *) shmempos + 1;
+                    } else switch (residency.flags) {
+                        case Residency::RESIDENT:
+                            CurrArg.PointerVal = bufferRegistry.lookup(key, residency.version);
+                            if (CurrArg.PointerVal == nullptr)
+                                error(std::string("ERROR, array of argument " + std::to_string(i+1) + " is not resident in requested version").c_str());
+                            shmempos = (int64_t *) shmempos + 1;
+                            break;
+                        case Residency::KEEP:
+                            CurrArg.PointerVal = bufferRegistry.keep(key, residency.version);
+                            ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoExistingMemory(shmempos, typeIDAndBitwidth, CurrArg.PointerVal);
+                            break;
+                        default:
+                            CurrArg.PointerVal = ShmemHelperFunctions::unmarshalArrayFromMemoryAsTypeIntoNewMemory(shmempos, pointerToTy);
+                            transientArrays.push_back(CurrArg.PointerVal);
+                    }
+                    argumentSizes[i] = key.size;
+                    // only arrays written by the function are transferred back
+                    if (residency.flags != Residency::SHARED && ArgumentDirection::isDownloaded(residency.direction))
+                        indexesOfPointersInArgs.push_back(i);
                 break;
+            }
             case llvm::Type::FloatTyID:
                 CurrArg.FloatVal = *(float *)shmempos;
                 shmempos = (float *) shmempos + 1;
@@ -214,25 +323,42 @@ void ShmemServer::unmarshalCallArgs(char *buffer, int functionName_offset, llvm:
     }
     if (numArgs == 0)
         std::cout << ")'\n";
+
+    // behind the arguments: resident arrays not needed by the client anymore
+    const uint64_t numReleased = *(uint64_t *)shmempos;
+    shmempos = (uint64_t *) shmempos + 1;
+    for (uint64_t i = 0; i < numReleased; i++)
+        bufferRegistry.release(((Residency::BufferKey *) shmempos)[i]);
 }
 
-void ShmemServer::handle_conn()
+void ShmemServer::handle_conn(void *channel, pid_t clientPid)
 {
 #ifndef NDEBUG
     std::cout << "DEBUG" << ": got IR" << std::endl;
 #endif
-    // initialize backend with received IR
-    auto backend = parseIRtoBackend((char *) shmemptr);
+    void *shmemptr = ShmemChannel::messages(channel);
+    ShmemChannel::Header *header = ShmemChannel::header(channel);
+    Doorbell *toServer = &header->toServer;
+    Doorbell *toClient = &header->toClient;
+
+    // get backends for the IR the client put into its channel, clients sending the same module share them,
+    // calls into them are serialised
+    auto backend = getSharedBackend((char *) shmemptr, SHMEM_SIZE - ShmemChannel::HEADER_SIZE);
+    if (!backend) {
+        std::cout << "WARNING" << ": could not build module, closing channel of client " << clientPid << "\n";
+        header->status.store(ShmemChannel::FAILED);
+        toClient->ring();
+        return;
+    }
+    mapArena(header);
     *(long *)shmemptr = TimeDiffOpt.count();
     *(((long *)shmemptr) + 1) = TimeDiffInit.count();
     // signal to client: got IR, ready to get calls, time measures in shmem
-    sem_post(shmem_sem);
+    header->status.store(ShmemChannel::SERVING);
+    toClient->ring();
 
-    while (1) {
-        sem_wait(shmem_force_order_sem);
-        // wait for call
-        sem_wait(shmem_sem);
-        sem_post(shmem_force_order_sem);
+    // wait for calls
+    while (waitForClient(toServer, clientPid)) {
 #ifndef NDEBUG
         std::cout << "DEBUG" << ": got call \n";
 #endif
@@ -247,7 +373,14 @@ void ShmemServer::handle_conn()
         llvm::Function* calledFunction = nullptr;
         std::vector<llvm::GenericValue> args;
         std::list<std::vector<llvm::GenericValue>::size_type> indexesOfPointersInArgs;
-        llvm::GenericValue result = handleCall(backend.get(), (char *) shmemptr, calledFunction, args, indexesOfPointersInArgs);
+        const std::string functionName = AbstractBackend::parseFunctionName((char *) shmemptr);
+        AbstractBackend *variant = backend->variants->select(functionName);
+        llvm::GenericValue result;
+        {
+            std::lock_guard<std::mutex> lock(backend->callMutex);
+            result = handleCall(variant, (char *) shmemptr, calledFunction, args, indexesOfPointersInArgs);
+        }
+        backend->variants->record(functionName, variant, TimeDiffLastExecution);
 
         auto shmempos = shmemptr;
         // write measured time to memory
@@ -264,9 +397,11 @@ void ShmemServer::handle_conn()
                 ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(args[indexOfPtr].PointerVal, args[indexOfPtr+1].IntVal.getSExtValue(), std::pair<llvm::Type::TypeID, unsigned>(paramType->getTypeID(), ((llvm::IntegerType*)paramType)->getBitWidth()), shmempos);
             } else
                 ShmemHelperFunctions::marshallArrayOfSizeAndTypeIntoMemory(args[indexOfPtr].PointerVal, args[indexOfPtr+1].IntVal.getSExtValue(), std::pair<llvm::Type::TypeID, unsigned>(paramType->getTypeID(), 0U), shmempos);
-
-            free(args[indexOfPtr].PointerVal);
         }
+        // resident arrays stay in the buffer registry for the next call
+        for (auto array : transientArrays)
+            free(array);
+        transientArrays.clear();
 
         switch (calledFunction->getReturnType()->getTypeID()) {
             case llvm::Type::VoidTyID:
@@ -316,6 +451,11 @@ void ShmemServer::handle_conn()
         std::cout << "DEBUG" << ": signaling 'result is ready' to client \n";
 #endif
 
-        sem_post(shmem_sem);
+        toClient->ring();
     }
+    bufferRegistry.clear();
+    if (arena != nullptr && munmap(arena, arenaSize))
+        perror("ERROR, unable to unmap arena of client");
+    arena = nullptr;
+    arenaSize = 0U;
 }
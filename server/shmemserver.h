@@ -25,8 +25,20 @@
 #define SHMEMSERVER_H
 
 #include "abstractserver.h"
+#include "threadpool.h"
+#include "../common/shmemchannel.h"
+
 #include <semaphore.h>
+#include <sys/types.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 
+// Serves any number of clients over shared memory, every client over its own channel (see ShmemChannel).
+// Channels are served in parallel by a pool of worker threads, clients sending the same IR share the backend (see
+// AbstractServer::getSharedBackend), their calls into it are serialised.
+// Every worker serves one client until it exits, clients beyond the number of workers are refused.
 class ShmemServer : public AbstractServer
 {
 public:
@@ -39,12 +51,23 @@ protected:
     virtual void unmarshalCallArgs(char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs);
 
 private:
-    void *shmemptr;
-    sem_t *shmem_sem;
-    sem_t *shmem_force_order_sem;
+    void *controlptr = nullptr;
+    sem_t *control_sem = nullptr;
+
+    std::unique_ptr<ThreadPool> workers;
+    std::atomic<bool> shuttingDown;
+    std::atomic<unsigned> activeSessions;   // clients currently served by a worker
+
+    // arrays of the current call of a worker's client not kept in the buffer registry, freed after the call
+    static thread_local std::vector<void *> transientArrays;
+    // SharedArena of a worker's client, arrays in there are used in place
+    static thread_local char *arena;
+    static thread_local uint64_t arenaSize;
 
-    void handle_conn();
-    void marshallArray(void *arr, int64_t size, std::pair<llvm::Type::TypeID, unsigned> typeIDWithBitwidthPointedTo, void *&shmempos);
+    void serveChannel(unsigned slot);
+    bool waitForClient(Doorbell *toServer, pid_t clientPid);
+    void mapArena(const ShmemChannel::Header *header);
+    void handle_conn(void *channel, pid_t clientPid);
 };
 
 #endif // SHMEMSERVER_H
@@ -28,23 +28,33 @@
 #include <cstring>
 #include <cstdint>
 #include <cinttypes>
+#include <cerrno>
 #include <unistd.h>
-#include <signal.h>
+#include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <limits.h>
 #include <iostream>
 #include <unordered_map>
 #include <vector>
 #include <string>
+#include <thread>
 
 #include "llvm/IR/Function.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ADT/APInt.h"
 #include "llvm/ADT/APFloat.h"
+#include "llvm/Support/CommandLine.h"
 
+#include "../common/callframe.h"
 #include "../common/sockethelperfunctions.h"
+#include "../common/argumentdirection.h"
+
+llvm::cl::opt<unsigned> SocketThreads("socket-threads", llvm::cl::desc("Number of socket clients served in parallel, defaults to the number of cores"), llvm::cl::init(0));
+
+thread_local SocketServer::Session *SocketServer::session = nullptr;
 
 SocketServer::SocketServer(backendTypes backendType) : AbstractServer(backendType)
 {
@@ -68,177 +78,281 @@ void SocketServer::initCommunication()
     if (bind(sockfd, (struct sockaddr *) &server_addr, sizeof(server_addr)) < 0)
         error("ERROR, could not bind socket to server address");
 
-    listen(sockfd, 5); // start listening for connections
-
-    std::cout << "INFO" << ": waiting for connections" << std::endl;
+    listen(sockfd, SOMAXCONN); // start listening for connections
+    // connections are accepted until none is left, without blocking
+    if (fcntl(sockfd, F_SETFL, fcntl(sockfd, F_GETFL) | O_NONBLOCK) < 0)
+        error("ERROR, could not make socket non-blocking");
+
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd < 0)
+        error("ERROR, could not create epoll instance");
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr; // the listening socket, sessions are registered with their Session
+    if (epoll_ctl(epollfd, EPOLL_CTL_ADD, sockfd, &event) < 0)
+        error("ERROR, could not watch socket");
+
+    workers.reset(new ThreadPool(SocketThreads ? SocketThreads : std::thread::hardware_concurrency()));
+    std::cout << "INFO" << ": waiting for connections, serving up to " << workers->getNumThreads() << " clients in parallel" << std::endl;
 }
 
 void SocketServer::handleCommunication()
 {
-    struct sockaddr_in client_addr;
-    unsigned int client_addr_len = sizeof(client_addr);
-    signal(SIGCHLD, SIG_IGN); // We are not interested in results from the children
+    struct epoll_event events[64];
     while (1) {
-        // get next incoming connection, block if none
-        int newsockfd = accept(sockfd, (struct sockaddr *) &client_addr, &client_addr_len);
-        if (newsockfd < 0)
-            error("ERROR, could not retrieve incoming connection");
-
-        int pid = fork(); // new process for every connection
-        if (pid < 0)
-            error("ERROR, could not fork process");
-        if (pid == 0) { // child
-            close(sockfd);
-            std::cout << "New client connection assigned to process " << getpid() << std::endl;
-            handle_conn(newsockfd);
-            exit(0);
-        } else // parent
-        {
-            close(newsockfd);
+        const int numEvents = epoll_wait(epollfd, events, 64, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR)
+                continue;
+            error("ERROR, could not wait for connections");
+        }
+
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.ptr == nullptr) {
+                acceptConnections();
+                continue;
+            }
+            // sessions are watched one-shot, nobody else touches it until the worker watches it again
+            auto s = (Session *) events[i].data.ptr;
+            workers->enqueue([this, s] { serveSession(s); });
         }
     }
 }
 
 void SocketServer::cleanupCommunication()
 {
+    // workers blocked on their clients return once the connections are shut down
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        for (auto s : sessions)
+            shutdown(s->sockfd, SHUT_RDWR);
+    }
+    workers.reset();
+    for (auto s : sessions) {
+        close(s->sockfd);
+        delete s;
+    }
+    sessions.clear();
+
+    if (epollfd != -1)
+        close(epollfd);
     close(sockfd);
 }
 
-void SocketServer::unmarshalCallArgs( char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs)
+bool SocketServer::dropClient(const char *reason)
 {
-    llvm::FunctionType *CalledFuncType = calledFunction->getFunctionType();
-    int numArgs = CalledFuncType->getNumParams();
+    std::cout << "WARNING" << ": " << reason << ", closing connection to client\n";
+    return false;
+}
 
+void SocketServer::acceptConnections()
+{
+    while (1) {
+        struct sockaddr_in client_addr;
+        socklen_t client_addr_len = sizeof(client_addr);
+        int newsockfd = accept(sockfd, (struct sockaddr *) &client_addr, &client_addr_len);
+        if (newsockfd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            perror("ERROR, could not retrieve incoming connection");
+            return;
+        }
+        // sessions are served with blocking sockets, epoll only tells when a client sent something
+        fcntl(newsockfd, F_SETFL, fcntl(newsockfd, F_GETFL) & ~O_NONBLOCK);
 
-    int mpi_server_tag = MPI_SERVER_TAG;
-    MPI_Status status;
-  
-    #ifndef NDEBUG
-        std::cout << "\nMPI SERVER: Waiting for Header";
-        std::cout.flush();
-    #endif
-    MPI_Recv(argumentList, MAX_NUMBER_OF_ARGUMENTS, ArgListType, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-    #ifndef NDEBUG
-        std::cout << "\nMPI SERVER: Header Recieved";
-        std::cout.flush();
-    #endif
+        auto s = new Session;
+        s->sockfd = newsockfd;
+        {
+            std::lock_guard<std::mutex> lock(sessionsMutex);
+            sessions.insert(s);
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        event.data.ptr = s;
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, newsockfd, &event) < 0) {
+            perror("ERROR, could not watch connection");
+            closeSession(s);
+            continue;
+        }
+        std::cout << "New client connection on socket " << newsockfd << std::endl;
+    }
+}
 
-    int recordCount=0;
-    MPI_Get_count(&status,ArgListType,&recordCount);
+void SocketServer::serveSession(Session *s)
+{
+    // everything the client sent in a row is handled, before the worker turns to other clients
+    session = s;
+    bool open;
+    char next;
+    do {
+        open = s->backend ? handleCallFrame() : handleModule();
+    } while (open && recv(s->sockfd, &next, 1, MSG_PEEK | MSG_DONTWAIT) > 0);
+    session = nullptr;
+
+    if (!open) {
+        closeSession(s);
+        return;
+    }
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    event.data.ptr = s;
+    if (epoll_ctl(epollfd, EPOLL_CTL_MOD, s->sockfd, &event) < 0) {
+        perror("ERROR, could not watch connection");
+        closeSession(s);
+    }
+}
 
-    #ifndef NDEBUG
-        //Display sent DS
-        for (int i=0; i<recordCount; i++) {
-            std::cout <<  "\n MPI Recieved DS : Size : " << argumentList[i].sizeOfArg << "  Type" << argumentList[i].typeofArg ;
-            std::cout.flush();
+void SocketServer::closeSession(Session *s)
+{
+    {
+        std::lock_guard<std::mutex> lock(sessionsMutex);
+        sessions.erase(s);
+    }
+    close(s->sockfd); // also ends watching it
+    delete s;
+}
+
+bool SocketServer::receiveArrays(const CallFrame::Header &header, CallFrame::ArgDescriptor *descriptors)
+{
+    std::vector<struct iovec> segments;
+    if (!prepareArrays(header, descriptors, segments))
+        return false;
+    if (header.chunkSize != 0U)
+        return receiveChunks(session, header, descriptors, nullptr);
+    return CallFrame::recvScatteredFully(session->sockfd, segments.data(), segments.size());
+}
+
+bool SocketServer::receiveChunks(Session *s, const CallFrame::Header &header, const CallFrame::ArgDescriptor *descriptors, ArrivalTracker *arrivals)
+{
+    // interleaved, without padding
+    for (const auto &chunk : CallFrame::interleave(descriptors, header.numArgs, header.chunkSize)) {
+        if (!CallFrame::recvFully(s->sockfd, (char *) s->argumentArrays[chunk.descriptor] + chunk.offset, chunk.size))
+            return false;
+        if (arrivals != nullptr)
+            arrivals->arrived(chunk.descriptor, chunk.offset + chunk.size);
+    }
+    return true;
+}
+
+bool SocketServer::prepareArrays(const CallFrame::Header &header, CallFrame::ArgDescriptor *descriptors, std::vector<struct iovec> &segments)
+{
+    session->payload_buffer.clear();
+    char *payload = session->payload_buffer.resize(header.payloadSize);
+    session->argumentArrays.assign(header.numArgs, nullptr);
+
+    // transient arrays and padding go to the payload buffer, arrays to be kept to their resident buffer
+    segments.clear();
+    uint64_t payloadPos = 0U;
+    for (uint32_t i = 0; i < header.numArgs; i++) {
+        CallFrame::ArgDescriptor &descriptor = descriptors[i];
+        if (descriptor.typeID != llvm::Type::PointerTyID)
+            continue;
+        const Residency::BufferKey key = { descriptor.clientAddress, descriptor.payloadSize };
+        if (descriptor.flags == Residency::RESIDENT) {
+            session->argumentArrays[i] = session->bufferRegistry.lookup(key, descriptor.version);
+            if (session->argumentArrays[i] == nullptr)
+                return dropClient(std::string("array of argument " + std::to_string(i+1) + " is not resident in requested version").c_str());
+            continue;
         }
-    #endif
+        if (descriptor.payloadOffset < payloadPos || descriptor.payloadOffset + descriptor.payloadSize > header.payloadSize)
+            return dropClient("array exceeds payload of call frame");
+
+        if (descriptor.flags == Residency::KEEP) {
+            if (descriptor.payloadOffset != payloadPos)
+                segments.push_back({ payload + payloadPos, descriptor.payloadOffset - payloadPos });
+            session->argumentArrays[i] = session->bufferRegistry.keep(key, descriptor.version);
+            segments.push_back({ session->argumentArrays[i], descriptor.payloadSize });
+        } else {
+            session->argumentArrays[i] = payload + descriptor.payloadOffset;
+            segments.push_back({ payload + payloadPos, descriptor.payloadOffset + descriptor.payloadSize - payloadPos });
+        }
+        payloadPos = descriptor.payloadOffset + descriptor.payloadSize;
+    }
+    if (header.payloadSize != payloadPos)
+        segments.push_back({ payload + payloadPos, header.payloadSize - payloadPos });
 
-    assert(numArgs == recordCount && "Number of function arguments do not match");
-    void *array;
+    return true;
+}
+
+void SocketServer::unmarshalCallArgs( char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs)
+{
+    llvm::FunctionType *CalledFuncType = calledFunction->getFunctionType();
+    int numArgs = CalledFuncType->getNumParams();
+
+    // descriptors follow the (padded) function name, arrays were already received by receiveArrays
+    auto header = (CallFrame::Header *) (buffer - sizeof(CallFrame::Header));
+    auto descriptors = (CallFrame::ArgDescriptor *) (buffer + header->functionNameSize);
+    assert(header->functionNameSize >= functionName_offset + 1 && "Function name does not fit into call frame");
+
+    if (header->numArgs != numArgs)
+        error("ERROR, number of function arguments do not match");
+    argumentSizes.assign(numArgs, 0U);
 
-    //MPI_DATA_MOVEMENT
     for (int i = 0; i < numArgs; i++) {
         llvm::GenericValue CurrArg;
         llvm::Type* CurrType = CalledFuncType->getParamType(i);
+        const CallFrame::ArgDescriptor &descriptor = descriptors[i];
 
-        long arraySize=argumentList[i].sizeOfArg;
-
-        #ifndef NDEBUG
-            std::cout << "\nProcessing arg -> "<< arraySize << i << "\n";
-            std::cout.flush();
-        #endif
+        if (descriptor.typeID != CurrType->getTypeID())
+            error(std::string("ERROR, type of argument " + std::to_string(i+1) + " does not match").c_str());
 
         switch (CurrType->getTypeID()) {
             case llvm::Type::PointerTyID:
-                indexesOfPointersInArgs.push_back(i);
-
-                //Get each argument
-                #ifndef NDEBUG
-                        std::cout << "\nProcessing parameters size -> "<< arraySize <<", Type -> " << argumentList[i].typeofArg << "\n";
-                        std::cout.flush();
-                #endif
-
-                if(arraySize>0) {
-                    //array
-                    switch(argumentList[i].typeofArg) {
-                    case ENUM_MPI_CHAR:
-                        array = malloc(arraySize*sizeof(char));
-                        MPI_Recv(array, arraySize, MPI_CHAR, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_SHORT:
-                        array = malloc(arraySize*sizeof(short));
-                        MPI_Recv(array, arraySize, MPI_SHORT, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_INT:
-                        array = malloc(arraySize*sizeof(int));
-                        MPI_Recv(array, arraySize, MPI_INT, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_LONG:
-                        array = malloc(arraySize*sizeof(long));
-                        MPI_Recv(array, arraySize, MPI_LONG, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_LONG_LONG:
-                        array = malloc(arraySize*sizeof(long long));
-                        MPI_Recv(array, arraySize, MPI_LONG_LONG, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_FLOAT:
-                        array = malloc(arraySize*sizeof(float));
-                        MPI_Recv(array, arraySize, MPI_FLOAT, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_DOUBLE:
-                        array = malloc(arraySize*sizeof(double));
-                        MPI_Recv(array, arraySize, MPI_DOUBLE, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    case ENUM_MPI_LONG_DOUBLE:
-                        array = malloc(arraySize*sizeof(long double));
-                        MPI_Recv(array, arraySize, MPI_LONG_DOUBLE, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                        CurrArg.PointerVal=array;
-                        break;
-                    default:
-                        std::cout << "Data-type : " << argumentList[i].typeofArg << "%d is not supported";
-                        std::cout.flush();
-                    }
-                }
-
+                // only arrays written by the function are transferred back
+                if (ArgumentDirection::isDownloaded(descriptor.direction))
+                    indexesOfPointersInArgs.push_back(i);
+                CurrArg.PointerVal = session->argumentArrays[i];
+                argumentSizes[i] = descriptor.payloadSize;
                 break;
             case llvm::Type::FloatTyID:
-                MPI_Recv(&CurrArg.FloatVal, 1, MPI_FLOAT, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
+                memcpy(&CurrArg.FloatVal, descriptor.value, sizeof(float));
                 break;
             case llvm::Type::DoubleTyID:
-                MPI_Recv(&CurrArg.DoubleVal, 1, MPI_DOUBLE, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
+                memcpy(&CurrArg.DoubleVal, descriptor.value, sizeof(double));
                 break;
             case llvm::Type::X86_FP80TyID: {
-                //TODO
-                //             size_t valstring_size = strcspn(buffer, ":\0");
-                //             std::string valstring(buffer, valstring_size);
-                //             buffer += valstring_size;
-                //             llvm::APFloat bigval(llvm::APFloat::x87DoubleExtended, valstring);
-                //             CurrArg.IntVal = bigval.bitcastToAPInt();
+                // easiest way to get correct APInt representing this long double
+                long double val;
+                memcpy(&val, descriptor.value, sizeof(long double));
+                char valstring[64];
+                sprintf(valstring, "%La", val);
+                llvm::APFloat bigval(llvm::APFloat::x87DoubleExtended, valstring);
+                CurrArg.IntVal = bigval.bitcastToAPInt();
                 break;
             }
             case llvm::Type::FP128TyID: {
-                //TODO
-                //             size_t valstring_size = strcspn(buffer, ":\0");
-                //             std::string valstring(buffer, valstring_size);
-                //             buffer += valstring_size;
-                //             llvm::APFloat bigval(llvm::APFloat::IEEEquad, valstring);
-                //             CurrArg.IntVal = bigval.bitcastToAPInt();
+                // easiest way to get correct APInt representing this long double
+                long double val;
+                memcpy(&val, descriptor.value, sizeof(long double));
+                char valstring[64];
+                sprintf(valstring, "%La", val);
+                llvm::APFloat bigval(llvm::APFloat::IEEEquad, valstring);
+                CurrArg.IntVal = bigval.bitcastToAPInt();
                 break;
             }
             case llvm::Type::IntegerTyID: { // Note: LLVM does not differentiate between signed/unsiged int types
-                void *tmpInt = nullptr;
-                tmpInt = malloc(sizeof(int));
-                MPI_Recv(tmpInt, 1, MPI_INT, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-                CurrArg.IntVal = *(int*)tmpInt;
-                free(tmpInt);
+                auto bitwidth = ((llvm::IntegerType*)CurrType)->getBitWidth();
+                uint64_t intval;
+                switch (bitwidth) {
+                case 8:
+                    intval = *(int8_t *)descriptor.value;
+                    break;
+                case 16:
+                    intval = *(int16_t *)descriptor.value;
+                    break;
+                case 32:
+                    intval = *(int32_t *)descriptor.value;
+                    break;
+                case 64:
+                    intval = *(int64_t *)descriptor.value;
+                    break;
+                default:
+                    intval = *(int *)descriptor.value;
+                    break;
+                }
+                CurrArg.IntVal = llvm::APInt(bitwidth, intval);
                 break;
             }
             default:
@@ -250,7 +364,7 @@ void SocketServer::unmarshalCallArgs( char *buffer, int functionName_offset, llv
         #ifndef NDEBUG
             switch (CurrType->getTypeID()) {
             case llvm::Type::PointerTyID:
-                std::cout << "ptr " ;//<< pointerToTy->getTypeID();
+                std::cout << "ptr to TyID " << descriptor.pointedToTypeID << " (" << descriptor.numElements << " elements)";
                 break;
             case llvm::Type::FloatTyID:
                 std::cout << CurrArg.FloatVal;
@@ -278,207 +392,294 @@ void SocketServer::unmarshalCallArgs( char *buffer, int functionName_offset, llv
     #endif
 }
 
-void SocketServer::handle_conn(int sockfd)
+bool SocketServer::handleModule()
 {
-    //MPI_CONNECTION_INIT
-    // TODO: check this! 
-    int argc = 0;
-    
-    #ifndef NDEBUG
-        std::cout << "INFO" << ": trying MPI_Init " << std::endl;
-    #endif
-    MPI_Init( &argc, NULL );
-    #ifndef NDEBUG
-        std::cout << "INFO" << ": ... done " << std::endl;
-    #endif
-    
-    // Create MPI Structure
-    int sizeOfData;
-    MPI_Type_size( MPI_INT,&sizeOfData );
-    int array_of_block_lengths[2] = {1, 1};
-    MPI_Aint array_of_displacements[2] = {0, sizeOfData};
-    MPI_Datatype array_of_types[2] = { MPI_INT, MPI_INT };
-
-    MPI_Type_create_struct(2, array_of_block_lengths, array_of_displacements, array_of_types, &ArgListType);
-    MPI_Type_commit(&ArgListType);
-    // End of MPI struct
-    
-    client = MPI_COMM_WORLD;
-
     #ifndef NDEBUG
         std::cout << "DEBUG: Waiting for IR\n" << std::endl;
     #endif
-    
-    MPI_Status status;
-    int mpi_server_tag = MPI_SERVER_TAG;
-    int myrank;
-    MPI_Comm_rank(client, &myrank);
-    int mpi_server_rank =0;
-    
-    // TODO: check this! 
-    if(myrank==0)
-          mpi_server_rank = 1;
-    
-    int incomingMessageSize=0;    
-    MPI_Probe(MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-    MPI_Get_count(&status,MPI_CHAR,&incomingMessageSize);    
-    char *module_ir_buffer = (char *) calloc(incomingMessageSize + 1 , sizeof(char));    
-    MPI_Recv(module_ir_buffer, incomingMessageSize + 1, MPI_CHAR, MPI_ANY_SOURCE, mpi_server_tag, client, &status);
-    
+
+    CallFrame::Header header;
+    if (!CallFrame::recvFully(session->sockfd, &header, sizeof(header)))
+        return dropClient("client closed its socket before sending its module");
+    const bool swapBytes = CallFrame::needsByteSwap(header);
+    if (swapBytes)
+        CallFrame::byteSwapHeader(header);
+    if (!CallFrame::isValidHeader(header, CallFrame::MODULE))
+        return dropClient("received malformed module frame");
+
+    session->msg_buffer.clear();
+    char *module = session->msg_buffer.resize(header.payloadSize);
+    if (!CallFrame::recvFully(session->sockfd, module, header.payloadSize))
+        return dropClient("could not read module from socket");
+
     #ifndef NDEBUG
         std::cout << "DEBUG: Recieved IR\n" << std::endl;
     #endif
-  
-    auto backend = parseIRtoBackend(module_ir_buffer);
+
+    session->backend = getSharedBackend(module, header.payloadSize);
+    session->msg_buffer.clear();
+    if (!session->backend)
+        return dropClient("could not build module");
+
     // notify client that calls can be accepted now by sending time taken for optimizing module and initialising backend
-    const std::string readyStr(std::to_string(TimeDiffOpt.count()) + ":" + std::to_string(TimeDiffInit.count()));
-    MPI_Send((void *)readyStr.c_str(), readyStr.size() , MPI_CHAR, mpi_server_rank, mpi_server_tag, client);
-    free(module_ir_buffer);
+    CallFrame::Header readyHeader;
+    CallFrame::ReadyTimes times = { TimeDiffOpt.count(), TimeDiffInit.count() };
+    CallFrame::initHeader(readyHeader, CallFrame::READY, 0U, 0U, sizeof(times));
+    struct iovec frame[] = { { &readyHeader, sizeof(readyHeader) }, { &times, sizeof(times) } };
+    if (!CallFrame::sendFully(session->sockfd, frame, 2))
+        return dropClient("could not write to socket");
+    return true;
+}
 
-    // initialise msg_buffer
-    std::shared_ptr<char> msg_buffer((char*)calloc(MSG_BUFFER_SIZE, sizeof(char)), &free);
-    while (1) {
-        bzero(msg_buffer.get(), MSG_BUFFER_SIZE);
-        // first acquire message length
-        unsigned msg_length;
-        auto UINT_MAX_str_len = std::to_string(UINT_MAX).length();
-        int num_chars = recv(sockfd, msg_buffer.get(), UINT_MAX_str_len + 1, 0);
-    
-        if (num_chars == 0) {
-            std::cout << "Client assigned to process " << getpid() << " has closed its socket 3 \n";
-            exit(0);
-        }
+bool SocketServer::handleCallFrame()
+{
+    const int sockfd = session->sockfd;
+    MessageBuffer &msg_buffer = session->msg_buffer;
+    MessageBuffer &result_buffer = session->result_buffer;
+
+    // first acquire fixed size header of call frame
+    msg_buffer.clear();
+    auto header = (CallFrame::Header *) msg_buffer.resize(sizeof(CallFrame::Header));
+    if (!CallFrame::recvFully(sockfd, header, sizeof(CallFrame::Header))) {
+        std::cout << "Client on socket " << sockfd << " has closed its socket\n";
+        return false;
+    }
 
-        if (num_chars < 0)
-            error("ERROR, could not read from socket");
+    const bool swapBytes = CallFrame::needsByteSwap(*header);
+    if (swapBytes)
+        CallFrame::byteSwapHeader(*header);
+    if (!CallFrame::isValidHeader(*header, CallFrame::CALL))
+        return dropClient("received malformed call frame");
+
+    const auto callMetadataSize = CallFrame::metadataSize(header->functionNameSize, header->numArgs, header->numReleased);
+    if (header->numArgs > MAX_NUMBER_OF_ARGUMENTS || callMetadataSize > MSG_BUFFER_SIZE)
+        return dropClient("call frame exceeds message buffer");
+
+    // get function name, argument descriptors and released arrays
+    char *metadata = msg_buffer.resize(callMetadataSize);
+    header = (CallFrame::Header *) metadata;
+    if (!CallFrame::recvFully(sockfd, metadata + sizeof(CallFrame::Header), callMetadataSize - sizeof(CallFrame::Header)))
+        return dropClient("could not read from socket");
+    auto descriptors = (CallFrame::ArgDescriptor *) (metadata + sizeof(CallFrame::Header) + header->functionNameSize);
+    auto released = (Residency::BufferKey *) (descriptors + header->numArgs);
+    if (swapBytes) { // client uses different byte order, convert arguments
+        CallFrame::byteSwapDescriptors(descriptors, header->numArgs);
+        CallFrame::byteSwapReleased(released, header->numReleased);
+    }
 
-        #ifndef NDEBUG
-            //std::cout << getpid() << ": got message \"" << msg_buffer << "\"\n"; // TODO command line argument to print messages
-            std::cout << getpid() << ": got message \n";
-        #endif
+    for (uint32_t i = 0; i < header->numReleased; i++)
+        session->bufferRegistry.release(released[i]);
 
-        llvm::Function* calledFunction = nullptr;
-        std::vector<llvm::GenericValue> args;
-        std::list<std::vector<llvm::GenericValue>::size_type> indexesOfPointersInArgs;
-        llvm::GenericValue result = handleCall(backend.get(), msg_buffer.get(), calledFunction, args, indexesOfPointersInArgs);
-
-        // reset buffer and write time taken to buffer
-        bzero(msg_buffer.get(), MSG_BUFFER_SIZE);
-        sprintf(msg_buffer.get(), ";%ld", (long)TimeDiffLastExecution.count());
-
-        //MPI_DATA_MOVEMENT
-        //Send data back to the client
-        //Create the MPI data structure
-        //allocate memory for struct    
-        #ifndef TIMING 
-            auto StartTime = std::chrono::high_resolution_clock::now();
-        #endif  
-    
-        struct ArgumentList argList[MAX_NUMBER_OF_ARGUMENTS];
-        MPI_Status status;
-
-        //Create the structure
-        int structSize=0;
-    
-        for (const auto& indexOfPtr : indexesOfPointersInArgs) {
-            auto paramType = calledFunction->getFunctionType()->getParamType(indexOfPtr);
-            while (paramType->getTypeID() == llvm::Type::ArrayTyID || paramType->getTypeID() == llvm::Type::PointerTyID)
-            paramType = llvm::cast<llvm::SequentialType>(paramType)->getElementType();
-
-            if (paramType->getTypeID() == llvm::Type::IntegerTyID) {
-                argList[structSize].typeofArg = ENUM_MPI_INT;
-            } else {
-                argList[structSize].typeofArg = ENUM_MPI_DOUBLE;
-            }
-            argList[structSize].sizeOfArg =argumentList[indexOfPtr].sizeOfArg;
-            structSize++;
-        }
+    Autotuner &variants = *session->backend->variants;
+    const std::string functionName = AbstractBackend::parseFunctionName(metadata + sizeof(CallFrame::Header));
+    AbstractBackend *backend = variants.select(functionName);
 
-        #ifndef NDEBUG
-            std::cout << "\nMPI SERVER: Sending message back from server to client";
-            std::cout.flush();
-        #endif
+    // functions which can be run in tiles start while their arrays still arrive
+    if (header->chunkSize != 0U && !swapBytes && backend->getPipelinePlan(metadata + sizeof(CallFrame::Header)) != nullptr) {
+        const bool open = handlePipelinedCall(backend, header, descriptors);
+        if (open)
+            variants.record(functionName, backend, TimeDiffLastExecution);
+        return open;
+    }
 
+    // then all arrays at once, arrays to be kept are received directly into the buffer registry
+    if (!receiveArrays(*header, descriptors))
+        return dropClient("could not read from socket");
 
-        #ifndef NDEBUG
-            std::cout << "\nMPI SERVER: Sending MPI Header";
-            std::cout.flush();
+    #ifndef NDEBUG
+        std::cout << sockfd << ": got call frame with payload of " << header->payloadSize << " bytes, " << session->bufferRegistry.getResidentBytes() << " bytes resident\n";
+    #endif
+
+    if (swapBytes) {
+        for (uint32_t i = 0; i < header->numArgs; i++) {
+            if (descriptors[i].typeID != llvm::Type::PointerTyID || descriptors[i].flags == Residency::RESIDENT)
+                continue;
+            SocketHelperFunctions::byteSwapArray(session->argumentArrays[i], descriptors[i].numElements,
+                                                 CallFrame::elementSize(std::make_pair((llvm::Type::TypeID) descriptors[i].pointedToTypeID, descriptors[i].bitwidth)));
+        }
+    }
 
-            for (int i=0; i<structSize; i++) {
-                std::cout <<  "\n MPI Sent DS : Size : " << argList[i].sizeOfArg << "  Type" << argList[i].typeofArg ;
-                std::cout.flush();
+    #ifndef TIMING 
+        auto StartTime = std::chrono::high_resolution_clock::now();
+    #endif  
+
+    llvm::Function* calledFunction = nullptr;
+    std::vector<llvm::GenericValue> args;
+    std::list<std::vector<llvm::GenericValue>::size_type> indexesOfPointersInArgs;
+    llvm::GenericValue result;
+    {
+        // calls of all clients sharing the backend are serialised, their transfers are not
+        std::lock_guard<std::mutex> callLock(session->backend->callMutex);
+        result = handleCall(backend, metadata + sizeof(CallFrame::Header), calledFunction, args, indexesOfPointersInArgs);
+    }
+    variants.record(functionName, backend, TimeDiffLastExecution);
+
+    // build result frame: header with time taken and return value, one descriptor per array, arrays sent from payload buffer
+    const auto resultMetadataSize = CallFrame::metadataSize(0U, indexesOfPointersInArgs.size());
+    result_buffer.clear();
+    char *resultMetadata = result_buffer.resize(resultMetadataSize);
+    memset(resultMetadata, 0, resultMetadataSize);
+    auto resultHeader = (CallFrame::Header *) resultMetadata;
+    auto resultDescriptors = (CallFrame::ArgDescriptor *) (resultMetadata + sizeof(CallFrame::Header));
+
+    std::vector<struct iovec> frame;
+    frame.push_back({ resultMetadata, resultMetadataSize });
+    uint64_t payloadSize = 0U;
+    int i = 0;
+    for (const auto& indexOfPtr : indexesOfPointersInArgs) {
+        CallFrame::ArgDescriptor &descriptor = resultDescriptors[i++];
+        descriptor = descriptors[indexOfPtr];
+        descriptor.payloadOffset = payloadSize;
+
+        frame.push_back({ args[indexOfPtr].PointerVal, descriptor.payloadSize });
+        payloadSize += descriptor.payloadSize;
+        const size_t paddingSize = CallFrame::alignUp(payloadSize, CallFrame::PAYLOAD_ALIGNMENT) - payloadSize;
+        if (paddingSize) {
+            frame.push_back({ (void *) CallFrame::padding(), paddingSize });
+            payloadSize += paddingSize;
+        }
+    }
+    CallFrame::initHeader(*resultHeader, CallFrame::RESULT, indexesOfPointersInArgs.size(), 0U, payloadSize);
+    resultHeader->timeDiff = TimeDiffLastExecution.count();
+
+    switch (calledFunction->getReturnType()->getTypeID()) {
+        case llvm::Type::VoidTyID:
+            // void return
+            break;
+        case llvm::Type::FloatTyID:
+            memcpy(resultHeader->returnValue, &result.FloatVal, sizeof(float));
+            break;
+        case llvm::Type::DoubleTyID:
+            memcpy(resultHeader->returnValue, &result.DoubleVal, sizeof(double));
+            break;
+        case llvm::Type::X86_FP80TyID: {
+            char tmpHexString[64];
+            llvm::APFloat(llvm::APFloat::x87DoubleExtended, result.IntVal).convertToHexString(tmpHexString, 0U, false, llvm::APFloat::roundingMode::rmNearestTiesToEven);
+            long double val = strtold(tmpHexString, nullptr);
+            memcpy(resultHeader->returnValue, &val, sizeof(long double));
+            break;
+        }
+        case llvm::Type::FP128TyID: {
+            char tmpHexString[64];
+            llvm::APFloat(llvm::APFloat::IEEEquad, result.IntVal).convertToHexString(tmpHexString, 0U, false, llvm::APFloat::roundingMode::rmNearestTiesToEven);
+            long double val = strtold(tmpHexString, nullptr);
+            memcpy(resultHeader->returnValue, &val, sizeof(long double));
+            break;
+        }
+        case llvm::Type::IntegerTyID: { // Note: LLVM does not differentiate between signed/unsiged int types
+            const uint64_t intval = result.IntVal.getZExtValue();
+            switch (result.IntVal.getBitWidth()) {
+                case 8:
+                case 16:
+                case 32:
+                case 64:
+                    memcpy(resultHeader->returnValue, &intval, result.IntVal.getBitWidth() / 8);
+                    break;
+                default:
+                    error(std::string("ERROR, integer bitwidth of " + std::to_string(result.IntVal.getBitWidth()) + " not supported").c_str());
             }
-        #endif
-        MPI_Send(argList, structSize, ArgListType, mpi_server_rank, mpi_server_tag, client);
+            break;
+        }
+        default:
+            error(std::string("ERROR, LLVM TypeID " + std::to_string(calledFunction->getReturnType()->getTypeID()) + " of result of function \"" + calledFunction->getName().str() + "\" is not supported").c_str());
+    }
 
-        #ifndef NDEBUG
-            std::cout << "\nMPI SERVER: Sent MPI Header";
-            std::cout.flush();
+    if (!CallFrame::sendFully(sockfd, frame.data(), frame.size()))
+        return dropClient("could not write to socket");
 
-            std::cout << "\nMPI SERVER: Sending data";
-            std::cout.flush();
-        #endif
+    #ifndef TIMING 
+        auto EndTime = std::chrono::high_resolution_clock::now();
+        std::cout << "\n SERVR: Call handled, including transfer S->C = " <<    std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime).count() << "\n";
+    #endif
+    return true;
+}
 
-        //Start sending individual arrrays
-        for (const auto& indexOfPtr : indexesOfPointersInArgs) {
-            auto paramType = calledFunction->getFunctionType()->getParamType(indexOfPtr);
-            while (paramType->getTypeID() == llvm::Type::ArrayTyID || paramType->getTypeID() == llvm::Type::PointerTyID)
-            paramType = llvm::cast<llvm::SequentialType>(paramType)->getElementType();
+bool SocketServer::handlePipelinedCall(AbstractBackend *backend, CallFrame::Header *header, CallFrame::ArgDescriptor *descriptors)
+{
+    const int sockfd = session->sockfd;
 
-            if (paramType->getTypeID() == llvm::Type::IntegerTyID) {
-            MPI_Send(args[indexOfPtr].PointerVal,argList[indexOfPtr].sizeOfArg, MPI_INT, mpi_server_rank, mpi_server_tag, client);
-            } else {
-            MPI_Send(args[indexOfPtr].PointerVal, argList[indexOfPtr].sizeOfArg, MPI_DOUBLE, mpi_server_rank, mpi_server_tag, client);
-            }
-            free(args[indexOfPtr].PointerVal);
-        }
+    #ifndef TIMING
+        auto StartTime = std::chrono::high_resolution_clock::now();
+    #endif
 
-        #ifndef TIMING 
-            auto EndTime = std::chrono::high_resolution_clock::now();
-            std::cout << "\n SERVR: MPI_DATA_TRANSFER S->C = " <<    std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime).count() << "\n";
-        #endif
-    
-        #ifndef NDEBUG
-            std::cout << "\nMPI SERVER: Data sent";
-            std::cout.flush();
+    // the result starts with the descriptors of all arrays written by the function, their parts follow as soon as they are final
+    std::vector<uint64_t> arraySizes(header->numArgs, 0U);
+    std::vector<uint64_t> expected(header->numArgs, 0U);
+    std::vector<uint32_t> resultIndexes(header->numArgs, 0U);
+    uint32_t numResultArrays = 0U;
+    for (uint32_t i = 0; i < header->numArgs; i++) {
+        if (descriptors[i].typeID != llvm::Type::PointerTyID)
+            continue;
+        arraySizes[i] = descriptors[i].payloadSize;
+        if (CallFrame::isTransferred(descriptors[i]))
+            expected[i] = descriptors[i].payloadSize;
+        if (ArgumentDirection::isDownloaded(descriptors[i].direction))
+            resultIndexes[i] = numResultArrays++;
+    }
 
-            std::cout << "\nMPI SERVER: Return Messages sent";
-            std::cout.flush();
-        #endif
-        
-        char returnValStr[MAX_VAL_SIZE];
-        switch (calledFunction->getReturnType()->getTypeID()) {
-            case llvm::Type::VoidTyID:
-                sprintf(returnValStr, ":");
-                break;
-            case llvm::Type::FloatTyID:
-                sprintf(returnValStr, ":%a", result.FloatVal);
-                break;
-            case llvm::Type::DoubleTyID:
-                sprintf(returnValStr, ":%la", result.DoubleVal);
-                break;
-            case llvm::Type::X86_FP80TyID:
-                returnValStr[0]=':';
-                llvm::APFloat(llvm::APFloat::x87DoubleExtended, result.IntVal).convertToHexString(returnValStr+1, 0U, false, llvm::APFloat::roundingMode::rmNearestTiesToEven);
-                break;
-            case llvm::Type::FP128TyID:
-                returnValStr[0]=':';
-                llvm::APFloat(llvm::APFloat::IEEEquad, result.IntVal).convertToHexString(returnValStr+1, 0U, false, llvm::APFloat::roundingMode::rmNearestTiesToEven);
-                break;
-            case llvm::Type::IntegerTyID: // Note: LLVM does not differentiate between signed/unsiged int types
-                sprintf(returnValStr, ":%s", result.IntVal.toString(16,false).c_str());
-                break;
-            default:
-                error(std::string("ERROR, LLVM TypeID " + std::to_string(calledFunction->getReturnType()->getTypeID()) + " of result of function \"" + calledFunction->getName().str() + "\" is not supported").c_str());
-        }
-        strcat(msg_buffer.get(), returnValStr);
-
-        //Send the message
-        MPI_Send(msg_buffer.get(), strlen(msg_buffer.get()), MPI_CHAR, mpi_server_rank, mpi_server_tag, client);
-    
-        MPI_Type_free(&ArgListType);
-    
-        // TODO: check this!
-        MPI_Finalize();
+    const auto resultMetadataSize = CallFrame::metadataSize(0U, numResultArrays);
+    session->result_buffer.clear();
+    char *resultMetadata = session->result_buffer.resize(resultMetadataSize);
+    memset(resultMetadata, 0, resultMetadataSize);
+    auto resultHeader = (CallFrame::Header *) resultMetadata;
+    auto resultDescriptors = (CallFrame::ArgDescriptor *) (resultMetadata + sizeof(CallFrame::Header));
+    uint64_t payloadSize = 0U;
+    for (uint32_t i = 0; i < header->numArgs; i++) {
+        if (descriptors[i].typeID != llvm::Type::PointerTyID || !ArgumentDirection::isDownloaded(descriptors[i].direction))
+            continue;
+        CallFrame::ArgDescriptor &descriptor = resultDescriptors[resultIndexes[i]];
+        descriptor = descriptors[i];
+        descriptor.payloadOffset = payloadSize;
+        payloadSize += descriptor.payloadSize;
     }
+    CallFrame::initHeader(*resultHeader, CallFrame::RESULT, numResultArrays, 0U, payloadSize);
+    resultHeader->chunkSize = header->chunkSize;
+    struct iovec metadataPart = { resultMetadata, resultMetadataSize };
+    if (!CallFrame::sendFully(sockfd, &metadataPart, 1))
+        return dropClient("could not write to socket");
+
+    // arrays are received in their own thread, the buffer registry is only touched before
+    std::vector<struct iovec> segments;
+    if (!prepareArrays(*header, descriptors, segments))
+        return false;
+    // if the connection fails, the tiles still run to their end on what arrived, the session is closed afterwards
+    bool connectionFailed = false;
+    ArrivalTracker arrivals(expected);
+    Session *s = session;
+    std::thread receiver([this, s, header, descriptors, &arrivals, &connectionFailed] {
+        if (!receiveChunks(s, *header, descriptors, &arrivals)) {
+            connectionFailed = true;
+            arrivals.cancel();
+        }
+    });
+
+    llvm::Function* calledFunction = nullptr;
+    std::vector<llvm::GenericValue> args;
+    std::list<std::vector<llvm::GenericValue>::size_type> indexesOfPointersInArgs;
+    std::vector<uint64_t> sent(header->numArgs, 0U);
+    bool sendFailed = false;
+    // only the tiles hold the call mutex of the backend, waiting for arrays and sending results does not keep other clients from calling
+    handleCallPipelined(backend, (char *) header + sizeof(CallFrame::Header), calledFunction, args, indexesOfPointersInArgs, arraySizes, header->chunkSize, arrivals, s->backend->callMutex,
+                        [&](std::vector<llvm::GenericValue>::size_type i, uint64_t final) {
+        CallFrame::ChunkHeader chunk = { resultIndexes[i], 0U, sent[i], final - sent[i], 0 };
+        struct iovec parts[] = { { &chunk, sizeof(chunk) }, { (char *) args[i].PointerVal + sent[i], final - sent[i] } };
+        if (!sendFailed && !CallFrame::sendFully(sockfd, parts, 2))
+            sendFailed = true;
+        sent[i] = final;
+    });
+    receiver.join();
+    if (connectionFailed)
+        return dropClient("could not read from socket");
+
+    CallFrame::ChunkHeader end = { CallFrame::END_OF_RESULT, 0U, 0U, 0U, TimeDiffLastExecution.count() };
+    struct iovec endPart = { &end, sizeof(end) };
+    if (sendFailed || !CallFrame::sendFully(sockfd, &endPart, 1))
+        return dropClient("could not write to socket");
+
+    #ifndef TIMING
+        auto EndTime = std::chrono::high_resolution_clock::now();
+        std::cout << "\n SERVR: Call handled in tiles, including transfers = " <<    std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime).count() << "\n";
+    #endif
+
+    return true;
 }
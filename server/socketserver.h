@@ -24,12 +24,20 @@
 #ifndef SOCKETSERVER_H
 #define SOCKETSERVER_H
 
-#include "mpi.h"
-
 #include "abstractserver.h"
+#include "threadpool.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "../common/mpihelper.h"
+#include "../common/messagebuffer.h"
+#include "../common/callframe.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_set>
 
+// Serves any number of clients over TCP from a single process. Connections are watched with epoll, whenever a client
+// sent something, one of a pool of worker threads handles it (the module or calls) and the connection is watched again.
+// Idle clients do not occupy a worker, clients sending the same module share its backend (see getSharedBackend).
 class SocketServer : public AbstractServer
 {
 public:
@@ -43,15 +51,42 @@ protected:
     virtual void unmarshalCallArgs(char *buffer, int functionName_offset, llvm::Function *calledFunction, std::vector<llvm::GenericValue> &args, std::list<std::vector<llvm::GenericValue>::size_type> &indexesOfPointersInArgs);
 
 private:
+    // everything kept for a client between its calls, a client is served by one worker at a time
+    struct Session {
+        int sockfd;
+        std::shared_ptr<SharedBackend> backend; // nullptr until the client sent its module
+        BufferRegistry bufferRegistry;
+
+        // metadata and payload of the call frame currently handled, arrays passed to the called function point into the payload
+        // or the buffer registry
+        MessageBuffer msg_buffer;
+        MessageBuffer payload_buffer;
+        MessageBuffer result_buffer;
+        std::vector<void *> argumentArrays;
+    };
+
     int sockfd;
+    int epollfd = -1;
+    std::unique_ptr<ThreadPool> workers;
+    std::unordered_set<Session *> sessions;
+    std::mutex sessionsMutex;
 
-    // MPI_CONNECTION_INIT
-    MPI_Comm client; 
-    char port_name[MPI_MAX_PORT_NAME];
+    // session the worker is serving right now
+    static thread_local Session *session;
 
-    void handle_conn(int sockfd);
-    struct ArgumentList argumentList[MAX_NUMBER_OF_ARGUMENTS];
-    MPI_Datatype ArgListType;
+    void acceptConnections();
+    void serveSession(Session *s);
+    void closeSession(Session *s);
+    // false if the connection was closed or failed, the session ends then
+    static bool dropClient(const char *reason);
+    bool handleModule();
+    bool handleCallFrame();
+    bool handlePipelinedCall(AbstractBackend *backend, CallFrame::Header *header, CallFrame::ArgDescriptor *descriptors);
+    bool receiveArrays(const CallFrame::Header &header, CallFrame::ArgDescriptor *descriptors);
+    // sets argumentArrays and where the payload of a call frame without chunks goes
+    bool prepareArrays(const CallFrame::Header &header, CallFrame::ArgDescriptor *descriptors, std::vector<struct iovec> &segments);
+    // arrays of a chunked call frame for the session s (also from other threads), arrivals learns about every chunk if given
+    bool receiveChunks(Session *s, const CallFrame::Header &header, const CallFrame::ArgDescriptor *descriptors, ArrivalTracker *arrivals);
 };
 
 #endif // SOCKETSERVER_H
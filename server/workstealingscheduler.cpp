@@ -0,0 +1,164 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#include "workstealingscheduler.h"
+
+#include <algorithm>
+#include <signal.h>
+#include <pthread.h>
+
+thread_local int WorkStealingScheduler::workerIndex = -1;
+
+WorkStealingScheduler::WorkStealingScheduler(unsigned numWorkers) : nextDeque(0U), queued(0U), executed(0U), stolen(0U), busy(0U)
+{
+    if (numWorkers == 0)
+        numWorkers = 1;
+    for (unsigned i = 0; i < numWorkers; i++)
+        deques.emplace_back(new Worker);
+
+    // threads inherit the signal mask of their creator
+    sigset_t allSignals, previousSignals;
+    sigfillset(&allSignals);
+    pthread_sigmask(SIG_BLOCK, &allSignals, &previousSignals);
+    for (unsigned i = 0; i < numWorkers; i++)
+        workers.emplace_back(&WorkStealingScheduler::work, this, i);
+    pthread_sigmask(SIG_SETMASK, &previousSignals, nullptr);
+}
+
+WorkStealingScheduler::~WorkStealingScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    tasksAvailable.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void WorkStealingScheduler::submit(std::function<void()> task)
+{
+    const unsigned index = workerIndex >= 0 ? (unsigned) workerIndex : nextDeque++ % deques.size();
+    queued++; // before the task can be taken
+    {
+        std::lock_guard<std::mutex> lock(deques[index]->mutex);
+        deques[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // taken, so a worker going to sleep either sees the task or gets woken up
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    tasksAvailable.notify_one();
+}
+
+bool WorkStealingScheduler::take(int index, std::function<void()> &task)
+{
+    if (index >= 0) {
+        Worker &own = *deques[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            queued--;
+            return true;
+        }
+    }
+
+    // steal the oldest task of another worker, those are the largest parts of a split kernel
+    const unsigned start = index >= 0 ? index + 1 : nextDeque.load();
+    for (unsigned i = 0; i < deques.size(); i++) {
+        const unsigned victim = (start + i) % deques.size();
+        if ((int) victim == index)
+            continue;
+        Worker &other = *deques[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            queued--;
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingScheduler::work(unsigned index)
+{
+    workerIndex = index;
+    while (1) {
+        std::function<void()> task;
+        if (!take(index, task)) {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            tasksAvailable.wait(lock, [this] { return stopping || queued.load() > 0; });
+            if (stopping)
+                return;
+            continue;
+        }
+        busy++;
+        task();
+        busy--;
+        executed++;
+    }
+}
+
+unsigned WorkStealingScheduler::admit(uint64_t numIterations, uint64_t minIterations) const
+{
+    const int64_t idle = (int64_t) workers.size() - busy.load() - (int64_t) queued.load();
+    const uint64_t parts = std::min<uint64_t>(std::max<int64_t>(idle, 0) + 1, numIterations / std::max<uint64_t>(minIterations, 1U));
+    return (unsigned) std::max<uint64_t>(parts, 1U);
+}
+
+void WorkStealingScheduler::parallelFor(uint64_t begin, uint64_t end, unsigned parts, const std::function<void(uint64_t, uint64_t)> &body)
+{
+    std::atomic<unsigned> remaining(parts);
+    std::mutex doneMutex;
+    std::condition_variable done;
+    auto runPart = [&](unsigned part) {
+        const uint64_t count = end - begin;
+        body(begin + count * part / parts, begin + count * (part + 1) / parts);
+        // decremented under the lock, the caller returns (and its stack is gone) only after the last part released it
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (--remaining == 0)
+            done.notify_all();
+    };
+
+    // the last parts are taken first by the owner, the first ones are stolen
+    for (unsigned part = 1; part < parts; part++)
+        submit([&runPart, part] { runPart(part); });
+    runPart(0);
+
+    // help with whatever is queued instead of waiting idle, this might be parts of other kernels as well
+    std::function<void()> task;
+    while (remaining.load() > 0 && take(workerIndex, task)) {
+        task();
+        executed++;
+    }
+    std::unique_lock<std::mutex> lock(doneMutex);
+    done.wait(lock, [&remaining] { return remaining.load() == 0; });
+}
+
+WorkStealingScheduler::Statistics WorkStealingScheduler::getStatistics() const
+{
+    return { executed.load(), stolen.load(), queued.load(), busy.load() };
+}
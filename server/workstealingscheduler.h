@@ -0,0 +1,92 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+#ifndef WORKSTEALINGSCHEDULER_H
+#define WORKSTEALINGSCHEDULER_H
+
+#include <functional>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cinttypes>
+
+// Runs the kernels of all clients on one worker thread per core. Every worker has its own deque: tasks a worker submits
+// are pushed to and taken from its back, idle workers steal from the front of the others. Tasks submitted by other threads
+// are spread round robin. Workers block all signals, like the ones of ThreadPool.
+class WorkStealingScheduler
+{
+public:
+    struct Statistics {
+        uint64_t executed;  // tasks run so far
+        uint64_t stolen;    // tasks taken from the deque of another worker
+        uint64_t queued;    // tasks waiting right now
+        unsigned busy;      // workers running a task right now
+    };
+
+    explicit WorkStealingScheduler(unsigned numWorkers);
+    ~WorkStealingScheduler(); // finishes running tasks, queued tasks are dropped
+
+    WorkStealingScheduler(const WorkStealingScheduler &) = delete;
+    WorkStealingScheduler &operator=(const WorkStealingScheduler &) = delete;
+
+    void submit(std::function<void()> task);
+    // admission policy: number of parts a kernel of numIterations iterations should be split into, each with at least
+    // minIterations; only as many as there are idle workers (plus the caller), kernels of other clients keep their cores
+    unsigned admit(uint64_t numIterations, uint64_t minIterations) const;
+    // runs body on parts sub-ranges of [begin, end) in parallel, the calling thread takes part and returns once all are done
+    void parallelFor(uint64_t begin, uint64_t end, unsigned parts, const std::function<void(uint64_t, uint64_t)> &body);
+
+    Statistics getStatistics() const;
+    unsigned getNumWorkers() const { return workers.size(); }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void work(unsigned index);
+    // from the back of the own deque (index of a worker) or the front of any other (index -1 for threads not in the pool)
+    bool take(int index, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Worker>> deques;
+    std::vector<std::thread> workers;
+    std::atomic<uint64_t> nextDeque;
+    std::atomic<uint64_t> queued;
+    std::atomic<uint64_t> executed;
+    std::atomic<uint64_t> stolen;
+    std::atomic<unsigned> busy;
+
+    std::mutex sleepMutex;
+    std::condition_variable tasksAvailable;
+    bool stopping = false;
+
+    // index of the worker the current thread is, -1 for other threads
+    static thread_local int workerIndex;
+};
+
+#endif // WORKSTEALINGSCHEDULER_H
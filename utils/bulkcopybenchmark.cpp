@@ -0,0 +1,97 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+// Bandwidth benchmark for copying arrays into and out of shared memory: plain memcpy, the non-temporal
+// kernels of BulkCopy with one and several threads, and BulkCopy::copy choosing by itself
+
+#include "../common/bulkcopy.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <functional>
+#include <thread>
+
+#include <sys/mman.h>
+
+llvm::cl::opt<unsigned> ArrayMegabytes("megabytes", llvm::cl::desc("Size of the copied array in MB, defaults to 128 (jacobi grid)"), llvm::cl::init(128));
+llvm::cl::opt<unsigned> Repetitions("repetitions", llvm::cl::desc("Number of measured copies per variant, defaults to 10"), llvm::cl::init(10));
+
+static void error(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+    if (Repetitions == 0)
+        error("ERROR, at least one repetition is needed");
+
+    // destination is shared memory like a channel, source is program memory
+    const size_t bytes = (size_t) ArrayMegabytes << 20;
+    char *src = (char *) malloc(bytes);
+    char *dst = (char *) mmap(0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (src == nullptr || dst == MAP_FAILED)
+        error("ERROR, unable to allocate arrays");
+    for (size_t i = 0; i < bytes; i++)
+        src[i] = (char) i;
+    memset(dst, 0, bytes);
+
+    const BulkCopy::Kernel streaming = BulkCopy::streamingKernel();
+    const unsigned numThreads = std::max(std::thread::hardware_concurrency(), 1U);
+    const std::vector<std::pair<std::string, std::function<void()>>> variants = {
+        { "memcpy", [&] { memcpy(dst, src, bytes); } },
+        { BulkCopy::kernelName(streaming), [&] { BulkCopy::copyWith(streaming, 1U, dst, src, bytes); } },
+        { std::string(BulkCopy::kernelName(streaming)) + " x" + std::to_string(numThreads), [&] { BulkCopy::copyWith(streaming, numThreads, dst, src, bytes); } },
+        { "BulkCopy::copy", [&] { BulkCopy::copy(dst, src, bytes); } }
+    };
+
+    std::cout << "INFO: copying " << ArrayMegabytes << " MB " << Repetitions << " times per variant, best bandwidth in GB/s\n";
+    for (const auto &variant : variants) {
+        double best = 0.0;
+        for (unsigned i = 0; i < Repetitions; i++) {
+            auto StartTime = std::chrono::high_resolution_clock::now();
+            variant.second();
+            auto EndTime = std::chrono::high_resolution_clock::now();
+            const double seconds = std::chrono::duration<double>(EndTime - StartTime).count();
+            best = std::max(best, bytes / seconds / 1e9);
+        }
+        if (memcmp(dst, src, bytes) != 0)
+            error("ERROR, copy is not equal to the original");
+        memset(dst, 0, bytes);
+        std::cout << std::left << std::setw(22) << variant.first << std::right << std::fixed << std::setprecision(2) << std::setw(10) << best << "\n";
+    }
+
+    munmap(dst, bytes);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,145 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+// Micro-benchmark comparing the former text (hex) based array marshalling with arrays sent in binary call frames
+
+#include "../common/sockethelperfunctions.h"
+#include "../common/callframe.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+
+llvm::cl::opt<unsigned long> NumElements("elements", llvm::cl::desc("Number of array elements to marshal, defaults to 4M"), llvm::cl::init(1UL << 22));
+llvm::cl::opt<unsigned> Repetitions("repetitions", llvm::cl::desc("How often every measurement is repeated, the fastest run is reported, defaults to 3"), llvm::cl::init(3));
+
+// reference: text marshalling as used by SocketClient/SocketServer before the binary codec
+template<typename T>
+static uint64_t marshallArrayAsText(const T *arr, uint64_t size, const char *format, char *outputBuffer)
+{
+    uint64_t arrayStrLen = sprintf(outputBuffer, ":%" PRIu64, size);
+    for (uint64_t i = 0; i < size; i++)
+        arrayStrLen += sprintf(outputBuffer + arrayStrLen, format, arr[i]);
+    return arrayStrLen;
+}
+
+template<typename T>
+static void unmarshalArrayFromText(char *buffer, T *pointerToMemory, bool isFloatingPoint)
+{
+    int64_t numberOfElements = strtoll(buffer + 1, &buffer, 10);
+    buffer++;
+    for (int64_t i = 0; i != numberOfElements; i++) {
+        pointerToMemory[i] = isFloatingPoint ? (T) strtod(buffer, &buffer) : (T) strtoll(buffer, &buffer, 16);
+        buffer++;
+    }
+}
+
+template<typename F>
+static double fastestRunInSeconds(F f)
+{
+    double fastest = -1.0;
+    for (unsigned r = 0; r < Repetitions; r++) {
+        const auto StartTime = std::chrono::high_resolution_clock::now();
+        f();
+        const auto EndTime = std::chrono::high_resolution_clock::now();
+        const double seconds = std::chrono::duration_cast<std::chrono::microseconds>(EndTime - StartTime).count() / 1e6;
+        if (fastest < 0 || seconds < fastest)
+            fastest = seconds;
+    }
+    return fastest;
+}
+
+static void printResult(const std::string &typeName, const std::string &codec, uint64_t encodedSize, double encodeSeconds, double decodeSeconds, uint64_t rawSize)
+{
+    std::cout << std::left << std::setw(8) << typeName << std::setw(14) << codec
+              << std::right << std::setw(14) << encodedSize << std::setw(10) << std::fixed << std::setprecision(2) << (double) encodedSize / rawSize
+              << std::setw(14) << std::setprecision(1) << rawSize / encodeSeconds / 1e6
+              << std::setw(14) << rawSize / decodeSeconds / 1e6 << "\n";
+}
+
+template<typename T>
+static bool benchmarkType(const std::string &typeName, std::pair<llvm::Type::TypeID, unsigned> typeIDAndBitwidth, const char *textFormat, bool isFloatingPoint)
+{
+    const uint64_t size = NumElements;
+    const uint64_t rawSize = size * sizeof(T);
+    std::unique_ptr<T[]> input(new T[size]);
+    std::unique_ptr<T[]> output(new T[size]);
+    for (uint64_t i = 0; i < size; i++)
+        input[i] = isFloatingPoint ? (T) (((double) i * (i % 7 + 2) + 2) / 4000) : (T) (i * 2654435761U);
+
+    // text: up to ~32 characters per element
+    std::unique_ptr<char[]> textBuffer(new char[size * 32 + 32]);
+    uint64_t textSize = 0;
+    const double textEncode = fastestRunInSeconds([&]() { textSize = marshallArrayAsText(input.get(), size, textFormat, textBuffer.get()); });
+    const double textDecode = fastestRunInSeconds([&]() { unmarshalArrayFromText(textBuffer.get(), output.get(), isFloatingPoint); });
+    bool correct = memcmp(input.get(), output.get(), rawSize) == 0;
+    printResult(typeName, "text", textSize, textEncode, textDecode, rawSize);
+    textBuffer.reset();
+
+    // binary: arrays are sent as they are in memory, behind a descriptor in the call frame's metadata
+    const uint64_t binarySize = sizeof(CallFrame::ArgDescriptor) + rawSize;
+    std::unique_ptr<T[]> payload(new T[size]);
+    const double binaryEncode = fastestRunInSeconds([&]() { memcpy(payload.get(), input.get(), rawSize); });
+    const double binaryDecode = fastestRunInSeconds([&]() { memcpy(output.get(), payload.get(), rawSize); });
+    correct &= memcmp(input.get(), output.get(), rawSize) == 0;
+    printResult(typeName, "binary", binarySize, binaryEncode, binaryDecode, rawSize);
+
+    // binary, receiver has different byte order (elements are swapped in place after receiving them)
+    const size_t elementSize = CallFrame::elementSize(typeIDAndBitwidth);
+    SocketHelperFunctions::byteSwapArray(payload.get(), size, elementSize);
+    const double swappedDecode = fastestRunInSeconds([&]() {
+        memcpy(output.get(), payload.get(), rawSize);
+        SocketHelperFunctions::byteSwapArray(output.get(), size, elementSize);
+    });
+    correct &= memcmp(input.get(), output.get(), rawSize) == 0;
+    printResult(typeName, "binary+swap", binarySize, binaryEncode, swappedDecode, rawSize);
+
+    if (!correct)
+        std::cout << "ERROR, " << typeName << " array changed during marshalling\n";
+    return correct;
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+
+    std::cout << "INFO: marshalling arrays of " << NumElements << " elements, fastest of " << Repetitions << " runs\n";
+    std::cout << std::left << std::setw(8) << "type" << std::setw(14) << "codec" << std::right << std::setw(14) << "bytes" << std::setw(10) << "ratio"
+              << std::setw(14) << "enc MB/s" << std::setw(14) << "dec MB/s" << "\n";
+
+    bool correct = true;
+    correct &= benchmarkType<double>("double", std::make_pair(llvm::Type::DoubleTyID, 0U), ";%la", true);
+    correct &= benchmarkType<float>("float", std::make_pair(llvm::Type::FloatTyID, 0U), ";%a", true);
+    correct &= benchmarkType<int32_t>("i32", std::make_pair(llvm::Type::IntegerTyID, 32U), ";%" PRIx32, false);
+    correct &= benchmarkType<int64_t>("i64", std::make_pair(llvm::Type::IntegerTyID, 64U), ";%" PRIx64, false);
+
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,168 @@
+//    Copyright (c) 2015 University of Paderborn 
+//                         (Marvin Damschen <marvin.damschen@gullz.de>,
+//                          Gavin Vaz <gavin.vaz@uni-paderborn.de>,
+//                          Heinrich Riebler <heinrich.riebler@uni-paderborn.de>)
+
+//    Permission is hereby granted, free of charge, to any person obtaining a copy
+//    of this software and associated documentation files (the "Software"), to deal
+//    in the Software without restriction, including without limitation the rights
+//    to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+//    copies of the Software, and to permit persons to whom the Software is
+//    furnished to do so, subject to the following conditions:
+
+//    The above copyright notice and this permission notice shall be included in
+//    all copies or substantial portions of the Software.
+
+//    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+//    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+//    FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+//    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+//    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+//    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+//    THE SOFTWARE.
+
+// Latency benchmark for the notification of the shared memory transport: a client and a server process
+// exchange a small message through shared memory, round trips are measured for the Doorbell (with and without
+// spinning) and for a pair of process-shared POSIX semaphores
+
+#include "../common/doorbell.h"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include <unistd.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+llvm::cl::opt<unsigned> RoundTrips("round-trips", llvm::cl::desc("Number of measured round trips per protocol, defaults to 100000"), llvm::cl::init(100000));
+llvm::cl::opt<unsigned> MessageBytes("message-bytes", llvm::cl::desc("Size of the message copied in both directions, defaults to 64"), llvm::cl::init(64));
+
+struct SharedState {
+    Doorbell toServer;
+    Doorbell toClient;
+    sem_t toServerSem;
+    sem_t toClientSem;
+    alignas(64) char message[1];    // MessageBytes
+};
+
+static void error(const char *msg)
+{
+    perror(msg);
+    exit(1);
+}
+
+struct Protocol {
+    std::string name;
+    std::function<void(SharedState *)> clientNotifyAndWait;
+    std::function<void(SharedState *)> serverWait;
+    std::function<void(SharedState *)> serverNotify;
+};
+
+static void reportLatencies(const std::string &name, std::vector<double> &latencies)
+{
+    std::sort(latencies.begin(), latencies.end());
+    double sum = 0.0;
+    for (double latency : latencies)
+        sum += latency;
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << sum / latencies.size()
+              << std::setw(12) << latencies[latencies.size() / 2]
+              << std::setw(12) << latencies[latencies.size() * 99 / 100]
+              << std::setw(12) << latencies.back() << "\n";
+}
+
+static void runProtocol(SharedState *shared, const Protocol &protocol)
+{
+    shared->toServer.init();
+    shared->toClient.init();
+    sem_init(&shared->toServerSem, 1, 0);
+    sem_init(&shared->toClientSem, 1, 0);
+
+    // warm up round trips are not measured
+    const unsigned warmUp = std::min(1000U, (unsigned) RoundTrips);
+    const unsigned total = RoundTrips + warmUp;
+    std::vector<char> message(MessageBytes, 'c');
+    std::vector<char> reply(MessageBytes);
+
+    std::cout.flush(); // not to be written twice
+    pid_t pid = fork();
+    if (pid < 0)
+        error("ERROR, could not fork process");
+    if (pid == 0) { // server
+        for (unsigned i = 0; i < total; i++) {
+            protocol.serverWait(shared);
+            for (unsigned b = 0; b < MessageBytes; b++)
+                shared->message[b] = shared->message[b] + 1;
+            protocol.serverNotify(shared);
+        }
+        _exit(0);
+    }
+
+    std::vector<double> latencies;
+    latencies.reserve(RoundTrips);
+    for (unsigned i = 0; i < total; i++) {
+        const auto StartTime = std::chrono::high_resolution_clock::now();
+        memcpy(shared->message, message.data(), MessageBytes);
+        protocol.clientNotifyAndWait(shared);
+        memcpy(reply.data(), shared->message, MessageBytes);
+        const auto EndTime = std::chrono::high_resolution_clock::now();
+        if (i >= warmUp)
+            latencies.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(EndTime - StartTime).count() / 1000.0);
+    }
+    waitpid(pid, nullptr, 0);
+
+    if (MessageBytes && reply[0] != 'c' + 1)
+        std::cout << "ERROR, " << protocol.name << ": server did not answer the message\n";
+    reportLatencies(protocol.name, latencies);
+
+    sem_destroy(&shared->toServerSem);
+    sem_destroy(&shared->toClientSem);
+}
+
+int main(int argc, char* argv[])
+{
+    llvm::cl::ParseCommandLineOptions(argc, argv);
+    if (RoundTrips == 0)
+        error("ERROR, at least one round trip is needed");
+
+    const size_t sharedSize = sizeof(SharedState) + MessageBytes;
+    auto shared = (SharedState *) mmap(0, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        error("ERROR, unable to map shared memory region into memory");
+
+    const std::vector<Protocol> protocols = {
+        { "doorbell",
+          [](SharedState *s) { s->toServer.ring(); s->toClient.wait(); },
+          [](SharedState *s) { s->toServer.wait(); },
+          [](SharedState *s) { s->toClient.ring(); } },
+        { "doorbell (no spin)",
+          [](SharedState *s) { s->toServer.ring(); s->toClient.wait(0U, 0U); },
+          [](SharedState *s) { s->toServer.wait(0U, 0U); },
+          [](SharedState *s) { s->toClient.ring(); } },
+        { "semaphores",
+          [](SharedState *s) { sem_post(&s->toServerSem); sem_wait(&s->toClientSem); },
+          [](SharedState *s) { sem_wait(&s->toServerSem); },
+          [](SharedState *s) { sem_post(&s->toClientSem); } }
+    };
+
+    std::cout << "INFO: " << RoundTrips << " round trips of " << MessageBytes << " byte messages, latencies in microseconds\n";
+    std::cout << std::left << std::setw(22) << "protocol" << std::right << std::setw(12) << "mean" << std::setw(12) << "median"
+              << std::setw(12) << "p99" << std::setw(12) << "max" << "\n";
+    for (const auto &protocol : protocols)
+        runProtocol(shared, protocol);
+
+    munmap(shared, sharedSize);
+    return 0;
+}